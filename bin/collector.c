@@ -37,6 +37,11 @@
 
 #include "config.h"
 
+#ifdef HAVE_RECVMMSG
+// recvmmsg() is a GNU extension
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -73,6 +78,36 @@
 #include "nfx.h"
 
 #include "nffile_inline.c"
+#include "collector_inline.c"
+
+struct packet_batch_s {
+	uint32_t	num;			// number of packets received
+	uint32_t	next;			// next packet to process
+	char		*buff;			// RECEIVE_BATCH input buffers of NETWORK_INPUT_BUFF_SIZE
+	ssize_t		len[RECEIVE_BATCH];
+	socklen_t	sender_size[RECEIVE_BATCH];
+	struct sockaddr_storage sender[RECEIVE_BATCH];
+#ifdef HAVE_RECVMMSG
+	struct mmsghdr	msgs[RECEIVE_BATCH];
+	struct iovec	iov[RECEIVE_BATCH];
+#endif
+};
+
+struct packet_ring_s {
+	// written by the producer only
+	uint64_t	head;			// byte offset of the next entry to write
+	uint32_t	dropped;		// datagrams dropped, as the ring was full
+	char		pad_head[52];	// head and tail in different cache lines
+	// written by the consumer only
+	uint64_t	tail;			// byte offset of the next entry to read
+	char		pad_tail[56];
+	char		*buff;			// PACKET_RING_SIZE bytes
+};
+
+// ring entries are 8 byte aligned
+#define RING_ALIGN(size)	(((size) + 7) & ~((size_t)7))
+
+extern extension_descriptor_t extension_descriptor[];
 
 /* globals */
 uint32_t default_sampling   = 1;
@@ -82,23 +117,124 @@ uint32_t overwrite_sampling = 0;
 static uint32_t	exporter_sysid = 0;
 static char *DynamicSourcesDir = NULL;
 
+/*
+ * Flow source hash
+ * Open addressing hash of all flow sources with an IP address, to map incoming packets to 
+ * their flow source. The any source ( -l ) matches all IP addresses not found in the hash.
+ */
+static struct source_hash_s {
+	FlowSource_t	**slot;
+	uint32_t		size;		// power of 2
+	uint32_t		count;		// number of hashed flow sources
+	FlowSource_t	*any_source;
+} SourceHash = { NULL, 0, 0, NULL };
+
+// initial hash sizes
+#define SOURCE_HASH_SIZE	64
+#define EXPORTER_HASH_SIZE	16
+
 /* local prototypes */
 static uint32_t AssignExporterID(void);
 
+static inline uint32_t HashIP(ip_addr_t *ip, uint64_t key);
+
+static int HashFlowSource(FlowSource_t *fs);
+
 /* local functions */
 static uint32_t AssignExporterID(void) {
 
-	if ( exporter_sysid >= 255 ) {
-		LogError("Too many exporters (id > 255). Flow records collected but without reference to exporter");
+uint32_t sysid;
+
+	// exporters may be added concurrently by several decode threads
+	sysid = __sync_add_and_fetch(&exporter_sysid, 1);
+	if ( sysid > MAX_EXPORTER_SYSID ) {
+		LogError("Too many exporters (id > %u). Flow records collected but without reference to exporter", MAX_EXPORTER_SYSID);
 		return 0;
 	}
 
-	return ++exporter_sysid;
+	return sysid;
 
 } // End of AssignExporterID
 
 /* global functions */
 
+static inline uint32_t HashIP(ip_addr_t *ip, uint64_t key) {
+uint64_t hash;
+
+	// multiplicative hashing - the upper bits are well mixed
+	hash = ( ip->v6[0] ^ ip->v6[1] ^ key ) * 0x9E3779B97F4A7C15ULL;
+	return (uint32_t)(hash >> 32);
+
+} // End of HashIP
+
+static int HashFlowSource(FlowSource_t *fs) {
+uint32_t mask, index;
+
+	if ( fs->any_source ) {
+		SourceHash.any_source = fs;
+		return 1;
+	}
+
+	// keep the load factor below 50%
+	if ( 2 * (SourceHash.count + 1) > SourceHash.size ) {
+		FlowSource_t **slot;
+		uint32_t size, i;
+
+		size = SourceHash.size ? 2 * SourceHash.size : SOURCE_HASH_SIZE;
+		slot = (FlowSource_t **)calloc(size, sizeof(FlowSource_t *));
+		if ( !slot ) {
+			LogError("calloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+			return 0;
+		}
+		mask = size - 1;
+		for ( i=0; i<SourceHash.size; i++ ) {
+			FlowSource_t *s = SourceHash.slot[i];
+			if ( s ) {
+				index = HashIP(&s->ip, 0) & mask;
+				while ( slot[index] ) 
+					index = (index + 1) & mask;
+				slot[index] = s;
+			}
+		}
+		free(SourceHash.slot);
+		SourceHash.slot = slot;
+		SourceHash.size = size;
+	}
+
+	mask  = SourceHash.size - 1;
+	index = HashIP(&fs->ip, 0) & mask;
+	while ( SourceHash.slot[index] ) {
+		FlowSource_t *s = SourceHash.slot[index];
+		// the first source of an IP address receives the packets
+		if ( s->ip.v6[0] == fs->ip.v6[0] && s->ip.v6[1] == fs->ip.v6[1] ) 
+			return 1;
+		index = (index + 1) & mask;
+	}
+	SourceHash.slot[index] = fs;
+	SourceHash.count++;
+
+	return 1;
+
+} // End of HashFlowSource
+
+FlowSource_t *LookupFlowSource(ip_addr_t *ip) {
+uint32_t mask, index;
+FlowSource_t *fs;
+
+	if ( SourceHash.count ) {
+		mask  = SourceHash.size - 1;
+		index = HashIP(ip, 0) & mask;
+		while ( (fs = SourceHash.slot[index]) != NULL ) {
+			if ( fs->ip.v6[0] == ip->v6[0] && fs->ip.v6[1] == ip->v6[1] ) 
+				return fs;
+			index = (index + 1) & mask;
+		}
+	}
+
+	return SourceHash.any_source;
+
+} // End of LookupFlowSource
+
 int SetDynamicSourcesDir(FlowSource_t **FlowSource, char *dir) {
 
 	if ( *FlowSource ) 
@@ -227,7 +363,7 @@ int ok;
 		return 0;
 	}
 
-	return 1;
+	return HashFlowSource(*source);
 
 } // End of AddFlowSource
 
@@ -295,7 +431,7 @@ char s[MAXPATHLEN];
 		return 0;
 	}
 
-	return 1;
+	return HashFlowSource(*FlowSource);
 
 } // End of AddDefaultFlowSource
 
@@ -425,6 +561,12 @@ int				err;
 	}
 	(*source)->current = strdup(path);
 
+	if ( !HashFlowSource(*source) ) {
+		free(*source);
+		*source = NULL;
+		return NULL;
+	}
+
 	LogInfo("Dynamically add source ident: %s in directory: %s", ident, path);
 	return *source;
 
@@ -473,6 +615,115 @@ int next_slot = fs->extension_map_list.next_free;
 
 } // End of AddExtensionMap
 
+generic_exporter_t *LookupExporter(FlowSource_t *fs, uint32_t version, uint32_t id) {
+generic_exporter_t *e;
+uint32_t mask, index;
+
+	// consecutive packets are often sent by the same exporter
+	e = fs->exporter_hash.last;
+	if ( e && e->info.id == id && e->info.version == version &&
+		 e->info.ip.v6[0] == fs->ip.v6[0] && e->info.ip.v6[1] == fs->ip.v6[1] ) 
+		return e;
+
+	if ( !fs->exporter_hash.count ) 
+		return NULL;
+
+	mask  = fs->exporter_hash.size - 1;
+	index = HashIP(&fs->ip, ((uint64_t)version << 32) | id) & mask;
+	while ( (e = fs->exporter_hash.slot[index]) != NULL ) {
+		if ( e->info.id == id && e->info.version == version &&
+			 e->info.ip.v6[0] == fs->ip.v6[0] && e->info.ip.v6[1] == fs->ip.v6[1] ) {
+			fs->exporter_hash.last = e;
+			return e;
+		}
+		index = (index + 1) & mask;
+	}
+
+	return NULL;
+
+} // End of LookupExporter
+
+int HashExporter(FlowSource_t *fs, generic_exporter_t *exporter) {
+uint32_t mask, index;
+
+	// keep the load factor below 50%
+	if ( 2 * (fs->exporter_hash.count + 1) > fs->exporter_hash.size ) {
+		generic_exporter_t **slot;
+		uint32_t size, i;
+
+		size = fs->exporter_hash.size ? 2 * fs->exporter_hash.size : EXPORTER_HASH_SIZE;
+		slot = (generic_exporter_t **)calloc(size, sizeof(generic_exporter_t *));
+		if ( !slot ) {
+			LogError("calloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+			return 0;
+		}
+		mask = size - 1;
+		for ( i=0; i<fs->exporter_hash.size; i++ ) {
+			generic_exporter_t *e = fs->exporter_hash.slot[i];
+			if ( e ) {
+				index = HashIP(&e->info.ip, ((uint64_t)e->info.version << 32) | e->info.id) & mask;
+				while ( slot[index] ) 
+					index = (index + 1) & mask;
+				slot[index] = e;
+			}
+		}
+		free(fs->exporter_hash.slot);
+		fs->exporter_hash.slot = slot;
+		fs->exporter_hash.size = size;
+	}
+
+	mask  = fs->exporter_hash.size - 1;
+	index = HashIP(&exporter->info.ip, ((uint64_t)exporter->info.version << 32) | exporter->info.id) & mask;
+	while ( fs->exporter_hash.slot[index] ) 
+		index = (index + 1) & mask;
+	fs->exporter_hash.slot[index] = exporter;
+	fs->exporter_hash.count++;
+	fs->exporter_hash.last = exporter;
+
+	return 1;
+
+} // End of HashExporter
+
+extension_map_t *CopyExtensionMap(extension_map_t *map, uint32_t sysid) {
+extension_map_t *copy;
+int i, num, map_size;
+
+	// the common record has room for an 8 bit exporter sysid only
+	if ( sysid <= 255 ) {
+		copy = (extension_map_t *)malloc(map->size);
+		if ( !copy ) {
+			LogError("malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+			return NULL;
+		}
+		memcpy((void *)copy, (void *)map, map->size);
+		return copy;
+	}
+
+	for ( num=0; map->ex_id[num]; num++ ) {;}
+
+	// one more extension
+	map_size = sizeof(extension_map_t) + (num+1) * sizeof(uint16_t);
+	// align 32 bits
+	if ( ( map_size & 0x3 ) != 0 )
+		map_size += 2;
+
+	copy = (extension_map_t *)calloc(1, map_size);
+	if ( !copy ) {
+		LogError("calloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		return NULL;
+	}
+	copy->type 	   		 = ExtensionMapType;
+	copy->size 	   		 = map_size;
+	copy->map_id   		 = map->map_id;
+	copy->extension_size = map->extension_size + extension_descriptor[EX_EXPORTER_SYSID].size;
+	for ( i=0; i<num; i++ ) 
+		copy->ex_id[i] = map->ex_id[i];
+	copy->ex_id[num] = EX_EXPORTER_SYSID;
+
+	return copy;
+
+} // End of CopyExtensionMap
+
 int FlushInfoExporter(FlowSource_t *fs, exporter_info_record_t *exporter) {
 
 	exporter->sysid = AssignExporterID();
@@ -612,12 +863,295 @@ uint32_t i, size;
 int HasOptionTable(FlowSource_t *fs, uint16_t id ) {
 option_offset_t *t;
 
-	t = fs->option_offset_table;
-	while ( t && t->id != id )
-		t = t->next;
+	t = (option_offset_t *)IndexLookup(&fs->option_index, id);
 
 	dbg_printf("Has option table: %s\n", t == NULL ? "not found" : "found");
 
 	return t != NULL;
 
 } // End of HasOptionTable
+
+int IndexInsert(id_index_t *index, uint16_t id, void *entry) {
+void **page = index->page[id >> 8];
+
+	if ( !page ) {
+		// nothing to remove
+		if ( !entry ) 
+			return 1;
+		page = (void **)calloc(INDEX_PAGE_SIZE, sizeof(void *));
+		if ( !page ) {
+			LogError("calloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+			return 0;
+		}
+		index->page[id >> 8] = page;
+	}
+	page[id & 0xFF] = entry;
+
+	return 1;
+
+} // End of IndexInsert
+
+void IndexFree(id_index_t *index) {
+int i;
+
+	for ( i=0; i<INDEX_PAGES; i++ ) {
+		free(index->page[i]);
+		index->page[i] = NULL;
+	}
+
+} // End of IndexFree
+
+int WriteCacheRecord(FILE *fd, uint16_t type, exporter_info_record_t *info, void *data, uint32_t size) {
+template_cache_record_t record;
+uint32_t	padding = 0;
+size_t		pad = ( 4 - (size & 0x3) ) & 0x3;
+
+	memset((void *)&record, 0, sizeof(record));
+	record.type		 = type;
+	record.version	 = info->version;
+	record.size		 = sizeof(template_cache_record_t) + size + pad;
+	record.id		 = info->id;
+	record.sa_family = info->sa_family;
+	record.ip		 = info->ip;
+
+	if ( fwrite((void *)&record, sizeof(record), 1, fd) != 1 || 
+		 fwrite(data, size, 1, fd) != 1 ||
+		 ( pad && fwrite((void *)&padding, pad, 1, fd) != 1 ) ) {
+		LogError("fwrite() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		return 0;
+	}
+
+	return 1;
+
+} // End of WriteCacheRecord
+
+packet_batch_t *InitPacketBatch(void) {
+packet_batch_t *batch;
+
+	batch = (packet_batch_t *)calloc(1, sizeof(packet_batch_t));
+	if ( !batch ) {
+		LogError("calloc() allocation error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		return NULL;
+	}
+	batch->buff = malloc((size_t)RECEIVE_BATCH * NETWORK_INPUT_BUFF_SIZE);
+	if ( !batch->buff ) {
+		LogError("malloc() allocation error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		free(batch);
+		return NULL;
+	}
+
+#ifdef HAVE_RECVMMSG
+	{
+	int i;
+	for ( i=0; i<RECEIVE_BATCH; i++ ) {
+		batch->iov[i].iov_base = batch->buff + (size_t)i * NETWORK_INPUT_BUFF_SIZE;
+		batch->iov[i].iov_len  = NETWORK_INPUT_BUFF_SIZE;
+		batch->msgs[i].msg_hdr.msg_iov	   = &batch->iov[i];
+		batch->msgs[i].msg_hdr.msg_iovlen  = 1;
+		batch->msgs[i].msg_hdr.msg_name	   = &batch->sender[i];
+	}
+	}
+#endif
+
+	return batch;
+
+} // End of InitPacketBatch
+
+void FreePacketBatch(packet_batch_t *batch) {
+
+	free(batch->buff);
+	free(batch);
+
+} // End of FreePacketBatch
+
+/*
+ * Blocks until at least one datagram is available and returns the number of
+ * datagrams received. Returns -1 on error - errno EINTR e.g. for the periodic alarm.
+ */
+ssize_t ReceiveBatch(packet_batch_t *batch, int socket) {
+int	i, ret;
+
+	batch->num	= 0;
+	batch->next = 0;
+
+#ifdef HAVE_RECVMMSG
+	for ( i=0; i<RECEIVE_BATCH; i++ ) 
+		batch->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+
+	// return with whatever is available, as soon as the first datagram arrived
+	ret = recvmmsg(socket, batch->msgs, RECEIVE_BATCH, MSG_WAITFORONE, NULL);
+	if ( ret < 0 ) 
+		return -1;
+
+	for ( i=0; i<ret; i++ ) {
+		batch->len[i]		  = batch->msgs[i].msg_len;
+		batch->sender_size[i] = batch->msgs[i].msg_hdr.msg_namelen;
+	}
+#else
+	i = 0;
+	batch->sender_size[i] = sizeof(struct sockaddr_storage);
+	batch->len[i] = recvfrom(socket, batch->buff, NETWORK_INPUT_BUFF_SIZE, 0, 
+		(struct sockaddr *)&batch->sender[i], &batch->sender_size[i]);
+	if ( batch->len[i] < 0 ) 
+		return -1;
+	ret = 1;
+#endif
+	batch->num = ret;
+
+	return ret;
+
+} // End of ReceiveBatch
+
+// returns the length of the next datagram of the batch or -1, if all are processed
+ssize_t NextPacket(packet_batch_t *batch, void **buff, struct sockaddr_storage *sender, socklen_t *sender_size) {
+uint32_t i;
+
+	if ( batch->next >= batch->num ) 
+		return -1;
+
+	i = batch->next++;
+	*buff		 = batch->buff + (size_t)i * NETWORK_INPUT_BUFF_SIZE;
+	*sender_size = batch->sender_size[i];
+	memcpy((void *)sender, (void *)&batch->sender[i], batch->sender_size[i]);
+
+	return batch->len[i];
+
+} // End of NextPacket
+
+int PacketsPending(packet_batch_t *batch) {
+
+	return batch->next < batch->num;
+
+} // End of PacketsPending
+
+packet_ring_t *InitPacketRing(void) {
+packet_ring_t *ring;
+
+	ring = (packet_ring_t *)calloc(1, sizeof(packet_ring_t));
+	if ( !ring ) {
+		LogError("calloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		return NULL;
+	}
+	ring->buff = malloc(PACKET_RING_SIZE);
+	if ( !ring->buff ) {
+		LogError("malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		free(ring);
+		return NULL;
+	}
+
+	return ring;
+
+} // End of InitPacketRing
+
+void FreePacketRing(packet_ring_t *ring) {
+
+	free(ring->buff);
+	free(ring);
+
+} // End of FreePacketRing
+
+// producer: returns 1, if the datagram was queued, 0 if the ring is full
+int PacketRingPut(packet_ring_t *ring, FlowSource_t *fs, void *buff, ssize_t length, struct sockaddr_storage *sender, struct timeval *received) {
+ring_packet_t *packet;
+uint64_t	head, tail;
+uint32_t	pos, size, room;
+
+	size = RING_ALIGN(sizeof(ring_packet_t) + length);
+	head = ring->head;
+	tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+	pos  = head & (PACKET_RING_SIZE - 1);
+	room = PACKET_RING_SIZE - pos;
+	if ( size > room ) {
+		// entry does not fit at the end of the ring - wrap to the beginning
+		if ( (head + room + size - tail) > PACKET_RING_SIZE ) {
+			__atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+			return 0;
+		}
+		*((uint32_t *)(ring->buff + pos)) = 0;
+		head += room;
+		pos   = 0;
+	} else if ( (head + size - tail) > PACKET_RING_SIZE ) {
+		__atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	packet = (ring_packet_t *)(ring->buff + pos);
+	packet->size	 = size;
+	packet->length	 = length;
+	packet->fs		 = fs;
+	packet->sender	 = *sender;
+	packet->received = *received;
+	memcpy((void *)&packet[1], buff, length);
+
+	// publish the entry
+	__atomic_store_n(&ring->head, head + size, __ATOMIC_RELEASE);
+
+	return 1;
+
+} // End of PacketRingPut
+
+// consumer: returns the next datagram or NULL, if the ring is empty
+ring_packet_t *PacketRingGet(packet_ring_t *ring) {
+uint64_t	head, tail;
+uint32_t	pos;
+
+	tail = ring->tail;
+	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	if ( tail == head ) 
+		return NULL;
+
+	pos = tail & (PACKET_RING_SIZE - 1);
+	if ( *((uint32_t *)(ring->buff + pos)) == 0 ) {
+		// wrap marker - the entry is at the beginning of the ring
+		tail += PACKET_RING_SIZE - pos;
+		__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+		if ( tail == head ) 
+			return NULL;
+		pos = 0;
+	}
+
+	return (ring_packet_t *)(ring->buff + pos);
+
+} // End of PacketRingGet
+
+/*
+ * consumer: returns up to max consecutive datagrams without releasing them. The batch ends
+ * at the wrap marker, so the datagrams are released in order with PacketRingRelease()
+ */
+int PacketRingGetBatch(packet_ring_t *ring, ring_packet_t **packets, int max) {
+ring_packet_t	*packet;
+uint64_t		head, pos;
+int				num;
+
+	packet = PacketRingGet(ring);
+	if ( !packet ) 
+		return 0;
+
+	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	pos  = ring->tail;
+	num  = 0;
+	while ( num < max && pos != head ) {
+		packet = (ring_packet_t *)(ring->buff + (pos & (PACKET_RING_SIZE - 1)));
+		if ( packet->size == 0 ) 
+			break;
+		packets[num++] = packet;
+		pos += packet->size;
+	}
+
+	return num;
+
+} // End of PacketRingGetBatch
+
+// consumer: the datagram returned by PacketRingGet() is processed - release its space
+void PacketRingRelease(packet_ring_t *ring, ring_packet_t *packet) {
+
+	__atomic_store_n(&ring->tail, ring->tail + packet->size, __ATOMIC_RELEASE);
+
+} // End of PacketRingRelease
+
+uint32_t PacketRingDropped(packet_ring_t *ring) {
+
+	return __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+
+} // End of PacketRingDropped
@@ -53,6 +53,19 @@ typedef struct srecord_s {
 // should be enough anyway
 
 
+/*
+ * Direct index for 16 bit ids such as template or sampler ids.
+ * Two level table with INDEX_PAGES pages of INDEX_PAGE_SIZE slots each. Pages are
+ * allocated on demand. The index stores the pointers only, the entries are owned by
+ * the caller and never move, so a lookup is constant time regardless of the number
+ * of entries.
+ */
+#define INDEX_PAGES		256
+#define INDEX_PAGE_SIZE	256
+typedef struct id_index_s {
+	void	**page[INDEX_PAGES];
+} id_index_t;
+
 typedef struct option_offset_s {
 	struct option_offset_s *next;
 	uint32_t	id;					// table id
@@ -91,6 +104,45 @@ typedef struct generic_exporter_s {
 
 } generic_exporter_t;
 
+/*
+ * Template cache
+ * nfcapd keeps the v9 and IPFIX templates and samplers of the exporters of each flow source
+ * in the file TEMPLATE_CACHE in the data directory of the flow source. The file is written at
+ * each file rotation and read, before the first packet of the source is processed, so after a
+ * restart, data flowsets are decoded at once instead of being dropped until the exporters
+ * resend their templates. Templates are kept in their raw network format and are restored by
+ * the regular template processing, therefore any template refreshed by the exporter replaces
+ * the cached one.
+ */
+#define TEMPLATE_CACHE			".nfcapd.templates"
+#define TEMPLATE_CACHE_MAGIC	0xA50E
+#define TEMPLATE_CACHE_VERSION	1
+#define MAX_TEMPLATE_CACHE_SIZE	(16 * 1024 * 1024)
+
+typedef struct template_cache_header_s {
+	uint16_t	magic;
+	uint16_t	version;
+	uint32_t	fill;
+} template_cache_header_t;
+
+typedef struct template_cache_record_s {
+	uint16_t	type;				// record type
+#define CACHE_TEMPLATE	1			// raw template record
+#define CACHE_SAMPLER	2			// cache_sampler_t
+	uint16_t	version;			// netflow version of the exporter: 9 or 10 ( IPFIX )
+	uint32_t	size;				// size of this record incl. data
+	uint32_t	id;					// exporter id - source id or observation domain
+	uint32_t	sa_family;			// exporter IP
+	ip_addr_t	ip;
+	// data follows, padded to 4 bytes
+} template_cache_record_t;
+
+typedef struct cache_sampler_s {
+	int32_t		id;
+	uint32_t	mode;
+	uint32_t	interval;
+} cache_sampler_t;
+
 typedef struct FlowSource_s {
 	// link
 	struct FlowSource_s *next;
@@ -101,6 +153,7 @@ typedef struct FlowSource_s {
 	uint32_t			sa_family;
 
 	int					any_source;
+	int					worker;			// decode worker owning this source - threaded nfcapd
 	bookkeeper_t 		*bookkeeper;
 
 	// all about data storage
@@ -121,6 +174,14 @@ typedef struct FlowSource_s {
 	uint32_t			exporter_count;
 	struct timeval		received;
 
+	// open addressing hash of exporter_data, keyed on IP, version and id
+	struct {
+		generic_exporter_t	**slot;
+		uint32_t			size;	// power of 2
+		uint32_t			count;
+		generic_exporter_t	*last;	// last hit
+	} exporter_hash;
+
 	// extension map list
 	struct {
 #define BLOCK_SIZE	16
@@ -130,12 +191,44 @@ typedef struct FlowSource_s {
 	} extension_map_list;
 
 	option_offset_t *option_offset_table;
+	id_index_t		option_index;	// option_offset_table indexed by template id
 
+	int				cache_loaded;	// template cache restored
 } FlowSource_t;
 
 /* input buffer size, to read data from the network */
 #define NETWORK_INPUT_BUFF_SIZE 65535	// Maximum UDP message size
 
+/*
+ * Packet batch
+ * The collectors receive up to RECEIVE_BATCH datagrams with a single recvmmsg() syscall 
+ * into a ring of input buffers and process them one by one. Without recvmmsg(), a batch 
+ * holds a single datagram received by recvfrom().
+ */
+#define RECEIVE_BATCH	64
+
+typedef struct packet_batch_s packet_batch_t;
+
+/*
+ * Packet ring
+ * Lock-free single producer, single consumer ring buffer of received datagrams. The 
+ * producer copies each datagram together with its flow source and sender into the ring,
+ * the consumer processes the datagram in place and releases it afterwards. The producer 
+ * never waits - if the ring is full, the datagram is dropped and counted.
+ */
+#define PACKET_RING_SIZE	(1 << 22)	// 4MB - must be a power of 2
+
+typedef struct ring_packet_s {
+	uint32_t				size;		// size of the ring entry - 0: wrap to the beginning
+	uint32_t				length;		// length of the datagram
+	FlowSource_t			*fs;
+	struct sockaddr_storage	sender;
+	struct timeval			received;
+	// datagram follows
+} ring_packet_t;
+
+typedef struct packet_ring_s packet_ring_t;
+
 // prototypes
 int AddFlowSource(FlowSource_t **FlowSource, char *ident);
 
@@ -145,20 +238,58 @@ int SetDynamicSourcesDir(FlowSource_t **FlowSource, char *dir);
 
 FlowSource_t *AddDynamicSource(FlowSource_t **FlowSource, struct sockaddr_storage *ss);
 
+FlowSource_t *LookupFlowSource(ip_addr_t *ip);
+
 int InitExtensionMapList(FlowSource_t *fs);
 
 int AddExtensionMap(FlowSource_t *fs, extension_map_t *map);
 
+extension_map_t *CopyExtensionMap(extension_map_t *map, uint32_t sysid);
+
 void FlushStdRecords(FlowSource_t *fs);
 
 void FlushExporterStats(FlowSource_t *fs);
 
+generic_exporter_t *LookupExporter(FlowSource_t *fs, uint32_t version, uint32_t id);
+
+int HashExporter(FlowSource_t *fs, generic_exporter_t *exporter);
+
 int FlushInfoExporter(FlowSource_t *fs, exporter_info_record_t *exporter);
 
 int FlushInfoSampler(FlowSource_t *fs, sampler_info_record_t *sampler);
 
 int HasOptionTable(FlowSource_t *fs, uint16_t id );
 
+int IndexInsert(id_index_t *index, uint16_t id, void *entry);
+
+void IndexFree(id_index_t *index);
+
+int WriteCacheRecord(FILE *fd, uint16_t type, exporter_info_record_t *info, void *data, uint32_t size);
+
+packet_batch_t *InitPacketBatch(void);
+
+void FreePacketBatch(packet_batch_t *batch);
+
+ssize_t ReceiveBatch(packet_batch_t *batch, int socket);
+
+ssize_t NextPacket(packet_batch_t *batch, void **buff, struct sockaddr_storage *sender, socklen_t *sender_size);
+
+int PacketsPending(packet_batch_t *batch);
+
+packet_ring_t *InitPacketRing(void);
+
+void FreePacketRing(packet_ring_t *ring);
+
+int PacketRingPut(packet_ring_t *ring, FlowSource_t *fs, void *buff, ssize_t length, struct sockaddr_storage *sender, struct timeval *received);
+
+ring_packet_t *PacketRingGet(packet_ring_t *ring);
+
+int PacketRingGetBatch(packet_ring_t *ring, ring_packet_t **packets, int max);
+
+void PacketRingRelease(packet_ring_t *ring, ring_packet_t *packet);
+
+uint32_t PacketRingDropped(packet_ring_t *ring);
+
 void launcher (char *commbuff, FlowSource_t *FlowSource, char *process, int expire);
 
 /* Default time window in seconds to rotate files */
@@ -35,6 +35,16 @@
  *	
  */
 
+static inline void *IndexLookup(id_index_t *index, uint16_t id) {
+void **page = index->page[id >> 8];
+
+	return page ? page[id & 0xFF] : NULL;
+
+} // End of IndexLookup
+
+// last flow source hit of this thread
+static __thread FlowSource_t *last_source = NULL;
+
 static inline FlowSource_t *GetFlowSource(struct sockaddr_storage *ss) {
 FlowSource_t	*fs;
 void			*ptr;
@@ -94,19 +104,21 @@ char			as[100];
 	printf("Flow Source IP: %s\n", as);
 #endif
 
-	fs = FlowSource;
-	while ( fs ) {
-		if ( ip.v6[0] ==  fs->ip.v6[0] && ip.v6[1] == fs->ip.v6[1] )
-			return fs; 
+	// consecutive packets mostly arrive from the same source
+	fs = last_source;
+	if ( fs && ip.v6[0] == fs->ip.v6[0] && ip.v6[1] == fs->ip.v6[1] )
+		return fs;
 
-		// if we match any source, store the current IP address - works as faster cache next time
-		// and identifies the current source by IP
+	fs = LookupFlowSource(&ip);
+	if ( fs ) {
+		// if we match any source, store the current IP address
+		// and identify the current source by IP
 		if ( fs->any_source ) {
 			fs->ip = ip;
 			fs->sa_family = ss->ss_family;
-			return fs;
-		}
-		fs = fs->next;
+		} else
+			last_source = fs;
+		return fs;
 	}
 
 	if ( ptr ) {
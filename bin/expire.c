@@ -356,6 +356,65 @@ char		first_timestring[16], last_timestring[16];
 
 } // End of RescanDir
 
+int RebuildIndex(char *dir) {
+FTS 		*fts;
+FTSENT 		*ftsent;
+char *const path[] = { dir, NULL };
+size_t		sub_index;
+uint32_t	numfiles;
+
+	if ( !CreateIndex(dir) )
+		return -1;
+
+	fts = fts_open(path, FTS_LOGICAL,  compare);
+	if ( !fts ) {
+		LogError( "fts_open() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		return -1;
+	}
+	sub_index = strlen(dir) + 1;
+	numfiles  = 0;
+	while ( (ftsent = fts_read(fts)) != NULL) {
+		if ( ftsent->fts_info == FTS_F && ftsent->fts_namelen == 19 ) {
+			// nfcapd.200604301200 strlen = 19
+			if ( strncmp(ftsent->fts_name, "nfcapd.", 7) == 0 ) {
+				char *s, *p = &(ftsent->fts_name[7]);
+
+				// make sure, we have only digits
+				s = p;
+				while ( *s ) {
+					if ( *s < '0' || *s > '9' ) 
+						break;
+					s++;
+				}
+				// otherwise skip
+				if ( *s )
+					continue;
+
+				// files are indexed relative to the data directory
+				if ( AppendIndex(dir, &(ftsent->fts_path[sub_index]), ISO2UNIX(p)) )
+					numfiles++;
+			}
+		} else {
+			switch (ftsent->fts_info) {
+				case FTS_D:
+					// skip all '.' entries as well as hidden directories
+					if ( ftsent->fts_level > 0 && ftsent->fts_name[0] == '.' ) 
+						fts_set(fts, ftsent, FTS_SKIP);
+					// any valid dirctory need to start with a digit ( %Y -> year )
+					if ( ftsent->fts_level > 0 && !isdigit(ftsent->fts_name[0]) )
+						fts_set(fts, ftsent, FTS_SKIP);
+					break;
+				case FTS_DP:
+					break;
+			}
+		}
+	}
+	fts_close(fts);
+
+	return numfiles;
+
+} // End of RebuildIndex
+
 void ExpireDir(char *dir, dirstat_t *dirstat, uint64_t maxsize, uint64_t maxlife, uint32_t runtime ) {
 FTS 		*fts;
 FTSENT 		*ftsent;
@@ -530,6 +589,9 @@ time_t 		now = time(NULL);
 
 	free(expire_timelimit);
 
+	// drop the expired files from the file index
+	ExpireIndex(dir);
+
 } // End of ExpireDir
 
 static void PrepareDirLists(channel_t *channel) {
@@ -796,6 +858,12 @@ uint64_t	sizelimit, num_expired;
 		LogError( "Maximum execution time reached! Interrupt expire.\n");
 	}
 
+	// drop the expired files from the file index of each channel
+	while ( channel ) {
+		ExpireIndex(channel->datadir);
+		channel = channel->next;
+	}
+
 } // End of ExpireProfile
 
 void UpdateBookStat(dirstat_t *dirstat, bookkeeper_t *books) {
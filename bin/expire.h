@@ -58,6 +58,8 @@ uint64_t ParseTimeDef(char *s, uint64_t *value);
 
 void RescanDir(char *dir, dirstat_t *dirstat);
 
+int RebuildIndex(char *dir);
+
 void ExpireDir(char *dir, dirstat_t *dirstat, uint64_t maxsize, uint64_t maxlife, uint32_t runtime );
 
 void ExpireProfile(channel_t *channel, dirstat_t *current_stat, uint64_t maxsize, uint64_t maxlife, uint32_t runtime );
@@ -77,7 +77,7 @@
 generic_exporter_t **exporter_list;
 
 /* local variables */
-#define MAX_EXPORTERS 256
+#define MAX_EXPORTERS (MAX_EXPORTER_SYSID+1)
 static generic_exporter_t *exporter_root;
 
 #include "nffile_inline.c"
@@ -121,7 +121,7 @@ char *p1, *p2;
 			for ( i = id+1; i < MAX_EXPORTERS  && exporter_list[i] != NULL; i++ ) {;}
 			if ( i >= MAX_EXPORTERS ) {
 				// all slots taken
-				LogError("Too many exporters (>256)\n");
+				LogError("Too many exporters (>%u)\n", MAX_EXPORTER_SYSID);
 				return 0;
 			} 
 			dbg_printf("Move existing exporter from slot %u, to %i\n", id, i);
@@ -245,7 +245,7 @@ exporter_stats_record_t *rec;
 
 	for (i=0; i<rec->stat_count; i++ ) {
 		uint32_t id = rec->stat[i].sysid;
-		if ( !exporter_list[id] ) {
+		if ( id >= MAX_EXPORTERS || !exporter_list[id] ) {
 			LogError("Exporter SysID: %u not found! - Skip stat record record.\n");
 			continue;
 		}
@@ -219,18 +219,36 @@ static struct entry_filter_s {
 
 #define NUM_PTR 16
 
+// number of index records read at once
+#define INDEX_CHUNK 256
+
 // globals
 extern uint32_t	twin_first, twin_last;
+extern char 	*CurrentIdent;
 
 static char		*first_file, *last_file;
 static char		*current_file = NULL;
 static stringlist_t source_dirs, file_list;
 
+// index records of all files in file_list, if the files were selected from the file index
+static index_record_t *file_index;
+static uint32_t	max_index;
+
+typedef struct index_source_s {
+	char		*dir;
+	int			fd;
+	uint32_t	first;			// first valid record
+	uint32_t	num_records;
+	uint32_t	flags;
+} index_source_t;
+
 /* Function prototypes */
 static inline int CheckTimeWindow(uint32_t t_start, uint32_t t_end, stat_record_t *stat_record);
 
 static void GetFileList(char *path);
 
+static int GetIndexList(int file_list_level);
+
 static void CleanPath(char *entry);
 
 static void Getsource_dirs(char *dirs);
@@ -417,6 +435,278 @@ char *p, *q, *first_mark, *last_mark;
 
 } // End of CreateDirListFilter
 
+/*
+ * File index
+ * If every source directory contains a file index, the files are selected from the
+ * index instead of walking the directory tree. The selection is identical to the
+ * fts walk in GetFileList: the same directory level and entry filters are applied,
+ * and the files are listed in the same order.
+ */
+static int OpenIndexFile(char *dir, index_header_t *index_header, uint32_t *num_records) {
+struct flock fl;
+struct stat	stat_buf;
+char	path[MAXPATHLEN];
+int		fd;
+
+	snprintf(path, MAXPATHLEN-1, "%s/%s", dir, INDEX_FILE);
+	path[MAXPATHLEN-1] = '\0';
+
+	fd = open(path, O_RDONLY);
+	if ( fd < 0 ) 
+		return -1;
+
+	// wait for a collector or nfexpire, updating the index
+	fl.l_type	= F_RDLCK;
+	fl.l_whence = SEEK_SET;
+	fl.l_start	= 0;
+	fl.l_len	= 0;
+	fl.l_pid	= getpid();
+	if ( fcntl(fd, F_SETLKW, &fl) < 0 ) {
+		close(fd);
+		return -1;
+	}
+
+	if ( pread(fd, (void *)index_header, sizeof(index_header_t), 0) != sizeof(index_header_t) ||
+		 index_header->magic != INDEX_MAGIC || index_header->version != INDEX_VERSION ||
+		 index_header->record_size != sizeof(index_record_t) || fstat(fd, &stat_buf) < 0 ) {
+		LogError("Corrupt index file '%s' - ignored\n", path);
+		close(fd);
+		return -1;
+	}
+	*num_records = (stat_buf.st_size - sizeof(index_header_t)) / sizeof(index_record_t);
+
+	return fd;
+
+} // End of OpenIndexFile
+
+static inline int ReadIndexRecords(int fd, uint32_t index, uint32_t num, index_record_t *index_record) {
+ssize_t	ret;
+uint32_t i;
+
+	ret = pread(fd, (void *)index_record, num * sizeof(index_record_t), 
+			sizeof(index_header_t) + (off_t)index * sizeof(index_record_t));
+	if ( ret != (ssize_t)(num * sizeof(index_record_t)) ) {
+		LogError("read() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		return 0;
+	}
+	for ( i=0; i<num; i++ ) {
+		index_record[i].name[sizeof(index_record[i].name)-1] = '\0';
+		index_record[i].ident[IDENTLEN-1] = '\0';
+	}
+
+	return 1;
+
+} // End of ReadIndexRecords
+
+static int IndexFilter(char *name, int file_list_level) {
+char *p, *base;
+int level, skip;
+
+	// -R directory: all files in all sub directories
+	if ( file_list_level == 0 )
+		return 1;
+
+	// files are listed at file_list_level only
+	if ( (dirlevels(name) + 1) != file_list_level )
+		return 0;
+
+	// intermediate directory level filters
+	level = 1;
+	p = name;
+	while ( (p = strchr(p, '/')) != NULL ) {
+		*p = '\0';
+		skip = ( dir_entry_filter[level].first_entry && strcmp(name, dir_entry_filter[level].first_entry) < 0 ) ||
+			   ( dir_entry_filter[level].last_entry  && strcmp(name, dir_entry_filter[level].last_entry)  > 0 );
+		*p++ = '/';
+		if ( skip )
+			return 0;
+		level++;
+	}
+
+	// file level filter
+	base = strrchr(name, '/');
+	base = base ? base + 1 : name;
+	if ( ( dir_entry_filter[level].first_entry && strcmp(base, dir_entry_filter[level].first_entry) < 0 ) ||
+		 ( dir_entry_filter[level].last_entry  && strcmp(base, dir_entry_filter[level].last_entry)  > 0 ) )
+		return 0;
+
+	return 1;
+
+} // End of IndexFilter
+
+static char *IndexBound(int file_list_level, int last) {
+char	*dir, *file, bound[MAXPATHLEN];
+
+	// no bound for -R directory
+	file = last ? last_file : first_file;
+	if ( file_list_level == 0 || !file )
+		return NULL;
+
+	if ( file_list_level == 1 )
+		return strdup(file);
+
+	dir = last ? dir_entry_filter[file_list_level-1].last_entry : dir_entry_filter[file_list_level-1].first_entry;
+	if ( !dir )
+		return NULL;
+
+	snprintf(bound, MAXPATHLEN-1, "%s/%s", dir, file);
+	bound[MAXPATHLEN-1] = '\0';
+	return strdup(bound);
+
+} // End of IndexBound
+
+static int index_compare(const void *p1, const void *p2) {
+	return ComparePath(((index_record_t *)p1)->name, ((index_record_t *)p2)->name);
+} // End of index_compare
+
+static int source_compare(const void *p1, const void *p2) {
+	return strcmp(((index_source_t *)p1)->dir, ((index_source_t *)p2)->dir);
+} // End of source_compare
+
+static void InsertIndexRecord(char *dir, index_record_t *index_record) {
+char path[MAXPATHLEN];
+
+	if ( file_list.num_strings == max_index ) {
+		max_index += 64;
+		file_index = (index_record_t *)realloc(file_index, max_index * sizeof(index_record_t));
+		if ( !file_index ) {
+			fprintf(stderr, "realloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+			exit(250);
+		}
+	}
+	file_index[file_list.num_strings] = *index_record;
+
+	snprintf(path, MAXPATHLEN-1, "%s/%s", dir, index_record->name);
+	path[MAXPATHLEN-1] = '\0';
+	InsertString(&file_list, path);
+
+} // End of InsertIndexRecord
+
+static int GetIndexList(int file_list_level) {
+index_source_t	*source;
+index_header_t	index_header;
+index_record_t	*index_record, *selected;
+uint32_t		num_selected, max_selected, num, lo, hi, mid;
+char			*lower_bound, *upper_bound;
+int				i, j, num_dirs, sorted, ok, done;
+
+	num_dirs = source_dirs.num_strings;
+	if ( num_dirs == 0 )
+		return 0;
+
+	source		 = (index_source_t *)malloc(num_dirs * sizeof(index_source_t));
+	index_record = (index_record_t *)malloc(INDEX_CHUNK * sizeof(index_record_t));
+	if ( !source || !index_record ) {
+		fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		exit(250);
+	}
+
+	// fts lists the source directories in sorted order
+	for ( i=0; i<num_dirs; i++ ) {
+		source[i].dir = source_dirs.list[i];
+		source[i].fd  = -1;
+	}
+	qsort(source, num_dirs, sizeof(index_source_t), source_compare);
+
+	// all source directories need an index
+	ok = 1;
+	for ( i=0; i<num_dirs && ok; i++ ) {
+		source[i].fd = OpenIndexFile(source[i].dir, &index_header, &source[i].num_records);
+		source[i].first = index_header.first;
+		source[i].flags = index_header.flags;
+		ok = source[i].fd >= 0;
+	}
+
+	lower_bound = ok ? IndexBound(file_list_level, 0) : NULL;
+	upper_bound = ok ? IndexBound(file_list_level, 1) : NULL;
+
+	selected	 = NULL;
+	max_selected = 0;
+	for ( i=0; i<num_dirs && ok; i++ ) {
+		sorted = (source[i].flags & INDEX_UNSORTED) == 0;
+		lo = source[i].first;
+		hi = source[i].num_records;
+
+		// binary search for the first record of the range
+		if ( sorted && lower_bound ) {
+			while ( ok && lo < hi ) {
+				mid = lo + (hi - lo) / 2;
+				ok = ReadIndexRecords(source[i].fd, mid, 1, index_record);
+				if ( !ok )
+					break;
+				if ( ComparePath(index_record[0].name, lower_bound) < 0 )
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+			hi = source[i].num_records;
+		}
+
+		num_selected = 0;
+		done = 0;
+		while ( ok && !done && lo < hi ) {
+			num = (hi - lo) > INDEX_CHUNK ? INDEX_CHUNK : hi - lo;
+			ok = ReadIndexRecords(source[i].fd, lo, num, index_record);
+			for ( j=0; ok && j<num; j++ ) {
+				if ( sorted && upper_bound && ComparePath(index_record[j].name, upper_bound) > 0 ) {
+					// end of range
+					done = 1;
+					break;
+				}
+				if ( !IndexFilter(index_record[j].name, file_list_level) ) 
+					continue;
+
+				if ( num_selected == max_selected ) {
+					max_selected += INDEX_CHUNK;
+					selected = (index_record_t *)realloc(selected, max_selected * sizeof(index_record_t));
+					if ( !selected ) {
+						fprintf(stderr, "realloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+						exit(250);
+					}
+				}
+				selected[num_selected++] = index_record[j];
+			}
+			lo += num;
+		}
+		if ( !ok )
+			break;
+
+		if ( !sorted ) 
+			qsort(selected, num_selected, sizeof(index_record_t), index_compare);
+
+		for ( j=0; j<num_selected; j++ ) {
+			// skip duplicate records
+			if ( j && strcmp(selected[j].name, selected[j-1].name) == 0 )
+				continue;
+			InsertIndexRecord(source[i].dir, &selected[j]);
+		}
+	}
+
+	for ( i=0; i<num_dirs; i++ ) {
+		if ( source[i].fd >= 0 ) 
+			close(source[i].fd);
+	}
+
+	if ( !ok ) {
+		// fall back to scan the directories
+		for ( i=0; i<file_list.num_strings; i++ ) 
+			free(file_list.list[i]);
+		file_list.num_strings = 0;
+		free(file_index);
+		file_index = NULL;
+		max_index  = 0;
+	}
+
+	free(lower_bound);
+	free(upper_bound);
+	free(selected);
+	free(index_record);
+	free(source);
+
+	return ok;
+
+} // End of GetIndexList
+
 static void GetFileList(char *path) {
 struct stat stat_buf;
 char *last_file_ptr, *first_path, *last_path;
@@ -747,6 +1037,10 @@ printf("file_list_level: %i\n", file_list_level);
 */
 	CreateDirListFilter(first_path, last_path, file_list_level );
 
+	// select the files from the file index, if available
+	if ( GetIndexList(file_list_level) ) 
+		return;
+
 	// last entry must be NULL
 	InsertString(&source_dirs, NULL);
 	fts = fts_open(source_dirs.list, FTS_LOGICAL,  compare);
@@ -791,8 +1085,9 @@ printf("DGB: short fts: '%s', filer_first: '%s', filter_last: '%s'\n",
 				// file entry
 // printf("==> Check: %s\n", ftsent->fts_name);
 
-				// skip stat file
-				if ( strcmp(ftsent->fts_name, ".nfstat") == 0 ||
+				// skip stat, index and nfcapd template cache file
+				if ( strcmp(ftsent->fts_name, ".nfstat") == 0 || strcmp(ftsent->fts_name, INDEX_FILE) == 0 ||
+					 strncmp(ftsent->fts_name, ".nfcapd.templates", 17) == 0 ||
 					 strncmp(ftsent->fts_name, NF_DUMPFILE , strlen(NF_DUMPFILE)) == 0)
 					continue;
 				if ( strstr(ftsent->fts_name, ".stat") != NULL )
@@ -907,7 +1202,11 @@ void SetupInputFileSequence(char *multiple_dirs, char *single_file, char *multip
 		GetFileList(multiple_files);
 
 		// get time window spanning all the files 
-		if ( file_list.num_strings ) {
+		if ( file_index && file_list.num_strings ) {
+			// from the file index
+			twin_first = file_index[0].stat_record.first_seen;
+			twin_last  = file_index[file_list.num_strings-1].stat_record.last_seen;
+		} else if ( file_list.num_strings ) {
 			stat_record_t stat_ptr;
 
 			// read the stat record
@@ -1020,6 +1319,16 @@ static int cnt;
 #ifdef DEVEL
 		printf("Process: '%s'\n", file_list.list[cnt] ? file_list.list[cnt] : "<stdin>");
 #endif
+		if ( file_index ) {
+			struct stat stat_buf;
+			// skip files outside the time window without opening them
+			// as well as files expired after the index was read
+			if ( !CheckTimeWindow(twin_start, twin_end, &file_index[cnt].stat_record) ||
+				 ( stat(file_list.list[cnt], &stat_buf) < 0 && errno == ENOENT ) ) {
+				cnt++;
+				continue;
+			}
+		}
 		nffile = OpenFile(file_list.list[cnt], nffile);	// Open the file
 		if ( !nffile ) {
 			return NULL;
@@ -1045,6 +1354,32 @@ static int cnt;
 
 } // End of GetNextFile
 
+int GetIndexStat(stat_record_t *sum_stat) {
+static char ident[IDENTLEN];
+int i;
+
+	if ( !file_index || file_list.num_strings == 0 )
+		return 0;
+
+	for ( i=0; i<file_list.num_strings; i++ ) {
+		SumStatRecords(sum_stat, &file_index[i].stat_record);
+	}
+	strncpy(ident, file_index[file_list.num_strings-1].ident, IDENTLEN-1);
+	ident[IDENTLEN-1] = '\0';
+	CurrentIdent = ident;
+
+	return 1;
+
+} // End of GetIndexStat
+
+// returns the number of files to process and the list of file names - stdin is a NULL entry
+int GetFileNames(char ***list) {
+
+	*list = file_list.list;
+	return file_list.num_strings;
+
+} // End of GetFileNames
+
 
 int InitHierPath(int num) {
 int i;
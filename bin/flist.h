@@ -48,4 +48,8 @@ int SetupSubDir(char *dir, char *subdir, char *error, size_t errlen );
 
 nffile_t *GetNextFile(nffile_t *nffile, time_t twin_start, time_t twin_end);
 
+int GetIndexStat(stat_record_t *sum_stat);
+
+int GetFileNames(char ***list);
+
 #endif //_FLIST_H
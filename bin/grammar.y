@@ -475,8 +475,8 @@ term:	ANY { /* this is an unconditionally true expression, as a filter applies i
 	}
 
 	| SYSID NUMBER { 	
-		if ( $2 > 255 ) {
-			yyerror("Router SysID expected between be 1..255");
+		if ( $2 > MAX_EXPORTER_SYSID ) {
+			yyerror("Router SysID expected between be 1..65535");
 			YYABORT;
 		}
 		$$.self = NewBlock(OffsetExporterSysID, MaskExporterSysID, ($2 << ShiftExporterSysID) & MaskExporterSysID, CMP_EQ, FUNC_NONE, NULL); 
@@ -111,10 +111,13 @@ typedef struct sequence_map_s {
 #define zero32			17
 #define zero64			18
 #define zero128			19
+#define copy_block		20
+#define zero_block		21
 
 	uint32_t	id;				// sequence ID as defined above
 	uint16_t	input_offset;	// copy/process data at this input offset
 	uint16_t	output_offset;	// copy final data to this output offset
+	uint16_t	length;			// number of bytes of copy_block and zero_block
 	void		*stack;			// optionally copy data onto this stack
 } sequence_map_t;
 
@@ -148,6 +151,7 @@ typedef struct input_translation_s {
 //	uint32_t	engine_offset;
 	uint32_t	router_ip_offset;
 	uint32_t	received_offset;
+	uint32_t	sysid_offset;
 
 	// etension map infos
 	uint32_t	extension_map_changed;	// map changed while refreshing?
@@ -156,6 +160,10 @@ typedef struct input_translation_s {
 	// sequence map information
 	uint32_t	number_of_sequences;	// number of sequences for the translate 
 	sequence_map_t *sequence;			// sequence map
+
+	// raw template record for the template cache
+	void		*template_record;
+	uint32_t	template_size;
 } input_translation_t;
 
 /*
@@ -188,9 +196,8 @@ typedef struct exporter_ipfix_domain_s {
 	// linked list of all templates sent by this exporter
 	input_translation_t	*input_translation_table; 
 
-	// in order to prevent search through all lists keep
-	// the last template we processed as a cache
-	input_translation_t *current_table;
+	// translation tables indexed by template id
+	id_index_t			template_index;
 
 } exporter_ipfix_domain_t;
 
@@ -268,8 +275,8 @@ static struct ipfix_element_map_s {
 	{0, 0, 0}
 };
 
-// cache to be used while parsing a template
-static struct cache_s {
+// cache to be used while parsing a template - per thread, call Init_IPFIX() in each thread
+static __thread struct cache_s {
 	struct element_param_s {
 		uint16_t index;
 		uint16_t found;
@@ -282,7 +289,7 @@ static struct cache_s {
 } cache;
 
 // module limited globals
-static uint32_t	processed_records;
+static __thread uint32_t	processed_records;
 
 // externals
 extern int verbose;
@@ -304,15 +311,22 @@ static inline uint32_t MapElement(uint16_t Type, uint16_t Length, uint16_t Offse
 
 static inline void PushSequence(input_translation_t *table, uint16_t Type, uint32_t *offset, void *stack);
 
+static inline uint32_t BlockSequence(sequence_map_t *sequence, uint32_t *length);
+
+static void CompileSequence(input_translation_t *table);
+
 static inline void Process_ipfix_templates(exporter_ipfix_domain_t *exporter, void *flowset_header, uint32_t size_left, FlowSource_t *fs);
 
 static inline void Process_ipfix_template_add(exporter_ipfix_domain_t *exporter, void *DataPtr, uint32_t size_left, FlowSource_t *fs);
 
+static void SaveTemplateRecord(input_translation_t *table, void *template, uint32_t size);
+
 static inline void Process_ipfix_template_withdraw(exporter_ipfix_domain_t *exporter, void *DataPtr, uint32_t size_left, FlowSource_t *fs);
 
 
 #include "inline.c"
 #include "nffile_inline.c"
+#include "collector_inline.c"
 
 int Init_IPFIX(void) {
 int i;
@@ -344,14 +358,17 @@ static inline exporter_ipfix_domain_t *GetExporter(FlowSource_t *fs, ipfix_heade
 #define IP_STRING_LEN   40
 char ipstr[IP_STRING_LEN];
 exporter_ipfix_domain_t **e = (exporter_ipfix_domain_t **)&(fs->exporter_data);
+exporter_ipfix_domain_t *exporter;
 uint32_t ObservationDomain = ntohl(ipfix_header->ObservationDomain);
 
-	while ( *e ) {
-		if ( (*e)->info.id == ObservationDomain && (*e)->info.version == 10 && 
-			 (*e)->info.ip.v6[0] == fs->ip.v6[0] && (*e)->info.ip.v6[1] == fs->ip.v6[1]) 
-			return *e;
+	// search the appropriate exporter engine
+	exporter = (exporter_ipfix_domain_t *)LookupExporter(fs, 10, ObservationDomain);
+	if ( exporter ) 
+		return exporter;
+
+	// append new exporter
+	while ( *e ) 
 		e = &((*e)->next);
-	}
 
 	if ( fs->sa_family == AF_INET ) {
 		uint32_t _ip = htonl(fs->ip.v4);
@@ -386,6 +403,12 @@ uint32_t ObservationDomain = ntohl(ipfix_header->ObservationDomain);
 	(*e)->next	 			= NULL;
 	(*e)->sampler 			= NULL;
 
+	if ( !HashExporter(fs, (generic_exporter_t *)(*e)) ) {
+		free(*e);
+		*e = NULL;
+		return NULL;
+	}
+
 	FlushInfoExporter(fs, &((*e)->info));
 
 	dbg_printf("[%u] New exporter: SysID: %u, Observation domain %u from: %s\n", 
@@ -426,22 +449,10 @@ int	index;
 static inline input_translation_t *GetTranslationTable(exporter_ipfix_domain_t *exporter, uint16_t id) {
 input_translation_t *table;
 
-	if ( exporter->current_table && ( exporter->current_table->id == id ) )
-		return exporter->current_table;
-
-	table = exporter->input_translation_table;
-	while ( table ) {
-		if ( table->id == id ) {
-			exporter->current_table = table;
-			return table;
-		}
-
-		table = table->next;
-	}
+	table = (input_translation_t *)IndexLookup(&exporter->template_index, id);
 
 	dbg_printf("[%u] Get translation table %u: %s\n", exporter->info.id, id, table == NULL ? "not found" : "found");
 
-	exporter->current_table = table;
 	return table;
 
 } // End of GetTranslationTable
@@ -464,12 +475,21 @@ input_translation_t **table;
 	(*table)->sequence = calloc(cache.max_ipfix_elements, sizeof(sequence_map_t));
 	if ( !(*table)->sequence ) {
 			syslog(LOG_ERR, "Process_ipfix: Panic! malloc() %s line %d: %s", __FILE__, __LINE__, strerror (errno));
+			free(*table);
+			*table = NULL;
 			return NULL;
 	}
 
 	(*table)->id   = id;
 	(*table)->next = NULL;
 
+	if ( !IndexInsert(&exporter->template_index, id, *table) ) {
+		free((*table)->sequence);
+		free(*table);
+		*table = NULL;
+		return NULL;
+	}
+
 	dbg_printf("[%u] Get new translation table %u\n", exporter->info.id, id);
 
 	return *table;
@@ -501,12 +521,14 @@ input_translation_t *table, *parent;
 		// remove table from list
 		parent->next = table->next;
 	} else {
-		// last table removed
-		exporter->input_translation_table = NULL;
+		// first table removed
+		exporter->input_translation_table = table->next;
 	}
+	IndexInsert(&exporter->template_index, id, NULL);
 
 	free(table->sequence);
 	free(table->extension_info.map);
+	free(table->template_record);
 	free(table);
 
 } // End of remove_translation_table
@@ -525,13 +547,101 @@ input_translation_t *table, *next;
 
 		free(table->sequence);
 		free(table->extension_info.map);
+		free(table->template_record);
 		free(table);
 
 		table = next;
 	}
+	exporter->input_translation_table = NULL;
+	IndexFree(&exporter->template_index);
 
 } // End of remove_all_translation_tables
 
+static inline uint32_t BlockSequence(sequence_map_t *sequence, uint32_t *length) {
+
+	switch (sequence->id) {
+		case copy_block:
+		case zero_block:
+			*length = sequence->length;
+			return sequence->id;
+		case move8:
+			*length = 1;
+			return copy_block;
+#ifdef WORDS_BIGENDIAN
+		// no byte swapping required - plain copies
+		case move16:
+			*length = 2;
+			return copy_block;
+		case move32:
+			*length = 4;
+			return copy_block;
+		case move64:
+			*length = 8;
+			return copy_block;
+		case move128:
+			*length = 16;
+			return copy_block;
+#endif
+		case zero8:
+			*length = 1;
+			return zero_block;
+		case zero16:
+			*length = 2;
+			return zero_block;
+		case zero32:
+			*length = 4;
+			return zero_block;
+		case zero64:
+			*length = 8;
+			return zero_block;
+		case zero128:
+			*length = 16;
+			return zero_block;
+	}
+
+	*length = 0;
+	return nop;
+
+} // End of BlockSequence
+
+static void CompileSequence(input_translation_t *table) {
+uint32_t i, num_sequences;
+
+	/*
+	 * Lower the sequence list into a shorter program, executed for each data record:
+	 * nop sequences are dropped, consecutive sequences, which copy bytes from adjacent
+	 * input to adjacent output offsets, are fused into a single copy_block and consecutive
+	 * zero sequences with adjacent output offsets into a single zero_block.
+	 */
+	num_sequences = 0;
+	for ( i=0; i<table->number_of_sequences; i++ ) {
+		sequence_map_t *sequence = &table->sequence[i];
+		uint32_t block, length;
+
+		if ( sequence->id == nop ) 
+			continue;
+
+		block = BlockSequence(sequence, &length);
+		if ( block != nop && num_sequences ) {
+			sequence_map_t *prev = &table->sequence[num_sequences-1];
+			uint32_t prev_length;
+
+			if ( BlockSequence(prev, &prev_length) == block && 
+				 (prev->output_offset + prev_length) == sequence->output_offset &&
+				 (block == zero_block || (prev->input_offset + prev_length) == sequence->input_offset) ) {
+				prev->id	 = block;
+				prev->length = prev_length + length;
+				continue;
+			}
+		}
+		table->sequence[num_sequences++] = *sequence;
+	}
+
+	dbg_printf("Compiled %u sequences into %u\n", table->number_of_sequences, num_sequences);
+	table->number_of_sequences = num_sequences;
+
+} // End of CompileSequence
+
 static inline void PushSequence(input_translation_t *table, uint16_t Type, uint32_t *offset, void *stack) {
 uint32_t i = table->number_of_sequences;
 uint32_t index = cache.lookup_info[Type].index;
@@ -626,6 +736,7 @@ size_t				size_required;
 //	table->engine_offset 	= 0;
 	table->router_ip_offset = 0;
 	table->received_offset  = 0;
+	table->sysid_offset 	= 0;
 
 	dbg_printf("[%u] Build sequence table %u\n", exporter->info.id, id);
 
@@ -806,6 +917,11 @@ size_t				size_required;
 				dbg_printf("Received offset: %u\n", offset);
 				offset				   += 8;
 				break;
+			case EX_EXPORTER_SYSID:
+				table->sysid_offset = offset;
+				dbg_printf("Exporter sysid offset: %u\n", offset);
+				offset				   += 4;
+				break;
 
 		}
 		extension_map->size += sizeof(uint16_t);
@@ -839,6 +955,8 @@ size_t				size_required;
 		table->ICMP_offset = cache.lookup_info[IPFIX_icmpTypeCodeIPv4].offset;
 	}
 
+	CompileSequence(table);
+
 #ifdef DEVEL
 	if ( table->extension_map_changed ) {
 		printf("Extension Map id=%u changed!\n", extension_map->map_id);
@@ -865,6 +983,24 @@ size_t				size_required;
 
 } // End of setup_translation_table
 
+static void SaveTemplateRecord(input_translation_t *table, void *template, uint32_t size) {
+
+	// templates are refreshed frequently - copy changed templates only
+	if ( table->template_size == size && memcmp(table->template_record, template, size) == 0 ) 
+		return;
+
+	free(table->template_record);
+	table->template_size   = 0;
+	table->template_record = malloc(size);
+	if ( !table->template_record ) {
+		syslog(LOG_ERR, "Process_ipfix: Panic! malloc() %s line %d: %s", __FILE__, __LINE__, strerror (errno));
+		return;
+	}
+	memcpy(table->template_record, template, size);
+	table->template_size = size;
+
+} // End of SaveTemplateRecord
+
 static inline void Process_ipfix_templates(exporter_ipfix_domain_t *exporter, void *flowset_header, uint32_t size_left, FlowSource_t *fs) {
 ipfix_template_record_t *ipfix_template_record;
 void *DataPtr;
@@ -1008,6 +1144,15 @@ uint16_t Offset = 0;
 			dbg_printf("Force add packet received time, Extension: %u\n", EX_RECEIVED);
 		}
 
+		// the common record has room for an 8 bit exporter sysid only
+		if ( exporter->info.sysid > 255 ) {
+			if ( cache.common_extensions[EX_EXPORTER_SYSID] == 0 ) {
+				cache.common_extensions[EX_EXPORTER_SYSID] = 1;
+				num_extensions++;
+			}
+			dbg_printf("Force add exporter sysid: %u, Extension: %u\n", exporter->info.sysid, EX_EXPORTER_SYSID);
+		}
+
 #ifdef DEVEL
 		{
 			int i;
@@ -1020,6 +1165,8 @@ uint16_t Offset = 0;
 #endif
 	
 		translation_table = setup_translation_table(exporter, id, Offset);
+		if ( !translation_table ) 
+			return;
 		if (translation_table->extension_map_changed ) {
 			translation_table->extension_map_changed = 0;
 			// refresh he map in the ouput buffer
@@ -1027,6 +1174,7 @@ uint16_t Offset = 0;
 			AddExtensionMap(fs, translation_table->extension_info.map);
 			dbg_printf("Translation Table added! map ID: %i\n", translation_table->extension_info.map->map_id);
 		}
+		SaveTemplateRecord(translation_table, DataPtr, size_required+4);
 
 		// update size left of this flowset
 		size_left -= size_required;
@@ -1421,6 +1569,13 @@ char				*string;
 						*((uint32_t *)&out[output_offset+4]) = t.val.val32[1];
 					}
 					break;
+				// fused sequences
+				case copy_block:
+					memcpy((void *)&out[output_offset], (void *)&in[input_offset], table->sequence[i].length);
+					break;
+				case zero_block:
+					memset((void *)&out[output_offset], 0, table->sequence[i].length);
+					break;
 				case zero8:
 					out[output_offset] = 0;
 					break;
@@ -1462,6 +1617,10 @@ char				*string;
 				*((uint32_t *)&out[table->received_offset+4]) = t.val.val32[1];
 		}
 
+		// exporter sysid > 255
+		if ( table->sysid_offset ) 
+			*((uint32_t *)&out[table->sysid_offset]) = exporter->info.sysid;
+
 		// split first/last time into epoch/msec values
 		data_record->first 		= table->flow_start / 1000;
 		data_record->msec_first = table->flow_start % 1000;
@@ -1724,3 +1883,68 @@ static uint32_t		packet_cntr = 0;
 
 } // End of Process_IPFIX
 
+/*
+ * Template cache: write the templates of all IPFIX exporters of this flow source
+ * Returns the number of records written or -1 on error
+ */
+int Save_ipfix_templates(FlowSource_t *fs, FILE *fd) {
+exporter_ipfix_domain_t	*exporter;
+input_translation_t		*table;
+int						num_records;
+
+	num_records = 0;
+	exporter = (exporter_ipfix_domain_t *)fs->exporter_data;
+	while ( exporter ) {
+		if ( exporter->info.version != 10 ) {
+			exporter = exporter->next;
+			continue;
+		}
+
+		table = exporter->input_translation_table;
+		while ( table ) {
+			if ( table->template_record ) {
+				if ( !WriteCacheRecord(fd, CACHE_TEMPLATE, &exporter->info, table->template_record, table->template_size) )
+					return -1;
+				num_records++;
+			}
+			table = table->next;
+		}
+
+		exporter = exporter->next;
+	}
+
+	return num_records;
+
+} // End of Save_ipfix_templates
+
+/*
+ * Template cache: restore a template of the IPFIX exporter, identified by the IP address in fs
+ * and the observation domain of the record. The template is processed as if sent by the exporter
+ * Returns 1 if restored, 0 otherwise
+ */
+int Restore_ipfix_template(FlowSource_t *fs, template_cache_record_t *record) {
+exporter_ipfix_domain_t	*exporter;
+ipfix_header_t			ipfix_header;
+ipfix_template_record_t *ipfix_template_record;
+uint32_t	size = record->size - sizeof(template_cache_record_t);
+
+	// IPFIX samplers are not yet processed
+	if ( record->type != CACHE_TEMPLATE || size < 4 ) 
+		return 0;
+
+	ipfix_template_record = (ipfix_template_record_t *)((void *)record + sizeof(template_cache_record_t));
+	if ( ntohs(ipfix_template_record->FieldCount) == 0 ) 
+		return 0;
+
+	memset((void *)&ipfix_header, 0, sizeof(ipfix_header_t));
+	ipfix_header.ObservationDomain = htonl(record->id);
+	exporter = GetExporter(fs, &ipfix_header);
+	if ( !exporter ) 
+		return 0;
+
+	Process_ipfix_template_add(exporter, (void *)ipfix_template_record, size, fs);
+
+	return 1;
+
+} // End of Restore_ipfix_template
+
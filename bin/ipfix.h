@@ -264,4 +264,8 @@ int Init_IPFIX(void);
 
 void Process_IPFIX(void *in_buff, ssize_t in_buff_cnt, FlowSource_t *fs);
 
+int Save_ipfix_templates(FlowSource_t *fs, FILE *fd);
+
+int Restore_ipfix_template(FlowSource_t *fs, template_cache_record_t *record);
+
 #endif //_IPFIX_H 1
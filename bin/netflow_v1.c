@@ -74,7 +74,7 @@ extern extension_descriptor_t extension_descriptor[];
 
 /* module limited globals */
 static extension_info_t v1_extension_info;		// common for all v1 records
-static uint16_t v1_output_record_size;
+static __thread uint16_t v1_output_record_size;
 
 // All required extension to save full v1 records
 static uint16_t v1_full_map[] = { EX_IO_SNMP_2, EX_NEXT_HOP_v4, EX_ROUTER_IP_v4, EX_RECEIVED, 0 };
@@ -135,10 +135,6 @@ uint16_t	map_size;
 		}
 		i++;
 	}
-	// extension_size contains the sum of all optional extensions
-	// caculate the record size 
-	v1_output_record_size = COMMON_RECORD_DATA_SIZE + V1_BLOCK_DATA_SIZE + extension_size;  
- 
 	// now the full extension map size
 	map_size	+= sizeof(extension_map_t);
  
@@ -178,17 +174,19 @@ uint16_t	map_size;
 
 static inline exporter_v1_t *GetExporter(FlowSource_t *fs, netflow_v1_header_t *header) {
 exporter_v1_t **e = (exporter_v1_t **)&(fs->exporter_data);
+exporter_v1_t *exporter;
 uint16_t	version    = ntohs(header->version);
 #define IP_STRING_LEN   40
 char ipstr[IP_STRING_LEN];
 
 	// search the appropriate exporter engine
-	while ( *e ) {
-		if ( (*e)->info.version == version && 
-			 (*e)->info.ip.v6[0] == fs->ip.v6[0] && (*e)->info.ip.v6[1] == fs->ip.v6[1]) 
-			return *e;
+	exporter = (exporter_v1_t *)LookupExporter(fs, version, 0);
+	if ( exporter ) 
+		return exporter;
+
+	// append new exporter
+	while ( *e ) 
 		e = &((*e)->next);
-	}
 
 	// nothing found
 	*e = (exporter_v1_t *)malloc(sizeof(exporter_v1_t));
@@ -209,15 +207,22 @@ char ipstr[IP_STRING_LEN];
 	(*e)->sequence_failure	= 0;
 	(*e)->sampler			= NULL;
 
-	// copy the v1 generic extension map
-	(*e)->extension_map		= (extension_map_t *)malloc(v1_extension_info.map->size);
+	(*e)->info.sysid = 0;
+	if ( !HashExporter(fs, (generic_exporter_t *)(*e)) ) {
+		free(*e);
+		*e = NULL;
+		return NULL;
+	}
+
+	FlushInfoExporter(fs, &((*e)->info));
+
+	// copy the v1 generic extension map - the exporter sysid decides about EX_EXPORTER_SYSID
+	(*e)->extension_map		= CopyExtensionMap(v1_extension_info.map, (*e)->info.sysid);
 	if ( !(*e)->extension_map ) {
-		syslog(LOG_ERR, "Process_v1: malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror (errno));
 		free(*e);
 		*e = NULL;
 		return NULL;
 	}
-	memcpy((void *)(*e)->extension_map, (void *)v1_extension_info.map, v1_extension_info.map->size);
 
 	if ( !AddExtensionMap(fs, (*e)->extension_map) ) {
 		// bad - we must free this map and fail - otherwise data can not be read any more
@@ -227,9 +232,6 @@ char ipstr[IP_STRING_LEN];
 		return NULL;
 	}
 
-	(*e)->info.sysid = 0;
-	FlushInfoExporter(fs, &((*e)->info));
-
 	if ( fs->sa_family == AF_INET ) {
 		uint32_t _ip = htonl(fs->ip.v4);
 		inet_ntop(AF_INET, &_ip, ipstr, sizeof(ipstr));
@@ -279,6 +281,10 @@ char		*string;
 		extension_map = exporter->extension_map;
 		flow_record_length = NETFLOW_V1_RECORD_LENGTH;
 
+		// extension_size contains the sum of all optional extensions of this exporter
+		// caculate the record size 
+		v1_output_record_size = COMMON_RECORD_DATA_SIZE + V1_BLOCK_DATA_SIZE + extension_map->extension_size;
+
 		// this many data to process
 		size_left	= in_buff_cnt;
 
@@ -380,6 +386,11 @@ char		*string;
 							tpl->received  = (uint64_t)((uint64_t)fs->received.tv_sec * 1000LL) + (uint64_t)((uint64_t)fs->received.tv_usec / 1000LL);
 							data_ptr = (void *)tpl->data;
 							} break;
+						case EX_EXPORTER_SYSID: {
+							tpl_ext_28_t *tpl = (tpl_ext_28_t *)data_ptr;
+							tpl->exporter_sysid = exporter->info.sysid;
+							data_ptr = (void *)tpl->data;
+							} break;
 
 						default:
 							// this should never happen, as v1 has no other extensions
@@ -52,6 +52,10 @@
 #include <stdint.h>
 #endif
 
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
 #include "util.h"
 #include "nffile.h"
 #include "nfx.h"
@@ -76,7 +80,7 @@ extern uint32_t overwrite_sampling;
 
 /* module limited globals */
 static extension_info_t v5_extension_info;		// common for all v5 records
-static uint16_t v5_output_record_size, v5_output_record_base_size;
+static __thread uint16_t v5_output_record_size;
 
 // All required extension to save full v5 records
 static uint16_t v5_full_mapp[] = { EX_IO_SNMP_2, EX_AS_2, EX_MULIPLE, EX_NEXT_HOP_v4, EX_ROUTER_IP_v4, EX_ROUTER_ID, EX_RECEIVED, 0 };
@@ -119,6 +123,8 @@ static exporter_v5_t 		output_engine;
 
 static inline exporter_v5_t *GetExporter(FlowSource_t *fs, netflow_v5_header_t *header);
 
+static inline void Decode_v5_records(void *in, int record_length, int count, netflow_v5_record_t *out);
+
 static inline int CheckBufferSpace(nffile_t *nffile, size_t required);
 
 /* functions */
@@ -147,10 +153,6 @@ uint16_t	map_size;
 		}
 		i++;
 	}
-	// extension_size contains the sum of all optional extensions
-	// caculate the record size without counters!
-	v5_output_record_base_size = COMMON_RECORD_DATA_SIZE + 8 + extension_size;  // + 8 for 2 x IPv4 addr
- 
 	// align 32 bits
 	if ( ( map_size & 0x3 ) != 0 )
 		map_size += 2;
@@ -186,6 +188,7 @@ uint16_t	map_size;
 
 static inline exporter_v5_t *GetExporter(FlowSource_t *fs, netflow_v5_header_t *header) {
 exporter_v5_t **e = (exporter_v5_t **)&(fs->exporter_data);
+exporter_v5_t *exporter;
 generic_sampler_t *sampler;
 uint16_t	engine_tag = ntohs(header->engine_tag);
 uint16_t	version    = ntohs(header->version);
@@ -193,12 +196,13 @@ uint16_t	version    = ntohs(header->version);
 char ipstr[IP_STRING_LEN];
 
 	// search the appropriate exporter engine
-	while ( *e ) {
-		if ( (*e)->info.version == version && (*e)->info.id == engine_tag &&
-			 (*e)->info.ip.v6[0] == fs->ip.v6[0] && (*e)->info.ip.v6[1] == fs->ip.v6[1]) 
-			return *e;
+	exporter = (exporter_v5_t *)LookupExporter(fs, version, engine_tag);
+	if ( exporter ) 
+		return exporter;
+
+	// append new exporter
+	while ( *e ) 
 		e = &((*e)->next);
-	}
 
 	// nothing found
 	*e = (exporter_v5_t *)malloc(sizeof(exporter_v5_t));
@@ -237,15 +241,23 @@ char ipstr[IP_STRING_LEN];
 	if ( sampler->info.interval == 0 )
 		sampler->info.interval = default_sampling;
 
-	// copy the v5 generic extension map
-	(*e)->extension_map		= (extension_map_t *)malloc(v5_extension_info.map->size);
+	(*e)->info.sysid = 0;
+	if ( !HashExporter(fs, (generic_exporter_t *)(*e)) ) {
+		free(sampler);
+		free(*e);
+		*e = NULL;
+		return NULL;
+	}
+
+	FlushInfoExporter(fs, &((*e)->info));
+
+	// copy the v5 generic extension map - the exporter sysid decides about EX_EXPORTER_SYSID
+	(*e)->extension_map		= CopyExtensionMap(v5_extension_info.map, (*e)->info.sysid);
 	if ( !(*e)->extension_map ) {
-		syslog(LOG_ERR, "Process_v5: malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror (errno));
 		free(*e);
 		*e = NULL;
 		return NULL;
 	}
-	memcpy((void *)(*e)->extension_map, (void *)v5_extension_info.map, v5_extension_info.map->size);
 
 	if ( !AddExtensionMap(fs, (*e)->extension_map) ) {
 		// bad - we must free this map and fail - otherwise data can not be read any more
@@ -255,8 +267,6 @@ char ipstr[IP_STRING_LEN];
 		return NULL;
 	}
 
-	(*e)->info.sysid = 0;
-	FlushInfoExporter(fs, &((*e)->info));
 	sampler->info.exporter_sysid		= (*e)->info.sysid;
 	FlushInfoSampler(fs, &(sampler->info));
 
@@ -288,9 +298,61 @@ char ipstr[IP_STRING_LEN];
 
 } // End of GetExporter
 
+static inline void Decode_v5_records(void *in, int record_length, int count, netflow_v5_record_t *out) {
+uint8_t *p = (uint8_t *)in;
+int i;
+
+	/*
+	 * Byte swap all v5/v7 records of a PDU into host order in a single pass.
+	 * The v5 record has a fixed layout and all fields are naturally aligned within
+	 * each 16 byte chunk, so a fixed shuffle per chunk swaps all fields at once.
+	 * v7 records carry 4 additional bytes ( router_sc ), which are not used.
+	 */
+#if defined(__SSSE3__) && !defined(WORDS_BIGENDIAN)
+	const __m128i swap0 = _mm_setr_epi8( 3, 2, 1, 0,  7, 6, 5, 4, 11,10, 9, 8, 13,12,15,14);	// addr, nexthop, input, output
+	const __m128i swap1 = _mm_setr_epi8( 3, 2, 1, 0,  7, 6, 5, 4, 11,10, 9, 8, 15,14,13,12);	// dPkts, dOctets, First, Last
+	const __m128i swap2 = _mm_setr_epi8( 1, 0, 3, 2,  4, 5, 6, 7,  9, 8,11,10, 12,13,15,14);	// ports, flags, proto, tos, as, mask
+
+	for ( i=0; i<count; i++ ) {
+		__m128i *o = (__m128i *)&out[i];
+		_mm_storeu_si128(o,   _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)p), swap0));
+		_mm_storeu_si128(o+1, _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)(p+16)), swap1));
+		_mm_storeu_si128(o+2, _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)(p+32)), swap2));
+		p += record_length;
+	}
+#else
+	for ( i=0; i<count; i++ ) {
+		netflow_v5_record_t *v5_record = (netflow_v5_record_t *)p;
+
+		out[i].srcaddr	 = ntohl(v5_record->srcaddr);
+		out[i].dstaddr	 = ntohl(v5_record->dstaddr);
+		out[i].nexthop	 = ntohl(v5_record->nexthop);
+		out[i].input	 = ntohs(v5_record->input);
+		out[i].output	 = ntohs(v5_record->output);
+		out[i].dPkts	 = ntohl(v5_record->dPkts);
+		out[i].dOctets	 = ntohl(v5_record->dOctets);
+		out[i].First	 = ntohl(v5_record->First);
+		out[i].Last		 = ntohl(v5_record->Last);
+		out[i].srcport	 = ntohs(v5_record->srcport);
+		out[i].dstport	 = ntohs(v5_record->dstport);
+		out[i].tcp_flags = v5_record->tcp_flags;
+		out[i].prot		 = v5_record->prot;
+		out[i].tos		 = v5_record->tos;
+		out[i].src_as	 = ntohs(v5_record->src_as);
+		out[i].dst_as	 = ntohs(v5_record->dst_as);
+		out[i].src_mask	 = v5_record->src_mask;
+		out[i].dst_mask	 = v5_record->dst_mask;
+		p += record_length;
+	}
+#endif
+
+} // End of Decode_v5_records
+
 void Process_v5_v7(void *in_buff, ssize_t in_buff_cnt, FlowSource_t *fs) {
 netflow_v5_header_t	*v5_header;
 netflow_v5_record_t *v5_record;
+netflow_v5_record_t v5_host[NETFLOW_V5_MAX_RECORDS];	// records of the current PDU in host order
+uint64_t			v5_start[NETFLOW_V5_MAX_RECORDS], v5_end[NETFLOW_V5_MAX_RECORDS];
 exporter_v5_t 		*exporter;
 extension_map_t		*extension_map;
 common_record_t		*common_record;
@@ -316,21 +378,25 @@ char		*string;
 		}
 		exporter->packets++;
 
+		extension_map = exporter->extension_map;
+
+		// caculate the record size without counters: + 8 for 2 x IPv4 addr
+		// extension_size contains the sum of all optional extensions of this exporter
+		v5_output_record_size = COMMON_RECORD_DATA_SIZE + 8 + extension_map->extension_size;
+
 		// calculate record size depending on counter size
 		// sigh .. one day I should fix switch to 64bits
 		if ( exporter->sampler->info.interval == 1 ) {
 			flags = 0;
-			v5_output_record_size = v5_output_record_base_size + 8; // 2 x  4 byte counters
+			v5_output_record_size += 8; // 2 x  4 byte counters
 		} else {
 			flags = 0;
 			SetFlag(flags, FLAG_SAMPLED);
 			SetFlag(flags, FLAG_PKG_64);
 			SetFlag(flags, FLAG_BYTES_64);
-			v5_output_record_size = v5_output_record_base_size + 16; // 2 x  8 byte counters
+			v5_output_record_size += 16; // 2 x  8 byte counters
 		}
 
-		extension_map = exporter->extension_map;
-
 		version = ntohs(v5_header->version);
 		flow_record_length = version == 5 ? NETFLOW_V5_RECORD_LENGTH : NETFLOW_V7_RECORD_LENGTH;
 
@@ -407,7 +473,52 @@ char		*string;
 			// process all records
 			v5_record	= (netflow_v5_record_t *)((pointer_addr_t)v5_header + NETFLOW_V5_HEADER_LENGTH);
 
+			// byte swap all records of this PDU in one pass
+			Decode_v5_records((void *)v5_record, flow_record_length, count, v5_host);
+
+			// calculate the time stamps of all records in one pass
+			for (i = 0; i < count; i++) {
+				First = v5_host[i].First;
+				Last  = v5_host[i].Last;
+
+#ifdef FIXTIMEBUG
+				/* 
+				 * Some users report, that they see flows, which have duration time of about 40days
+				 * which is almost the overflow value. Investigating this, it cannot be an overflow
+				 * and the difference is always 15160 or 15176 msec too little for a classical 
+				 * overflow. Therefore assume this must be an exporter bug
+				 */
+				if ( First > Last && ( (First - Last)  < 20000) ) {
+					uint32_t _t;
+					syslog(LOG_ERR,"Process_v5: Unexpected time swap: First 0x%llx smaller than boot time: 0x%llx", start_time, boot_time);
+					_t= First;
+					First = Last;
+					Last = _t;
+				}
+#endif
+				if ( First > Last ) {
+					/* First in msec, in case of msec overflow, between start and end */
+					start_time = boot_time - 0x100000000LL + (uint64_t)First;
+				} else {
+					start_time = boot_time + (uint64_t)First;
+				}
+
+				/* end time in msecs */
+				end_time = (uint64_t)Last + boot_time;
+
+				// if overflow happened after flow ended but before got exported
+				// the additional check > 100000 is required due to a CISCO IOS bug
+				// CSCei12353 - thanks to Bojan
+				if ( Last > v5_header->SysUptime && (( Last - v5_header->SysUptime) > 100000)) {
+					start_time  -= 0x100000000LL;
+					end_time    -= 0x100000000LL;
+				}
+				v5_start[i] = start_time;
+				v5_end[i]	= end_time;
+			}
+
 			/* loop over each records associated with this header */
+			v5_record = v5_host;
 			for (i = 0; i < count; i++) {
 				pointer_addr_t	bsize;
 				uint64_t	packets, bytes;
@@ -422,22 +533,22 @@ char		*string;
 	  			common_record->size			  = v5_output_record_size;
 
 				// v5 common fields
-	  			common_record->srcport		  = ntohs(v5_record->srcport);
-	  			common_record->dstport		  = ntohs(v5_record->dstport);
+	  			common_record->srcport		  = v5_record->srcport;
+	  			common_record->dstport		  = v5_record->dstport;
 	  			common_record->tcp_flags	  = v5_record->tcp_flags;
 	  			common_record->prot			  = v5_record->prot;
 	  			common_record->tos			  = v5_record->tos;
 	  			common_record->fwd_status 	  = 0;
 
 				// v5 typed data as fixed struct v5_block
-	  			ipv4_block->srcaddr	= ntohl(v5_record->srcaddr);
-	  			ipv4_block->dstaddr	= ntohl(v5_record->dstaddr);
+	  			ipv4_block->srcaddr	= v5_record->srcaddr;
+	  			ipv4_block->dstaddr	= v5_record->dstaddr;
 
 				if ( exporter->sampler->info.interval == 1 ) {
 					value32_t   *v = (value32_t *)ipv4_block->data;
 
-	  				packets  	= (uint64_t)ntohl(v5_record->dPkts);
-	  				bytes		= (uint64_t)ntohl(v5_record->dOctets);
+	  				packets  	= (uint64_t)v5_record->dPkts;
+	  				bytes		= (uint64_t)v5_record->dOctets;
 
 					v->val		= packets;
 					v 			= (value32_t *)v->data;
@@ -448,8 +559,8 @@ char		*string;
 					value64_t   *v = (value64_t *)ipv4_block->data;
 					uint32_t    *ptr = (uint32_t *)&packets;
 
-	  				packets  	= (uint64_t)ntohl(v5_record->dPkts)   * (uint64_t)exporter->sampler->info.interval;
-	  				bytes		= (uint64_t)ntohl(v5_record->dOctets) * (uint64_t)exporter->sampler->info.interval;
+	  				packets  	= (uint64_t)v5_record->dPkts   * (uint64_t)exporter->sampler->info.interval;
+	  				bytes		= (uint64_t)v5_record->dOctets * (uint64_t)exporter->sampler->info.interval;
 
 					// pack packets in 32bit chunks
 					v->val.val32[0] = ptr[0];
@@ -470,14 +581,14 @@ char		*string;
 					switch (id) {
 						case EX_IO_SNMP_2:	{	// 2 byte input/output interface index
 							tpl_ext_4_t *tpl = (tpl_ext_4_t *)data_ptr;
-	  						tpl->input  = ntohs(v5_record->input);
-	  						tpl->output = ntohs(v5_record->output);
+	  						tpl->input  = v5_record->input;
+	  						tpl->output = v5_record->output;
 							data_ptr = (void *)tpl->data;
 							} break;
 						case EX_AS_2:	 {	// 2 byte src/dst AS number
 							tpl_ext_6_t *tpl = (tpl_ext_6_t *)data_ptr;
-	  						tpl->src_as	= ntohs(v5_record->src_as);
-	  						tpl->dst_as	= ntohs(v5_record->dst_as);
+	  						tpl->src_as	= v5_record->src_as;
+	  						tpl->dst_as	= v5_record->dst_as;
 							data_ptr = (void *)tpl->data;
 							} break;
 						case EX_MULIPLE:	 {	// dst tos, direction, src/dst mask
@@ -490,7 +601,7 @@ char		*string;
 							} break;
 						case EX_NEXT_HOP_v4:	 {	// IPv4 next hop
 							tpl_ext_9_t *tpl = (tpl_ext_9_t *)data_ptr;
-							tpl->nexthop = ntohl(v5_record->nexthop);
+							tpl->nexthop = v5_record->nexthop;
 							data_ptr = (void *)tpl->data;
 							} break;
 						case EX_ROUTER_IP_v4:	 {	// IPv4 router address
@@ -511,6 +622,11 @@ char		*string;
 							tpl->received  = (uint64_t)((uint64_t)fs->received.tv_sec * 1000LL) + (uint64_t)((uint64_t)fs->received.tv_usec / 1000LL);
 							data_ptr = (void *)tpl->data;
 							} break;
+						case EX_EXPORTER_SYSID: {
+							tpl_ext_28_t *tpl = (tpl_ext_28_t *)data_ptr;
+							tpl->exporter_sysid = exporter->info.sysid;
+							data_ptr = (void *)tpl->data;
+							} break;
 
 						default:
 							// this should never happen, as v5 has no other extensions
@@ -519,42 +635,8 @@ char		*string;
 					j++;
 				}
 	
-				// Time issues
-	  			First	 				= ntohl(v5_record->First);
-	  			Last		 			= ntohl(v5_record->Last);
-
-#ifdef FIXTIMEBUG
-				/* 
-				 * Some users report, that they see flows, which have duration time of about 40days
-				 * which is almost the overflow value. Investigating this, it cannot be an overflow
-				 * and the difference is always 15160 or 15176 msec too little for a classical 
-				 * overflow. Therefore assume this must be an exporter bug
-				 */
-				if ( First > Last && ( (First - Last)  < 20000) ) {
-					uint32_t _t;
-					syslog(LOG_ERR,"Process_v5: Unexpected time swap: First 0x%llx smaller than boot time: 0x%llx", start_time, boot_time);
-					_t= First;
-					First = Last;
-					Last = _t;
-				}
-#endif
-				if ( First > Last ) {
-					/* First in msec, in case of msec overflow, between start and end */
-					start_time = boot_time - 0x100000000LL + (uint64_t)First;
-				} else {
-					start_time = boot_time + (uint64_t)First;
-				}
-
-				/* end time in msecs */
-				end_time = (uint64_t)Last + boot_time;
-
-				// if overflow happened after flow ended but before got exported
-				// the additional check > 100000 is required due to a CISCO IOS bug
-				// CSCei12353 - thanks to Bojan
-				if ( Last > v5_header->SysUptime && (( Last - v5_header->SysUptime) > 100000)) {
-					start_time  -= 0x100000000LL;
-					end_time    -= 0x100000000LL;
-				}
+				start_time = v5_start[i];
+				end_time   = v5_end[i];
 
 				common_record->first 		= start_time/1000;
 				common_record->msec_first	= start_time - common_record->first*1000;
@@ -636,7 +718,7 @@ char		*string;
 				}
 
 				// advance to next input flow record
-				v5_record		= (netflow_v5_record_t *)((pointer_addr_t)v5_record + flow_record_length);
+				v5_record++;
 
 				if ( ((pointer_addr_t)data_ptr - (pointer_addr_t)common_record) != v5_output_record_size ) {
 					printf("Panic size check: ptr diff: %llu, record size: %u\n", 
@@ -693,6 +775,8 @@ void Init_v5_v7_output(send_peer_t *peer) {
 	v5_output_header->unix_secs		= 0;
 	v5_output_header->unix_nsecs	= 0;
 	v5_output_header->count 		= 0;
+	v5_output_header->engine_tag	= 0;
+	v5_output_header->sampling_interval = 0;
 	output_engine.first				= 1;
 
 	output_engine.sequence		   = 0;
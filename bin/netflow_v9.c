@@ -121,10 +121,13 @@ typedef struct sequence_map_s {
 #define zero64			23
 #define zero96			24
 #define zero128			25
+#define copy_block		26
+#define zero_block		27
 
 	uint32_t	id;				// sequence ID as defined above
 	uint16_t	input_offset;	// copy/process data at this input offset
 	uint16_t	output_offset;	// copy final data to this output offset
+	uint16_t	length;			// number of bytes of copy_block and zero_block
 	void		*stack;			// optionally copy data onto this stack
 } sequence_map_t;
 
@@ -151,6 +154,7 @@ typedef struct input_translation_s {
 	uint32_t	engine_offset;
 	uint32_t	received_offset;
 	uint32_t	router_ip_offset;
+	uint32_t	sysid_offset;
 
 	// extension map infos
 	uint32_t	extension_map_changed;		// map changed while refreshing
@@ -160,6 +164,10 @@ typedef struct input_translation_s {
 	uint32_t	number_of_sequences;	// number of sequences for the translate 
 	sequence_map_t *sequence;			// sequence map
 
+	// raw template record for the template cache
+	void		*template_record;
+	uint32_t	template_size;
+
 } input_translation_t;
 
 typedef struct exporter_v9_domain_s {
@@ -191,10 +199,12 @@ typedef struct exporter_v9_domain_s {
 
 	// global sampling information #34 #35
 	// stored in a sampler with id = -1;
+	generic_sampler_t	*std_sampler;
+	id_index_t			sampler_index;	// samplers indexed by sampler id
 
 	// translation table
 	input_translation_t	*input_translation_table; 
-	input_translation_t *current_table;
+	id_index_t			template_index;	// translation tables indexed by template id
 } exporter_v9_domain_t;
 
 
@@ -362,9 +372,10 @@ static struct v9_element_map_s {
  * tmp cache while processing template records
  * array index = extension id, 
  * value = 1 -> extension exists, 0 -> extension does not exists
+ * Each decode thread has its own cache - call Init_v9() in each thread
  */
 
-static struct cache_s {
+static __thread struct cache_s {
 	struct element_param_s {
 		uint16_t index;
 		uint16_t found;
@@ -394,7 +405,7 @@ static output_template_t	*output_templates;
 static uint64_t	boot_time;	// in msec
 static uint16_t				template_id;
 static uint32_t				Max_num_v9_tags;
-static uint32_t				processed_records;
+static __thread uint32_t		processed_records;
 
 /* local function prototypes */
 static void InsertSamplerOffset( FlowSource_t *fs, uint16_t id, uint16_t offset_sampler_id, uint16_t sampler_id_length, 
@@ -407,6 +418,8 @@ static void InsertSampler( FlowSource_t *fs, exporter_v9_domain_t *exporter, int
 
 static inline void Process_v9_templates(exporter_v9_domain_t *exporter, void *template_flowset, FlowSource_t *fs);
 
+static void SaveTemplateRecord(input_translation_t *table, void *template, uint32_t size);
+
 static inline void Process_v9_option_templates(exporter_v9_domain_t *exporter, void *option_template_flowset, FlowSource_t *fs);
 
 static inline void Process_v9_data(exporter_v9_domain_t *exporter, void *data_flowset, FlowSource_t *fs, input_translation_t *table );
@@ -421,6 +434,10 @@ static input_translation_t *setup_translation_table (exporter_v9_domain_t *expor
 
 static input_translation_t *add_translation_table(exporter_v9_domain_t *exporter, uint16_t id);
 
+static inline uint32_t BlockSequence(sequence_map_t *sequence, uint32_t *length);
+
+static void CompileSequence(input_translation_t *table);
+
 static output_template_t *GetOutputTemplate(uint32_t flags, extension_map_t *extension_map);
 
 static void Append_Record(send_peer_t *peer, master_record_t *master_record);
@@ -440,6 +457,7 @@ static netflow_v9_header_t	*v9_output_header;
 /* functions */
 
 #include "nffile_inline.c"
+#include "collector_inline.c"
 
 int Init_v9(void) {
 int i;
@@ -474,13 +492,16 @@ static inline exporter_v9_domain_t *GetExporter(FlowSource_t *fs, uint32_t expor
 #define IP_STRING_LEN   40
 char ipstr[IP_STRING_LEN];
 exporter_v9_domain_t **e = (exporter_v9_domain_t **)&(fs->exporter_data);
+exporter_v9_domain_t *exporter;
+
+	// search the appropriate exporter engine
+	exporter = (exporter_v9_domain_t *)LookupExporter(fs, 9, exporter_id);
+	if ( exporter ) 
+		return exporter;
 
-	while ( *e ) {
-		if ( (*e)->info.id == exporter_id && (*e)->info.version == 9 && 
-			 (*e)->info.ip.v6[0] == fs->ip.v6[0] && (*e)->info.ip.v6[1] == fs->ip.v6[1]) 
-			return *e;
+	// append new exporter
+	while ( *e ) 
 		e = &((*e)->next);
-	}
 
 	if ( fs->sa_family == AF_INET ) {
 		uint32_t _ip = htonl(fs->ip.v4);
@@ -515,6 +536,12 @@ exporter_v9_domain_t **e = (exporter_v9_domain_t **)&(fs->exporter_data);
 	(*e)->sampler 	 = NULL;
 	(*e)->next	 	 = NULL;
 
+	if ( !HashExporter(fs, (generic_exporter_t *)(*e)) ) {
+		free(*e);
+		*e = NULL;
+		return NULL;
+	}
+
 	FlushInfoExporter(fs, &((*e)->info));
 
 	dbg_printf("Process_v9: New exporter: SysID: %u, Domain: %u, IP: %s\n", 
@@ -556,23 +583,11 @@ int	index;
 static inline input_translation_t *GetTranslationTable(exporter_v9_domain_t *exporter, uint16_t id) {
 input_translation_t *table;
 
-	if ( exporter->current_table && ( exporter->current_table->id == id ) )
-		return exporter->current_table;
-
-	table = exporter->input_translation_table;
-	while ( table ) {
-		if ( table->id == id ) {
-			exporter->current_table = table;
-			return table;
-		}
-
-		table = table->next;
-	}
+	table = (input_translation_t *)IndexLookup(&exporter->template_index, id);
 
 	dbg_printf("[%u/%u] Get translation table %u: %s\n", 
 		exporter->info.id, exporter->info.sysid, id, table == NULL ? "not found" : "found");
 
-	exporter->current_table = table;
 	return table;
 
 } // End of GetTranslationTable
@@ -595,18 +610,118 @@ input_translation_t **table;
 	(*table)->sequence = calloc(cache.max_v9_elements, sizeof(sequence_map_t));
 	if ( !(*table)->sequence ) {
 			syslog(LOG_ERR, "Process_v9: Panic! malloc() %s line %d: %s", __FILE__, __LINE__, strerror (errno));
+			free(*table);
+			*table = NULL;
 			return NULL;
 	}
 
 	(*table)->id   = id;
 	(*table)->next = NULL;
 
+	if ( !IndexInsert(&exporter->template_index, id, *table) ) {
+		free((*table)->sequence);
+		free(*table);
+		*table = NULL;
+		return NULL;
+	}
+
 	dbg_printf("[%u] Get new translation table %u\n", exporter->info.id, id);
 
 	return *table;
 
 } // End of add_translation_table
 
+static inline uint32_t BlockSequence(sequence_map_t *sequence, uint32_t *length) {
+
+	switch (sequence->id) {
+		case copy_block:
+		case zero_block:
+			*length = sequence->length;
+			return sequence->id;
+		case move8:
+			*length = 1;
+			return copy_block;
+#ifdef WORDS_BIGENDIAN
+		// no byte swapping required - plain copies
+		case move16:
+			*length = 2;
+			return copy_block;
+		case move32:
+			*length = 4;
+			return copy_block;
+		case move64:
+			*length = 8;
+			return copy_block;
+		case move96:
+			*length = 12;
+			return copy_block;
+		case move128:
+			*length = 16;
+			return copy_block;
+#endif
+		case zero8:
+			*length = 1;
+			return zero_block;
+		case zero16:
+			*length = 2;
+			return zero_block;
+		case zero32:
+			*length = 4;
+			return zero_block;
+		case zero64:
+			*length = 8;
+			return zero_block;
+		case zero96:
+			*length = 12;
+			return zero_block;
+		case zero128:
+			*length = 16;
+			return zero_block;
+	}
+
+	*length = 0;
+	return nop;
+
+} // End of BlockSequence
+
+static void CompileSequence(input_translation_t *table) {
+uint32_t i, num_sequences;
+
+	/*
+	 * Lower the sequence list into a shorter program, executed for each data record:
+	 * nop sequences are dropped, consecutive sequences, which copy bytes from adjacent
+	 * input to adjacent output offsets, are fused into a single copy_block and consecutive
+	 * zero sequences with adjacent output offsets into a single zero_block.
+	 */
+	num_sequences = 0;
+	for ( i=0; i<table->number_of_sequences; i++ ) {
+		sequence_map_t *sequence = &table->sequence[i];
+		uint32_t block, length;
+
+		if ( sequence->id == nop ) 
+			continue;
+
+		block = BlockSequence(sequence, &length);
+		if ( block != nop && num_sequences ) {
+			sequence_map_t *prev = &table->sequence[num_sequences-1];
+			uint32_t prev_length;
+
+			if ( BlockSequence(prev, &prev_length) == block && 
+				 (prev->output_offset + prev_length) == sequence->output_offset &&
+				 (block == zero_block || (prev->input_offset + prev_length) == sequence->input_offset) ) {
+				prev->id	 = block;
+				prev->length = prev_length + length;
+				continue;
+			}
+		}
+		table->sequence[num_sequences++] = *sequence;
+	}
+
+	dbg_printf("Compiled %u sequences into %u\n", table->number_of_sequences, num_sequences);
+	table->number_of_sequences = num_sequences;
+
+} // End of CompileSequence
+
 static inline void PushSequence(input_translation_t *table, uint16_t Type, uint32_t *offset, void *stack) {
 uint32_t i = table->number_of_sequences;
 uint32_t index = cache.lookup_info[Type].index;
@@ -709,6 +824,7 @@ size_t				size_required;
 	table->engine_offset 	= 0;
 	table->received_offset 	= 0;
 	table->router_ip_offset = 0;
+	table->sysid_offset 	= 0;
 
 	dbg_printf("[%u] Fill translation table %u\n", exporter->info.id, id);
 
@@ -924,6 +1040,11 @@ size_t				size_required;
 				dbg_printf("Received offset: %u\n", offset);
 				offset				   += 8;
 				break;
+			case EX_EXPORTER_SYSID:
+				table->sysid_offset = offset;
+				dbg_printf("Exporter sysid offset: %u\n", offset);
+				offset				   += 4;
+				break;
 			case EX_LATENCY: {
 				// it's bit of a hack, but .. sigh ..
 				uint32_t i = table->number_of_sequences;
@@ -940,6 +1061,7 @@ size_t				size_required;
 				offset -= 8;
 				PushSequence( table, NF9_NPROBE_CLIENT_NW_DELAY_USEC, &offset, NULL);
 
+				i = table->number_of_sequences;
 				table->sequence[i].id = zero64;
 				table->sequence[i].input_offset  = 0;
 				table->sequence[i].output_offset = offset;
@@ -951,6 +1073,7 @@ size_t				size_required;
 				offset -= 8;
 				PushSequence( table, NF9_NPROBE_SERVER_NW_DELAY_USEC, &offset, NULL);
 
+				i = table->number_of_sequences;
 				table->sequence[i].id = zero64;
 				table->sequence[i].input_offset  = 0;
 				table->sequence[i].output_offset = offset;
@@ -1090,6 +1213,8 @@ size_t				size_required;
 		dbg_printf("No Sampling ID found\n");
 	}
 
+	CompileSequence(table);
+
 #ifdef DEVEL
 	if ( table->extension_map_changed ) {
 		printf("Extension Map id=%u changed!\n", extension_map->map_id);
@@ -1118,74 +1243,98 @@ size_t				size_required;
 
 static void InsertSamplerOffset( FlowSource_t *fs, uint16_t id, uint16_t offset_sampler_id, uint16_t sampler_id_length,
 	uint16_t offset_sampler_mode, uint16_t offset_sampler_interval) {
-option_offset_t	**t;
+option_offset_t	*t;
 
-	t = &(fs->option_offset_table);
-	while ( *t ) {
-		if ( (*t)->id == id ) { // table already known to us - update data
-			dbg_printf("Found existing sampling info in template %i\n", id);
-			break;
-		}
-	
-		t = &((*t)->next);
-	}
+	// table already known to us - update data
+	t = (option_offset_t *)IndexLookup(&fs->option_index, id);
+	if ( t ) {
+		dbg_printf("Found existing sampling info in template %i\n", id);
+	} else {	// new table
+		option_offset_t **tail = &(fs->option_offset_table);
+		while ( *tail ) 
+			tail = &((*tail)->next);
 
-	if ( *t == NULL ) {	// new table
 		dbg_printf("Allocate new sampling info from template %i\n", id);
-		*t = (option_offset_t *)calloc(1, sizeof(option_offset_t));
-		if ( !*t ) {
+		t = (option_offset_t *)calloc(1, sizeof(option_offset_t));
+		if ( !t ) {
 			fprintf(stderr, "malloc() allocation error: %s\n", strerror(errno));
 			return ;
 		} 
+		if ( !IndexInsert(&fs->option_index, id, t) ) {
+			free(t);
+			return ;
+		}
+		*tail = t;
 		dbg_printf("Process_v9: New sampler: ID %i, mode: %i, interval: %i\n", 
 			offset_sampler_id, offset_sampler_mode, offset_sampler_interval);
 	}	// else existing table
 
 	dbg_printf("Insert/Update sampling info from template %i\n", id);
-	SetFlag((*t)->flags, HAS_SAMPLER_DATA);
-	(*t)->id 				= id;
-	(*t)->offset_id			= offset_sampler_id;
-	(*t)->sampler_id_length = sampler_id_length;
-	(*t)->offset_mode		= offset_sampler_mode;
-	(*t)->offset_interval	= offset_sampler_interval;
+	SetFlag(t->flags, HAS_SAMPLER_DATA);
+	t->id 				 = id;
+	t->offset_id		 = offset_sampler_id;
+	t->sampler_id_length = sampler_id_length;
+	t->offset_mode		 = offset_sampler_mode;
+	t->offset_interval	 = offset_sampler_interval;
 
 } // End of InsertSamplerOffset
 
 static void InsertStdSamplerOffset( FlowSource_t *fs, uint16_t id, uint16_t offset_std_sampler_interval, uint16_t offset_std_sampler_algorithm) {
-option_offset_t	**t;
+option_offset_t	*t;
 
-	t = &(fs->option_offset_table);
-	while ( *t ) {
-		if ( (*t)->id == id ) { // table already known to us - update data
-			dbg_printf("Found existing std sampling info in template %i\n", id);
-			break;
-		}
-	
-		t = &((*t)->next);
-	}
+	// table already known to us - update data
+	t = (option_offset_t *)IndexLookup(&fs->option_index, id);
+	if ( t ) {
+		dbg_printf("Found existing std sampling info in template %i\n", id);
+	} else {	// new table
+		option_offset_t **tail = &(fs->option_offset_table);
+		while ( *tail ) 
+			tail = &((*tail)->next);
 
-	if ( *t == NULL ) {	// new table
 		dbg_printf("Allocate new std sampling info from template %i\n", id);
-		*t = (option_offset_t *)calloc(1, sizeof(option_offset_t));
-		if ( !*t ) {
+		t = (option_offset_t *)calloc(1, sizeof(option_offset_t));
+		if ( !t ) {
 			fprintf(stderr, "malloc() allocation error: %s\n", strerror(errno));
 			return ;
 		} 
+		if ( !IndexInsert(&fs->option_index, id, t) ) {
+			free(t);
+			return ;
+		}
+		*tail = t;
 		syslog(LOG_ERR, "Process_v9: New std sampler: interval: %i, algorithm: %i", 
 			offset_std_sampler_interval, offset_std_sampler_algorithm);
 	}	// else existing table
 
 	dbg_printf("Insert/Update sampling info from template %i\n", id);
-	SetFlag((*t)->flags, HAS_STD_SAMPLER_DATA);
-	(*t)->id 				= id;
-	(*t)->offset_id			= 0;
-	(*t)->offset_mode		= 0;
-	(*t)->offset_interval	= 0;
-	(*t)->offset_std_sampler_interval	= offset_std_sampler_interval;
-	(*t)->offset_std_sampler_algorithm	= offset_std_sampler_algorithm;
+	SetFlag(t->flags, HAS_STD_SAMPLER_DATA);
+	t->id 				= id;
+	t->offset_id		= 0;
+	t->offset_mode		= 0;
+	t->offset_interval	= 0;
+	t->offset_std_sampler_interval	= offset_std_sampler_interval;
+	t->offset_std_sampler_algorithm	= offset_std_sampler_algorithm;
 	
 } // End of InsertStdSamplerOffset
 
+static void SaveTemplateRecord(input_translation_t *table, void *template, uint32_t size) {
+
+	// templates are refreshed frequently - copy changed templates only
+	if ( table->template_size == size && memcmp(table->template_record, template, size) == 0 ) 
+		return;
+
+	free(table->template_record);
+	table->template_size   = 0;
+	table->template_record = malloc(size);
+	if ( !table->template_record ) {
+		syslog(LOG_ERR, "Process_v9: Panic! malloc() %s line %d: %s", __FILE__, __LINE__, strerror (errno));
+		return;
+	}
+	memcpy(table->template_record, template, size);
+	table->template_size = size;
+
+} // End of SaveTemplateRecord
+
 static inline void Process_v9_templates(exporter_v9_domain_t *exporter, void *template_flowset, FlowSource_t *fs) {
 void				*template;
 input_translation_t *translation_table;
@@ -1283,6 +1432,15 @@ int			i;
 			}
 			dbg_printf("Force add packet received time, Extension: %u\n", EX_RECEIVED);
 		}
+
+		// the common record has room for an 8 bit exporter sysid only
+		if ( exporter->info.sysid > 255 ) {
+			if ( cache.common_extensions[EX_EXPORTER_SYSID] == 0 ) {
+				cache.common_extensions[EX_EXPORTER_SYSID] = 1;
+				num_extensions++;
+			}
+			dbg_printf("Force add exporter sysid: %u, Extension: %u\n", exporter->info.sysid, EX_EXPORTER_SYSID);
+		}
 	
 		dbg_printf("Parsed %u v9 tags, total %u extensions\n", num_v9tags, num_extensions);
 
@@ -1299,6 +1457,10 @@ int			i;
 #endif
 
 		translation_table = setup_translation_table(exporter, id, Offset);
+		if ( !translation_table ) {
+			size_left = 0;
+			continue;
+		}
 		if (translation_table->extension_map_changed ) {
 			translation_table->extension_map_changed = 0;
 			// refresh he map in the ouput buffer
@@ -1306,6 +1468,7 @@ int			i;
 			AddExtensionMap(fs, translation_table->extension_info.map);
 			dbg_printf("Translation Table added! map ID: %i\n", translation_table->extension_info.map->map_id);
 		}
+		SaveTemplateRecord(translation_table, template, size_required);
 		size_left -= size_required;
 		processed_records++;
 
@@ -1461,7 +1624,7 @@ char				*string;
 
 	// Check if sampling is announced
 	if ( table->sampler_offset && exporter->sampler  ) {
-		generic_sampler_t *sampler = exporter->sampler;
+		generic_sampler_t *sampler;
 		uint32_t sampler_id;
 		if ( table->sampler_size == 2 ) {
 			sampler_id = Get_val16((void *)&in[table->sampler_offset]);
@@ -1469,9 +1632,7 @@ char				*string;
 			sampler_id = in[table->sampler_offset];
 		}
 		dbg_printf("Extract sampler: %u\n", sampler_id);
-		// usually not that many samplers, so following a chain is not too expensive.
-		while ( sampler && sampler->info.id != sampler_id ) 
-			sampler = sampler->next;
+		sampler = (generic_sampler_t *)IndexLookup(&exporter->sampler_index, sampler_id);
 
 		if ( sampler ) {
 			sampling_rate = sampler->info.interval;
@@ -1485,9 +1646,7 @@ char				*string;
 		}
 
 	} else {
-		generic_sampler_t *sampler = exporter->sampler;
-		while ( sampler && sampler->info.id != -1 ) 
-			sampler = sampler->next;
+		generic_sampler_t *sampler = exporter->std_sampler;
 
 		if ( sampler ) {
 			sampling_rate = sampler->info.interval;
@@ -1682,6 +1841,14 @@ char				*string;
 
 					} break;
 
+				// fused sequences
+				case copy_block:
+					memcpy((void *)&out[output_offset], (void *)&in[input_offset], table->sequence[i].length);
+					break;
+				case zero_block:
+					memset((void *)&out[output_offset], 0, table->sequence[i].length);
+					break;
+
 				// zero sequences for unavailable elements
 				case zero8:
 					out[output_offset] = 0;
@@ -1814,6 +1981,10 @@ char				*string;
 				*((uint32_t *)&out[table->received_offset+4]) = t.val.val32[1];
 		}
 
+		// exporter sysid > 255
+		if ( table->sysid_offset ) 
+			*((uint32_t *)&out[table->sysid_offset]) = exporter->info.sysid;
+
 		switch (data_record->prot ) { // switch protocol of
 			case IPPROTO_ICMP:
 				fs->nffile->stat_record->numflows_icmp++;
@@ -1912,9 +2083,7 @@ uint8_t		*in;
 
 	id 	= GET_FLOWSET_ID(data_flowset);
 
-	offset_table = fs->option_offset_table;
-	while ( offset_table && offset_table->id != id )
-		offset_table = offset_table->next;
+	offset_table = (option_offset_t *)IndexLookup(&fs->option_index, id);
 
 	if ( !offset_table ) {
 		// should never happen - catch it anyway
@@ -1977,7 +2146,7 @@ netflow_v9_header_t	*v9_header;
 int64_t 			distance;
 uint32_t 			expected_records, flowset_id, flowset_length, exporter_id;
 ssize_t				size_left;
-static int pkg_num = 0;
+static __thread int pkg_num = 0;
 
 	pkg_num++;
 	size_left = in_buff_cnt;
@@ -2127,6 +2296,96 @@ static int pkg_num = 0;
 	
 } /* End of Process_v9 */
 
+/*
+ * Template cache: write the templates and samplers of all v9 exporters of this flow source
+ * Returns the number of records written or -1 on error
+ */
+int Save_v9_templates(FlowSource_t *fs, FILE *fd) {
+exporter_v9_domain_t	*exporter;
+input_translation_t		*table;
+generic_sampler_t		*sampler;
+cache_sampler_t			cache_sampler;
+int						num_records;
+
+	num_records = 0;
+	exporter = (exporter_v9_domain_t *)fs->exporter_data;
+	while ( exporter ) {
+		if ( exporter->info.version != 9 ) {
+			exporter = exporter->next;
+			continue;
+		}
+
+		table = exporter->input_translation_table;
+		while ( table ) {
+			if ( table->template_record ) {
+				if ( !WriteCacheRecord(fd, CACHE_TEMPLATE, &exporter->info, table->template_record, table->template_size) )
+					return -1;
+				num_records++;
+			}
+			table = table->next;
+		}
+
+		sampler = exporter->sampler;
+		while ( sampler ) {
+			cache_sampler.id	   = sampler->info.id;
+			cache_sampler.mode	   = sampler->info.mode;
+			cache_sampler.interval = sampler->info.interval;
+			if ( !WriteCacheRecord(fd, CACHE_SAMPLER, &exporter->info, &cache_sampler, sizeof(cache_sampler_t)) )
+				return -1;
+			num_records++;
+			sampler = sampler->next;
+		}
+
+		exporter = exporter->next;
+	}
+
+	return num_records;
+
+} // End of Save_v9_templates
+
+/*
+ * Template cache: restore a template or sampler of the v9 exporter, identified by the IP 
+ * address in fs and the id of the record. The template is processed as if sent by the exporter
+ * Returns 1 if restored, 0 otherwise
+ */
+int Restore_v9_template(FlowSource_t *fs, template_cache_record_t *record) {
+exporter_v9_domain_t	*exporter;
+void		*data = (void *)record + sizeof(template_cache_record_t);
+uint32_t	size  = record->size - sizeof(template_cache_record_t);
+uint8_t		flowset[65536];
+
+	exporter = GetExporter(fs, record->id);
+	if ( !exporter ) 
+		return 0;
+
+	switch (record->type) {
+		case CACHE_TEMPLATE: {
+			uint32_t template_size;
+			if ( size < 4 ) 
+				return 0;
+			template_size = 4 + 4 * GET_TEMPLATE_COUNT(data);
+			if ( template_size > size || (template_size + 4) > 0xFFFF )
+				return 0;
+			// the template flowset header: id and length
+			*((uint16_t *)flowset)		 = htons(NF9_TEMPLATE_FLOWSET_ID);
+			*((uint16_t *)(flowset + 2)) = htons(template_size + 4);
+			memcpy(flowset + 4, data, template_size);
+			Process_v9_templates(exporter, (void *)flowset, fs);
+			} break;
+		case CACHE_SAMPLER: {
+			cache_sampler_t *cache_sampler = (cache_sampler_t *)data;
+			if ( size < sizeof(cache_sampler_t) ) 
+				return 0;
+			InsertSampler(fs, exporter, cache_sampler->id, cache_sampler->mode, cache_sampler->interval);
+			} break;
+		default:
+			return 0;
+	}
+
+	return 1;
+
+} // End of Restore_v9_template
+
 /*
  * functions for sending netflow v9 records
  */
@@ -2933,88 +3192,67 @@ time_t		now = time(NULL);
 
 
 static void InsertSampler( FlowSource_t *fs, exporter_v9_domain_t *exporter, int32_t id, uint16_t mode, uint32_t interval) {
-generic_sampler_t *sampler;
+generic_sampler_t *sampler, **tail;
 
 	dbg_printf("[%u] Insert Sampler: Exporter is 0x%llu\n", exporter->info.id, (long long unsigned)exporter);
-	if ( !exporter->sampler ) {
-		// no samplers so far 
-		sampler = (generic_sampler_t *)malloc(sizeof(generic_sampler_t));
-		if ( !sampler ) {
-			syslog(LOG_ERR, "Process_v9: Panic! malloc(): %s line %d: %s", __FILE__, __LINE__, strerror (errno));
-			return;
-		}
 
-		sampler->info.header.type = SamplerInfoRecordype;
-		sampler->info.header.size = sizeof(sampler_info_record_t);
-		sampler->info.exporter_sysid = exporter->info.sysid;
-		sampler->info.id 	   = id;
-		sampler->info.mode 	   = mode;
-		sampler->info.interval = interval;
-		sampler->next 		   = NULL;
-		exporter->sampler = sampler;
-
-		FlushInfoSampler(fs, &(sampler->info));
-		syslog(LOG_INFO, "Add new sampler: ID: %i, mode: %u, interval: %u\n", 
+	// test for update of existing sampler
+	if ( id == -1 ) 
+		sampler = exporter->std_sampler;
+	else
+		sampler = (generic_sampler_t *)IndexLookup(&exporter->sampler_index, id);
+
+	if ( sampler ) {
+		// found same sampler id - update record
+		syslog(LOG_INFO, "Update existing sampler id: %i, mode: %u, interval: %u\n", 
 			id, mode, interval);
-		dbg_printf("Add new sampler: ID: %i, mode: %u, interval: %u\n", 
+		dbg_printf("Update existing sampler id: %i, mode: %u, interval: %u\n", 
 			id, mode, interval);
 
-	} else {
-		sampler = exporter->sampler;
-		while ( sampler ) {
-			// test for update of existing sampler
-			if ( sampler->info.id == id ) {
-				// found same sampler id - update record
-				syslog(LOG_INFO, "Update existing sampler id: %i, mode: %u, interval: %u\n", 
-					id, mode, interval);
-				dbg_printf("Update existing sampler id: %i, mode: %u, interval: %u\n", 
-					id, mode, interval);
-
-				// we update only on changes
-				if ( mode != sampler->info.mode || interval != sampler->info.interval ) {
-					FlushInfoSampler(fs, &(sampler->info));
-					sampler->info.mode 	   = mode;
-					sampler->info.interval = interval;
-				} else {
-					dbg_printf("Sampler unchanged!\n");
-				}
-
-				break;
-			}
-
-			// test for end of chain
-			if ( sampler->next == NULL ) {
-				// end of sampler chain - insert new sampler
-				sampler->next = (generic_sampler_t *)malloc(sizeof(generic_sampler_t));
-				if ( !sampler->next ) {
-					syslog(LOG_ERR, "Process_v9: Panic! malloc(): %s line %d: %s", __FILE__, __LINE__, strerror (errno));
-					return;
-				}
-				sampler = sampler->next;
-
-				sampler->info.header.type 	 = SamplerInfoRecordype;
-				sampler->info.header.size 	 = sizeof(sampler_info_record_t);
-				sampler->info.exporter_sysid = exporter->info.sysid;
-				sampler->info.id 	   = id;
-				sampler->info.mode 	   = mode;
-				sampler->info.interval = interval;
-				sampler->next 		   = NULL;
+		// we update only on changes
+		if ( mode != sampler->info.mode || interval != sampler->info.interval ) {
+			FlushInfoSampler(fs, &(sampler->info));
+			sampler->info.mode 	   = mode;
+			sampler->info.interval = interval;
+		} else {
+			dbg_printf("Sampler unchanged!\n");
+		}
+		return;
+	}
 
-				FlushInfoSampler(fs, &(sampler->info));
+	// new sampler - append to the sampler chain
+	sampler = (generic_sampler_t *)malloc(sizeof(generic_sampler_t));
+	if ( !sampler ) {
+		syslog(LOG_ERR, "Process_v9: Panic! malloc(): %s line %d: %s", __FILE__, __LINE__, strerror (errno));
+		return;
+	}
 
+	sampler->info.header.type 	 = SamplerInfoRecordype;
+	sampler->info.header.size 	 = sizeof(sampler_info_record_t);
+	sampler->info.exporter_sysid = exporter->info.sysid;
+	sampler->info.id 	   = id;
+	sampler->info.mode 	   = mode;
+	sampler->info.interval = interval;
+	sampler->next 		   = NULL;
+
+	if ( id == -1 ) {
+		exporter->std_sampler = sampler;
+	} else if ( !IndexInsert(&exporter->sampler_index, id, sampler) ) {
+		free(sampler);
+		return;
+	}
 
-				syslog(LOG_INFO, "Append new sampler: ID: %u, mode: %u, interval: %u\n", 
-					id, mode, interval);
-				dbg_printf("Append new sampler: ID: %u, mode: %u, interval: %u\n", 
-					id, mode, interval);
-				break;
-			}
+	tail = &(exporter->sampler);
+	while ( *tail ) 
+		tail = &((*tail)->next);
+	*tail = sampler;
 
-			// advance
-			sampler = sampler->next;
-		}
+	FlushInfoSampler(fs, &(sampler->info));
 
-	} 
+	syslog(LOG_INFO, "Add new sampler: ID: %i, mode: %u, interval: %u\n", 
+		id, mode, interval);
+	dbg_printf("Add new sampler: ID: %i, mode: %u, interval: %u\n", 
+		id, mode, interval);
 	
 } // End of InsertSampler
 
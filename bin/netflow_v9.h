@@ -295,6 +295,10 @@ int Init_v9(void);
 
 void Process_v9(void *in_buff, ssize_t in_buff_cnt, FlowSource_t *fs);
 
+int Save_v9_templates(FlowSource_t *fs, FILE *fd);
+
+int Restore_v9_template(FlowSource_t *fs, template_cache_record_t *record);
+
 void Init_v9_output(send_peer_t *peer);
 
 int Add_v9_output_record(master_record_t *master_record, send_peer_t *peer);
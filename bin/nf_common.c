@@ -47,6 +47,7 @@
 #include <ctype.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <unistd.h>
 
 #ifdef HAVE_STDINT_H
 #include <stdint.h>
@@ -58,33 +59,42 @@
 
 typedef void (*string_function_t)(master_record_t *, char *);
 
-static struct token_list_s {
+typedef char *(*writer_function_t)(master_record_t *, char *);
+
+/* 
+ * The output format is compiled into a flat list of operations, executed in order for each record:
+ * a static string is copied, a token is either written directly into the output line by its writer
+ * function, or - if no writer exists - generated by its string function and copied.
+ */
+static struct format_op_s {
+	writer_function_t	writer;				// writes token directly into output line, returns end of string
 	string_function_t	string_function;	// function generation output string
-	char				*string_buffer;		// buffer for output string
-} *token_list;
+	char				*string;			// static string
+	size_t				length;				// length of static string
+} *format_op_list;
 
-static int	max_token_index	= 0;
-static int	token_index		= 0;
+static int	max_format_op	= 0;
+static int	format_op_index	= 0;
 
 #define BLOCK_SIZE	32
 
-static char **format_list;		// ordered list of all individual strings formating the output line
-static int	max_format_index	= 0;
-static int	format_index		= 0;
-
-static int		do_tag 		 = 0;
+/* 
+ * printer functions may be called from several threads at the same time. 
+ * Therefore all per record state is thread local.
+ */
+static __thread int		do_tag 		 = 0;
 static int 		long_v6 	 = 0;
 static int		scale	 	 = 1;
-static double	duration;
+static __thread double	duration;
 
 #define STRINGSIZE 10240
 #define IP_STRING_LEN (INET6_ADDRSTRLEN)
 
 static char header_string[STRINGSIZE];
-static char data_string[STRINGSIZE];
+static __thread char data_string[STRINGSIZE];
 
 // tag 
-static char tag_string[2];
+static __thread char tag_string[2];
 
 /* prototypes */
 static inline void ICMP_Port_decode(master_record_t *r, char *string);
@@ -363,6 +373,9 @@ static struct format_token_list_s {
 /* each of the tokens above must not generate output strings larger than this */
 #define MAX_STRING_LENGTH	256
 
+// output string of a token without direct writer
+static __thread char token_string[MAX_STRING_LENGTH];
+
 #define NumProtos	138
 #define MAX_PROTO_STR 8
 char protolist[NumProtos][MAX_PROTO_STR] = {
@@ -626,6 +639,313 @@ char *Get_fwd_status_name(uint32_t id) {
 
 } // End of Get_fwd_status_name
 
+/*
+ * Fast formatting helpers
+ * The output writers and the csv output do not use the printf family for the frequent
+ * tokens, but the helpers below, which write directly into the output line and return
+ * the end of the string. The output is identical to the corresponding printf format.
+ */
+static const char digit_pairs[] = 
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+static const char hex_digits[] = "0123456789abcdef";
+
+// convert value into decimal digits ending at end, return start of digits
+static inline char *UintDigits(char *end, uint64_t value) {
+char *s = end;
+
+	while ( value >= 100 ) {
+		int i = (value % 100) << 1;
+		value /= 100;
+		*--s = digit_pairs[i+1];
+		*--s = digit_pairs[i];
+	}
+	if ( value >= 10 ) {
+		int i = value << 1;
+		*--s = digit_pairs[i+1];
+		*--s = digit_pairs[i];
+	} else {
+		*--s = '0' + value;
+	}
+	return s;
+
+} // End of UintDigits
+
+// "%llu"
+static inline char *WriteUint(char *s, uint64_t value) {
+char tmp[24], *t;
+int len;
+
+	t = UintDigits(tmp + 24, value);
+	len = tmp + 24 - t;
+	memcpy(s, t, len);
+	return s + len;
+
+} // End of WriteUint
+
+// string, right aligned in width: "%<width>s"
+static inline char *WritePadded(char *s, char *string, int len, int width) {
+
+	while ( width > len ) {
+		*s++ = ' ';
+		width--;
+	}
+	memcpy(s, string, len);
+	return s + len;
+
+} // End of WritePadded
+
+// "%<width>llu" or "%0<width>llu" for pad '0'
+static inline char *WriteUintWidth(char *s, uint64_t value, int width, char pad) {
+char tmp[24], *t;
+int len;
+
+	t = UintDigits(tmp + 24, value);
+	len = tmp + 24 - t;
+	while ( width > len ) {
+		*s++ = pad;
+		width--;
+	}
+	memcpy(s, t, len);
+	return s + len;
+
+} // End of WriteUintWidth
+
+// "%-<width>llu"
+static inline char *WriteUintLeft(char *s, uint64_t value, int width) {
+char tmp[24], *t;
+int len;
+
+	t = UintDigits(tmp + 24, value);
+	len = tmp + 24 - t;
+	memcpy(s, t, len);
+	s += len;
+	while ( width > len ) {
+		*s++ = ' ';
+		width--;
+	}
+	return s;
+
+} // End of WriteUintLeft
+
+// value / 1000 as "%<width>.3f"
+static inline char *WriteMilli(char *s, int64_t value, int width) {
+char tmp[32], *t;
+uint64_t v;
+int i;
+
+	v = value < 0 ? -value : value;
+	t = tmp + 32;
+	i = v % 1000;
+	*--t = '0' + i % 10;
+	*--t = '0' + (i / 10) % 10;
+	*--t = '0' + i / 100;
+	*--t = '.';
+	t = UintDigits(t, v / 1000);
+	if ( value < 0 )
+		*--t = '-';
+	return WritePadded(s, t, tmp + 32 - t, width);
+
+} // End of WriteMilli
+
+// "%.2x:%.2x:%.2x:%.2x:%.2x:%.2x" of a mac address, most significant byte first
+static inline char *WriteMac(char *s, uint64_t mac) {
+int i;
+
+	for ( i=5; i>=0; i-- ) {
+		uint8_t b = (mac >> ( i*8 )) & 0xFF;
+		*s++ = hex_digits[b >> 4];
+		*s++ = hex_digits[b & 0xF];
+		if ( i )
+			*s++ = ':';
+	}
+	return s;
+
+} // End of WriteMac
+
+// IPv4 address in host byte order - same as inet_ntop()
+static inline char *WriteIPv4(char *s, uint32_t ip) {
+int i;
+
+	for ( i=24; i>=0; i-=8 ) {
+		s = WriteUint(s, (ip >> i) & 0xFF);
+		if ( i )
+			*s++ = '.';
+	}
+	return s;
+
+} // End of WriteIPv4
+
+// IPv6 address in host byte order - same as inet_ntop(): the longest run of zero words is compressed
+static char *WriteIPv6(char *s, uint64_t *ip) {
+uint16_t words[8];
+int	i, best_base, best_len, cur_base, cur_len;
+
+	for ( i=0; i<4; i++ ) {
+		words[i]   = ip[0] >> ( 48 - 16*i );
+		words[i+4] = ip[1] >> ( 48 - 16*i );
+	}
+
+	best_base = cur_base = -1;
+	best_len  = cur_len  = 0;
+	for ( i=0; i<8; i++ ) {
+		if ( words[i] == 0 ) {
+			if ( cur_base == -1 ) {
+				cur_base = i;
+				cur_len  = 1;
+			} else 
+				cur_len++;
+		} else if ( cur_base != -1 ) {
+			if ( best_base == -1 || cur_len > best_len ) {
+				best_base = cur_base;
+				best_len  = cur_len;
+			}
+			cur_base = -1;
+		}
+	}
+	if ( cur_base != -1 && ( best_base == -1 || cur_len > best_len ) ) {
+		best_base = cur_base;
+		best_len  = cur_len;
+	}
+	if ( best_len < 2 )
+		best_base = -1;
+
+	for ( i=0; i<8; i++ ) {
+		if ( best_base != -1 && i >= best_base && i < ( best_base + best_len ) ) {
+			if ( i == best_base )
+				*s++ = ':';
+			continue;
+		}
+		if ( i )
+			*s++ = ':';
+		// embedded IPv4 address
+		if ( i == 6 && best_base == 0 && ( best_len == 6 || ( best_len == 5 && words[5] == 0xffff ) ) ) 
+			return WriteIPv4(s, ( (uint32_t)words[6] << 16 ) | words[7]);
+
+		if ( words[i] >= 0x1000 ) 
+			*s++ = hex_digits[words[i] >> 12];
+		if ( words[i] >= 0x100 ) 
+			*s++ = hex_digits[(words[i] >> 8) & 0xF];
+		if ( words[i] >= 0x10 ) 
+			*s++ = hex_digits[(words[i] >> 4) & 0xF];
+		*s++ = hex_digits[words[i] & 0xF];
+	}
+	if ( best_base != -1 && ( best_base + best_len ) == 8 )
+		*s++ = ':';
+
+	return s;
+
+} // End of WriteIPv6
+
+/*
+ * Date strings are cached per minute: all seconds within the same minute share the date string
+ * up to the minutes. Only a new minute requires localtime() and strftime().
+ */
+#define DateCacheSize	64
+
+typedef struct date_cache_s {
+	time_t	minute;		// first second of the cached minute
+	char	string[24];	// "%Y-%m-%d %H:%M:"
+	int		length;		// length of string - 0 if slot is empty
+} date_cache_t;
+
+static __thread date_cache_t date_cache[DateCacheSize];
+
+// "%Y-%m-%d %H:%M:%S" of localtime(when)
+static char *WriteDate(char *s, time_t when) {
+date_cache_t *cache = &date_cache[( when / 60 ) & ( DateCacheSize - 1 )];
+int	second;
+
+	if ( cache->length == 0 || when < cache->minute || when >= ( cache->minute + 60 ) ) {
+		struct tm ts;
+		if ( !localtime_r(&when, &ts) ) {
+			return s;
+		}
+		if ( ts.tm_sec > 59 ) {
+			// leap second - do not cache
+			s += strftime(s, 24, "%Y-%m-%d %H:%M:%S", &ts);
+			return s;
+		}
+		cache->length = strftime(cache->string, 24, "%Y-%m-%d %H:%M:", &ts);
+		cache->minute = when - ts.tm_sec;
+	}
+	memcpy(s, cache->string, cache->length);
+	s += cache->length;
+	second = ( when - cache->minute ) << 1;
+	*s++ = digit_pairs[second];
+	*s++ = digit_pairs[second+1];
+	return s;
+
+} // End of WriteDate
+
+/*
+ * Buffered output
+ * Printed records are collected in a large buffer, which is written with a single write()
+ * instead of a printf() for each record. Any output of stdio is flushed first to keep the order.
+ */
+#define OUTPUT_BUFFSIZE	(1024 * 1024)
+
+static char		output_buffer[OUTPUT_BUFFSIZE];
+static size_t	output_fill = 0;
+
+static void WriteOutput(char *p, size_t len) {
+
+	while ( len ) {
+		ssize_t ret = write(STDOUT_FILENO, p, len);
+		if ( ret < 0 ) {
+			if ( errno == EINTR )
+				continue;
+			fprintf(stderr, "write() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+			exit(255);
+		}
+		p   += ret;
+		len -= ret;
+	}
+
+} // End of WriteOutput
+
+void FlushOutput(void) {
+
+	fflush(stdout);
+	WriteOutput(output_buffer, output_fill);
+	output_fill = 0;
+
+} // End of FlushOutput
+
+// same as printf("%s\n", string)
+void OutputString(char *string) {
+size_t len = strlen(string);
+
+	if ( ( output_fill + len + 1 ) > OUTPUT_BUFFSIZE ) {
+		FlushOutput();
+		if ( ( len + 1 ) > OUTPUT_BUFFSIZE ) {
+			printf("%s\n", string);
+			return;
+		}
+	}
+	memcpy(output_buffer + output_fill, string, len);
+	output_fill += len;
+	output_buffer[output_fill++] = '\n';
+
+} // End of OutputString
+
+// append len bytes of already formatted output lines
+void OutputText(char *text, size_t len) {
+
+	if ( ( output_fill + len ) > OUTPUT_BUFFSIZE ) {
+		FlushOutput();
+		if ( len > OUTPUT_BUFFSIZE ) {
+			WriteOutput(text, len);
+			return;
+		}
+	}
+	memcpy(output_buffer + output_fill, text, len);
+	output_fill += len;
+
+} // End of OutputText
+
 void format_file_block_header(void *header, char ** s, int tag) {
 data_block_header_t *h = (data_block_header_t *)header;
 	
@@ -1209,200 +1529,109 @@ master_record_t *r = (master_record_t *)record;
 } // End of flow_record_pipe
 
 void flow_record_to_csv(void *record, char ** s, int tag) {
-char 		*_s, as[IP_STRING_LEN], ds[IP_STRING_LEN]; 
-char		proto_str[MAX_PROTO_STR], datestr1[64], datestr2[64], datestr3[64], flags_str[16];
-char		s_snet[IP_STRING_LEN], s_dnet[IP_STRING_LEN];
-ssize_t		slen, _slen;
-time_t		when;
-struct tm 	*ts;
+char 		*_s, flags_str[16];
+uint32_t	seconds;
+int			i;
 master_record_t *r = (master_record_t *)record;
 
-	as[0] = 0;
-	ds[0] = 0;
-	if ( (r->flags & FLAG_IPV6_ADDR ) != 0 ) { // IPv6
-		uint64_t snet[2];
-		uint64_t dnet[2];
-
-		// remember IPs for network 
-		snet[0] = r->v6.srcaddr[0];
-		snet[1] = r->v6.srcaddr[1];
-		dnet[0] = r->v6.dstaddr[0];
-		dnet[1] = r->v6.dstaddr[1];
-		r->v6.srcaddr[0] = htonll(r->v6.srcaddr[0]);
-		r->v6.srcaddr[1] = htonll(r->v6.srcaddr[1]);
-		r->v6.dstaddr[0] = htonll(r->v6.dstaddr[0]);
-		r->v6.dstaddr[1] = htonll(r->v6.dstaddr[1]);
-		inet_ntop(AF_INET6, r->v6.srcaddr, as, sizeof(as));
-		inet_ntop(AF_INET6, r->v6.dstaddr, ds, sizeof(ds));
-
-		if ( r->src_mask || r->dst_mask) {
-			if ( r->src_mask > 64 )
-				snet[1] &= 0xffffffffffffffffLL << ( 128 - r->src_mask );
-			else {
-				snet[1] &= 0xffffffffffffffffLL << ( 64 - r->src_mask );
-				snet[1] = 0;
-			}
-			snet[0] = htonll(snet[0]);
-			snet[1] = htonll(snet[1]);
-			inet_ntop(AF_INET6, &snet, s_snet, sizeof(s_snet));
+	_s = data_string;
 
-			if ( r->dst_mask > 64 )
-				dnet[1] &= 0xffffffffffffffffLL << ( 128 - r->dst_mask );
-			else {
-				dnet[1] &= 0xffffffffffffffffLL << ( 64 - r->dst_mask );
-				dnet[1] = 0;
-			}
-			dnet[0] = htonll(dnet[0]);
-			dnet[1] = htonll(dnet[1]);
-			inet_ntop(AF_INET6, &dnet, s_dnet, sizeof(s_dnet));
+	_s = WriteDate(_s, r->first);
+	*_s++ = ',';
+	_s = WriteDate(_s, r->last);
+	*_s++ = ',';
 
-		} else {
-			s_snet[0] = '\0';
-			s_dnet[0] = '\0';
-		}
+	seconds = r->last - r->first;
+	_s = WriteMilli(_s, (int64_t)seconds * 1000LL + (int)r->msec_last - (int)r->msec_first, 0);
+	*_s++ = ',';
 
+	if ( (r->flags & FLAG_IPV6_ADDR ) != 0 ) { // IPv6
+		_s = WriteIPv6(_s, r->v6.srcaddr);
+		*_s++ = ',';
+		_s = WriteIPv6(_s, r->v6.dstaddr);
 	} else {	// IPv4
-		uint32_t snet, dnet;
-		snet = r->v4.srcaddr;
-		dnet = r->v4.dstaddr;
-		r->v4.srcaddr = htonl(r->v4.srcaddr);
-		r->v4.dstaddr = htonl(r->v4.dstaddr);
-		inet_ntop(AF_INET, &r->v4.srcaddr, as, sizeof(as));
-		inet_ntop(AF_INET, &r->v4.dstaddr, ds, sizeof(ds));
-		if ( r->src_mask || r->dst_mask) {
-			snet &= 0xffffffffL << ( 32 - r->src_mask );
-			snet = htonl(snet);
-			inet_ntop(AF_INET, &snet, s_snet, sizeof(s_snet));
-
-			dnet &= 0xffffffffL << ( 32 - r->dst_mask );
-			dnet = htonl(dnet);
-			inet_ntop(AF_INET, &dnet, s_dnet, sizeof(s_dnet));
-		} else {
-			s_snet[0] = '\0';
-			s_dnet[0] = '\0';
-		}
+		_s = WriteIPv4(_s, r->v4.srcaddr);
+		*_s++ = ',';
+		_s = WriteIPv4(_s, r->v4.dstaddr);
 	}
-	as[IP_STRING_LEN-1] = 0;
-	ds[IP_STRING_LEN-1] = 0;
-
-	when = r->first;
-	ts = localtime(&when);
-	strftime(datestr1, 63, "%Y-%m-%d %H:%M:%S", ts);
-
-	when = r->last;
-	ts = localtime(&when);
-	strftime(datestr2, 63, "%Y-%m-%d %H:%M:%S", ts);
-
-	duration = r->last - r->first;
-	duration += ((double)r->msec_last - (double)r->msec_first) / 1000.0;
-
-	String_Flags(record, flags_str);
+	*_s++ = ',';
+	_s = WriteUint(_s, r->srcport);
+	*_s++ = ',';
+	_s = WriteUint(_s, r->dstport);
+	*_s++ = ',';
 
 	if ( r->prot >= NumProtos ) {
-		snprintf(proto_str,MAX_PROTO_STR-1,"%u", r->prot );
-		proto_str[MAX_PROTO_STR-1] = '\0';
+		_s = WriteUint(_s, r->prot);
 	} else {
-		int i = 0;;
-		strncpy(proto_str, protolist[r->prot], MAX_PROTO_STR);
 		// remove white spaces for csv
-		while ( proto_str[i] ) {
-			if ( proto_str[i] == ' ' )
-				proto_str[i] = '\0';
-			i++;
-		}
+		char *p = protolist[r->prot];
+		while ( *p && *p != ' ' ) 
+			*_s++ = *p++;
 	}
+	*_s++ = ',';
 
-	_s = data_string;
-	slen = STRINGSIZE;
-	snprintf(_s, slen-1, "%s,%s,%.3f,%s,%s,%u,%u,%s,%s,%u,%u,%llu,%llu,%llu,%llu",
-		datestr1, datestr2, duration, as,ds,r->srcport, r->dstport, proto_str, flags_str, 
-		r->fwd_status, r->tos, (unsigned long long)r->dPkts, (unsigned long long)r->dOctets,
-		(long long unsigned)r->out_pkts, (long long unsigned)r->out_bytes
-	);
+	String_Flags(record, flags_str);
+	i = strlen(flags_str);
+	memcpy(_s, flags_str, i);
+	_s += i;
+
+	*_s++ = ',';
+	_s = WriteUint(_s, r->fwd_status);
+	*_s++ = ',';
+	_s = WriteUint(_s, r->tos);
+	*_s++ = ',';
+	_s = WriteUint(_s, r->dPkts);
+	*_s++ = ',';
+	_s = WriteUint(_s, r->dOctets);
+	*_s++ = ',';
+	_s = WriteUint(_s, r->out_pkts);
+	*_s++ = ',';
+	_s = WriteUint(_s, r->out_bytes);
 
-	_slen = strlen(data_string);
-	_s += _slen;
-	slen -= _slen;
-	
 	// EX_IO_SNMP_2:
 	// EX_IO_SNMP_4:
-	snprintf(_s, slen-1, ",%u,%u" , r->input, r->output);
-		_slen = strlen(data_string);
-		_s = data_string + _slen;
-		slen = STRINGSIZE - _slen;
+	*_s++ = ',';
+	_s = WriteUint(_s, r->input);
+	*_s++ = ',';
+	_s = WriteUint(_s, r->output);
 
 	// EX_AS_2:
 	// EX_AS_4:
-	snprintf(_s, slen-1, ",%u,%u", r->srcas, r->dstas);
-		_slen = strlen(data_string);
-		_s = data_string + _slen;
-		slen = STRINGSIZE - _slen;
+	*_s++ = ',';
+	_s = WriteUint(_s, r->srcas);
+	*_s++ = ',';
+	_s = WriteUint(_s, r->dstas);
 
 	// EX_MULIPLE:
-	snprintf(_s, slen-1, ",%u,%u,%u,%u" , r->src_mask, r->dst_mask, r->dst_tos, r->dir );
-		_slen = strlen(data_string);
-		_s = data_string + _slen;
-		slen = STRINGSIZE - _slen;
-
+	*_s++ = ',';
+	_s = WriteUint(_s, r->src_mask);
+	*_s++ = ',';
+	_s = WriteUint(_s, r->dst_mask);
+	*_s++ = ',';
+	_s = WriteUint(_s, r->dst_tos);
+	*_s++ = ',';
+	_s = WriteUint(_s, r->dir);
+
+	*_s++ = ',';
 	if ( (r->flags & FLAG_IPV6_NH ) != 0 ) { // IPv6
 		// EX_NEXT_HOP_v6:
-		as[0] = 0;
-		r->ip_nexthop.v6[0] = htonll(r->ip_nexthop.v6[0]);
-		r->ip_nexthop.v6[1] = htonll(r->ip_nexthop.v6[1]);
-		inet_ntop(AF_INET6, r->ip_nexthop.v6, as, sizeof(as));
-		as[IP_STRING_LEN-1] = 0;
-	
-		snprintf(_s, slen-1, ",%s", as);
-		_slen = strlen(data_string);
-		_s = data_string + _slen;
-		slen = STRINGSIZE - _slen;
-
+		_s = WriteIPv6(_s, r->ip_nexthop.v6);
+		// EX_NEXT_HOP_BGP_v6: - compatible with previous versions, which list the next hop IP again
+		*_s++ = ',';
+		_s = WriteIPv6(_s, r->ip_nexthop.v6);
 	} else {
 		// EX_NEXT_HOP_v4:
-		as[0] = 0;
-		r->ip_nexthop.v4 = htonl(r->ip_nexthop.v4);
-		inet_ntop(AF_INET, &r->ip_nexthop.v4, as, sizeof(as));
-		as[IP_STRING_LEN-1] = 0;
-
-		snprintf(_s, slen-1, ",%s", as);
-		_slen = strlen(data_string);
-		_s = data_string + _slen;
-		slen = STRINGSIZE - _slen;
-	}
-	
-	if ( (r->flags & FLAG_IPV6_NH ) != 0 ) { // IPv6
-		// EX_NEXT_HOP_BGP_v6:
-		as[0] = 0;
-		r->bgp_nexthop.v6[0] = htonll(r->bgp_nexthop.v6[0]);
-		r->bgp_nexthop.v6[1] = htonll(r->bgp_nexthop.v6[1]);
-		inet_ntop(AF_INET6, r->ip_nexthop.v6, as, sizeof(as));
-		as[IP_STRING_LEN-1] = 0;
-	
-		snprintf(_s, slen-1, ",%s", as);
-		_slen = strlen(data_string);
-		_s = data_string + _slen;
-		slen = STRINGSIZE - _slen;
-
-	} else {
+		_s = WriteIPv4(_s, r->ip_nexthop.v4);
 		// 	EX_NEXT_HOP_BGP_v4:
-		as[0] = 0;
-		r->bgp_nexthop.v4 = htonl(r->bgp_nexthop.v4);
-		inet_ntop(AF_INET, &r->bgp_nexthop.v4, as, sizeof(as));
-		as[IP_STRING_LEN-1] = 0;
-
-		snprintf(_s, slen-1, ",%s", as);
-		_slen = strlen(data_string);
-		_s = data_string + _slen;
-		slen = STRINGSIZE - _slen;
-
+		*_s++ = ',';
+		_s = WriteIPv4(_s, r->bgp_nexthop.v4);
 	}
 
 	// EX_VLAN:
-	snprintf(_s, slen-1, ",%u,%u", r->src_vlan, r->dst_vlan);
-	_slen = strlen(data_string);
-	_s = data_string + _slen;
-	slen = STRINGSIZE - _slen;
-
+	*_s++ = ',';
+	_s = WriteUint(_s, r->src_vlan);
+	*_s++ = ',';
+	_s = WriteUint(_s, r->dst_vlan);
 
 	/* already in default output:
 	EX_OUT_PKG_4:
@@ -1412,123 +1641,60 @@ master_record_t *r = (master_record_t *)record;
 	*/
 
 	// case EX_MAC_1: 
-	{
-		int i;
-		uint8_t mac1[6], mac2[6];
-
-		for ( i=0; i<6; i++ ) {
-			mac1[i] = (r->in_src_mac >> ( i*8 )) & 0xFF;
-		}
-		for ( i=0; i<6; i++ ) {
-			mac2[i] = (r->out_dst_mac >> ( i*8 )) & 0xFF;
-		}
-
-		snprintf(_s, slen-1, ",%.2x:%.2x:%.2x:%.2x:%.2x:%.2x,%.2x:%.2x:%.2x:%.2x:%.2x:%.2x",
-			mac1[5], mac1[4], mac1[3], mac1[2], mac1[1], mac1[0], 
-			mac2[5], mac2[4], mac2[3], mac2[2], mac2[1], mac2[0] );
-		_slen = strlen(data_string);
-		_s = data_string + _slen;
-		slen = STRINGSIZE - _slen;
-	} 
+	*_s++ = ',';
+	_s = WriteMac(_s, r->in_src_mac);
+	*_s++ = ',';
+	_s = WriteMac(_s, r->out_dst_mac);
 
 	// EX_MAC_2: 
-	{
-		int i;
-		uint8_t mac1[6], mac2[6];
-
-		for ( i=0; i<6; i++ ) {
-			mac1[i] = (r->in_dst_mac >> ( i*8 )) & 0xFF;
-		}
-		for ( i=0; i<6; i++ ) {
-			mac2[i] = (r->out_src_mac >> ( i*8 )) & 0xFF;
-		}
-
-		snprintf(_s, slen-1, ",%.2x:%.2x:%.2x:%.2x:%.2x:%.2x,%.2x:%.2x:%.2x:%.2x:%.2x:%.2x",
-			mac1[5], mac1[4], mac1[3], mac1[2], mac1[1], mac1[0], 
-			mac2[5], mac2[4], mac2[3], mac2[2], mac2[1], mac2[0] );
-		_slen = strlen(data_string);
-		_s = data_string + _slen;
-		slen = STRINGSIZE - _slen;
-	}
+	*_s++ = ',';
+	_s = WriteMac(_s, r->in_dst_mac);
+	*_s++ = ',';
+	_s = WriteMac(_s, r->out_src_mac);
 
 	// EX_MPLS: 
-	{
-		unsigned int i;
-		for ( i=0; i<10; i++ ) {
-			snprintf(_s, slen-1, ",%u-%1u-%1u", 
-				r->mpls_label[i] >> 4 , (r->mpls_label[i] & 0xF ) >> 1, r->mpls_label[i] & 1 );
-			_slen = strlen(data_string);
-			_s = data_string + _slen;
-			slen = STRINGSIZE - _slen;
-		}
-	} 
-
-	{
-		double f1, f2, f3;
-		f1 = (double)r->client_nw_delay_usec / 1000.0;
-		f2 = (double)r->server_nw_delay_usec / 1000.0;
-		f3 = (double)r->appl_latency_usec / 1000.0;
-
-				snprintf(_s, slen-1,
-",%9.3f,%9.3f,%9.3f", f1, f2, f3);
-
-		_slen = strlen(data_string);
-		_s = data_string + _slen;
-		slen = STRINGSIZE - _slen;
-	} 
+	for ( i=0; i<10; i++ ) {
+		*_s++ = ',';
+		_s = WriteUint(_s, r->mpls_label[i] >> 4);
+		*_s++ = '-';
+		_s = WriteUint(_s, (r->mpls_label[i] & 0xF ) >> 1);
+		*_s++ = '-';
+		_s = WriteUint(_s, r->mpls_label[i] & 1);
+	}
 
+	// latency
+	*_s++ = ',';
+	_s = WriteMilli(_s, r->client_nw_delay_usec, 9);
+	*_s++ = ',';
+	_s = WriteMilli(_s, r->server_nw_delay_usec, 9);
+	*_s++ = ',';
+	_s = WriteMilli(_s, r->appl_latency_usec, 9);
 
 	// EX_ROUTER_IP_v4:
+	*_s++ = ',';
 	if ( (r->flags & FLAG_IPV6_EXP ) != 0 ) { // IPv6
-		// EX_NEXT_HOP_v6:
-		as[0] = 0;
-		r->ip_router.v6[0] = htonll(r->ip_router.v6[0]);
-		r->ip_router.v6[1] = htonll(r->ip_router.v6[1]);
-		inet_ntop(AF_INET6, r->ip_router.v6, as, sizeof(as));
-		as[IP_STRING_LEN-1] = 0;
-	
-		snprintf(_s, slen-1, ",%s", as);
-		_slen = strlen(data_string);
-		_s = data_string + _slen;
-		slen = STRINGSIZE - _slen;
-
+		_s = WriteIPv6(_s, r->ip_router.v6);
 	} else {
-		// EX_NEXT_HOP_v4:
-		as[0] = 0;
-		r->ip_router.v4 = htonl(r->ip_router.v4);
-		inet_ntop(AF_INET, &r->ip_router.v4, as, sizeof(as));
-		as[IP_STRING_LEN-1] = 0;
-
-		snprintf(_s, slen-1, ",%s", as);
-		_slen = strlen(data_string);
-		_s = data_string + _slen;
-		slen = STRINGSIZE - _slen;
+		_s = WriteIPv4(_s, r->ip_router.v4);
 	}
 
 	// EX_ROUTER_ID
-	snprintf(_s, slen-1, ",%u/%u", r->engine_type, r->engine_id);
-		_slen = strlen(data_string);
-		_s = data_string + _slen;
-		slen = STRINGSIZE - _slen;
+	*_s++ = ',';
+	_s = WriteUint(_s, r->engine_type);
+	*_s++ = '/';
+	_s = WriteUint(_s, r->engine_id);
 
 	// Exporter SysID
-	snprintf(_s, slen-1, ",%u", r->exporter_sysid);
-		_slen = strlen(data_string);
-		_s = data_string + _slen;
-		slen = STRINGSIZE - _slen;
+	*_s++ = ',';
+	_s = WriteUint(_s, r->exporter_sysid);
 
 	// Date flow received
-	when = r->received / 1000LL;
- 	ts = localtime(&when);
- 	strftime(datestr3, 63, ",%Y-%m-%d %H:%M:%S", ts);
- 
- 	snprintf(_s, slen-1, "%s.%03llu", datestr3, (long long unsigned)r->received % 1000LL);
- 	        _slen = strlen(data_string);
- 	        _s = data_string + _slen;
- 	        slen = STRINGSIZE - _slen;
+	*_s++ = ',';
+	_s = WriteDate(_s, r->received / 1000LL);
+	*_s++ = '.';
+	_s = WriteUintWidth(_s, r->received % 1000LL, 3, '0');
 
-	// snprintf(_s, slen-1, "\n");
-	data_string[STRINGSIZE-1] = 0;
+	*_s = '\0';
 	*s = data_string;
 
 
@@ -1538,9 +1704,349 @@ void flow_record_to_null(void *record, char ** s, int tag) {
 	// empty - do not list any flows
 } // End of flow_record_to_null
 
+/* 
+ * Direct writers for the most frequently used tokens. Each writer produces exactly the same
+ * string as the corresponding String_* function, but writes into the output line.
+ */
+static inline char *WriteAddr(char *s, int is_v6, uint64_t *ipv6, uint32_t ipv4) {
+char tmp_str[IP_STRING_LEN], *t;
+
+	if ( is_v6 ) {
+		t = WriteIPv6(tmp_str, ipv6);
+		*t = '\0';
+		if ( ! long_v6 ) {
+			condense_v6(tmp_str);
+			t = tmp_str + strlen(tmp_str);
+		}
+	} else {
+		t = WriteIPv4(tmp_str, ipv4);
+	}
+	if ( tag_string[0] )
+		*s++ = tag_string[0];
+	return WritePadded(s, tmp_str, t - tmp_str, long_v6 ? 39 : 16);
+
+} // End of WriteAddr
+
+// ICMP type.code or dst port, left aligned in 5 chars - "%-5s"
+static inline char *WriteICMPPortLeft(char *s, master_record_t *r) {
+char *start = s;
+
+	if ( r->prot == IPPROTO_ICMP || r->prot == IPPROTO_ICMPV6 ) { // ICMP
+		s = WriteUint(s, r->icmp_type);
+		*s++ = '.';
+		s = WriteUint(s, r->icmp_code);
+	} else {
+		s = WriteUint(s, r->dstport);
+	}
+	while ( ( s - start ) < 5 ) 
+		*s++ = ' ';
+	return s;
+
+} // End of WriteICMPPortLeft
+
+// packets, bytes, bps or pps as "%8s" of format_number()
+static inline char *WriteNumber(char *s, uint64_t num) {
+char tmp[NUMBER_STRING_SIZE];
+
+	if ( !scale || (double)num < _1MB ) 
+		return WriteUintWidth(s, num, 8, ' ');
+
+	format_number(num, tmp, scale, FIXED_WIDTH);
+	return WritePadded(s, tmp, strlen(tmp), 8);
+
+} // End of WriteNumber
+
+static char *Write_FirstSeen(master_record_t *r, char *s) {
+
+	s = WriteDate(s, r->first);
+	*s++ = '.';
+	return WriteUintWidth(s, r->msec_first, 3, '0');
+
+} // End of Write_FirstSeen
+
+static char *Write_LastSeen(master_record_t *r, char *s) {
+
+	s = WriteDate(s, r->last);
+	*s++ = '.';
+	return WriteUintWidth(s, r->msec_last, 3, '0');
+
+} // End of Write_LastSeen
+
+static char *Write_Received(master_record_t *r, char *s) {
+
+	s = WriteDate(s, r->received / 1000LL);
+	*s++ = '.';
+	return WriteUintWidth(s, r->received % 1000LL, 3, '0');
+
+} // End of Write_Received
+
+static char *Write_Duration(master_record_t *r, char *s) {
+uint32_t seconds = r->last - r->first;
+
+	return WriteMilli(s, (int64_t)seconds * 1000LL + (int)r->msec_last - (int)r->msec_first, 9);
+
+} // End of Write_Duration
+
+static char *Write_Protocol(master_record_t *r, char *s) {
+
+	if ( r->prot >= NumProtos || !scale ) {
+		return WriteUintLeft(s, r->prot, 5);
+	} else {
+		size_t len = strlen(protolist[r->prot]);
+		memcpy(s, protolist[r->prot], len);
+		return s + len;
+	}
+
+} // End of Write_Protocol
+
+static char *Write_SrcAddr(master_record_t *r, char *s) {
+
+	return WriteAddr(s, r->flags & FLAG_IPV6_ADDR, r->v6.srcaddr, r->v4.srcaddr);
+
+} // End of Write_SrcAddr
+
+static char *Write_DstAddr(master_record_t *r, char *s) {
+
+	return WriteAddr(s, r->flags & FLAG_IPV6_ADDR, r->v6.dstaddr, r->v4.dstaddr);
+
+} // End of Write_DstAddr
+
+static char *Write_SrcAddrPort(master_record_t *r, char *s) {
+
+	s = WriteAddr(s, r->flags & FLAG_IPV6_ADDR, r->v6.srcaddr, r->v4.srcaddr);
+	*s++ = ( r->flags & FLAG_IPV6_ADDR ) ? '.' : ':';
+	return WriteUintLeft(s, r->srcport, 5);
+
+} // End of Write_SrcAddrPort
+
+static char *Write_DstAddrPort(master_record_t *r, char *s) {
+
+	s = WriteAddr(s, r->flags & FLAG_IPV6_ADDR, r->v6.dstaddr, r->v4.dstaddr);
+	*s++ = ( r->flags & FLAG_IPV6_ADDR ) ? '.' : ':';
+	return WriteICMPPortLeft(s, r);
+
+} // End of Write_DstAddrPort
+
+static char *Write_NextHop(master_record_t *r, char *s) {
+
+	return WriteAddr(s, r->flags & FLAG_IPV6_NH, r->ip_nexthop.v6, r->ip_nexthop.v4);
+
+} // End of Write_NextHop
+
+static char *Write_BGPNextHop(master_record_t *r, char *s) {
+
+	return WriteAddr(s, r->flags & FLAG_IPV6_NH, r->bgp_nexthop.v6, r->bgp_nexthop.v4);
+
+} // End of Write_BGPNextHop
+
+static char *Write_RouterIP(master_record_t *r, char *s) {
+
+	return WriteAddr(s, r->flags & FLAG_IPV6_EXP, r->ip_router.v6, r->ip_router.v4);
+
+} // End of Write_RouterIP
+
+static char *Write_SrcPort(master_record_t *r, char *s) {
+
+	return WriteUintWidth(s, r->srcport, 6, ' ');
+
+} // End of Write_SrcPort
+
+static char *Write_DstPort(master_record_t *r, char *s) {
+char tmp[16], *t;
+
+	if ( r->prot == IPPROTO_ICMP || r->prot == IPPROTO_ICMPV6 ) { // ICMP
+		t = WriteUint(tmp, r->icmp_type);
+		*t++ = '.';
+		t = WriteUint(t, r->icmp_code);
+		return WritePadded(s, tmp, t - tmp, 6);
+	} 
+	return WriteUintWidth(s, r->dstport, 6, ' ');
+
+} // End of Write_DstPort
+
+static char *Write_SrcAS(master_record_t *r, char *s) {
+
+	return WriteUintWidth(s, r->srcas, 6, ' ');
+
+} // End of Write_SrcAS
+
+static char *Write_DstAS(master_record_t *r, char *s) {
+
+	return WriteUintWidth(s, r->dstas, 6, ' ');
+
+} // End of Write_DstAS
+
+static char *Write_Input(master_record_t *r, char *s) {
+
+	return WriteUintWidth(s, r->input, 6, ' ');
+
+} // End of Write_Input
+
+static char *Write_Output(master_record_t *r, char *s) {
+
+	return WriteUintWidth(s, r->output, 6, ' ');
+
+} // End of Write_Output
+
+static char *Write_InPackets(master_record_t *r, char *s) {
+
+	return WriteNumber(s, r->dPkts);
+
+} // End of Write_InPackets
+
+static char *Write_OutPackets(master_record_t *r, char *s) {
+
+	return WriteNumber(s, r->out_pkts);
+
+} // End of Write_OutPackets
+
+static char *Write_InBytes(master_record_t *r, char *s) {
+
+	return WriteNumber(s, r->dOctets);
+
+} // End of Write_InBytes
+
+static char *Write_OutBytes(master_record_t *r, char *s) {
+
+	return WriteNumber(s, r->out_bytes);
+
+} // End of Write_OutBytes
+
+static char *Write_Flows(master_record_t *r, char *s) {
+
+	return WriteUintWidth(s, r->aggr_flows, 5, ' ');
+
+} // End of Write_Flows
+
+static char *Write_Flags(master_record_t *r, char *s) {
+
+	String_Flags(r, s);
+	return s + strlen(s);
+
+} // End of Write_Flags
+
+static char *Write_Tos(master_record_t *r, char *s) {
+
+	return WriteUintWidth(s, r->tos, 3, ' ');
+
+} // End of Write_Tos
+
+static char *Write_SrcTos(master_record_t *r, char *s) {
+
+	return WriteUintWidth(s, r->tos, 4, ' ');
+
+} // End of Write_SrcTos
+
+static char *Write_DstTos(master_record_t *r, char *s) {
+
+	return WriteUintWidth(s, r->dst_tos, 4, ' ');
+
+} // End of Write_DstTos
+
+static char *Write_SrcMask(master_record_t *r, char *s) {
+
+	return WriteUintWidth(s, r->src_mask, 5, ' ');
+
+} // End of Write_SrcMask
+
+static char *Write_DstMask(master_record_t *r, char *s) {
+
+	return WriteUintWidth(s, r->dst_mask, 5, ' ');
+
+} // End of Write_DstMask
+
+static char *Write_FwdStatus(master_record_t *r, char *s) {
+
+	return WriteUintWidth(s, r->fwd_status, 3, ' ');
+
+} // End of Write_FwdStatus
+
+static char *Write_bps(master_record_t *r, char *s) {
+uint64_t	bps;
+
+	if ( duration ) {
+		bps = (( r->dOctets << 3 ) / duration);	// bits per second. ( >> 3 ) -> * 8 to convert octets into bits
+	} else {
+		bps = 0;
+	}
+	return WriteNumber(s, bps);
+
+} // End of Write_bps
+
+static char *Write_pps(master_record_t *r, char *s) {
+uint64_t	pps;
+
+	if ( duration ) {
+		pps = r->dPkts / duration;				// packets per second
+	} else {
+		pps = 0;
+	}
+	return WriteNumber(s, pps);
+
+} // End of Write_pps
+
+static char *Write_bpp(master_record_t *r, char *s) {
+uint32_t 	Bpp; 
+
+	if ( r->dPkts ) 
+		Bpp = r->dOctets / r->dPkts;			// Bytes per Packet
+	else 
+		Bpp = 0;
+	return WriteUintWidth(s, Bpp, 6, ' ');
+
+} // End of Write_bpp
+
+static char *Write_ExpSysID(master_record_t *r, char *s) {
+
+	return WriteUintWidth(s, r->exporter_sysid, 6, ' ');
+
+} // End of Write_ExpSysID
+
+static struct format_writer_list_s {
+	string_function_t	string_function;	// token function in format_token_list
+	writer_function_t	writer;				// equivalent direct writer
+} format_writer_list[] = {
+	{ String_FirstSeen, 	Write_FirstSeen },
+	{ String_LastSeen, 		Write_LastSeen },
+	{ String_Received, 		Write_Received },
+	{ String_Duration, 		Write_Duration },
+	{ String_Protocol, 		Write_Protocol },
+	{ String_SrcAddr, 		Write_SrcAddr },
+	{ String_DstAddr, 		Write_DstAddr },
+	{ String_SrcAddrPort, 	Write_SrcAddrPort },
+	{ String_DstAddrPort, 	Write_DstAddrPort },
+	{ String_NextHop, 		Write_NextHop },
+	{ String_BGPNextHop, 	Write_BGPNextHop },
+	{ String_RouterIP, 		Write_RouterIP },
+	{ String_SrcPort, 		Write_SrcPort },
+	{ String_DstPort, 		Write_DstPort },
+	{ String_SrcAS, 		Write_SrcAS },
+	{ String_DstAS, 		Write_DstAS },
+	{ String_Input, 		Write_Input },
+	{ String_Output, 		Write_Output },
+	{ String_InPackets, 	Write_InPackets },
+	{ String_OutPackets, 	Write_OutPackets },
+	{ String_InBytes, 		Write_InBytes },
+	{ String_OutBytes, 		Write_OutBytes },
+	{ String_Flows, 		Write_Flows },
+	{ String_Flags, 		Write_Flags },
+	{ String_Tos, 			Write_Tos },
+	{ String_SrcTos, 		Write_SrcTos },
+	{ String_DstTos, 		Write_DstTos },
+	{ String_SrcMask, 		Write_SrcMask },
+	{ String_DstMask, 		Write_DstMask },
+	{ String_FwdStatus, 	Write_FwdStatus },
+	{ String_bps, 			Write_bps },
+	{ String_pps, 			Write_pps },
+	{ String_bpp, 			Write_bpp },
+	{ String_ExpSysID, 		Write_ExpSysID },
+	{ NULL, NULL }
+};
+
 void format_special(void *record, char ** s, int tag) {
 master_record_t *r 		  = (master_record_t *)record;
-int	i, index;
+char	*p, *end;
+int		i;
 
 	do_tag		  = tag;
 	tag_string[0] = do_tag ? TAG_CHAR : '\0';
@@ -1548,25 +2054,42 @@ int	i, index;
 
 	duration = r->last - r->first;
 	duration += ((double)r->msec_last - (double)r->msec_first) / 1000.0;
-	for ( i=0; i<token_index; i++ ) {
-		token_list[i].string_function(r, token_list[i].string_buffer);
-	}
 
-	// concat all strings together for the output line
-	i = 0;
-	for ( index=0; index<format_index; index++ ) {
-		int j = 0;
-		while ( format_list[index][j] && i < STRINGSIZE ) 
-			data_string[i++] = format_list[index][j++];
+	// execute the compiled format list - every token needs at most MAX_STRING_LENGTH bytes
+	p	= data_string;
+	end	= data_string + STRINGSIZE - MAX_STRING_LENGTH;
+	for ( i=0; i<format_op_index && p < end; i++ ) {
+		struct format_op_s *op = &format_op_list[i];
+		if ( op->writer ) {
+			p = op->writer(r, p);
+		} else if ( op->string_function ) {
+			size_t len;
+			op->string_function(r, token_string);
+			len = strlen(token_string);
+			memcpy(p, token_string, len);
+			p += len;
+		} else {
+			size_t len = op->length;
+			if ( len > (size_t)(end - p) ) 
+				len = end - p;
+			memcpy(p, op->string, len);
+			p += len;
+		}
 	}
-	if ( i < STRINGSIZE ) 
-		data_string[i] = '\0';
+	*p = '\0';
 
-	data_string[STRINGSIZE-1] = '\0';
 	*s = data_string;
 
 } // End of format_special 
 
+/* printers, which only use thread local state and may format records in several threads */
+int ParallelPrinter(printer_t print_record) {
+
+	return print_record == format_special || print_record == flow_record_to_csv || 
+		print_record == flow_record_to_pipe;
+
+} // End of ParallelPrinter
+
 char *get_record_header(void) {
 	return header_string;
 } // End of get_record_header
@@ -1580,10 +2103,10 @@ void set_record_header(void) {
 
 static void InitFormatParser(void) {
 
-	max_format_index = max_token_index = BLOCK_SIZE;
-	format_list = (char **)malloc(max_format_index * sizeof(char *));
-	token_list  = (struct token_list_s *)malloc(max_token_index * sizeof(struct token_list_s));
-	if ( !format_list || !token_list ) {
+	max_format_op	= BLOCK_SIZE;
+	format_op_index	= 0;
+	format_op_list	= (struct format_op_s *)malloc(max_format_op * sizeof(struct format_op_s));
+	if ( !format_op_list ) {
 		fprintf(stderr, "Memory allocation error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
 		exit(255);
 	}
@@ -1591,45 +2114,52 @@ static void InitFormatParser(void) {
 
 } // End of InitFormatParser
 
-static void AddToken(int index) {
+static struct format_op_s *NewFormatOp(void) {
+struct format_op_s *op;
 
-	if ( token_index >= max_token_index ) { // no slot available - expand table
-		max_token_index += BLOCK_SIZE;
-		token_list = (struct token_list_s *)realloc(token_list, max_token_index * sizeof(struct token_list_s));
-		if ( !token_list ) {
+	if ( format_op_index >= max_format_op ) { // no slot available - expand table
+		max_format_op += BLOCK_SIZE;
+		format_op_list = (struct format_op_s *)realloc(format_op_list, max_format_op * sizeof(struct format_op_s));
+		if ( !format_op_list ) {
 			fprintf(stderr, "Memory allocation error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
 			exit(255);
 		}
 	}
-	token_list[token_index].string_function	 = format_token_list[index].string_function;
-	token_list[token_index].string_buffer = malloc(MAX_STRING_LENGTH);
-	if ( !token_list[token_index].string_buffer ) {
-		fprintf(stderr, "Memory allocation error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
-		exit(255);
-	}
+	op = &format_op_list[format_op_index++];
+	memset((void *)op, 0, sizeof(struct format_op_s));
+
+	return op;
 
-	AddString(token_list[token_index].string_buffer);
-	token_index++;
+} // End of NewFormatOp
+
+static void AddToken(int index) {
+struct format_op_s *op = NewFormatOp();
+int i;
+
+	op->string_function	= format_token_list[index].string_function;
+
+	// use the direct writer of this token, if available
+	for ( i=0; format_writer_list[i].string_function; i++ ) {
+		if ( format_writer_list[i].string_function == op->string_function ) {
+			op->writer = format_writer_list[i].writer;
+			return;
+		}
+	}
 
 } // End of AddToken
 
-/* Add either a static string or the memory for a variable string from a token to the list */
+/* Add a static string to the list */
 static void AddString(char *string) {
+struct format_op_s *op;
 
 	if ( !string ) {
 		fprintf(stderr, "Panic! NULL string in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
 		exit(255);
 	}
 
-	if ( format_index >= max_format_index ) { // no slot available - expand table
-		max_format_index += BLOCK_SIZE;
-		format_list = (char **)realloc(format_list, max_format_index * sizeof(char *));
-		if ( !format_list ) {
-			fprintf(stderr, "Memory allocation error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
-			exit(255);
-		}
-	}
-	format_list[format_index++] = string;
+	op = NewFormatOp();
+	op->string = string;
+	op->length = strlen(string);
 
 } // End of AddString
 
@@ -1782,12 +2312,12 @@ static inline void ICMP_Port_decode(master_record_t *r, char *string) {
 /* functions, which create the individual strings for the output line */
 static void String_FirstSeen(master_record_t *r, char *string) {
 time_t 	tt;
-struct tm * ts;
+struct tm ts;
 char 	*s;
 
 	tt = r->first;
-	ts = localtime(&tt);
-	strftime(string, MAX_STRING_LENGTH-1, "%Y-%m-%d %H:%M:%S", ts);
+	localtime_r(&tt, &ts);
+	strftime(string, MAX_STRING_LENGTH-1, "%Y-%m-%d %H:%M:%S", &ts);
 	s = string + strlen(string);
 	snprintf(s, MAX_STRING_LENGTH-strlen(string)-1,".%03u", r->msec_first);
 	string[MAX_STRING_LENGTH-1] = '\0';
@@ -1796,12 +2326,12 @@ char 	*s;
 
 static void String_LastSeen(master_record_t *r, char *string) {
 time_t 	tt;
-struct tm * ts;
+struct tm ts;
 char 	*s;
 
 	tt = r->last;
-	ts = localtime(&tt);
-	strftime(string, MAX_STRING_LENGTH-1, "%Y-%m-%d %H:%M:%S", ts);
+	localtime_r(&tt, &ts);
+	strftime(string, MAX_STRING_LENGTH-1, "%Y-%m-%d %H:%M:%S", &ts);
 	s = string + strlen(string);
 	snprintf(s, MAX_STRING_LENGTH-strlen(string)-1,".%03u", r->msec_last);
 	string[MAX_STRING_LENGTH-1] = '\0';
@@ -1810,12 +2340,12 @@ char 	*s;
 
 static void String_Received(master_record_t *r, char *string) {
 time_t 	tt;
-struct tm * ts;
+struct tm ts;
 char 	*s;
 
 	tt = r->received / 1000LL;
-	ts = localtime(&tt);
-	strftime(string, MAX_STRING_LENGTH-1, "%Y-%m-%d %H:%M:%S", ts);
+	localtime_r(&tt, &ts);
+	strftime(string, MAX_STRING_LENGTH-1, "%Y-%m-%d %H:%M:%S", &ts);
 	s = string + strlen(string);
 	snprintf(s, MAX_STRING_LENGTH-strlen(string)-1,".%03llu", r->received % 1000LL);
 	string[MAX_STRING_LENGTH-1] = '\0';
@@ -1825,12 +2355,12 @@ char 	*s;
 #ifdef NSEL
 static void String_FlowStart(master_record_t *r, char *string) {
 time_t 	tt;
-struct tm * ts;
+struct tm ts;
 char 	*s;
 
 	tt = r->flow_start / 1000LL;
-	ts = localtime(&tt);
-	strftime(string, MAX_STRING_LENGTH-1, "%Y-%m-%d %H:%M:%S", ts);
+	localtime_r(&tt, &ts);
+	strftime(string, MAX_STRING_LENGTH-1, "%Y-%m-%d %H:%M:%S", &ts);
 	s = string + strlen(string);
 	snprintf(s, MAX_STRING_LENGTH-strlen(string)-1,".%03llu", r->flow_start % 1000LL);
 	string[MAX_STRING_LENGTH-1] = '\0';
@@ -115,6 +115,14 @@ void Proto_string(uint8_t protonum, char *protostr);
 
 void condense_v6(char *s);
 
+void OutputString(char *string);
+
+void FlushOutput(void);
+
+void OutputText(char *text, size_t len);
+
+int ParallelPrinter(printer_t print_record);
+
 #define TAG_CHAR ''
 
 #endif //_NF_COMMON_H
@@ -0,0 +1,276 @@
+/*
+ *  This file is part of the nfdump project.
+ *
+ *  Copyright (c) 2014, the nfdump contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of SWITCH nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  $Author$
+ *
+ *  $Id$
+ *
+ *  $LastChangedRevision$
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <string.h>
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "nfarena.h"
+
+#ifndef MAP_ANONYMOUS
+#	define MAP_ANONYMOUS MAP_ANON
+#endif
+
+// LargeAlloc header - keeps the payload 64 byte aligned
+#define LARGE_HEADER	64
+
+/* function prototypes */
+static void *PageAlloc(size_t size);
+
+static void PageFree(void *ptr, size_t size);
+
+static int Arena_NewBlock(arena_t *arena, size_t size);
+
+static void Arena_MarkDirty(arena_t *arena);
+
+/* Functions */
+
+/*
+ * map size bytes of zeroed memory, preferable backed by huge pages
+ * size must be a multiple of HUGE_PAGE_SIZE
+ */
+static void *PageAlloc(size_t size) {
+void *p;
+char *q, *aligned;
+
+#ifdef MAP_HUGETLB
+	// reserved huge pages - usually only available if configured by the admin
+	p = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+	if ( p != MAP_FAILED )
+		return p;
+#endif
+
+	// transparent huge pages need a 2MB aligned region: map more and trim both ends
+	p = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if ( p == MAP_FAILED ) {
+		fprintf(stderr, "mmap() error in %s line %d: %s\n", __FILE__, __LINE__, strerror (errno));
+		return NULL;
+	}
+	q = (char *)p;
+	aligned = (char *)(((uintptr_t)q + HUGE_PAGE_SIZE - 1) & ~((uintptr_t)HUGE_PAGE_SIZE - 1));
+	if ( aligned > q )
+		munmap(q, aligned - q);
+	if ( (q + size + HUGE_PAGE_SIZE) > (aligned + size) )
+		munmap(aligned + size, (q + size + HUGE_PAGE_SIZE) - (aligned + size));
+
+#ifdef MADV_HUGEPAGE
+	madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+
+	return (void *)aligned;
+
+} // End of PageAlloc
+
+static void PageFree(void *ptr, size_t size) {
+
+	munmap(ptr, size);
+
+} // End of PageFree
+
+static int Arena_NewBlock(arena_t *arena, size_t size) {
+size_t length;
+
+	if ( arena->NumBlocks >= arena->MaxBlocks ) {
+		arena->MaxBlocks += ArenaMaxBlocks;
+		arena->block	   = (void **)realloc(arena->block, arena->MaxBlocks * sizeof(void *));
+		arena->BlockLength = (size_t *)realloc(arena->BlockLength, arena->MaxBlocks * sizeof(size_t));
+		arena->Dirty	   = (size_t *)realloc(arena->Dirty, arena->MaxBlocks * sizeof(size_t));
+		if ( !arena->block || !arena->BlockLength || !arena->Dirty ) {
+			fprintf(stderr, "realloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror (errno));
+			return 0;
+		}
+	}
+
+	length = arena->BlockSize;
+	if ( size > length ) 
+		length = (size + HUGE_PAGE_SIZE - 1) & ~((size_t)HUGE_PAGE_SIZE - 1);
+
+	arena->block[arena->NumBlocks] = PageAlloc(length);
+	if ( !arena->block[arena->NumBlocks] )
+		return 0;
+	arena->BlockLength[arena->NumBlocks] = length;
+	arena->Dirty[arena->NumBlocks]		 = 0;
+	arena->NumBlocks++;
+
+	return 1;
+
+} // End of Arena_NewBlock
+
+// remember the used part of the current block - it needs to be cleared, when reused
+static void Arena_MarkDirty(arena_t *arena) {
+
+	if ( arena->Allocated > arena->Dirty[arena->CurrentBlock] )
+		arena->Dirty[arena->CurrentBlock] = arena->Allocated;
+
+} // End of Arena_MarkDirty
+
+int Arena_Init(arena_t *arena, size_t BlockSize) {
+
+	memset((void *)arena, 0, sizeof(arena_t));
+	arena->BlockSize = (BlockSize + HUGE_PAGE_SIZE - 1) & ~((size_t)HUGE_PAGE_SIZE - 1);
+
+	return Arena_NewBlock(arena, arena->BlockSize);
+
+} // End of Arena_Init
+
+/*
+ * allocate size bytes, aligned to 8 bytes. The memory is not cleared
+ * Never returns NULL - exits cleanly, if no memory is available
+ */
+void *Arena_Alloc(arena_t *arena, size_t size) {
+uint32_t next;
+void *p;
+
+	size = (size + 7) & ~((size_t)7);
+
+	if ( (arena->Allocated + size) > arena->BlockLength[arena->CurrentBlock] ) {
+		// not enough space - continue with the next block large enough, kept from before
+		// the last reset, or with a new block
+		Arena_MarkDirty(arena);
+		next = arena->CurrentBlock + 1;
+		while ( next < arena->NumBlocks && arena->BlockLength[next] < size )
+			next++;
+		if ( next == arena->NumBlocks && !Arena_NewBlock(arena, size) )
+			exit(255);
+		arena->CurrentBlock = next;
+		arena->Allocated	= 0;
+	}
+
+	p = (char *)arena->block[arena->CurrentBlock] + arena->Allocated;
+	arena->Allocated += size;
+
+	return p;
+
+} // End of Arena_Alloc
+
+/*
+ * allocate size bytes of zeroed memory. Memory never used before is still zero from
+ * the mapping - only memory reused after Arena_Reset() is cleared
+ */
+void *Arena_Calloc(arena_t *arena, size_t size) {
+size_t offset, dirty;
+void *p;
+
+	p = Arena_Alloc(arena, size);
+
+	offset = (char *)p - (char *)arena->block[arena->CurrentBlock];
+	dirty  = arena->Dirty[arena->CurrentBlock];
+	if ( offset < dirty ) 
+		memset(p, 0, (dirty - offset) < size ? (dirty - offset) : size);
+
+	return p;
+
+} // End of Arena_Calloc
+
+/*
+ * release all allocated memory at once. The blocks remain mapped and are reused by
+ * the following allocations
+ */
+void Arena_Reset(arena_t *arena) {
+
+	Arena_MarkDirty(arena);
+	arena->CurrentBlock = 0;
+	arena->Allocated	= 0;
+
+} // End of Arena_Reset
+
+void Arena_Free(arena_t *arena) {
+uint32_t i;
+
+	for ( i=0; i<arena->NumBlocks; i++ ) 
+		PageFree(arena->block[i], arena->BlockLength[i]);
+
+	free((void *)arena->block);
+	free((void *)arena->BlockLength);
+	free((void *)arena->Dirty);
+	memset((void *)arena, 0, sizeof(arena_t));
+
+} // End of Arena_Free
+
+/*
+ * allocate a large zeroed array such as hash buckets or sort lists. Arrays of at least
+ * one huge page are mapped directly and backed by huge pages. Release with LargeFree()
+ */
+void *LargeAlloc(size_t size) {
+size_t	length;
+char	*p;
+
+	length = size + LARGE_HEADER;
+	if ( length < HUGE_PAGE_SIZE ) {
+		p = calloc(1, length);
+		if ( !p ) {
+			fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror (errno));
+			return NULL;
+		}
+		*((size_t *)p) = 0;
+	} else {
+		length = (length + HUGE_PAGE_SIZE - 1) & ~((size_t)HUGE_PAGE_SIZE - 1);
+		p = PageAlloc(length);
+		if ( !p )
+			return NULL;
+		*((size_t *)p) = length;
+	}
+
+	return (void *)(p + LARGE_HEADER);
+
+} // End of LargeAlloc
+
+void LargeFree(void *ptr) {
+char	*p;
+size_t	length;
+
+	if ( !ptr )
+		return;
+
+	p = (char *)ptr - LARGE_HEADER;
+	length = *((size_t *)p);
+	if ( length )
+		PageFree(p, length);
+	else
+		free(p);
+
+} // End of LargeFree
@@ -0,0 +1,87 @@
+/*
+ *  This file is part of the nfdump project.
+ *
+ *  Copyright (c) 2014, the nfdump contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of SWITCH nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  $Author$
+ *
+ *  $Id$
+ *
+ *  $LastChangedRevision$
+ *
+ */
+
+#ifndef _NFARENA_H
+#define _NFARENA_H 1
+
+/* Definitions */
+
+/*
+ * Memory arena
+ * The flow and stat tables allocate their records from an arena instead of malloc. An arena
+ * is a list of large blocks, which are mapped as anonymous memory backed by 2MB huge pages,
+ * if the system supports it. This reduces TLB misses for big aggregations. Fresh mapped
+ * memory is zero, therefore Arena_Calloc() only clears memory, which was used before the
+ * last Arena_Reset(). Arena_Reset() releases all records at once, but keeps the blocks
+ * mapped for reuse. Arena_Free() unmaps all blocks. As memory is placed at first touch,
+ * blocks are local to the NUMA node of the thread, which fills the table. An arena is
+ * not locked - each thread needs its own arena.
+ */
+#define HUGE_PAGE_SIZE	(2*1024*1024)
+
+// default block size - multiple of HUGE_PAGE_SIZE
+#define ArenaBlockSize	(8*1024*1024)
+#define ArenaMaxBlocks	256
+
+typedef struct arena_s {
+	size_t		BlockSize;		/* size of each arena block */
+	void		**block;		/* array of all NumBlocks allocated blocks */
+	size_t		*BlockLength;	/* mapped size of each block - larger for oversized requests */
+	size_t		*Dirty;			/* bytes of each block used before the last reset */
+	uint32_t	MaxBlocks;		/* size of block array */
+	uint32_t	NumBlocks;		/* number of allocated blocks */
+	uint32_t	CurrentBlock;	/* index of block to allocate from */
+	size_t		Allocated;		/* bytes allocated in current block */
+} arena_t;
+
+/* Function prototypes */
+int Arena_Init(arena_t *arena, size_t BlockSize);
+
+void *Arena_Alloc(arena_t *arena, size_t size);
+
+void *Arena_Calloc(arena_t *arena, size_t size);
+
+void Arena_Reset(arena_t *arena);
+
+void Arena_Free(arena_t *arena);
+
+void *LargeAlloc(size_t size);
+
+void LargeFree(void *ptr);
+
+#endif //_NFARENA_H
@@ -0,0 +1,918 @@
+/*
+ *  This file is part of the nfdump project.
+ *
+ *  Copyright (c) 2014, the nfdump contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of SWITCH nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  $Author$
+ *
+ *  $Id$
+ *
+ *  $LastChangedRevision$
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "nffile.h"
+#include "nf_common.h"
+#include "util.h"
+#include "nfarrow.h"
+
+/*
+ * Arrow IPC format
+ * Each message is a continuation marker 0xFFFFFFFF, the little endian length of the 
+ * flatbuffer metadata, the metadata padded to 8 bytes and the message body. The stream 
+ * starts with the schema message, followed by the record batch messages and ends with 
+ * an empty message. The file format wraps the stream between the magic "ARROW1" and 
+ * a footer, which repeats the schema and locates all record batches.
+ */
+
+// Message header types
+#define MessageHeader_Schema		1
+#define MessageHeader_RecordBatch	3
+
+// Type union
+#define Type_Int				2
+#define Type_Utf8				5
+#define Type_Timestamp			10
+#define Type_FixedSizeBinary	15
+#define Type_Duration			18
+
+#define MetadataVersion_V5		4
+#define TimeUnit_MILLISECOND	1
+
+#define MaxArrowFields	64
+#define Pad8(n) (((n) + 7) & ~7LL)
+
+/*
+ * Flatbuffer builder
+ * A flatbuffer is built back to front: each object is pushed in front of the objects
+ * it references, therefore all references are positive offsets. Offsets of objects are
+ * counted from the end of the buffer. Only one table can be open at any time.
+ */
+typedef struct fb_builder_s {
+	uint8_t		*buf;
+	uint32_t	size;				/* size of buf */
+	uint32_t	head;				/* bytes used at the end of buf */
+	uint32_t	minalign;			/* largest alignment pushed */
+	uint32_t	table_start;		/* head at start of the open table */
+	uint32_t	num_fields;			/* number of vtable entries of the open table */
+	uint32_t	field[16];			/* head after each field of the open table - 0 if not set */
+} fb_builder_t;
+
+typedef struct arrow_block_s {
+	uint64_t	offset;				/* file offset of the message */
+	uint64_t	metaDataLength;		/* int32 + padding */
+	uint64_t	bodyLength;
+} arrow_block_t;
+
+static arrow_field_t flow_fields[] = {
+	{ "ts",		ARROW_TIMESTAMP,	0 },
+	{ "te",		ARROW_TIMESTAMP,	0 },
+	{ "td",		ARROW_DURATION,		0 },
+	{ "sa",		ARROW_IPADDR,		0 },
+	{ "da",		ARROW_IPADDR,		0 },
+	{ "sp",		ARROW_UINT16,		0 },
+	{ "dp",		ARROW_UINT16,		0 },
+	{ "pr",		ARROW_UINT8,		0 },
+	{ "flg",	ARROW_UINT8,		0 },
+	{ "fwd",	ARROW_UINT8,		0 },
+	{ "stos",	ARROW_UINT8,		0 },
+	{ "ipkt",	ARROW_UINT64,		0 },
+	{ "ibyt",	ARROW_UINT64,		0 },
+	{ "opkt",	ARROW_UINT64,		0 },
+	{ "obyt",	ARROW_UINT64,		0 },
+	{ "fl",		ARROW_UINT64,		0 },
+	{ "in",		ARROW_UINT32,		0 },
+	{ "out",	ARROW_UINT32,		0 },
+	{ "sas",	ARROW_UINT32,		0 },
+	{ "das",	ARROW_UINT32,		0 },
+	{ "smk",	ARROW_UINT8,		0 },
+	{ "dmk",	ARROW_UINT8,		0 },
+	{ "dtos",	ARROW_UINT8,		0 },
+	{ "dir",	ARROW_UINT8,		0 },
+	{ "nh",		ARROW_IPADDR,		0 },
+	{ "nhb",	ARROW_IPADDR,		0 },
+	{ "svln",	ARROW_UINT16,		0 },
+	{ "dvln",	ARROW_UINT16,		0 },
+	{ "ismc",	ARROW_UINT64,		0 },
+	{ "odmc",	ARROW_UINT64,		0 },
+	{ "idmc",	ARROW_UINT64,		0 },
+	{ "osmc",	ARROW_UINT64,		0 },
+	{ "mpls1",	ARROW_UINT32,		0 },
+	{ "mpls2",	ARROW_UINT32,		0 },
+	{ "mpls3",	ARROW_UINT32,		0 },
+	{ "mpls4",	ARROW_UINT32,		0 },
+	{ "mpls5",	ARROW_UINT32,		0 },
+	{ "mpls6",	ARROW_UINT32,		0 },
+	{ "mpls7",	ARROW_UINT32,		0 },
+	{ "mpls8",	ARROW_UINT32,		0 },
+	{ "mpls9",	ARROW_UINT32,		0 },
+	{ "mpls10",	ARROW_UINT32,		0 },
+	{ "cl",		ARROW_UINT64,		0 },
+	{ "sl",		ARROW_UINT64,		0 },
+	{ "al",		ARROW_UINT64,		0 },
+	{ "ra",		ARROW_IPADDR,		0 },
+	{ "engt",	ARROW_UINT8,		0 },
+	{ "engid",	ARROW_UINT8,		0 },
+	{ "exid",	ARROW_UINT16,		0 },
+	{ "tr",		ARROW_TIMESTAMP,	0 },
+	{ NULL,		0,					0 }
+};
+
+static arrow_field_t stat_fields[] = {
+	{ "stat",	ARROW_UTF8,			0 },
+	{ "order",	ARROW_UTF8,			0 },
+	{ "slot",	ARROW_TIMESTAMP,	1 },
+	{ "ts",		ARROW_TIMESTAMP,	0 },
+	{ "te",		ARROW_TIMESTAMP,	0 },
+	{ "td",		ARROW_DURATION,		0 },
+	{ "pr",		ARROW_UINT8,		1 },
+	{ "val",	ARROW_UINT64,		1 },
+	{ "ip",		ARROW_IPADDR,		1 },
+	{ "fl",		ARROW_UINT64,		0 },
+	{ "ipkt",	ARROW_UINT64,		0 },
+	{ "ibyt",	ARROW_UINT64,		0 },
+	{ "dist",	ARROW_UINT64,		1 },
+	{ "p50",	ARROW_UINT64,		1 },
+	{ "p95",	ARROW_UINT64,		1 },
+	{ "p99",	ARROW_UINT64,		1 },
+	{ "err",	ARROW_UINT64,		1 },
+	{ NULL,		0,					0 }
+};
+
+static struct arrow_output_s {
+	int				format;			/* ARROW_FILE or ARROW_STREAM */
+	arrow_field_t	*fields;
+	arrow_column_t	*column;
+	uint32_t		NumFields;
+	uint32_t		NumRows;		/* rows collected for the next record batch */
+	uint64_t		offset;			/* bytes written so far */
+	int				started;		/* header and schema written */
+
+	arrow_block_t	*block;			/* record batches written - file format only */
+	uint32_t		NumBlocks;
+	uint32_t		MaxBlocks;
+
+	fb_builder_t	fbb;
+} arrow;
+
+/* function prototypes */
+static void fb_Reset(fb_builder_t *fbb);
+
+static void fb_Push(fb_builder_t *fbb, void *data, uint32_t len);
+
+static void fb_PushLE(fb_builder_t *fbb, uint64_t value, uint32_t len);
+
+static void fb_Prep(fb_builder_t *fbb, uint32_t align, uint32_t additional);
+
+static void fb_AddScalar(fb_builder_t *fbb, uint32_t id, uint64_t value, uint32_t len);
+
+static void fb_AddOffset(fb_builder_t *fbb, uint32_t id, uint32_t offset);
+
+static void fb_StartTable(fb_builder_t *fbb);
+
+static uint32_t fb_EndTable(fb_builder_t *fbb);
+
+static uint32_t fb_CreateString(fb_builder_t *fbb, char *s);
+
+static uint32_t fb_CreateOffsetVector(fb_builder_t *fbb, uint32_t *offset, uint32_t num);
+
+static uint32_t fb_CreateStructVector(fb_builder_t *fbb, uint64_t *words, uint32_t num, uint32_t struct_words);
+
+static uint8_t *fb_Finish(fb_builder_t *fbb, uint32_t root, uint32_t *len);
+
+static void ArrowWrite(void *data, size_t len);
+
+static void ArrowWriteLE(uint64_t value, uint32_t len);
+
+static void ArrowPad(void);
+
+static uint32_t BuildSchema(fb_builder_t *fbb);
+
+static uint32_t WriteMessage(uint8_t header_type, uint32_t header, uint64_t body_length);
+
+static void WriteSchema(void);
+
+static void WriteFooter(void);
+
+static inline void SetValid(arrow_column_t *column, int valid);
+
+static inline void PutValue(arrow_column_t *column, uint64_t value);
+
+static inline void PutNull(arrow_column_t *column);
+
+static inline void PutIP(arrow_column_t *column, uint64_t *addr6, uint32_t addr4, int ipv6);
+
+static void PutString(arrow_column_t *column, char *s);
+
+static void fb_Reset(fb_builder_t *fbb) {
+
+	fbb->head	  = 0;
+	fbb->minalign = 1;
+	fbb->num_fields = 0;
+
+} // End of fb_Reset
+
+static void fb_Push(fb_builder_t *fbb, void *data, uint32_t len) {
+
+	if ( (fbb->head + len) > fbb->size ) {
+		fprintf(stderr, "Arrow metadata exceeds %u bytes\n", fbb->size);
+		exit(255);
+	}
+	fbb->head += len;
+	memcpy(fbb->buf + fbb->size - fbb->head, data, len);
+
+} // End of fb_Push
+
+// all flatbuffer scalars are little endian
+static void fb_PushLE(fb_builder_t *fbb, uint64_t value, uint32_t len) {
+uint8_t	bytes[8];
+uint32_t i;
+
+	for ( i=0; i<len; i++ ) {
+		bytes[i] = value & 0xFF;
+		value >>= 8;
+	}
+	fb_Push(fbb, bytes, len);
+
+} // End of fb_PushLE
+
+// pad the buffer, such that after pushing additional bytes, head is aligned to align
+static void fb_Prep(fb_builder_t *fbb, uint32_t align, uint32_t additional) {
+uint32_t pad;
+
+	if ( align > fbb->minalign )
+		fbb->minalign = align;
+	pad = (~(fbb->head + additional) + 1) & (align - 1);
+	if ( pad )
+		fb_PushLE(fbb, 0, pad);
+
+} // End of fb_Prep
+
+static void fb_AddScalar(fb_builder_t *fbb, uint32_t id, uint64_t value, uint32_t len) {
+
+	fb_Prep(fbb, len, 0);
+	fb_PushLE(fbb, value, len);
+	fbb->field[id] = fbb->head;
+	if ( id >= fbb->num_fields )
+		fbb->num_fields = id + 1;
+
+} // End of fb_AddScalar
+
+static void fb_AddOffset(fb_builder_t *fbb, uint32_t id, uint32_t offset) {
+
+	fb_Prep(fbb, 4, 0);
+	fb_PushLE(fbb, fbb->head + 4 - offset, 4);
+	fbb->field[id] = fbb->head;
+	if ( id >= fbb->num_fields )
+		fbb->num_fields = id + 1;
+
+} // End of fb_AddOffset
+
+static void fb_StartTable(fb_builder_t *fbb) {
+
+	memset((void *)fbb->field, 0, sizeof(fbb->field));
+	fbb->num_fields  = 0;
+	fbb->table_start = fbb->head;
+
+} // End of fb_StartTable
+
+static uint32_t fb_EndTable(fb_builder_t *fbb) {
+uint32_t i, table, vtable;
+int32_t	 soffset;
+
+	// placeholder for the table's vtable offset
+	fb_Prep(fbb, 4, 0);
+	fb_PushLE(fbb, 0, 4);
+	table = fbb->head;
+
+	// vtable: size of vtable, size of table, offset of each field within the table
+	for ( i=fbb->num_fields; i>0; i-- ) 
+		fb_PushLE(fbb, fbb->field[i-1] ? table - fbb->field[i-1] : 0, 2);
+	fb_PushLE(fbb, table - fbb->table_start, 2);
+	fb_PushLE(fbb, 4 + 2 * fbb->num_fields, 2);
+	vtable = fbb->head;
+
+	soffset = vtable - table;
+	for ( i=0; i<4; i++ ) 
+		fbb->buf[fbb->size - table + i] = ( (uint32_t)soffset >> (8*i) ) & 0xFF;
+
+	return table;
+
+} // End of fb_EndTable
+
+static uint32_t fb_CreateString(fb_builder_t *fbb, char *s) {
+uint32_t len = strlen(s);
+
+	fb_Prep(fbb, 4, len + 1);
+	fb_PushLE(fbb, 0, 1);
+	fb_Push(fbb, s, len);
+	fb_PushLE(fbb, len, 4);
+	return fbb->head;
+
+} // End of fb_CreateString
+
+static uint32_t fb_CreateOffsetVector(fb_builder_t *fbb, uint32_t *offset, uint32_t num) {
+uint32_t i;
+
+	fb_Prep(fbb, 4, 4 * num);
+	for ( i=num; i>0; i-- ) 
+		fb_PushLE(fbb, fbb->head + 4 - offset[i-1], 4);
+	fb_PushLE(fbb, num, 4);
+	return fbb->head;
+
+} // End of fb_CreateOffsetVector
+
+// all Arrow structs are made of 8 byte words
+static uint32_t fb_CreateStructVector(fb_builder_t *fbb, uint64_t *words, uint32_t num, uint32_t struct_words) {
+uint32_t i;
+
+	fb_Prep(fbb, 4, 8 * num * struct_words);
+	fb_Prep(fbb, 8, 8 * num * struct_words);
+	for ( i=num * struct_words; i>0; i-- ) 
+		fb_PushLE(fbb, words[i-1], 8);
+	fb_PushLE(fbb, num, 4);
+	return fbb->head;
+
+} // End of fb_CreateStructVector
+
+static uint8_t *fb_Finish(fb_builder_t *fbb, uint32_t root, uint32_t *len) {
+
+	fb_Prep(fbb, fbb->minalign > 8 ? fbb->minalign : 8, 4);
+	fb_PushLE(fbb, fbb->head + 4 - root, 4);
+	*len = fbb->head;
+	return fbb->buf + fbb->size - fbb->head;
+
+} // End of fb_Finish
+
+static void ArrowWrite(void *data, size_t len) {
+
+	OutputText((char *)data, len);
+	arrow.offset += len;
+
+} // End of ArrowWrite
+
+static void ArrowWriteLE(uint64_t value, uint32_t len) {
+uint8_t	bytes[8];
+uint32_t i;
+
+	for ( i=0; i<len; i++ ) {
+		bytes[i] = value & 0xFF;
+		value >>= 8;
+	}
+	ArrowWrite(bytes, len);
+
+} // End of ArrowWriteLE
+
+static void ArrowPad(void) {
+static char zero[8] = { 0 };
+uint32_t pad = Pad8(arrow.offset) - arrow.offset;
+
+	if ( pad )
+		ArrowWrite(zero, pad);
+
+} // End of ArrowPad
+
+static uint32_t BuildSchema(fb_builder_t *fbb) {
+uint32_t	field[MaxArrowFields];
+uint32_t	i, name, type, type_type, children, fields;
+
+	for ( i=0; i<arrow.NumFields; i++ ) {
+		arrow_field_t *f = &arrow.fields[i];
+
+		name	 = fb_CreateString(fbb, f->name);
+		children = fb_CreateOffsetVector(fbb, NULL, 0);
+
+		fb_StartTable(fbb);
+		switch (f->type) {
+			case ARROW_UINT8:
+			case ARROW_UINT16:
+			case ARROW_UINT32:
+			case ARROW_UINT64:
+				// Int: bitWidth, is_signed defaults to false
+				fb_AddScalar(fbb, 0, 8 * arrow.column[i].width, 4);
+				type_type = Type_Int;
+				break;
+			case ARROW_TIMESTAMP:
+				// Timestamp: unit, no timezone
+				fb_AddScalar(fbb, 0, TimeUnit_MILLISECOND, 2);
+				type_type = Type_Timestamp;
+				break;
+			case ARROW_DURATION:
+				fb_AddScalar(fbb, 0, TimeUnit_MILLISECOND, 2);
+				type_type = Type_Duration;
+				break;
+			case ARROW_IPADDR:
+				// FixedSizeBinary: byteWidth
+				fb_AddScalar(fbb, 0, 16, 4);
+				type_type = Type_FixedSizeBinary;
+				break;
+			default:
+				type_type = Type_Utf8;
+		}
+		type = fb_EndTable(fbb);
+
+		// Field: name, nullable, type_type, type, dictionary, children
+		fb_StartTable(fbb);
+		fb_AddOffset(fbb, 0, name);
+		fb_AddOffset(fbb, 3, type);
+		fb_AddOffset(fbb, 5, children);
+		fb_AddScalar(fbb, 1, f->nullable, 1);
+		fb_AddScalar(fbb, 2, type_type, 1);
+		field[i] = fb_EndTable(fbb);
+	}
+	fields = fb_CreateOffsetVector(fbb, field, arrow.NumFields);
+
+	// Schema: endianness, fields
+	fb_StartTable(fbb);
+	fb_AddOffset(fbb, 1, fields);
+#ifdef WORDS_BIGENDIAN
+	fb_AddScalar(fbb, 0, 1, 2);
+#endif
+	return fb_EndTable(fbb);
+
+} // End of BuildSchema
+
+// write the metadata message - returns the length of the metadata including prefix
+static uint32_t WriteMessage(uint8_t header_type, uint32_t header, uint64_t body_length) {
+fb_builder_t *fbb = &arrow.fbb;
+uint32_t	message, len;
+uint8_t		*data;
+
+	// Message: version, header_type, header, bodyLength
+	fb_StartTable(fbb);
+	fb_AddScalar(fbb, 3, body_length, 8);
+	fb_AddOffset(fbb, 2, header);
+	fb_AddScalar(fbb, 0, MetadataVersion_V5, 2);
+	fb_AddScalar(fbb, 1, header_type, 1);
+	message = fb_EndTable(fbb);
+
+	// the finished buffer is a multiple of 8 bytes - the body stays aligned
+	data = fb_Finish(fbb, message, &len);
+	ArrowWriteLE(0xFFFFFFFF, 4);
+	ArrowWriteLE(len, 4);
+	ArrowWrite(data, len);
+
+	return len + 8;
+
+} // End of WriteMessage
+
+static void WriteSchema(void) {
+uint32_t schema;
+
+	if ( arrow.format == ARROW_FILE ) 
+		ArrowWrite("ARROW1\0\0", 8);
+
+	fb_Reset(&arrow.fbb);
+	schema = BuildSchema(&arrow.fbb);
+	WriteMessage(MessageHeader_Schema, schema, 0);
+	arrow.started = 1;
+
+} // End of WriteSchema
+
+static void WriteFooter(void) {
+fb_builder_t *fbb = &arrow.fbb;
+uint32_t	schema, dictionaries, batches, footer, len;
+uint8_t		*data;
+
+	fb_Reset(fbb);
+	schema		 = BuildSchema(fbb);
+	dictionaries = fb_CreateStructVector(fbb, NULL, 0, 3);
+	batches		 = fb_CreateStructVector(fbb, (uint64_t *)arrow.block, arrow.NumBlocks, 3);
+
+	// Footer: version, schema, dictionaries, recordBatches
+	fb_StartTable(fbb);
+	fb_AddOffset(fbb, 1, schema);
+	fb_AddOffset(fbb, 2, dictionaries);
+	fb_AddOffset(fbb, 3, batches);
+	fb_AddScalar(fbb, 0, MetadataVersion_V5, 2);
+	footer = fb_EndTable(fbb);
+
+	data = fb_Finish(fbb, footer, &len);
+	ArrowWrite(data, len);
+	ArrowWriteLE(len, 4);
+	ArrowWrite("ARROW1", 6);
+
+} // End of WriteFooter
+
+int Arrow_Init(int format, int schema) {
+uint32_t i;
+
+	memset((void *)&arrow, 0, sizeof(arrow));
+	arrow.format = format;
+	arrow.fields = schema == ARROW_STATS ? stat_fields : flow_fields;
+	while ( arrow.fields[arrow.NumFields].name )
+		arrow.NumFields++;
+
+	arrow.fbb.size = ArrowBuilderSize;
+	arrow.fbb.buf  = malloc(ArrowBuilderSize);
+	arrow.column   = calloc(arrow.NumFields, sizeof(arrow_column_t));
+	if ( !arrow.fbb.buf || !arrow.column ) {
+		fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror (errno));
+		return 0;
+	}
+
+	for ( i=0; i<arrow.NumFields; i++ ) {
+		arrow_column_t *column = &arrow.column[i];
+		switch (arrow.fields[i].type) {
+			case ARROW_UINT8:
+				column->width = 1;
+				break;
+			case ARROW_UINT16:
+				column->width = 2;
+				break;
+			case ARROW_UINT32:
+				column->width = 4;
+				break;
+			case ARROW_IPADDR:
+				column->width = 16;
+				break;
+			case ARROW_UTF8:
+				column->width = 0;
+				break;
+			default:
+				column->width = 8;
+		}
+		if ( column->width ) {
+			column->size = ArrowBatchRows * column->width;
+		} else {
+			column->size	= 16 * ArrowBatchRows;
+			column->offsets = calloc(ArrowBatchRows + 1, sizeof(int32_t));
+			if ( !column->offsets ) {
+				fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror (errno));
+				return 0;
+			}
+		}
+		column->values = malloc(column->size);
+		if ( !column->values ) {
+			fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror (errno));
+			return 0;
+		}
+		if ( arrow.fields[i].nullable ) {
+			column->validity = calloc(ArrowBatchRows / 8, 1);
+			if ( !column->validity ) {
+				fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror (errno));
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+
+} // End of Arrow_Init
+
+static inline void SetValid(arrow_column_t *column, int valid) {
+
+	if ( !column->validity )
+		return;
+
+	if ( valid ) {
+		column->validity[arrow.NumRows >> 3] |= 1 << ( arrow.NumRows & 7 );
+	} else {
+		column->validity[arrow.NumRows >> 3] &= ~( 1 << ( arrow.NumRows & 7 ) );
+		column->null_count++;
+	}
+
+} // End of SetValid
+
+static inline void PutValue(arrow_column_t *column, uint64_t value) {
+void *p = (void *)(column->values + column->length);
+
+	switch (column->width) {
+		case 1:
+			*((uint8_t *)p) = value;
+			break;
+		case 2:
+			*((uint16_t *)p) = value;
+			break;
+		case 4:
+			*((uint32_t *)p) = value;
+			break;
+		default:
+			*((uint64_t *)p) = value;
+	}
+	column->length += column->width;
+	SetValid(column, 1);
+
+} // End of PutValue
+
+static inline void PutNull(arrow_column_t *column) {
+
+	memset((void *)(column->values + column->length), 0, column->width);
+	column->length += column->width;
+	SetValid(column, 0);
+
+} // End of PutNull
+
+// IP addresses are stored in network byte order, IPv4 as IPv4 mapped IPv6 address
+static inline void PutIP(arrow_column_t *column, uint64_t *addr6, uint32_t addr4, int ipv6) {
+uint32_t *p = (uint32_t *)(column->values + column->length);
+
+	if ( ipv6 ) {
+		((uint64_t *)p)[0] = htonll(addr6[0]);
+		((uint64_t *)p)[1] = htonll(addr6[1]);
+	} else {
+		p[0] = 0;
+		p[1] = 0;
+		p[2] = htonl(0xFFFF);
+		p[3] = htonl(addr4);
+	}
+	column->length += 16;
+	SetValid(column, 1);
+
+} // End of PutIP
+
+static void PutString(arrow_column_t *column, char *s) {
+size_t len = strlen(s);
+
+	if ( (column->length + len) > column->size ) {
+		column->size = 2 * ( column->length + len );
+		column->values = realloc(column->values, column->size);
+		if ( !column->values ) {
+			fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror (errno));
+			exit(255);
+		}
+	}
+	memcpy((void *)(column->values + column->length), s, len);
+	column->length += len;
+	column->offsets[arrow.NumRows + 1] = column->length;
+	SetValid(column, 1);
+
+} // End of PutString
+
+void flow_record_to_arrow(void *record, char ** s, int tag) {
+master_record_t *r = (master_record_t *)record;
+arrow_column_t	*column = arrow.column;
+int i;
+
+	PutValue(column++, 1000LL * (uint64_t)r->first + r->msec_first);
+	PutValue(column++, 1000LL * (uint64_t)r->last + r->msec_last);
+	PutValue(column++, 1000LL * ((int64_t)r->last - (int64_t)r->first) + r->msec_last - r->msec_first);
+
+	PutIP(column++, r->v6.srcaddr, r->v4.srcaddr, r->flags & FLAG_IPV6_ADDR);
+	PutIP(column++, r->v6.dstaddr, r->v4.dstaddr, r->flags & FLAG_IPV6_ADDR);
+	PutValue(column++, r->srcport);
+	PutValue(column++, r->dstport);
+	PutValue(column++, r->prot);
+	PutValue(column++, r->tcp_flags);
+	PutValue(column++, r->fwd_status);
+	PutValue(column++, r->tos);
+
+	PutValue(column++, r->dPkts);
+	PutValue(column++, r->dOctets);
+	PutValue(column++, r->out_pkts);
+	PutValue(column++, r->out_bytes);
+	PutValue(column++, r->aggr_flows);
+
+	PutValue(column++, r->input);
+	PutValue(column++, r->output);
+	PutValue(column++, r->srcas);
+	PutValue(column++, r->dstas);
+	PutValue(column++, r->src_mask);
+	PutValue(column++, r->dst_mask);
+	PutValue(column++, r->dst_tos);
+	PutValue(column++, r->dir);
+
+	PutIP(column++, r->ip_nexthop.v6, r->ip_nexthop.v4, r->flags & FLAG_IPV6_NH);
+	PutIP(column++, r->bgp_nexthop.v6, r->bgp_nexthop.v4, r->flags & FLAG_IPV6_NHB);
+	PutValue(column++, r->src_vlan);
+	PutValue(column++, r->dst_vlan);
+
+	PutValue(column++, r->in_src_mac);
+	PutValue(column++, r->out_dst_mac);
+	PutValue(column++, r->in_dst_mac);
+	PutValue(column++, r->out_src_mac);
+	for ( i=0; i<10; i++ ) 
+		PutValue(column++, r->mpls_label[i]);
+
+	PutValue(column++, r->client_nw_delay_usec);
+	PutValue(column++, r->server_nw_delay_usec);
+	PutValue(column++, r->appl_latency_usec);
+
+	PutIP(column++, r->ip_router.v6, r->ip_router.v4, r->flags & FLAG_IPV6_EXP);
+	PutValue(column++, r->engine_type);
+	PutValue(column++, r->engine_id);
+	PutValue(column++, r->exporter_sysid);
+	PutValue(column++, r->received);
+
+	// nothing to print - the columns are written by Arrow_Batch()
+	*s = NULL;
+	if ( ++arrow.NumRows == ArrowBatchRows ) 
+		Arrow_Batch();
+
+} // End of flow_record_to_arrow
+
+void Arrow_StatRecord(arrow_stat_t *stat) {
+arrow_column_t	*column = arrow.column;
+int i;
+
+	PutString(column++, stat->stat);
+	PutString(column++, stat->order);
+	if ( stat->time_slot )
+		PutValue(column++, 1000LL * (uint64_t)stat->time_slot);
+	else
+		PutNull(column++);
+	PutValue(column++, stat->first);
+	PutValue(column++, stat->last);
+	PutValue(column++, stat->last - stat->first);
+	if ( stat->has_proto )
+		PutValue(column++, stat->prot);
+	else
+		PutNull(column++);
+
+	switch (stat->key_type) {
+		case ARROW_KEY_NUMBER:
+			PutValue(column++, stat->key[1]);
+			PutNull(column++);
+			break;
+		case ARROW_KEY_IPADDR:
+			PutNull(column++);
+			PutIP(column++, stat->key, stat->key[1], stat->ipv6);
+			break;
+		default:
+			PutNull(column++);
+			PutNull(column++);
+	}
+
+	PutValue(column++, stat->flows);
+	PutValue(column++, stat->packets);
+	PutValue(column++, stat->bytes);
+
+	if ( stat->has_distinct )
+		PutValue(column++, stat->distinct);
+	else
+		PutNull(column++);
+	for ( i=0; i<3; i++ ) {
+		if ( stat->has_quantile )
+			PutValue(column++, stat->quantile[i]);
+		else
+			PutNull(column++);
+	}
+	if ( stat->has_error )
+		PutValue(column++, stat->error);
+	else
+		PutNull(column++);
+
+	if ( ++arrow.NumRows == ArrowBatchRows ) 
+		Arrow_Batch();
+
+} // End of Arrow_StatRecord
+
+/*
+ * Write all collected rows as one record batch. The body holds the buffers of
+ * all columns in schema order: validity bitmap and values, or validity bitmap,
+ * offsets and data for utf8 columns. Each buffer is padded to 8 bytes.
+ */
+void Arrow_Batch(void) {
+fb_builder_t *fbb = &arrow.fbb;
+uint64_t	nodes[2 * MaxArrowFields], buffers[6 * MaxArrowFields];
+uint64_t	body_length, block_offset;
+uint32_t	i, num_buffers, rows, nodes_vector, buffers_vector, batch, metadata_length;
+
+	if ( !arrow.started ) 
+		WriteSchema();
+
+	rows = arrow.NumRows;
+	if ( rows == 0 )
+		return;
+
+	body_length = 0;
+	num_buffers = 0;
+	for ( i=0; i<arrow.NumFields; i++ ) {
+		arrow_column_t *column = &arrow.column[i];
+		uint64_t len;
+
+		// FieldNode: length, null_count
+		nodes[2*i]	 = rows;
+		nodes[2*i+1] = column->null_count;
+
+		// Buffer: offset, length - the validity bitmap may be omitted without nulls
+		len = column->null_count ? ( rows + 7 ) / 8 : 0;
+		buffers[num_buffers++] = body_length;
+		buffers[num_buffers++] = len;
+		body_length += Pad8(len);
+
+		if ( column->offsets ) {
+			len = 4 * ( rows + 1 );
+			buffers[num_buffers++] = body_length;
+			buffers[num_buffers++] = len;
+			body_length += Pad8(len);
+		}
+
+		len = column->length;
+		buffers[num_buffers++] = body_length;
+		buffers[num_buffers++] = len;
+		body_length += Pad8(len);
+	}
+
+	// RecordBatch: length, nodes, buffers
+	fb_Reset(fbb);
+	buffers_vector = fb_CreateStructVector(fbb, buffers, num_buffers / 2, 2);
+	nodes_vector   = fb_CreateStructVector(fbb, nodes, arrow.NumFields, 2);
+	fb_StartTable(fbb);
+	fb_AddScalar(fbb, 0, rows, 8);
+	fb_AddOffset(fbb, 1, nodes_vector);
+	fb_AddOffset(fbb, 2, buffers_vector);
+	batch = fb_EndTable(fbb);
+
+	block_offset	= arrow.offset;
+	metadata_length = WriteMessage(MessageHeader_RecordBatch, batch, body_length);
+
+	for ( i=0; i<arrow.NumFields; i++ ) {
+		arrow_column_t *column = &arrow.column[i];
+
+		if ( column->null_count ) {
+			ArrowWrite(column->validity, ( rows + 7 ) / 8);
+			ArrowPad();
+		}
+		if ( column->offsets ) {
+			ArrowWrite(column->offsets, 4 * ( rows + 1 ));
+			ArrowPad();
+		}
+		ArrowWrite(column->values, column->length);
+		ArrowPad();
+
+		column->length	   = 0;
+		column->null_count = 0;
+	}
+	arrow.NumRows = 0;
+
+	if ( arrow.format == ARROW_FILE ) {
+		if ( arrow.NumBlocks == arrow.MaxBlocks ) {
+			arrow.MaxBlocks += 1024;
+			arrow.block = realloc(arrow.block, arrow.MaxBlocks * sizeof(arrow_block_t));
+			if ( !arrow.block ) {
+				fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror (errno));
+				exit(255);
+			}
+		}
+		arrow.block[arrow.NumBlocks].offset			= block_offset;
+		arrow.block[arrow.NumBlocks].metaDataLength = metadata_length;
+		arrow.block[arrow.NumBlocks].bodyLength		= body_length;
+		arrow.NumBlocks++;
+	}
+
+} // End of Arrow_Batch
+
+void Arrow_Close(void) {
+uint32_t i;
+
+	// write the pending rows - or at least the schema
+	Arrow_Batch();
+
+	// end of stream marker
+	ArrowWriteLE(0xFFFFFFFF, 4);
+	ArrowWriteLE(0, 4);
+
+	if ( arrow.format == ARROW_FILE ) 
+		WriteFooter();
+
+	for ( i=0; i<arrow.NumFields; i++ ) {
+		free(arrow.column[i].values);
+		free(arrow.column[i].offsets);
+		free(arrow.column[i].validity);
+	}
+	free(arrow.column);
+	free(arrow.block);
+	free(arrow.fbb.buf);
+	memset((void *)&arrow, 0, sizeof(arrow));
+
+} // End of Arrow_Close
@@ -0,0 +1,128 @@
+/*
+ *  This file is part of the nfdump project.
+ *
+ *  Copyright (c) 2014, the nfdump contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of SWITCH nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  $Author$
+ *
+ *  $Id$
+ *
+ *  $LastChangedRevision$
+ *
+ */
+
+#ifndef _NFARROW_H
+#define _NFARROW_H 1
+
+/* Definitions */
+
+/*
+ * Arrow output
+ * -o arrow and -o arrows write the flows or the element statistics as Apache Arrow
+ * IPC file or stream respectively. Each record field is a typed column, therefore the
+ * output can be loaded into pandas, polars, duckdb etc. without parsing any text.
+ * The records are collected column by column and written as one record batch per
+ * data block read, or every ArrowBatchRows records. The flatbuffer metadata is
+ * encoded by a small builder in nfarrow.c - no Arrow library is needed.
+ * IP addresses are 16 byte fixed size binaries in network byte order, IPv4 addresses
+ * are mapped into ::ffff:0:0/96. All time stamps are in milliseconds.
+ */
+#define ArrowBatchRows		65536
+#define ArrowBuilderSize	(256 * 1024)
+
+// Arrow output formats
+#define ARROW_FILE		1
+#define ARROW_STREAM	2
+
+// Arrow schema
+#define ARROW_FLOWS		1
+#define ARROW_STATS		2
+
+// stat key types
+#define ARROW_KEY_NONE		0
+#define ARROW_KEY_NUMBER	1
+#define ARROW_KEY_IPADDR	2
+
+// column types
+enum { ARROW_UINT8 = 1, ARROW_UINT16, ARROW_UINT32, ARROW_UINT64, ARROW_TIMESTAMP, 
+	ARROW_DURATION, ARROW_IPADDR, ARROW_UTF8 };
+
+typedef struct arrow_field_s {
+	char		*name;
+	uint32_t	type;			/* ARROW_UINT8 .. ARROW_UTF8 */
+	uint32_t	nullable;
+} arrow_field_t;
+
+typedef struct arrow_column_s {
+	uint8_t		*values;		/* fixed size values or utf8 data */
+	int32_t		*offsets;		/* utf8 offsets */
+	uint8_t		*validity;		/* validity bitmap of nullable columns */
+	size_t		size;			/* allocated size of values */
+	size_t		length;			/* used size of values */
+	uint32_t	width;			/* size of a fixed size value */
+	uint32_t	null_count;
+} arrow_column_t;
+
+/*
+ * One row of the element statistics. Unused optional values are
+ * written as null.
+ */
+typedef struct arrow_stat_s {
+	char		*stat;			/* name of -s stat */
+	char		*order;			/* name of the order */
+	uint64_t	first;			/* msec */
+	uint64_t	last;			/* msec */
+	uint32_t	time_slot;		/* -P slot or 0 */
+	uint32_t	has_proto;
+	uint8_t		prot;
+	uint32_t	key_type;		/* ARROW_KEY_NONE, _NUMBER or _IPADDR */
+	uint64_t	key[2];			/* stat key as in StatRecord_t */
+	uint32_t	ipv6;
+	uint64_t	flows;
+	uint64_t	packets;
+	uint64_t	bytes;
+	uint32_t	has_distinct;
+	uint64_t	distinct;
+	uint32_t	has_quantile;
+	uint64_t	quantile[3];	/* p50, p95, p99 */
+	uint32_t	has_error;
+	uint64_t	error;
+} arrow_stat_t;
+
+/* Function prototypes */
+int Arrow_Init(int format, int schema);
+
+void flow_record_to_arrow(void *record, char ** s, int tag);
+
+void Arrow_StatRecord(arrow_stat_t *stat);
+
+void Arrow_Batch(void);
+
+void Arrow_Close(void);
+
+#endif //_NFARROW_H
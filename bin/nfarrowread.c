@@ -0,0 +1,460 @@
+/*
+ *  This file is part of the nfdump project.
+ *
+ *  Copyright (c) 2014, the nfdump contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of SWITCH nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  $Author$
+ *
+ *  $Id$
+ *
+ *  $LastChangedRevision$
+ *
+
+/*
+ * nfarrowread is a minimal reader for the Arrow IPC files written by nfdump -o arrow
+ * and -o arrows. It is used by the test suite to verify the output without any
+ * Arrow library: for the file format it locates the footer and walks the schema and
+ * all record batches referenced by the footer, for the stream format it walks all
+ * messages up to the end of stream marker. It prints the schema, the number of rows
+ * and optionally the values of the selected columns as comma separated lines.
+ *
+ * nfarrowread [-c col,col,...] <file>
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+// Type union - see nfarrow.c
+#define Type_Int				2
+#define Type_Utf8				5
+#define Type_Timestamp			10
+#define Type_FixedSizeBinary	15
+#define Type_Duration			18
+
+#define MessageHeader_Schema		1
+#define MessageHeader_RecordBatch	3
+
+#define MaxArrowFields	64
+
+typedef struct field_s {
+	char		*name;
+	uint32_t	type;
+	uint32_t	width;		/* bytes per value - 0 for utf8 */
+	int			nullable;
+	int			print;		/* print position + 1 - 0 if not selected */
+} field_t;
+
+static uint8_t	*buf;
+static size_t	buf_size;
+
+static field_t	field[MaxArrowFields];
+static uint32_t	NumFields;
+
+/* function prototypes */
+static void usage(char *name);
+
+static uint64_t GetLE(uint64_t offset, uint32_t len);
+
+static uint64_t fb_Field(uint64_t table, uint32_t id);
+
+static uint64_t fb_Deref(uint64_t offset);
+
+static uint64_t fb_Vector(uint64_t table, uint32_t id, uint32_t *len);
+
+static void ReadSchema(uint64_t schema);
+
+static uint64_t ReadMessage(uint64_t offset, uint32_t header_type, uint64_t *body_length);
+
+static uint64_t ReadBatch(uint64_t offset, uint64_t metadata_length, int *print, uint32_t num_print);
+
+static void PrintValue(field_t *f, uint64_t validity, uint64_t validity_len, uint64_t offsets, uint64_t values, uint64_t row);
+
+static void usage(char *name) {
+	printf("usage %s [options] <file>\n"
+					"-h\t\tthis text you see right here.\n"
+					"-c <cols>\tPrint the values of the comma separated columns.\n"
+					, name);
+} /* usage */
+
+static void Corrupt(char *what) {
+
+	fprintf(stderr, "Corrupt arrow file: %s\n", what);
+	exit(255);
+
+} // End of Corrupt
+
+static uint64_t GetLE(uint64_t offset, uint32_t len) {
+uint64_t value = 0;
+
+	if ( offset + len > buf_size )
+		Corrupt("offset out of range");
+
+	while ( len-- )
+		value = (value << 8) | buf[offset + len];
+
+	return value;
+
+} // End of GetLE
+
+// returns the absolute offset of field id of the table - 0 if the field is not set
+static uint64_t fb_Field(uint64_t table, uint32_t id) {
+uint64_t vtable;
+uint32_t vtable_size, offset;
+
+	vtable		= table - (int32_t)GetLE(table, 4);
+	vtable_size = GetLE(vtable, 2);
+	if ( 4 + 2 * id >= vtable_size )
+		return 0;
+
+	offset = GetLE(vtable + 4 + 2 * id, 2);
+	return offset ? table + offset : 0;
+
+} // End of fb_Field
+
+static uint64_t fb_Deref(uint64_t offset) {
+
+	return offset + GetLE(offset, 4);
+
+} // End of fb_Deref
+
+// returns the absolute offset of the first element of the vector field id
+static uint64_t fb_Vector(uint64_t table, uint32_t id, uint32_t *len) {
+uint64_t vector = fb_Field(table, id);
+
+	if ( !vector ) {
+		*len = 0;
+		return 0;
+	}
+	vector = fb_Deref(vector);
+	*len = GetLE(vector, 4);
+	return vector + 4;
+
+} // End of fb_Vector
+
+static void ReadSchema(uint64_t schema) {
+uint64_t fields, f, type, name;
+uint32_t i, num;
+
+	fields = fb_Vector(schema, 1, &num);
+	if ( num == 0 || num > MaxArrowFields )
+		Corrupt("number of fields");
+
+	for ( i=0; i<num; i++ ) {
+		f = fb_Deref(fields + 4 * i);
+
+		name = fb_Field(f, 0);
+		if ( !name )
+			Corrupt("field without name");
+		name = fb_Deref(name);
+		field[i].name = strndup((char *)(buf + name + 4), GetLE(name, 4));
+
+		field[i].nullable = fb_Field(f, 1) ? GetLE(fb_Field(f, 1), 1) : 0;
+		field[i].type	  = fb_Field(f, 2) ? GetLE(fb_Field(f, 2), 1) : 0;
+		type = fb_Field(f, 3) ? fb_Deref(fb_Field(f, 3)) : 0;
+		switch (field[i].type) {
+			case Type_Int:
+				if ( !type || !fb_Field(type, 0) )
+					Corrupt("int without bitWidth");
+				field[i].width = GetLE(fb_Field(type, 0), 4) / 8;
+				break;
+			case Type_FixedSizeBinary:
+				if ( !type || !fb_Field(type, 0) )
+					Corrupt("binary without byteWidth");
+				field[i].width = GetLE(fb_Field(type, 0), 4);
+				break;
+			case Type_Timestamp:
+			case Type_Duration:
+				field[i].width = 8;
+				break;
+			case Type_Utf8:
+				field[i].width = 0;
+				break;
+			default:
+				Corrupt("unknown field type");
+		}
+	}
+	NumFields = num;
+
+} // End of ReadSchema
+
+static void PrintValue(field_t *f, uint64_t validity, uint64_t validity_len, uint64_t offsets, uint64_t values, uint64_t row) {
+char	 s[INET6_ADDRSTRLEN];
+uint64_t start, end;
+
+	if ( validity_len && ( GetLE(validity + ( row >> 3 ), 1) & ( 1 << ( row & 7 ) ) ) == 0 ) 
+		return;
+
+	switch (f->type) {
+		case Type_Utf8:
+			start = GetLE(offsets + 4 * row, 4);
+			end	  = GetLE(offsets + 4 * row + 4, 4);
+			if ( end < start || values + end > buf_size )
+				Corrupt("utf8 offsets");
+			printf("%.*s", (int)(end - start), (char *)(buf + values + start));
+			break;
+		case Type_FixedSizeBinary: {
+			uint8_t *addr = buf + values + 16 * row;
+			if ( f->width != 16 || values + 16 * row + 16 > buf_size )
+				Corrupt("binary value");
+			// IPv4 mapped IPv6 address
+			if ( memcmp(addr, "\0\0\0\0\0\0\0\0\0\0\xff\xff", 12) == 0 ) 
+				inet_ntop(AF_INET, addr + 12, s, sizeof(s));
+			else
+				inet_ntop(AF_INET6, addr, s, sizeof(s));
+			printf("%s", s);
+			} break;
+		default:
+			printf("%llu", (unsigned long long)GetLE(values + f->width * row, f->width));
+	}
+
+} // End of PrintValue
+
+// returns the header of the message at offset
+static uint64_t ReadMessage(uint64_t offset, uint32_t header_type, uint64_t *body_length) {
+uint64_t message;
+
+	if ( GetLE(offset, 4) != 0xFFFFFFFF )
+		Corrupt("missing continuation marker");
+
+	// Message: version, header_type, header, bodyLength
+	message = fb_Deref(offset + 8);
+	if ( !fb_Field(message, 1) || GetLE(fb_Field(message, 1), 1) != header_type )
+		Corrupt("unexpected message type");
+	if ( !fb_Field(message, 2) )
+		Corrupt("message without header");
+	if ( body_length )
+		*body_length = fb_Field(message, 3) ? GetLE(fb_Field(message, 3), 8) : 0;
+
+	return fb_Deref(fb_Field(message, 2));
+
+} // End of ReadMessage
+
+// read the record batch at offset - returns the number of rows
+static uint64_t ReadBatch(uint64_t offset, uint64_t metadata_length, int *print, uint32_t num_print) {
+uint64_t batch, nodes, buffers, body, rows;
+uint64_t validity[MaxArrowFields], validity_len[MaxArrowFields], offsets[MaxArrowFields], values[MaxArrowFields];
+uint32_t i, j, num_nodes, num_buffers, b;
+
+	batch = ReadMessage(offset, MessageHeader_RecordBatch, NULL);
+
+	rows	= fb_Field(batch, 0) ? GetLE(fb_Field(batch, 0), 8) : 0;
+	nodes	= fb_Vector(batch, 1, &num_nodes);
+	buffers = fb_Vector(batch, 2, &num_buffers);
+	if ( num_nodes != NumFields )
+		Corrupt("number of field nodes");
+
+	body = offset + metadata_length;
+	b = 0;
+	for ( i=0; i<NumFields; i++ ) {
+		// FieldNode: length, null_count
+		if ( GetLE(nodes + 16 * i, 8) != rows )
+			Corrupt("field node length");
+		if ( GetLE(nodes + 16 * i + 8, 8) && !field[i].nullable )
+			Corrupt("null values in a non nullable field");
+
+		// Buffer: offset, length
+		if ( b + ( field[i].width ? 2 : 3 ) > num_buffers )
+			Corrupt("number of buffers");
+		validity[i]		= body + GetLE(buffers + 16 * b, 8);
+		validity_len[i] = GetLE(buffers + 16 * b + 8, 8);
+		b++;
+		if ( field[i].width == 0 ) {
+			offsets[i] = body + GetLE(buffers + 16 * b, 8);
+			b++;
+		}
+		values[i] = body + GetLE(buffers + 16 * b, 8);
+		if ( field[i].width && GetLE(buffers + 16 * b + 8, 8) != rows * field[i].width )
+			Corrupt("values buffer length");
+		b++;
+	}
+	if ( b != num_buffers )
+		Corrupt("number of buffers");
+
+	for ( j=0; j<rows && num_print; j++ ) {
+		for ( i=0; i<num_print; i++ ) {
+			if ( i )
+				printf(",");
+			PrintValue(&field[print[i]], validity[print[i]], validity_len[print[i]], offsets[print[i]], values[print[i]], j);
+		}
+		printf("\n");
+	}
+
+	return rows;
+
+} // End of ReadBatch
+
+int main( int argc, char **argv ) {
+struct stat stat_buf;
+char	 *columns, *c;
+FILE	 *fp;
+uint64_t footer, footer_len, blocks, rows, offset, body_length;
+uint32_t i, num_blocks, num_print, stream;
+int		 print[MaxArrowFields];
+int		 ch;
+
+	columns = NULL;
+	while ((ch = getopt(argc, argv, "hc:")) != EOF) {
+		switch (ch) {
+			case 'h':
+				usage(argv[0]);
+				exit(0);
+				break;
+			case 'c':
+				columns = optarg;
+				break;
+			default:
+				usage(argv[0]);
+				exit(0);
+		}
+	}
+	if ( optind != argc - 1 ) {
+		usage(argv[0]);
+		exit(255);
+	}
+
+	fp = fopen(argv[optind], "r");
+	if ( !fp || fstat(fileno(fp), &stat_buf) ) {
+		fprintf(stderr, "Can't open '%s': %s\n", argv[optind], strerror(errno));
+		exit(255);
+	}
+	buf_size = stat_buf.st_size;
+	buf = malloc(buf_size ? buf_size : 1);
+	if ( !buf ) {
+		fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror (errno));
+		exit(255);
+	}
+	if ( fread(buf, 1, buf_size, fp) != buf_size ) {
+		fprintf(stderr, "fread() error: %s\n", strerror(errno));
+		exit(255);
+	}
+	fclose(fp);
+
+	// file: "ARROW1" padded to 8 bytes, stream, footer, int32 footer length, "ARROW1"
+	stream = buf_size < 8 || memcmp(buf, "ARROW1\0\0", 8) != 0;
+	footer = 0;
+	if ( stream ) {
+		ReadSchema(ReadMessage(0, MessageHeader_Schema, NULL));
+	} else {
+		if ( buf_size < 18 || memcmp(buf + buf_size - 6, "ARROW1", 6) != 0 )
+			Corrupt("missing magic");
+		footer_len = GetLE(buf_size - 10, 4);
+		if ( footer_len + 18 > buf_size )
+			Corrupt("footer length");
+		footer = buf_size - 10 - footer_len;
+
+		// Footer: version, schema, dictionaries, recordBatches
+		footer = footer + GetLE(footer, 4);
+		if ( !fb_Field(footer, 1) )
+			Corrupt("footer without schema");
+		ReadSchema(fb_Deref(fb_Field(footer, 1)));
+	}
+
+	num_print = 0;
+	if ( columns ) {
+		c = strtok(columns, ",");
+		while ( c ) {
+			for ( i=0; i<NumFields; i++ ) {
+				if ( strcmp(c, field[i].name) == 0 )
+					break;
+			}
+			if ( i == NumFields || num_print == MaxArrowFields ) {
+				fprintf(stderr, "Unknown column '%s'\n", c);
+				exit(255);
+			}
+			print[num_print++] = i;
+			c = strtok(NULL, ",");
+		}
+	} else {
+		printf("fields:");
+		for ( i=0; i<NumFields; i++ ) {
+			switch (field[i].type) {
+				case Type_Int:
+					printf(" %s:uint%u", field[i].name, 8 * field[i].width);
+					break;
+				case Type_Utf8:
+					printf(" %s:utf8", field[i].name);
+					break;
+				case Type_Timestamp:
+					printf(" %s:timestamp", field[i].name);
+					break;
+				case Type_Duration:
+					printf(" %s:duration", field[i].name);
+					break;
+				case Type_FixedSizeBinary:
+					printf(" %s:binary%u", field[i].name, field[i].width);
+					break;
+			}
+			if ( field[i].nullable )
+				printf("?");
+		}
+		printf("\n");
+	}
+
+	rows = 0;
+	if ( stream ) {
+		// all record batches follow the schema up to the end of stream marker
+		num_blocks = 0;
+		offset = 8 + GetLE(4, 4);
+		while ( GetLE(offset + 4, 4) != 0 ) {
+			ReadMessage(offset, MessageHeader_RecordBatch, &body_length);
+			rows += ReadBatch(offset, 8 + GetLE(offset + 4, 4), print, num_print);
+			offset += 8 + GetLE(offset + 4, 4) + body_length;
+			num_blocks++;
+		}
+		if ( GetLE(offset, 4) != 0xFFFFFFFF || offset + 8 != buf_size )
+			Corrupt("end of stream marker");
+	} else {
+		// Block: offset, metaDataLength, bodyLength
+		blocks = fb_Vector(footer, 3, &num_blocks);
+		for ( i=0; i<num_blocks; i++ ) 
+			rows += ReadBatch(GetLE(blocks + 24 * i, 8), GetLE(blocks + 24 * i + 8, 4), print, num_print);
+	}
+
+	if ( !columns ) 
+		printf("batches: %u\nrows: %llu\n", num_blocks, (unsigned long long)rows);
+
+	free(buf);
+	for ( i=0; i<NumFields; i++ )
+		free(field[i].name);
+
+	return 0;
+
+} // End of main
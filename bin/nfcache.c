@@ -0,0 +1,379 @@
+/*
+ *  This file is part of the nfdump project.
+ *
+ *  Copyright (c) 2014, the nfdump contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of SWITCH nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  $Author$
+ *
+ *  $Id$
+ *
+ *  $LastChangedRevision$
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/param.h>
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "nffile.h"
+#include "nfcache.h"
+
+#define FNV_PRIME	0x100000001B3LL
+
+typedef struct cache_entry_s {
+	char		*name;
+	time_t		mtime;
+	off_t		size;
+} cache_entry_t;
+
+static struct cache_s {
+	char		dir[MAXPATHLEN];
+	char		file[MAXPATHLEN];
+	char		tmpfile[MAXPATHLEN];
+	uint64_t	maxsize;
+	uint64_t	digest[2];
+	int			stdout_fd;
+	int			done;
+} cache;
+
+/* function prototypes */
+static void Digest(void *data, size_t len);
+
+static int CopyData(int in_fd, int out_fd);
+
+static int CacheCMP(const void *p1, const void *p2);
+
+static void CacheExpire(void);
+
+static void CacheClose(void);
+
+/* Functions */
+
+// two FNV-1a hashes with different offset bases - 128bit of digest
+static void Digest(void *data, size_t len) {
+uint8_t *p = (uint8_t *)data;
+size_t	i;
+
+	for ( i=0; i<len; i++ ) {
+		cache.digest[0] = ( cache.digest[0] ^ p[i] ) * FNV_PRIME;
+		cache.digest[1] = ( cache.digest[1] ^ p[i] ) * FNV_PRIME;
+	}
+	// length as separator, so that "ab","c" differs from "a","bc"
+	cache.digest[0] = ( cache.digest[0] ^ len ) * FNV_PRIME;
+	cache.digest[1] = ( cache.digest[1] ^ len ) * FNV_PRIME;
+
+} // End of Digest
+
+static int CopyData(int in_fd, int out_fd) {
+char	buff[65536];
+ssize_t	ret;
+
+	while ( ( ret = read(in_fd, buff, sizeof(buff)) ) != 0 ) {
+		char *p = buff;
+		if ( ret < 0 ) {
+			if ( errno == EINTR )
+				continue;
+			return 0;
+		}
+		while ( ret ) {
+			ssize_t num = write(out_fd, p, ret);
+			if ( num < 0 ) {
+				if ( errno == EINTR )
+					continue;
+				return 0;
+			}
+			p   += num;
+			ret -= num;
+		}
+	}
+	return 1;
+
+} // End of CopyData
+
+int CacheInit(char *option) {
+struct stat stat_buf;
+char	*s, *end;
+
+	cache.maxsize	= CacheDefaultSize;
+	cache.stdout_fd = -1;
+	cache.done		= 0;
+	cache.file[0]	= '\0';
+
+	strncpy(cache.dir, option, MAXPATHLEN-1);
+	cache.dir[MAXPATHLEN-1] = '\0';
+
+	// optional max size: <dir>:<size>[K|M|G]
+	s = strrchr(cache.dir, ':');
+	if ( s ) {
+		*s++ = '\0';
+		cache.maxsize = strtoull(s, &end, 10);
+		switch (*end) {
+			case 'k':
+			case 'K':
+				cache.maxsize *= 1024LL;
+				end++;
+				break;
+			case 'm':
+			case 'M':
+				cache.maxsize *= 1024LL * 1024LL;
+				end++;
+				break;
+			case 'g':
+			case 'G':
+				cache.maxsize *= 1024LL * 1024LL * 1024LL;
+				end++;
+				break;
+		}
+		if ( *end != '\0' || cache.maxsize == 0 ) {
+			fprintf(stderr, "Invalid cache size '%s'\n", s);
+			return 0;
+		}
+	}
+
+	if ( stat(cache.dir, &stat_buf) || !S_ISDIR(stat_buf.st_mode) ) {
+		fprintf(stderr, "Cache directory '%s' does not exist\n", cache.dir);
+		return 0;
+	}
+
+	return 1;
+
+} // End of CacheInit
+
+/*
+ * Returns 1, if the query was answered from the cache, otherwise 0. In the later case
+ * stdout is redirected into a temporary file, which becomes the cache entry, if the
+ * query completes with CacheDone(). Any output is passed to the real stdout at exit.
+ */
+int CacheLookup(int argc, char **argv, char *filter, char **files, int num_files) {
+struct stat stat_buf;
+char	*s;
+int		i, fd;
+
+	cache.digest[0] = 0xCBF29CE484222325LL;
+	cache.digest[1] = 0x84222325CBF29CE4LL;
+
+	Digest(VERSION, strlen(VERSION));
+	for ( i=1; i<argc; i++ ) 
+		Digest(argv[i], strlen(argv[i]));
+
+	// the filter text - a filter file may change under the same name
+	if ( filter ) 
+		Digest(filter, strlen(filter));
+
+	// time strings are printed in local time
+	s = getenv("TZ");
+	if ( s ) 
+		Digest(s, strlen(s));
+
+	for ( i=0; i<num_files; i++ ) {
+		uint64_t	file_stat[3];
+		// stdin and files still written by a collector are not cached
+		if ( !files[i] ) 
+			return 0;
+		s = strrchr(files[i], '/');
+		s = s ? s+1 : files[i];
+		if ( strncmp(s, NF_DUMPFILE, strlen(NF_DUMPFILE)) == 0 )
+			return 0;
+		if ( stat(files[i], &stat_buf) ) 
+			return 0;
+
+		file_stat[0] = stat_buf.st_size;
+		file_stat[1] = stat_buf.st_mtime;
+		file_stat[2] = stat_buf.st_ino;
+		Digest(files[i], strlen(files[i]));
+		Digest(file_stat, sizeof(file_stat));
+	}
+
+	// run uncached, if the cache path does not fit
+	if ( snprintf(cache.file, MAXPATHLEN, "%s/%s%016llx%016llx", cache.dir, CachePrefix,
+		(unsigned long long)cache.digest[0], (unsigned long long)cache.digest[1]) >= MAXPATHLEN ) 
+		return 0;
+
+	fd = open(cache.file, O_RDONLY);
+	if ( fd >= 0 ) {
+		fflush(stdout);
+		if ( !CopyData(fd, STDOUT_FILENO) ) {
+			fprintf(stderr, "Failed to copy cache file '%s': %s\n", cache.file, strerror(errno));
+			close(fd);
+			return 0;
+		}
+		close(fd);
+		// most recently used
+		utime(cache.file, NULL);
+		return 1;
+	}
+
+	if ( snprintf(cache.tmpfile, MAXPATHLEN, "%s/.%s%lu", cache.dir, CachePrefix, (unsigned long)getpid()) >= MAXPATHLEN ) 
+		return 0;
+	fd = open(cache.tmpfile, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if ( fd < 0 ) {
+		fprintf(stderr, "Can't create cache file '%s': %s\n", cache.tmpfile, strerror(errno));
+		return 0;
+	}
+
+	fflush(stdout);
+	cache.stdout_fd = dup(STDOUT_FILENO);
+	if ( cache.stdout_fd < 0 || dup2(fd, STDOUT_FILENO) < 0 ) {
+		fprintf(stderr, "Can't redirect stdout: %s\n", strerror(errno));
+		if ( cache.stdout_fd >= 0 )
+			close(cache.stdout_fd);
+		cache.stdout_fd = -1;
+		close(fd);
+		unlink(cache.tmpfile);
+		return 0;
+	}
+	close(fd);
+	atexit(CacheClose);
+
+	return 0;
+
+} // End of CacheLookup
+
+void CacheDone(void) {
+
+	cache.done = 1;
+
+} // End of CacheDone
+
+static void CacheClose(void) {
+struct stat stat_buf;
+int		fd;
+
+	if ( cache.stdout_fd < 0 )
+		return;
+
+	fflush(stdout);
+	fd = dup(STDOUT_FILENO);
+	dup2(cache.stdout_fd, STDOUT_FILENO);
+	close(cache.stdout_fd);
+	cache.stdout_fd = -1;
+
+	// pass the output on in any case
+	lseek(fd, 0, SEEK_SET);
+	if ( !CopyData(fd, STDOUT_FILENO) ) 
+		fprintf(stderr, "write() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+
+	// keep only results of completed queries, which fit into the cache
+	if ( cache.done && fstat(fd, &stat_buf) == 0 && (uint64_t)stat_buf.st_size <= cache.maxsize ) {
+		close(fd);
+		if ( rename(cache.tmpfile, cache.file) < 0 ) {
+			fprintf(stderr, "rename() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+			unlink(cache.tmpfile);
+		}
+		CacheExpire();
+	} else {
+		close(fd);
+		unlink(cache.tmpfile);
+	}
+
+} // End of CacheClose
+
+static int CacheCMP(const void *p1, const void *p2) {
+cache_entry_t *e1 = (cache_entry_t *)p1;
+cache_entry_t *e2 = (cache_entry_t *)p2;
+
+	if ( e1->mtime == e2->mtime )
+		return 0;
+	return e1->mtime < e2->mtime ? -1 : 1;
+
+} // End of CacheCMP
+
+// remove the least recently used entries, until the cache fits into its max size
+static void CacheExpire(void) {
+DIR				*dir;
+struct dirent	*de;
+cache_entry_t	*entries;
+uint64_t		total;
+uint32_t		num, max, i;
+char			path[MAXPATHLEN];
+
+	dir = opendir(cache.dir);
+	if ( !dir ) 
+		return;
+
+	num = 0;
+	max = 256;
+	total = 0;
+	entries = (cache_entry_t *)malloc(max * sizeof(cache_entry_t));
+	if ( !entries ) {
+		fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		closedir(dir);
+		return;
+	}
+
+	while ( ( de = readdir(dir) ) != NULL ) {
+		struct stat stat_buf;
+		if ( strncmp(de->d_name, CachePrefix, strlen(CachePrefix)) != 0 )
+			continue;
+		if ( snprintf(path, MAXPATHLEN, "%s/%s", cache.dir, de->d_name) >= MAXPATHLEN || stat(path, &stat_buf) )
+			continue;
+		if ( num == max ) {
+			cache_entry_t *p;
+			max <<= 1;
+			p = (cache_entry_t *)realloc(entries, max * sizeof(cache_entry_t));
+			if ( !p ) {
+				fprintf(stderr, "realloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+				break;
+			}
+			entries = p;
+		}
+		entries[num].name  = strdup(de->d_name);
+		entries[num].mtime = stat_buf.st_mtime;
+		entries[num].size  = stat_buf.st_size;
+		total += stat_buf.st_size;
+		num++;
+	}
+	closedir(dir);
+
+	if ( total > cache.maxsize ) {
+		qsort(entries, num, sizeof(cache_entry_t), CacheCMP);
+		for ( i=0; i<num && total > cache.maxsize; i++ ) {
+			if ( snprintf(path, MAXPATHLEN, "%s/%s", cache.dir, entries[i].name) < MAXPATHLEN && unlink(path) == 0 ) 
+				total -= entries[i].size;
+		}
+	}
+
+	for ( i=0; i<num; i++ ) 
+		free(entries[i].name);
+	free(entries);
+
+} // End of CacheExpire
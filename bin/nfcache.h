@@ -0,0 +1,68 @@
+/*
+ *  This file is part of the nfdump project.
+ *
+ *  Copyright (c) 2014, the nfdump contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of SWITCH nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  $Author$
+ *
+ *  $Id$
+ *
+ *  $LastChangedRevision$
+ *
+ */
+
+#ifndef _NFCACHE_H
+#define _NFCACHE_H 1
+
+/* Definitions */
+
+/*
+ * Query result cache
+ * Dashboards tend to run the same statistics queries over the same rotated files again
+ * and again. With -C <dir>, nfdump keeps the output of -s, -A and -a queries in a cache
+ * directory. The cache key is a digest over the command line, the filter, the time zone
+ * and name, size and modification time of every input file. A query over the same,
+ * unchanged files is answered from the cache without reading any data. Queries reading
+ * stdin or any nfcapd.current file are never cached. The cache directory is bounded by
+ * size: if it grows beyond the limit, the least recently used results are removed.
+ */
+
+// default max size of the cache directory
+#define CacheDefaultSize	(256LL * 1024LL * 1024LL)
+
+// prefix of all cache files
+#define CachePrefix		"nfcache-"
+
+/* Function prototypes */
+int CacheInit(char *option);
+
+int CacheLookup(int argc, char **argv, char *filter, char **files, int num_files);
+
+void CacheDone(void);
+
+#endif //_NFCACHE_H
@@ -72,6 +72,7 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <dirent.h>
+#include <pthread.h>
 
 #ifdef PCAP
 #include "pcap_reader.h"
@@ -109,6 +110,8 @@
 #endif
 
 #include "expire.h"
+#include "nfrollup.h"
+#include "repeater.h"
 
 #define DEFAULTCISCOPORT "9995"
 #define DEFAULTHOSTNAME "127.0.0.1"
@@ -137,6 +140,80 @@ static int done, launcher_alive, periodic_trigger, launcher_pid;
 
 static const char *nfdump_version = VERSION;
 
+// file of a flow source, completed by the closer thread
+typedef struct closing_file_s {
+	struct closing_file_s	*next;
+	FlowSource_t			*fs;
+	nffile_t				*nffile;				// NULL, if already completed
+	uint32_t				bad_packets;
+	int						renamed;
+	char					filename[MAXPATHLEN];	// temporary name of the file
+} closing_file_t;
+
+// all files of a time slot
+typedef struct rotation_job_s {
+	struct rotation_job_s	*next;
+	closing_file_t			*files;
+	time_t					t_start;
+	struct tm				now;
+	char					subfilename[64];
+	char					*subdir;
+	char					subdir_buff[256];
+} rotation_job_t;
+
+static struct closer_s {
+	pthread_t			tid;
+	pthread_mutex_t		mutex;
+	pthread_cond_t		cond;
+	rotation_job_t		*first;
+	rotation_job_t		*last;
+	int					done;
+} closer;
+
+/*
+ * Hot restart ( -U socket )
+ * A new collector, started with the same socket path, connects to the running collector.
+ * The running collector stops receiving, closes the files of the current time slot in place,
+ * saves its template cache and passes its receive sockets and the state of its flow sources to
+ * the new collector, before it terminates as usual. The new collector waits for the old one to 
+ * terminate, continues the files of the time slot and receives on the same sockets, so all
+ * datagrams received in between are queued in the socket buffers.
+ */
+#define HANDOFF_MAGIC		0xA510
+#define HANDOFF_VERSION		1
+#define MAX_HANDOFF_SOCKETS	256
+
+typedef struct handoff_header_s {
+	uint16_t	magic;
+	uint16_t	version;
+	uint32_t	num_sockets;
+	uint32_t	num_sources;
+	uint32_t	fill;
+	uint64_t	t_start;		// time slot of the files handed over
+} handoff_header_t;
+
+typedef struct handoff_source_s {
+	char		datadir[MAXPATHLEN];
+	char		current[MAXPATHLEN];	// file of the current time slot
+	ip_addr_t	ip;						// exporter IP of a dynamic source
+	uint32_t	sa_family;
+	uint32_t	bad_packets;
+	uint64_t	first_seen;
+	uint64_t	last_seen;
+} handoff_source_t;
+
+static struct handoff_s {
+	char				*path;			// unix socket path
+	int					listen_sock;
+	int					sock;			// connection to the new collector
+	pthread_t			main_tid;
+	int					active;			// hand over at the end of this run
+	time_t				t_start;
+	// flow sources received from the previous collector
+	handoff_source_t	*sources;
+	uint32_t			num_sources;
+} handoff;
+
 
 /* Local function Prototypes */
 static void usage(char *name);
@@ -151,9 +228,56 @@ static void daemonize(void);
 
 static void SetPriv(char *userid, char *groupid );
 
-static void run(packet_function_t receive_packet, int socket, send_peer_t peer, 
+static struct tm *GetSubFilename(time_t t_start, int use_subdirs, char *subfilename, char **subdir);
+
+static rotation_job_t *NewRotationJob(time_t t_start, int use_subdirs);
+
+static closing_file_t *RotateFlowSource(FlowSource_t *fs, rotation_job_t *job, time_t twin, int compress, int reopen);
+
+static int CompleteFile(closing_file_t *cf, rotation_job_t *job);
+
+static void *CloserThread(void *arg);
+
+static void StartCloser(void);
+
+static void SubmitRotationJob(rotation_job_t *job);
+
+static void StopCloser(void);
+
+static void SignalLauncher(srecord_t *commbuff, char *subfilename, char *subdir, struct tm *now, time_t t_start);
+
+static void *HandoffThread(void *arg);
+
+static int StartHandoff(void);
+
+static int HandoffRequested(void);
+
+static void HandoffFlowSource(FlowSource_t *fs);
+
+static void SendHandoff(int *sockets, int num_sockets);
+
+static int TakeOver(int **sockets, int *num_sockets);
+
+static void AdoptSourceFiles(int compress);
+
+static void SaveTemplateCache(FlowSource_t *fs);
+
+static void LoadTemplateCache(FlowSource_t *fs);
+
+static int ProcessPacket(FlowSource_t *fs, void *in_buff, ssize_t cnt);
+
+static int OpenSourceFiles(int compress, int do_xstat);
+
+static FlowSource_t *NewDynamicSource(struct sockaddr_storage *sender, int compress, int *fatal);
+
+static void run(packet_function_t receive_packet, int socket, 
 	time_t twin, time_t t_begin, int report_seq, int use_subdirs, int compress, int do_xstat);
 
+#ifndef PCAP
+static void run_threaded(int *sockets, int num_receivers, int num_workers, 
+	time_t twin, time_t t_begin, int use_subdirs, int compress, int do_xstat);
+#endif
+
 /* Functions */
 static void usage(char *name) {
 		printf("usage %s [options] \n"
@@ -171,11 +295,14 @@ static void usage(char *name) {
 					"-H Add port histogram data to flow file.(default 'no')\n"
 					"-n Ident,IP,logdir\tAdd this flow source - multiple streams\n" 
 					"-P pidfile\tset the PID file\n"
-					"-R IP[/port]\tRepeat incoming packets to IP address/port\n"
+					"-R IP[/port][@exporter,...]\tRepeat incoming packets [of exporters] to IP address/port. Multiple -R allowed\n"
 					"-s rate\tset default sampling rate (default 1)\n"
 					"-x process\tlaunch process after a new file becomes available\n"
 					"-z\t\tCompress flows in output file.\n"
+					"-k stats[:K]\tAppend top K rollups of stats to each flow file. see nfcapd(1)\n"
 					"-B bufflen\tSet socket buffer to bufflen bytes\n"
+					"-W workers[:receivers]\tDecode in workers threads, receive in receivers threads\n"
+					"-U socket\tHot restart: take over from the nfcapd listening on unix socket\n"
 					"-e\t\tExpire data at each cycle.\n"
 					"-D\t\tFork to background\n"
 					"-E\t\tPrint extended format of netflow data. for debugging purpose only.\n"
@@ -355,12 +482,890 @@ int		err;
 		}
 	}
 
-} // End of SetPriv
+} // End of SetPriv
+
+#include "nffile_inline.c"
+#include "collector_inline.c"
+
+static struct tm *GetSubFilename(time_t t_start, int use_subdirs, char *subfilename, char **subdir) {
+struct  tm *now;
+
+	now = localtime(&t_start);
+
+	// prepare sub dir hierarchy
+	if ( use_subdirs ) {
+		*subdir = GetSubDir(now);
+		if ( !*subdir ) {
+			// failed to generate subdir path - put flows into base directory
+			LogError("Failed to create subdir path!");
+	
+			// failed to generate subdir path - put flows into base directory
+			*subdir = NULL;
+			snprintf(subfilename, 63, "nfcapd.%i%02i%02i%02i%02i",
+				now->tm_year + 1900, now->tm_mon + 1, now->tm_mday, now->tm_hour, now->tm_min);
+		} else {
+			snprintf(subfilename, 63, "%s/nfcapd.%i%02i%02i%02i%02i", *subdir,
+				now->tm_year + 1900, now->tm_mon + 1, now->tm_mday, now->tm_hour, now->tm_min);
+		}
+	} else {
+		*subdir = NULL;
+		snprintf(subfilename, 63, "nfcapd.%i%02i%02i%02i%02i",
+			now->tm_year + 1900, now->tm_mon + 1, now->tm_mday, now->tm_hour, now->tm_min);
+	}
+	subfilename[63] = '\0';
+
+	return now;
+
+} // End of GetSubFilename
+
+/*
+ * Asynchronous file rotation
+ * At the end of a time slot, the .current file of each flow source is renamed to a 
+ * temporary name and a new .current file is opened, so collecting continues right away.
+ * The closer thread completes the files of the time slot in the background - last data 
+ * block, file header, rollups, sub directories, final rename and books - and signals 
+ * the launcher, as soon as all files of the time slot are done.
+ */
+static rotation_job_t *NewRotationJob(time_t t_start, int use_subdirs) {
+rotation_job_t	*job;
+char			*subdir;
+
+	job = (rotation_job_t *)calloc(1, sizeof(rotation_job_t));
+	if ( !job ) {
+		LogError("calloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		exit(255);
+	}
+
+	job->now	 = *GetSubFilename(t_start, use_subdirs, job->subfilename, &subdir);
+	job->t_start = t_start;
+	if ( subdir ) {
+		strncpy(job->subdir_buff, subdir, sizeof(job->subdir_buff) - 1);
+		job->subdir = job->subdir_buff;
+	} else 
+		job->subdir = NULL;
+
+	return job;
+
+} // End of NewRotationJob
+
+/*
+ * Finish the current file of flow source fs for the time slot of job and open a new file,
+ * if reopen is set. The old file is returned to be completed by CompleteFile().
+ */
+static closing_file_t *RotateFlowSource(FlowSource_t *fs, rotation_job_t *job, time_t twin, int compress, int reopen) {
+closing_file_t	*cf;
+nffile_t		*nffile = fs->nffile;
+char			*string;
+
+	// the flow source failed to open a new file before
+	if ( !nffile ) 
+		return NULL;
+
+	cf = (closing_file_t *)calloc(1, sizeof(closing_file_t));
+	if ( !cf ) {
+		LogError("calloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		return NULL;
+	}
+
+	if ( verbose ) {
+		// Dump to stdout
+		format_file_block_header(nffile->block_header, &string, 0);
+		printf("%s\n", string);
+	}
+
+	// update stat record
+	// if no flows were collected, fs->last_seen is still 0
+	// set first_seen to start of this time slot, with twin window size.
+	if ( fs->last_seen == 0 ) {
+		fs->first_seen = (uint64_t)1000 * (uint64_t)job->t_start;
+		fs->last_seen  = (uint64_t)1000 * (uint64_t)(job->t_start + twin);
+	}
+	nffile->stat_record->first_seen = fs->first_seen/1000;
+	nffile->stat_record->msec_first	= fs->first_seen - nffile->stat_record->first_seen*1000;
+	nffile->stat_record->last_seen 	= fs->last_seen/1000;
+	nffile->stat_record->msec_last	= fs->last_seen - nffile->stat_record->last_seen*1000;
+
+	if ( fs->xstat ) {
+		if ( WriteExtraBlock(nffile, fs->xstat->block_header ) <= 0 ) 
+			LogError("Ident: %s, failed to write xstat buffer to disk: '%s'" , fs->Ident, strerror(errno));
+
+		ResetPortHistogram(fs->xstat->port_histogram);
+		ResetBppHistogram(fs->xstat->bpp_histogram);
+	}
+
+	// Flush Exporter Stat to file
+	FlushExporterStats(fs);
+
+	SaveTemplateCache(fs);
+
+	cf->fs			= fs;
+	cf->nffile		= nffile;
+	cf->bad_packets = fs->bad_packets;
+
+	// reset stats
+	fs->bad_packets = 0;
+	fs->first_seen  = 0xffffffffffffLL;
+	fs->last_seen 	= 0;
+	fs->nffile		= NULL;
+
+	// move the file out of the way of the new .current file
+	snprintf(cf->filename, MAXPATHLEN-1, "%s.%lu", fs->current, (unsigned long)job->t_start);
+	cf->filename[MAXPATHLEN-1] = '\0';
+	if ( rename(fs->current, cf->filename) ) {
+		// complete the file right here
+		LogError("Ident: %s, Can't rename dump file: %s", fs->Ident,  strerror(errno));
+		strncpy(cf->filename, fs->current, MAXPATHLEN-1);
+		cf->renamed = CompleteFile(cf, job);
+		cf->nffile	= NULL;
+	}
+
+	if ( reopen ) {
+		fs->nffile = OpenNewFile(fs->current, NULL, compress, 0, NULL);
+		if ( !fs->nffile ) {
+			LogError("killed due to fatal error: ident: %s", fs->Ident);
+			done = 1;
+			return cf;
+		}
+		/* XXX needs fixing */
+		if ( fs->xstat ) {
+			// to be implemented
+		}
+
+		// Dump all extension maps and exporters to the buffer
+		FlushStdRecords(fs);
+	}
+
+	return cf;
+
+} // End of RotateFlowSource
+
+/*
+ * Complete a file returned by RotateFlowSource() and move it to its final name. 
+ * Returns 1, if the file was renamed successfully, 0 otherwise.
+ */
+static int CompleteFile(closing_file_t *cf, rotation_job_t *job) {
+FlowSource_t *fs = cf->fs;
+nffile_t	*nffile = cf->nffile;
+char		nfcapd_filename[MAXPATHLEN];
+char		error[255];
+int			err;
+
+	if ( nffile->block_header->NumRecords ) {
+		// flush current buffer to disc
+		if ( WriteBlock(nffile) <= 0 )
+			LogError("Ident: %s, failed to write output buffer to disk: '%s'" , fs->Ident, strerror(errno));
+	} // else - no new records in current block
+
+	// prepare filename
+	snprintf(nfcapd_filename, MAXPATHLEN-1, "%s/%s", fs->datadir, job->subfilename);
+	nfcapd_filename[MAXPATHLEN-1] = '\0';
+
+	// Close file
+	CloseUpdateFile(nffile, fs->Ident);
+	// Append rollups of the closed file, if requested
+	if ( !WriteRollups(cf->filename) )
+		LogError("Ident: %s, failed to write rollups", fs->Ident);
+
+	if ( job->subdir && !SetupSubDir(fs->datadir, job->subdir, error, 255) ) {
+		// in this case the flows get lost! - the rename will fail
+		// but this should not happen anyway, unless i/o problems, inode problems etc.
+		LogError("Ident: %s, Failed to create sub hier directories: %s", fs->Ident, error );
+	}
+
+	// if rename fails, we are in big trouble, as we need to get rid of the old .current file
+	// otherwise, we will loose flows and can not continue collecting new flows
+	err = rename(cf->filename, nfcapd_filename);
+	if ( err ) {
+		LogError("Ident: %s, Can't rename dump file: %s", fs->Ident,  strerror(errno));
+		LogError("Ident: %s, Serious Problem! Fix manually", fs->Ident);
+
+		// we do not update the books here, as the file failed to rename properly
+		// otherwise the books may be wrong
+	} else {
+		struct stat	fstat;
+
+		// Update books
+		stat(nfcapd_filename, &fstat);
+		UpdateBooks(fs->bookkeeper, job->t_start, 512*fstat.st_blocks);
+
+		// Update file index, if the data directory is indexed
+		AppendIndex(fs->datadir, job->subfilename, job->t_start);
+	}
+
+	// log stats
+	LogInfo("Ident: '%s' Flows: %llu, Packets: %llu, Bytes: %llu, Sequence Errors: %u, Bad Packets: %u", 
+		fs->Ident, (unsigned long long)nffile->stat_record->numflows, (unsigned long long)nffile->stat_record->numpackets, 
+		(unsigned long long)nffile->stat_record->numbytes, nffile->stat_record->sequence_failure, cf->bad_packets);
+
+	DisposeFile(nffile);
+
+	return err == 0;
+
+} // End of CompleteFile
+
+static void *CloserThread(void *arg) {
+srecord_t		*commbuff = (srecord_t *)shmem;
+rotation_job_t	*job;
+closing_file_t	*cf;
+int				failed;
+
+	while ( 1 ) {
+		pthread_mutex_lock(&closer.mutex);
+		while ( !closer.first && !closer.done ) 
+			pthread_cond_wait(&closer.cond, &closer.mutex);
+		job = closer.first;
+		if ( job ) {
+			closer.first = job->next;
+			if ( !closer.first ) 
+				closer.last = NULL;
+		}
+		pthread_mutex_unlock(&closer.mutex);
+
+		// all jobs done and no more to come
+		if ( !job ) 
+			break;
+
+		failed = 0;
+		while ( job->files ) {
+			cf = job->files;
+			if ( cf->nffile ) 
+				cf->renamed = CompleteFile(cf, job);
+			failed |= !cf->renamed;
+			job->files = cf->next;
+			free(cf);
+		}
+
+		// All files of the time slot completed - signal launcher if required
+		if ( launcher_pid ) {
+			commbuff->failed = failed;
+			SignalLauncher(commbuff, job->subfilename, job->subdir, &job->now, job->t_start);
+		}
+		free(job);
+	}
+
+	return NULL;
+
+} // End of CloserThread
+
+static void StartCloser(void) {
+sigset_t	signal_set, old_set;
+int			err;
+
+	memset((void *)&closer, 0, sizeof(closer));
+	pthread_mutex_init(&closer.mutex, NULL);
+	pthread_cond_init(&closer.cond, NULL);
+
+	// all signals are handled by the main thread
+	sigfillset(&signal_set);
+	pthread_sigmask(SIG_BLOCK, &signal_set, &old_set);
+	err = pthread_create(&closer.tid, NULL, CloserThread, NULL);
+	pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+	if ( err ) {
+		LogError("pthread_create() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(err) );
+		exit(255);
+	}
+
+} // End of StartCloser
+
+static void SubmitRotationJob(rotation_job_t *job) {
+
+	pthread_mutex_lock(&closer.mutex);
+	if ( closer.last ) 
+		closer.last->next = job;
+	else
+		closer.first = job;
+	closer.last = job;
+	pthread_cond_signal(&closer.cond);
+	pthread_mutex_unlock(&closer.mutex);
+
+} // End of SubmitRotationJob
+
+// complete all submitted jobs and terminate the closer
+static void StopCloser(void) {
+
+	pthread_mutex_lock(&closer.mutex);
+	closer.done = 1;
+	pthread_cond_signal(&closer.cond);
+	pthread_mutex_unlock(&closer.mutex);
+
+	pthread_join(closer.tid, NULL);
+
+} // End of StopCloser
+
+
+static void SignalLauncher(srecord_t *commbuff, char *subfilename, char *subdir, struct tm *now, time_t t_start) {
+
+	// prepare filename for %f expansion
+	strncpy(commbuff->fname, subfilename, FNAME_SIZE-1);
+	commbuff->fname[FNAME_SIZE-1] = 0;
+	snprintf(commbuff->tstring, 16, "%i%02i%02i%02i%02i", 
+		now->tm_year + 1900, now->tm_mon + 1, now->tm_mday, now->tm_hour, now->tm_min);
+	commbuff->tstring[15] = 0;
+	commbuff->tstamp = t_start;
+	if ( subdir ) 
+		strncpy(commbuff->subdir, subdir, FNAME_SIZE);
+	else
+		commbuff->subdir[0] = '\0';
+
+	if ( launcher_alive ) {
+		LogInfo("Signal launcher");
+		kill(launcher_pid, SIGHUP);
+	} else 
+		LogError("ERROR: Launcher did unexpectedly!");
+
+} // End of SignalLauncher
+
+/*
+ * Write the v9 and IPFIX templates of all exporters of flow source fs to the template cache
+ * Called by the thread owning the flow source only
+ */
+static void SaveTemplateCache(FlowSource_t *fs) {
+template_cache_header_t header;
+char	cachefile[MAXPATHLEN], tmpfile[MAXPATHLEN];
+FILE	*fd;
+int		num_v9, num_ipfix;
+
+	if ( snprintf(cachefile, MAXPATHLEN, "%s/%s", fs->datadir, TEMPLATE_CACHE) >= MAXPATHLEN ||
+		 snprintf(tmpfile, MAXPATHLEN, "%s.%lu", cachefile, (unsigned long)getpid()) >= MAXPATHLEN ) {
+		LogError("Ident: %s, Template cache path too long", fs->Ident);
+		return;
+	}
+
+	fd = fopen(tmpfile, "w");
+	if ( !fd ) {
+		LogError("Ident: %s, Can't open template cache '%s': %s", fs->Ident, tmpfile, strerror(errno));
+		return;
+	}
+
+	memset((void *)&header, 0, sizeof(header));
+	header.magic	= TEMPLATE_CACHE_MAGIC;
+	header.version	= TEMPLATE_CACHE_VERSION;
+	num_v9	  = 0;
+	num_ipfix = 0;
+	if ( fwrite((void *)&header, sizeof(header), 1, fd) != 1 ||
+		 (num_v9 = Save_v9_templates(fs, fd)) < 0 || (num_ipfix = Save_ipfix_templates(fs, fd)) < 0 ) {
+		LogError("Ident: %s, Failed to write template cache '%s'", fs->Ident, tmpfile);
+		fclose(fd);
+		unlink(tmpfile);
+		return;
+	}
+
+	if ( fclose(fd) ) {
+		LogError("Ident: %s, Failed to write template cache '%s': %s", fs->Ident, tmpfile, strerror(errno));
+		unlink(tmpfile);
+		return;
+	}
+
+	// no v9 or IPFIX exporter seen so far - keep a previous cache
+	if ( (num_v9 + num_ipfix) == 0 ) {
+		unlink(tmpfile);
+		return;
+	}
+
+	if ( rename(tmpfile, cachefile) ) {
+		LogError("Ident: %s, Can't rename template cache '%s': %s", fs->Ident, tmpfile, strerror(errno));
+		unlink(tmpfile);
+	}
+
+} // End of SaveTemplateCache
+
+/*
+ * Restore the v9 and IPFIX templates of the exporters of flow source fs from the template cache
+ * Called by the thread owning the flow source only, before its first packet is processed
+ */
+static void LoadTemplateCache(FlowSource_t *fs) {
+template_cache_header_t *header;
+template_cache_record_t *record;
+struct stat	stat_buf;
+char		cachefile[MAXPATHLEN];
+void		*buff, *eob;
+ip_addr_t	ip;
+uint32_t	sa_family;
+int			fd, num_records;
+
+	fs->cache_loaded = 1;
+
+	if ( snprintf(cachefile, MAXPATHLEN, "%s/%s", fs->datadir, TEMPLATE_CACHE) >= MAXPATHLEN ) {
+		LogError("Ident: %s, Template cache path too long", fs->Ident);
+		return;
+	}
+
+	fd = open(cachefile, O_RDONLY);
+	if ( fd < 0 ) {
+		if ( errno != ENOENT ) 
+			LogError("Ident: %s, Can't open template cache '%s': %s", fs->Ident, cachefile, strerror(errno));
+		return;
+	}
+
+	if ( fstat(fd, &stat_buf) || stat_buf.st_size < sizeof(template_cache_header_t) || 
+		 stat_buf.st_size > MAX_TEMPLATE_CACHE_SIZE ) {
+		LogError("Ident: %s, Skip invalid template cache '%s'", fs->Ident, cachefile);
+		close(fd);
+		return;
+	}
+
+	buff = malloc(stat_buf.st_size);
+	if ( !buff ) {
+		LogError("malloc() allocation error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		close(fd);
+		return;
+	}
+	if ( read(fd, buff, stat_buf.st_size) != stat_buf.st_size ) {
+		LogError("Ident: %s, Failed to read template cache '%s': %s", fs->Ident, cachefile, strerror(errno));
+		free(buff);
+		close(fd);
+		return;
+	}
+	close(fd);
+
+	header = (template_cache_header_t *)buff;
+	if ( header->magic != TEMPLATE_CACHE_MAGIC || header->version != TEMPLATE_CACHE_VERSION ) {
+		LogError("Ident: %s, Skip template cache '%s': bad magic or version", fs->Ident, cachefile);
+		free(buff);
+		return;
+	}
+
+	// the exporter IP of each record is temporarily set in the flow source
+	ip		  = fs->ip;
+	sa_family = fs->sa_family;
+
+	num_records = 0;
+	record = (template_cache_record_t *)((void *)buff + sizeof(template_cache_header_t));
+	eob	   = buff + stat_buf.st_size;
+	while ( (void *)record + sizeof(template_cache_record_t) <= eob ) {
+		if ( record->size < sizeof(template_cache_record_t) || (record->size & 0x3) || 
+			 ((void *)record + record->size) > eob ) {
+			LogError("Ident: %s, Corrupt template cache '%s'", fs->Ident, cachefile);
+			break;
+		}
+
+		// the records of a static flow source must match its IP address
+		if ( fs->any_source || 
+			 ( record->sa_family == sa_family && memcmp((void *)&record->ip, (void *)&ip, sizeof(ip_addr_t)) == 0 ) ) {
+			fs->ip		  = record->ip;
+			fs->sa_family = record->sa_family;
+			switch (record->version) {
+				case 9:
+					num_records += Restore_v9_template(fs, record);
+					break;
+				case 10:
+					num_records += Restore_ipfix_template(fs, record);
+					break;
+			}
+		}
+		record = (template_cache_record_t *)((void *)record + record->size);
+	}
+
+	fs->ip		  = ip;
+	fs->sa_family = sa_family;
+	free(buff);
+
+	LogInfo("Ident: %s, Restored %i templates and samplers from template cache", fs->Ident, num_records);
+
+} // End of LoadTemplateCache
+
+/*
+ * Decode a single netflow packet of flow source fs into the output buffer of the source.
+ * Returns 1 if the packet was processed, 0 otherwise.
+ */
+static int ProcessPacket(FlowSource_t *fs, void *in_buff, ssize_t cnt) {
+common_flow_header_t *nf_header = (common_flow_header_t *)in_buff;
+uint16_t version;
+
+	// the flow source failed to open a new file
+	if ( !fs->nffile ) {
+		fs->bad_packets++;
+		return 0;
+	}
+
+	// restore the templates of the previous run
+	if ( !fs->cache_loaded ) 
+		LoadTemplateCache(fs);
+
+	/* check for too little data - cnt must be > 0 at this point */
+	if ( cnt < sizeof(common_flow_header_t) ) {
+		LogError("Ident: %s, Data length error: too little data for common netflow header. cnt: %i",fs->Ident, (int)cnt);
+		fs->bad_packets++;
+		return 0;
+	}
+
+	/* Process data - have a look at the common header */
+	version = ntohs(nf_header->version);
+	switch (version) {
+		case 1: 
+			Process_v1(in_buff, cnt, fs);
+			break;
+		case 5: // fall through
+		case 7: 
+			Process_v5_v7(in_buff, cnt, fs);
+			break;
+		case 9: 
+			Process_v9(in_buff, cnt, fs);
+			break;
+		case 10: 
+			Process_IPFIX(in_buff, cnt, fs);
+			break;
+		default:
+			// data error, while reading data from socket
+			LogError("Ident: %s, Error reading netflow header: Unexpected netflow version %i", fs->Ident, version);
+			fs->bad_packets++;
+			return 0;
+	}
+	// each Process_xx function has to process the entire input buffer, therefore it's empty now.
+
+	// flush current buffer to disc
+	if ( fs->nffile->block_header->size > BUFFSIZE ) {
+		// fishy! - we already wrote into someone elses memory! - I'm sorry
+		// reset output buffer - data may be lost, as we don not know, where it happen
+		fs->nffile->block_header->size 		 = 0;
+		fs->nffile->block_header->NumRecords = 0;
+		fs->nffile->buff_ptr = (void *)((pointer_addr_t)fs->nffile->block_header + sizeof(data_block_header_t) );
+		LogError("### Software bug ### Ident: %s, output buffer overflow: expect memory inconsitency", fs->Ident);
+	}
+
+	return 1;
+
+} // End of ProcessPacket
+
+static int OpenSourceFiles(int compress, int do_xstat) {
+FlowSource_t *fs;
+
+	// Init each netflow source output data buffer
+	fs = FlowSource;
+	while ( fs ) {
+
+		// prepare file
+		fs->nffile = OpenNewFile(fs->current, NULL, compress, 0, NULL);
+		if ( !fs->nffile ) {
+			return 0;
+		}
+		if ( do_xstat ) {
+			fs->xstat = InitXStat(fs->nffile);
+			if ( !fs->xstat ) 
+				return 0;
+		}
+		// init vars
+		fs->bad_packets		= 0;
+		fs->first_seen      = 0xffffffffffffLL;
+		fs->last_seen 		= 0;
+
+		// next source
+		fs = fs->next;
+	}
+
+	return 1;
+
+} // End of OpenSourceFiles
+
+static FlowSource_t *NewDynamicSource(struct sockaddr_storage *sender, int compress, int *fatal) {
+FlowSource_t *fs;
+
+	*fatal = 0;
+	fs = AddDynamicSource(&FlowSource, sender);
+	if ( fs == NULL ) 
+		return NULL;
+
+	if ( InitBookkeeper(&fs->bookkeeper, fs->datadir, getpid(), launcher_pid) != BOOKKEEPER_OK ) {
+		LogError("Failed to initialise bookkeeper for new source");
+		// fatal error
+		*fatal = 1;
+		return NULL;
+	}
+	fs->nffile = OpenNewFile(fs->current, NULL, compress, 0, NULL);
+	if ( !fs->nffile ) {
+		LogError("Failed to open new collector file");
+		*fatal = 1;
+		return NULL;
+	}
+
+	return fs;
+
+} // End of NewDynamicSource
+
+static void *HandoffThread(void *arg) {
+int sock;
+
+	do {
+		sock = accept(handoff.listen_sock, NULL, NULL);
+	} while ( sock < 0 && errno == EINTR );
+	close(handoff.listen_sock);
+	handoff.listen_sock = -1;
+
+	if ( sock < 0 ) {
+		LogError("accept() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno) );
+		return NULL;
+	}
+
+	LogInfo("Hot restart: hand over to new collector");
+	__atomic_store_n(&handoff.sock, sock, __ATOMIC_RELEASE);
+
+	// terminate and wake up the main thread
+	done = 1;
+	pthread_kill(handoff.main_tid, SIGALRM);
+
+	return NULL;
+
+} // End of HandoffThread
+
+static int StartHandoff(void) {
+pthread_t	tid;
+sigset_t	signal_set, old_set;
+int			err;
+
+	handoff.listen_sock = Unix_listen_socket(handoff.path);
+	if ( handoff.listen_sock < 0 ) 
+		return 0;
+	handoff.main_tid = pthread_self();
+
+	// all signals are handled by the main thread
+	sigfillset(&signal_set);
+	pthread_sigmask(SIG_BLOCK, &signal_set, &old_set);
+	err = pthread_create(&tid, NULL, HandoffThread, NULL);
+	pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+	if ( err ) {
+		LogError("pthread_create() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(err) );
+		close(handoff.listen_sock);
+		return 0;
+	}
+	pthread_detach(tid);
+
+	return 1;
+
+} // End of StartHandoff
+
+/*
+ * Decide at the end of the run, whether the files are handed over to a new collector.
+ * A new collector connecting later waits for this collector to terminate and starts as usual.
+ */
+static int HandoffRequested(void) {
+
+	handoff.active = __atomic_load_n(&handoff.sock, __ATOMIC_ACQUIRE) >= 0;
+	return handoff.active;
+
+} // End of HandoffRequested
+
+/*
+ * Close the file of flow source fs in place, to be continued by the new collector
+ * Called by the thread owning the flow source only
+ */
+static void HandoffFlowSource(FlowSource_t *fs) {
+
+	if ( !fs->nffile ) 
+		return;
+
+	FlushExporterStats(fs);
+	SaveTemplateCache(fs);
+
+	if ( !CloseUpdateFile(fs->nffile, fs->Ident) ) 
+		LogError("Ident: %s, failed to close file '%s'", fs->Ident, fs->current);
+	DisposeFile(fs->nffile);
+	fs->nffile = NULL;
+
+} // End of HandoffFlowSource
+
+static void SendHandoff(int *sockets, int num_sockets) {
+handoff_header_t header;
+handoff_source_t source;
+FlowSource_t	*fs;
+size_t			sent;
+ssize_t			ret;
+
+	memset((void *)&header, 0, sizeof(header));
+	header.magic	   = HANDOFF_MAGIC;
+	header.version	   = HANDOFF_VERSION;
+	header.num_sockets = num_sockets;
+	header.t_start	   = handoff.t_start;
+	for ( fs = FlowSource; fs; fs = fs->next ) 
+		header.num_sources++;
+
+	if ( !Send_descriptors(handoff.sock, sockets, num_sockets, (void *)&header, sizeof(header)) ) {
+		LogError("Hot restart: failed to hand over sockets");
+		return;
+	}
+
+	for ( fs = FlowSource; fs; fs = fs->next ) {
+		memset((void *)&source, 0, sizeof(source));
+		strncpy(source.datadir, fs->datadir, MAXPATHLEN-1);
+		strncpy(source.current, fs->current, MAXPATHLEN-1);
+		source.ip		   = fs->ip;
+		source.sa_family   = fs->sa_family;
+		source.bad_packets = fs->bad_packets;
+		source.first_seen  = fs->first_seen;
+		source.last_seen   = fs->last_seen;
+		sent = 0;
+		while ( sent < sizeof(source) ) {
+			ret = write(handoff.sock, (void *)&source + sent, sizeof(source) - sent);
+			if ( ret < 0 && errno == EINTR ) 
+				continue;
+			if ( ret <= 0 ) {
+				LogError("write() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+				return;
+			}
+			sent += ret;
+		}
+	}
+
+	// the connection is closed, when this process terminates
+	LogInfo("Hot restart: handed over %u sockets and %u flow sources", header.num_sockets, header.num_sources);
+
+} // End of SendHandoff
+
+/*
+ * Take over the sockets and flow sources of a running collector listening on the hot restart socket.
+ * Returns 1 if taken over, 0 if no collector is running or the collector did not hand over.
+ * In any case, the previous collector has terminated on return.
+ */
+static int TakeOver(int **sockets, int *num_sockets) {
+handoff_header_t header;
+struct timeval	timeout;
+int		fds[MAX_HANDOFF_SOCKETS];
+size_t	size, got;
+ssize_t	ret;
+int		sock, num, i;
+char	c;
+
+	sock = Unix_connect_socket(handoff.path);
+	if ( sock < 0 ) {
+		if ( errno != ENOENT && errno != ECONNREFUSED ) 
+			fprintf(stderr, "Hot restart: can't connect to '%s': %s\n", handoff.path, strerror(errno));
+		return 0;
+	}
+
+	num = Receive_descriptors(sock, fds, MAX_HANDOFF_SOCKETS, (void *)&header, sizeof(header));
+	if ( num > 0 && ( header.magic != HANDOFF_MAGIC || header.version != HANDOFF_VERSION || 
+		 header.num_sockets != num ) ) {
+		fprintf(stderr, "Hot restart: invalid handoff from running collector\n");
+		for ( i=0; i<num; i++ ) 
+			close(fds[i]);
+		num = -1;
+	}
+
+	if ( num > 0 && header.num_sources ) {
+		size = header.num_sources * sizeof(handoff_source_t);
+		handoff.sources = (handoff_source_t *)malloc(size);
+		if ( !handoff.sources ) {
+			fprintf(stderr, "malloc() allocation error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+			exit(255);
+		}
+		got = 0;
+		while ( got < size ) {
+			ret = read(sock, (void *)handoff.sources + got, size - got);
+			if ( ret < 0 && errno == EINTR ) 
+				continue;
+			if ( ret <= 0 ) 
+				break;
+			got += ret;
+		}
+		// incomplete - the files are left to the regular startup
+		handoff.num_sources = got / sizeof(handoff_source_t);
+	}
+
+	// wait for the running collector to terminate
+	while ( (ret = read(sock, &c, 1)) != 0 ) {
+		if ( ret < 0 && errno != EINTR ) 
+			break;
+	}
+	close(sock);
+
+	if ( num <= 0 ) 
+		return 0;
+
+	// the receivers of the previous collector may have set a receive timeout
+	timeout.tv_sec	= 0;
+	timeout.tv_usec = 0;
+	for ( i=0; i<num; i++ ) 
+		setsockopt(fds[i], SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	*sockets = (int *)malloc(num * sizeof(int));
+	if ( !*sockets ) {
+		fprintf(stderr, "malloc() allocation error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		exit(255);
+	}
+	memcpy((void *)*sockets, (void *)fds, num * sizeof(int));
+	*num_sockets	= num;
+	handoff.t_start = header.t_start;
+
+	return 1;
+
+} // End of TakeOver
+
+/*
+ * Continue the files of the flow sources of the previous collector 
+ * instead of the new files opened for these sources
+ */
+static void AdoptSourceFiles(int compress) {
+FlowSource_t	*fs;
+nffile_t		*nffile;
+struct stat		stat_buf;
+uint32_t		i;
+
+	for ( i=0; i<handoff.num_sources; i++ ) {
+		handoff_source_t *source = &handoff.sources[i];
+
+		source->datadir[MAXPATHLEN-1] = '\0';
+		source->current[MAXPATHLEN-1] = '\0';
+		if ( stat(source->current, &stat_buf) ) 
+			continue;
+
+		fs = FlowSource;
+		while ( fs && strcmp(fs->datadir, source->datadir) != 0 ) 
+			fs = fs->next;
+
+		if ( !fs ) {
+			// a dynamic source of the previous collector
+			struct sockaddr_storage ss;
+			int fatal;
+			memset((void *)&ss, 0, sizeof(ss));
+			if ( source->sa_family == PF_INET6 ) {
+				struct sockaddr_in6 *sa_in6 = (struct sockaddr_in6 *)&ss;
+				uint64_t _ip[2];
+				_ip[0] = htonll(source->ip.v6[0]);
+				_ip[1] = htonll(source->ip.v6[1]);
+				sa_in6->sin6_family = AF_INET6;
+				memcpy((void *)&sa_in6->sin6_addr, (void *)_ip, sizeof(_ip));
+			} else {
+				struct sockaddr_in *sa_in = (struct sockaddr_in *)&ss;
+				sa_in->sin_family	   = AF_INET;
+				sa_in->sin_addr.s_addr = htonl(source->ip.v4);
+			}
+			fs = NewDynamicSource(&ss, compress, &fatal);
+			if ( fs && strcmp(fs->datadir, source->datadir) != 0 ) 
+				fs = NULL;
+		}
+
+		if ( !fs || !fs->nffile ) {
+			LogError("Hot restart: no flow source for '%s' - file left", source->current);
+			continue;
+		}
+
+		nffile = AppendFile(source->current);
+		if ( !nffile ) 
+			continue;
+
+		// replaces the new empty file
+		if ( rename(source->current, fs->current) ) {
+			LogError("Ident: %s, Can't rename file '%s': %s", fs->Ident, source->current, strerror(errno));
+			CloseUpdateFile(nffile, fs->Ident);
+			DisposeFile(nffile);
+			continue;
+		}
+		close(fs->nffile->fd);
+		DisposeFile(fs->nffile);
+
+		fs->nffile		= nffile;
+		fs->bad_packets	= source->bad_packets;
+		fs->first_seen	= source->first_seen;
+		fs->last_seen	= source->last_seen;
+		LogInfo("Ident: %s, Hot restart: continue file of previous collector", fs->Ident);
+	}
+
+	free(handoff.sources);
+	handoff.sources		= NULL;
+	handoff.num_sources = 0;
 
-#include "nffile_inline.c"
-#include "collector_inline.c"
+} // End of AdoptSourceFiles
 
-static void run(packet_function_t receive_packet, int socket, send_peer_t peer, 
+static void run(packet_function_t receive_packet, int socket, 
 	time_t twin, time_t t_begin, int report_seq, int use_subdirs, int compress, int do_xstat) {
 common_flow_header_t	*nf_header;
 FlowSource_t			*fs;
@@ -369,51 +1374,41 @@ socklen_t 	nf_sender_size = sizeof(nf_sender);
 time_t 		t_start, t_now;
 uint64_t	export_packets;
 uint32_t	blast_cnt, blast_failures, ignored_packets;
-uint16_t	version;
 ssize_t		cnt;
 void 		*in_buff;
-int 		err;
-char 		*string;
-srecord_t	*commbuff;
+int 		new_time, last;
+struct timeval tv;
+#ifndef PCAP
+packet_batch_t	*batch;
+#endif
 
 	if ( !Init_v1() || !Init_v5_v7_input() || !Init_v9() || !Init_IPFIX() )
 		return;
 
+#ifdef PCAP
 	in_buff  = malloc(NETWORK_INPUT_BUFF_SIZE);
 	if ( !in_buff ) {
 		LogError("malloc() allocation error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
 		return;
 	}
+#else
+	batch = InitPacketBatch();
+	if ( !batch ) 
+		return;
+	in_buff = NULL;
+#endif
 
-	// init vars
-	commbuff = (srecord_t *)shmem;
-	nf_header = (common_flow_header_t *)in_buff;
-
-	// Init each netflow source output data buffer
-	fs = FlowSource;
-	while ( fs ) {
-
-		// prepare file
-		fs->nffile = OpenNewFile(fs->current, NULL, compress, 0, NULL);
-		if ( !fs->nffile ) {
-			return;
-		}
-		if ( do_xstat ) {
-			fs->xstat = InitXStat(fs->nffile);
-			if ( !fs->xstat ) 
-				return;
-		}
-		// init vars
-		fs->bad_packets		= 0;
-		fs->first_seen      = 0xffffffffffffLL;
-		fs->last_seen 		= 0;
+	if ( !OpenSourceFiles(compress, do_xstat) ) 
+		return;
+	AdoptSourceFiles(compress);
 
-		// next source
-		fs = fs->next;
-	}
+	StartCloser();
+	if ( !StartRepeater(1) ) 
+		return;
 
 	export_packets = blast_cnt = blast_failures = 0;
 	t_start = t_begin;
+	gettimeofday(&tv, NULL);
 
 	cnt = 0;
 	periodic_trigger = 0;
@@ -428,11 +1423,11 @@ srecord_t	*commbuff;
 	 * for proper cleanup 
 	 */
 	while ( 1 ) {
-		struct timeval tv;
 
+		new_time = 0;
 		/* read next bunch of data into beginn of input buffer */
-		if ( !done) {
 #ifdef PCAP
+		if ( !done) {
 			// Debug code to read from pcap file, or from socket 
 			cnt = receive_packet(socket, in_buff, NETWORK_INPUT_BUFF_SIZE , 0, 
 						(struct sockaddr *)&nf_sender, &nf_sender_size);
@@ -440,191 +1435,76 @@ srecord_t	*commbuff;
 			// in case of reading from file EOF => -2
 			if ( cnt == -2 ) 
 				done = 1;
-#else
-			cnt = recvfrom (socket, in_buff, NETWORK_INPUT_BUFF_SIZE , 0, 
-						(struct sockaddr *)&nf_sender, &nf_sender_size);
-#endif
 
 			if ( cnt == -1 && errno != EINTR ) {
 				LogError("ERROR: recvfrom: %s", strerror(errno));
 				continue;
 			}
-
-			if ( peer.hostname ) {
-				ssize_t len;
-				len = sendto(peer.sockfd, in_buff, cnt, 0, (struct sockaddr *)&(peer.addr), peer.addrlen);
-				if ( len < 0 ) {
-					LogError("ERROR: sendto(): %s", strerror(errno));
-				}
+			gettimeofday(&tv, NULL);
+			new_time = 1;
+		}
+		last = done;
+#else
+		// receive the next batch, when all packets of the current batch are processed
+		if ( !done && !PacketsPending(batch) ) {
+			if ( ReceiveBatch(batch, socket) < 0 && errno != EINTR ) {
+				LogError("ERROR: recvmmsg: %s", strerror(errno));
+				continue;
 			}
+			// one time stamp for all packets of the batch
+			gettimeofday(&tv, NULL);
+			new_time = 1;
 		}
+		// if we are done, process the rest of the batch first
+		last = done && !PacketsPending(batch);
+		if ( !last ) 
+			cnt = NextPacket(batch, &in_buff, &nf_sender, &nf_sender_size);
+#endif
+		nf_header = (common_flow_header_t *)in_buff;
+
+		if ( !last && cnt > 0 ) 
+			RepeatPacket(0, in_buff, cnt, &nf_sender, &tv);
 
 		/* Periodic file renaming, if time limit reached or if we are done.  */
-		// t_now = time(NULL);
-		gettimeofday(&tv, NULL);
 		t_now = tv.tv_sec;
 
-		if ( ((t_now - t_start) >= twin) || done ) {
-			char subfilename[64];
-			struct  tm *now;
-			char	*subdir;
+		if ( (new_time && (t_now - t_start) >= twin) || last ) {
+			rotation_job_t *job;
 
 			alarm(0);
-			now = localtime(&t_start);
-
-			// prepare sub dir hierarchy
-			if ( use_subdirs ) {
-				subdir = GetSubDir(now);
-				if ( !subdir ) {
-					// failed to generate subdir path - put flows into base directory
-					LogError("Failed to create subdir path!");
-			
-					// failed to generate subdir path - put flows into base directory
-					subdir = NULL;
-					snprintf(subfilename, 63, "nfcapd.%i%02i%02i%02i%02i",
-						now->tm_year + 1900, now->tm_mon + 1, now->tm_mday, now->tm_hour, now->tm_min);
-				} else {
-					snprintf(subfilename, 63, "%s/nfcapd.%i%02i%02i%02i%02i", subdir,
-						now->tm_year + 1900, now->tm_mon + 1, now->tm_mday, now->tm_hour, now->tm_min);
+
+			// hot restart - the new collector continues the files of this time slot
+			if ( last && HandoffRequested() ) {
+				fs = FlowSource;
+				while ( fs ) {
+					HandoffFlowSource(fs);
+					fs = fs->next;
 				}
-			} else {
-				subdir = NULL;
-				snprintf(subfilename, 63, "nfcapd.%i%02i%02i%02i%02i",
-					now->tm_year + 1900, now->tm_mon + 1, now->tm_mday, now->tm_hour, now->tm_min);
+				handoff.t_start = t_start;
+				break;
 			}
-			subfilename[63] = '\0';
 
-			// for each flow source update the stats, close the file and re-initialize the new file
+			job = NewRotationJob(t_start, use_subdirs);
+
+			// for each flow source update the stats, hand over the file to the closer and open a new file
 			fs = FlowSource;
 			while ( fs ) {
-				char nfcapd_filename[MAXPATHLEN];
-				char error[255];
-				nffile_t *nffile = fs->nffile;
-
-				if ( verbose ) {
-					// Dump to stdout
-					format_file_block_header(nffile->block_header, &string, 0);
-					printf("%s\n", string);
-				}
-
-				if ( nffile->block_header->NumRecords ) {
-					// flush current buffer to disc
-					if ( WriteBlock(nffile) <= 0 )
-						LogError("Ident: %s, failed to write output buffer to disk: '%s'" , fs->Ident, strerror(errno));
-				} // else - no new records in current block
-
-	
-				// prepare filename
-				snprintf(nfcapd_filename, MAXPATHLEN-1, "%s/%s", fs->datadir, subfilename);
-				nfcapd_filename[MAXPATHLEN-1] = '\0';
-	
-				// update stat record
-				// if no flows were collected, fs->last_seen is still 0
-				// set first_seen to start of this time slot, with twin window size.
-				if ( fs->last_seen == 0 ) {
-					fs->first_seen = (uint64_t)1000 * (uint64_t)t_start;
-					fs->last_seen  = (uint64_t)1000 * (uint64_t)(t_start + twin);
-				}
-				nffile->stat_record->first_seen = fs->first_seen/1000;
-				nffile->stat_record->msec_first	= fs->first_seen - nffile->stat_record->first_seen*1000;
-				nffile->stat_record->last_seen 	= fs->last_seen/1000;
-				nffile->stat_record->msec_last	= fs->last_seen - nffile->stat_record->last_seen*1000;
-
-				if ( fs->xstat ) {
-					if ( WriteExtraBlock(nffile, fs->xstat->block_header ) <= 0 ) 
-						LogError("Ident: %s, failed to write xstat buffer to disk: '%s'" , fs->Ident, strerror(errno));
-
-					ResetPortHistogram(fs->xstat->port_histogram);
-					ResetBppHistogram(fs->xstat->bpp_histogram);
+				closing_file_t *cf = RotateFlowSource(fs, job, twin, compress, !done);
+				if ( cf ) {
+					cf->next   = job->files;
+					job->files = cf;
 				}
 
-				// Flush Exporter Stat to file
-				FlushExporterStats(fs);
-				// Close file
-				CloseUpdateFile(nffile, fs->Ident);
-
-				if ( subdir && !SetupSubDir(fs->datadir, subdir, error, 255) ) {
-					// in this case the flows get lost! - the rename will fail
-					// but this should not happen anyway, unless i/o problems, inode problems etc.
-					LogError("Ident: %s, Failed to create sub hier directories: %s", fs->Ident, error );
-				}
-
-				// if rename fails, we are in big trouble, as we need to get rid of the old .current file
-				// otherwise, we will loose flows and can not continue collecting new flows
-				err = rename(fs->current, nfcapd_filename);
-				if ( err ) {
-					LogError("Ident: %s, Can't rename dump file: %s", fs->Ident,  strerror(errno));
-					LogError("Ident: %s, Serious Problem! Fix manually", fs->Ident);
-					if ( launcher_pid )
-						commbuff->failed = 1;
-
-					// we do not update the books here, as the file failed to rename properly
-					// otherwise the books may be wrong
-				} else {
-					struct stat	fstat;
-					if ( launcher_pid )
-						commbuff->failed = 0;
-
-					// Update books
-					stat(nfcapd_filename, &fstat);
-					UpdateBooks(fs->bookkeeper, t_start, 512*fstat.st_blocks);
-				}
-
-				// log stats
-				LogInfo("Ident: '%s' Flows: %llu, Packets: %llu, Bytes: %llu, Sequence Errors: %u, Bad Packets: %u", 
-					fs->Ident, (unsigned long long)nffile->stat_record->numflows, (unsigned long long)nffile->stat_record->numpackets, 
-					(unsigned long long)nffile->stat_record->numbytes, nffile->stat_record->sequence_failure, fs->bad_packets);
-
-				// reset stats
-				fs->bad_packets = 0;
-				fs->first_seen  = 0xffffffffffffLL;
-				fs->last_seen 	= 0;
-
-				if ( !done ) {
-					nffile = OpenNewFile(fs->current, nffile, compress, 0, NULL);
-					if ( !nffile ) {
-						LogError("killed due to fatal error: ident: %s", fs->Ident);
-						break;
-					}
-					/* XXX needs fixing */
-					if ( fs->xstat ) {
-						// to be implemented
-					}
-				}
-
-				// Dump all extension maps and exporters to the buffer
-				FlushStdRecords(fs);
-
 				// next flow source
 				fs = fs->next;
 			} // end of while (fs)
 
-			// All flow sources updated - signal launcher if required
-			if ( launcher_pid ) {
-				// Signal launcher
-		
-				// prepare filename for %f expansion
-				strncpy(commbuff->fname, subfilename, FNAME_SIZE-1);
-				commbuff->fname[FNAME_SIZE-1] = 0;
-				snprintf(commbuff->tstring, 16, "%i%02i%02i%02i%02i", 
-					now->tm_year + 1900, now->tm_mon + 1, now->tm_mday, now->tm_hour, now->tm_min);
-				commbuff->tstring[15] = 0;
-				commbuff->tstamp = t_start;
-				if ( subdir ) 
-					strncpy(commbuff->subdir, subdir, FNAME_SIZE);
-				else
-					commbuff->subdir[0] = '\0';
-
-				if ( launcher_alive ) {
-					LogInfo("Signal launcher");
-					kill(launcher_pid, SIGHUP);
-				} else 
-					LogError("ERROR: Launcher did unexpectedly!");
-
-			}
+			// the closer completes the files and signals the launcher
+			SubmitRotationJob(job);
 			
 			LogInfo("Total ignored packets: %u", ignored_packets);
 			ignored_packets = 0;
+			RepeaterStat();
 
 			if ( done )
 				break;
@@ -664,100 +1544,513 @@ srecord_t	*commbuff;
 		// get flow source record for current packet, identified by sender IP address
 		fs = GetFlowSource(&nf_sender);
 		if ( fs == NULL ) {
-			fs = AddDynamicSource(&FlowSource, &nf_sender);
+			int fatal;
+			fs = NewDynamicSource(&nf_sender, compress, &fatal);
 			if ( fs == NULL ) {
+				if ( fatal ) 
+					return;
 				LogError("Skip UDP packet. Ignored packets so far %u packets", ignored_packets);
 				ignored_packets++;
 				continue;
 			}
-			if ( InitBookkeeper(&fs->bookkeeper, fs->datadir, getpid(), launcher_pid) != BOOKKEEPER_OK ) {
-				LogError("Failed to initialise bookkeeper for new source");
-				// fatal error
-				return;
+		}
+
+		fs->received = tv;
+
+		// blast test header
+		if ( verbose && cnt >= sizeof(common_flow_header_t) && ntohs(nf_header->version) == 255 ) {
+			uint16_t count = ntohs(nf_header->count);
+			if ( blast_cnt != count ) {
+					// LogError("Missmatch blast check: Expected %u got %u\n", blast_cnt, count);
+				blast_cnt = count;
+				blast_failures++;
+			} else {
+				blast_cnt++;
 			}
-			fs->nffile = OpenNewFile(fs->current, NULL, compress, 0, NULL);
-			if ( !fs->nffile ) {
-				LogError("Failed to open new collector file");
-				return;
+			if ( blast_cnt == 65535 ) {
+				fprintf(stderr, "Total missed packets: %u\n", blast_failures);
+				done = 1;
 			}
+			export_packets++;
+			continue;
 		}
 
-		/* check for too little data - cnt must be > 0 at this point */
-		if ( cnt < sizeof(common_flow_header_t) ) {
-			LogError("Ident: %s, Data length error: too little data for common netflow header. cnt: %i",fs->Ident, (int)cnt);
-			fs->bad_packets++;
+		if ( ProcessPacket(fs, in_buff, cnt) )
+			export_packets++;
+	}
+
+	if ( verbose && blast_failures ) {
+		fprintf(stderr, "Total missed packets: %u\n", blast_failures);
+	}
+#ifdef PCAP
+	free(in_buff);
+#else
+	FreePacketBatch(batch);
+#endif
+
+	StopRepeater();
+	StopCloser();
+
+} /* End of run */
+
+#ifndef PCAP
+/*
+ * Threaded collector ( -W workers[:receivers] )
+ * Receiver threads read datagrams from their own socket - several sockets share the port
+ * with SO_REUSEPORT - and pass each datagram to the decode worker, which owns the flow
+ * source of the sender. Each worker has a lock-free packet ring per receiver, so a 
+ * receiver never waits for a worker. A worker decodes the datagrams and writes the files
+ * of its own flow sources only, therefore no flow source is ever touched by two workers.
+ * The main thread handles the signals and the time slots: it requests all workers to
+ * rotate their flow sources and passes the old files to the closer thread.
+ */
+#define WORKER_BATCH		64		// max number of datagrams processed from a ring at once
+#define WORKER_IDLE_WAIT	100		// max msec an idle worker waits for datagrams
+
+typedef struct worker_s {
+	pthread_t		tid;
+	int				id;
+	packet_ring_t	**ring;			// one ring per receiver
+	// an idle worker waits for datagrams or a rotation request
+	pthread_mutex_t	mutex;
+	pthread_cond_t	cond;
+	int				sleeping;
+	int				rotate;
+} worker_t;
+
+typedef struct receiver_s {
+	pthread_t		tid;
+	int				id;
+	int				socket;
+} receiver_t;
+
+static struct collector_s {
+	worker_t			*worker;
+	int					num_workers;
+	receiver_t			*receiver;
+	int					num_receivers;
+
+	// protects the list of flow sources, extended by the receivers with dynamic sources
+	pthread_rwlock_t	source_lock;
+	uint32_t			sources_added;
+	int					next_worker;
+
+	int					compress;
+	uint32_t			ignored_packets;
+
+	// rotation request
+	pthread_mutex_t		rotate_mutex;
+	pthread_cond_t		rotate_cond;
+	int					pending;
+	int					final;
+	int					handoff;		// final rotation hands over the files
+	rotation_job_t		*job;
+	time_t				twin;
+} collector;
+
+static void WakeWorkers(uint64_t workers) {
+int i;
+
+	// pairs with the store of sleeping in WorkerThread()
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	for ( i=0; workers; i++, workers >>= 1 ) {
+		worker_t *worker = &collector.worker[i];
+		if ( (workers & 1) && __atomic_load_n(&worker->sleeping, __ATOMIC_RELAXED) ) {
+			pthread_mutex_lock(&worker->mutex);
+			pthread_cond_signal(&worker->cond);
+			pthread_mutex_unlock(&worker->mutex);
+		}
+	}
+
+} // End of WakeWorkers
+
+// must be called with a read lock on the flow sources - may temporarily upgrade to a write lock
+static FlowSource_t *ReceiverFlowSource(struct sockaddr_storage *sender) {
+FlowSource_t *fs;
+uint32_t	sources_added;
+int			fatal;
+
+	// the any source is identified by the worker, as GetFlowSource() stores the sender IP
+	if ( FlowSource && FlowSource->any_source ) 
+		return FlowSource;
+
+	sources_added = collector.sources_added;
+	fs = GetFlowSource(sender);
+	if ( fs ) 
+		return fs;
+
+	pthread_rwlock_unlock(&collector.source_lock);
+	pthread_rwlock_wrlock(&collector.source_lock);
+
+	// another receiver may have added this source in the meantime
+	if ( collector.sources_added != sources_added ) 
+		fs = GetFlowSource(sender);
+
+	if ( !fs ) {
+		fs = NewDynamicSource(sender, collector.compress, &fatal);
+		if ( fs ) {
+			fs->worker = collector.next_worker;
+			collector.next_worker = ( collector.next_worker + 1 ) % collector.num_workers;
+			collector.sources_added++;
+		} else {
+			if ( fatal ) 
+				done = 1;
+			LogError("Skip UDP packet. Ignored packets so far %u packets", collector.ignored_packets);
+			collector.ignored_packets++;
+		}
+	}
+
+	pthread_rwlock_unlock(&collector.source_lock);
+	pthread_rwlock_rdlock(&collector.source_lock);
+
+	return fs;
+
+} // End of ReceiverFlowSource
+
+static void *ReceiverThread(void *arg) {
+receiver_t		*receiver = (receiver_t *)arg;
+packet_batch_t	*batch;
+FlowSource_t	*fs;
+struct sockaddr_storage sender;
+socklen_t		sender_size;
+struct timeval	tv, timeout;
+sigset_t		signal_set;
+uint64_t		wake;
+ssize_t			cnt;
+void			*in_buff;
+
+	batch = InitPacketBatch();
+	if ( !batch ) {
+		done = 1;
+		return NULL;
+	}
+
+	// the main thread interrupts a waiting receiver with SIGALRM on termination
+	sigemptyset(&signal_set);
+	sigaddset(&signal_set, SIGALRM);
+	pthread_sigmask(SIG_UNBLOCK, &signal_set, NULL);
+
+	// wake up regularly to check for termination
+	timeout.tv_sec  = 1;
+	timeout.tv_usec = 0;
+	if ( setsockopt(receiver->socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0 ) 
+		LogError("setsockopt(SO_RCVTIMEO): %s", strerror(errno));
+
+	while ( !done ) {
+		if ( ReceiveBatch(batch, receiver->socket) < 0 ) {
+			if ( errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK ) 
+				LogError("ERROR: recvmmsg: %s", strerror(errno));
 			continue;
 		}
+		// one time stamp for all packets of the batch
+		gettimeofday(&tv, NULL);
 
-		fs->received = tv;
-		/* Process data - have a look at the common header */
-		version = ntohs(nf_header->version);
-		switch (version) {
-			case 1: 
-				Process_v1(in_buff, cnt, fs);
-				break;
-			case 5: // fall through
-			case 7: 
-				Process_v5_v7(in_buff, cnt, fs);
-				break;
-			case 9: 
-				Process_v9(in_buff, cnt, fs);
-				break;
-			case 10: 
-				Process_IPFIX(in_buff, cnt, fs);
-				break;
-			case 255:
-				// blast test header
-				if ( verbose ) {
-					uint16_t count = ntohs(nf_header->count);
-					if ( blast_cnt != count ) {
-							// LogError("Missmatch blast check: Expected %u got %u\n", blast_cnt, count);
-						blast_cnt = count;
-						blast_failures++;
-					} else {
-						blast_cnt++;
-					}
-					if ( blast_cnt == 65535 ) {
-						fprintf(stderr, "Total missed packets: %u\n", blast_failures);
-						done = 1;
-					}
-					break;
-				}
-			default:
-				// data error, while reading data from socket
-				LogError("Ident: %s, Error reading netflow header: Unexpected netflow version %i", fs->Ident, version);
-				fs->bad_packets++;
+		wake = 0;
+		pthread_rwlock_rdlock(&collector.source_lock);
+		while ( PacketsPending(batch) ) {
+			cnt = NextPacket(batch, &in_buff, &sender, &sender_size);
+			if ( cnt <= 0 ) 
 				continue;
 
-				// not reached
-				break;
+			RepeatPacket(receiver->id, in_buff, cnt, &sender, &tv);
+
+			// get flow source record for current packet, identified by sender IP address
+			fs = ReceiverFlowSource(&sender);
+			if ( fs && PacketRingPut(collector.worker[fs->worker].ring[receiver->id], fs, in_buff, cnt, &sender, &tv) ) 
+				wake |= (uint64_t)1 << fs->worker;
 		}
-		// each Process_xx function has to process the entire input buffer, therefore it's empty now.
-		export_packets++;
+		pthread_rwlock_unlock(&collector.source_lock);
 
-		// flush current buffer to disc
-		if ( fs->nffile->block_header->size > BUFFSIZE ) {
-			// fishy! - we already wrote into someone elses memory! - I'm sorry
-			// reset output buffer - data may be lost, as we don not know, where it happen
-			fs->nffile->block_header->size 		 = 0;
-			fs->nffile->block_header->NumRecords = 0;
-			fs->nffile->buff_ptr = (void *)((pointer_addr_t)fs->nffile->block_header + sizeof(data_block_header_t) );
-			LogError("### Software bug ### Ident: %s, output buffer overflow: expect memory inconsitency", fs->Ident);
+		WakeWorkers(wake);
+	}
+
+	FreePacketBatch(batch);
+
+	return NULL;
+
+} // End of ReceiverThread
+
+static void RotateWorker(worker_t *worker) {
+FlowSource_t	*fs;
+closing_file_t	*cf;
+
+	pthread_rwlock_rdlock(&collector.source_lock);
+	fs = FlowSource;
+	while ( fs ) {
+		if ( fs->worker == worker->id && collector.handoff ) {
+			HandoffFlowSource(fs);
+		} else if ( fs->worker == worker->id ) {
+			cf = RotateFlowSource(fs, collector.job, collector.twin, collector.compress, !collector.final);
+			if ( cf ) {
+				pthread_mutex_lock(&collector.rotate_mutex);
+				cf->next = collector.job->files;
+				collector.job->files = cf;
+				pthread_mutex_unlock(&collector.rotate_mutex);
+			}
 		}
+		fs = fs->next;
 	}
+	pthread_rwlock_unlock(&collector.source_lock);
 
-	if ( verbose && blast_failures ) {
-		fprintf(stderr, "Total missed packets: %u\n", blast_failures);
+	pthread_mutex_lock(&collector.rotate_mutex);
+	collector.pending--;
+	if ( collector.pending == 0 ) 
+		pthread_cond_signal(&collector.rotate_cond);
+	pthread_mutex_unlock(&collector.rotate_mutex);
+
+} // End of RotateWorker
+
+static int RingsPending(worker_t *worker) {
+int i;
+
+	for ( i=0; i<collector.num_receivers; i++ ) {
+		if ( PacketRingGet(worker->ring[i]) ) 
+			return 1;
+	}
+
+	return 0;
+
+} // End of RingsPending
+
+static void *WorkerThread(void *arg) {
+worker_t		*worker = (worker_t *)arg;
+ring_packet_t	*packet;
+int				i, num, processed, final, decode;
+
+	// the template caches of the v9 and IPFIX decoders are per thread
+	decode = Init_v9() && Init_IPFIX();
+	if ( !decode ) {
+		LogError("Worker %i: failed to initialize decoders", worker->id);
+		done = 1;
+	}
+
+	while ( 1 ) {
+		processed = 0;
+		for ( i=0; i<collector.num_receivers; i++ ) {
+			packet_ring_t *ring = worker->ring[i];
+			num = 0;
+			while ( num < WORKER_BATCH && (packet = PacketRingGet(ring)) != NULL ) {
+				FlowSource_t *fs = packet->fs;
+				if ( decode ) {
+					if ( fs->any_source ) 
+						// store the sender IP in the flow source
+						GetFlowSource(&packet->sender);
+					fs->received = packet->received;
+					ProcessPacket(fs, (void *)&packet[1], packet->length);
+				}
+				PacketRingRelease(ring, packet);
+				num++;
+			}
+			processed += num;
+		}
+
+		if ( __atomic_load_n(&worker->rotate, __ATOMIC_ACQUIRE) ) {
+			final = collector.final;
+			// the final rotation waits until all rings are drained
+			if ( !final || processed == 0 ) {
+				__atomic_store_n(&worker->rotate, 0, __ATOMIC_RELAXED);
+				RotateWorker(worker);
+				if ( final ) 
+					break;
+			}
+			continue;
+		}
+
+		if ( processed ) 
+			continue;
+
+		// idle - wait for the receivers
+		pthread_mutex_lock(&worker->mutex);
+		__atomic_store_n(&worker->sleeping, 1, __ATOMIC_SEQ_CST);
+		if ( !RingsPending(worker) && !worker->rotate ) {
+			struct timeval	now;
+			struct timespec	wait;
+			gettimeofday(&now, NULL);
+			now.tv_usec += WORKER_IDLE_WAIT * 1000;
+			wait.tv_sec  = now.tv_sec + now.tv_usec / 1000000;
+			wait.tv_nsec = (now.tv_usec % 1000000) * 1000;
+			pthread_cond_timedwait(&worker->cond, &worker->mutex, &wait);
+		}
+		__atomic_store_n(&worker->sleeping, 0, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&worker->mutex);
+	}
+
+	return NULL;
+
+} // End of WorkerThread
+
+static void run_threaded(int *sockets, int num_receivers, int num_workers, 
+	time_t twin, time_t t_begin, int use_subdirs, int compress, int do_xstat) {
+FlowSource_t	*fs;
+sigset_t		signal_set, old_set;
+time_t			t_start, t_now;
+uint32_t		dropped, last_dropped;
+int				i, j, err;
+
+	if ( !Init_v1() || !Init_v5_v7_input() )
+		return;
+
+	if ( !OpenSourceFiles(compress, do_xstat) ) 
+		return;
+	AdoptSourceFiles(compress);
+
+	memset((void *)&collector, 0, sizeof(collector));
+	collector.num_workers	= num_workers;
+	collector.num_receivers	= num_receivers;
+	collector.compress		= compress;
+	collector.twin			= twin;
+	pthread_rwlock_init(&collector.source_lock, NULL);
+	pthread_mutex_init(&collector.rotate_mutex, NULL);
+	pthread_cond_init(&collector.rotate_cond, NULL);
+
+	collector.worker   = (worker_t *)calloc(num_workers, sizeof(worker_t));
+	collector.receiver = (receiver_t *)calloc(num_receivers, sizeof(receiver_t));
+	if ( !collector.worker || !collector.receiver ) {
+		LogError("malloc() allocation error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		return;
+	}
+	for ( i=0; i<num_workers; i++ ) {
+		worker_t *worker = &collector.worker[i];
+		worker->id	 = i;
+		worker->ring = (packet_ring_t **)calloc(num_receivers, sizeof(packet_ring_t *));
+		if ( !worker->ring ) {
+			LogError("malloc() allocation error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+			return;
+		}
+		for ( j=0; j<num_receivers; j++ ) {
+			worker->ring[j] = InitPacketRing();
+			if ( !worker->ring[j] ) 
+				return;
+		}
+		pthread_mutex_init(&worker->mutex, NULL);
+		pthread_cond_init(&worker->cond, NULL);
 	}
-	free(in_buff);
 
+	// distribute the configured flow sources among the workers
 	fs = FlowSource;
 	while ( fs ) {
-		DisposeFile(fs->nffile);
+		fs->worker = collector.next_worker;
+		collector.next_worker = ( collector.next_worker + 1 ) % num_workers;
 		fs = fs->next;
 	}
 
-} /* End of run */
+	StartCloser();
+	if ( !StartRepeater(num_receivers) ) 
+		return;
+
+	// all signals are handled by the main thread
+	sigfillset(&signal_set);
+	pthread_sigmask(SIG_BLOCK, &signal_set, &old_set);
+
+	for ( i=0; i<num_workers; i++ ) {
+		worker_t *worker = &collector.worker[i];
+		err = pthread_create(&worker->tid, NULL, WorkerThread, (void *)worker);
+		if ( err ) {
+			LogError("pthread_create() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(err) );
+			exit(255);
+		}
+	}
+	for ( i=0; i<num_receivers; i++ ) {
+		receiver_t *receiver = &collector.receiver[i];
+		receiver->id	 = i;
+		receiver->socket = sockets[i];
+		err = pthread_create(&receiver->tid, NULL, ReceiverThread, (void *)receiver);
+		if ( err ) {
+			LogError("pthread_create() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(err) );
+			exit(255);
+		}
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+	LogInfo("Started %i receiver and %i decode worker threads", num_receivers, num_workers);
+
+	last_dropped = 0;
+	t_start = t_begin;
+	while ( 1 ) {
+		int		final;
+
+		t_now = time(NULL);
+		final = done;
+		if ( !final && (t_now - t_start) < twin ) {
+			// sleep until the end of the time slot - any signal wakes us up
+			sleep(t_start + twin - t_now);
+			continue;
+		}
+
+		// time limit reached or we are done - rotate the files of all flow sources
+		if ( final ) {
+			// stop receiving - the workers drain their rings before the final rotation
+			for ( i=0; i<num_receivers; i++ ) 
+				pthread_kill(collector.receiver[i].tid, SIGALRM);
+			for ( i=0; i<num_receivers; i++ ) 
+				pthread_join(collector.receiver[i].tid, NULL);
+			// hot restart - the new collector continues the files of this time slot
+			collector.handoff = HandoffRequested();
+			handoff.t_start	  = t_start;
+		}
+
+		collector.job	= NewRotationJob(t_start, use_subdirs);
+		collector.final	= final;
+
+		pthread_mutex_lock(&collector.rotate_mutex);
+		collector.pending = num_workers;
+		pthread_mutex_unlock(&collector.rotate_mutex);
+
+		for ( i=0; i<num_workers; i++ ) {
+			worker_t *worker = &collector.worker[i];
+			pthread_mutex_lock(&worker->mutex);
+			__atomic_store_n(&worker->rotate, 1, __ATOMIC_RELEASE);
+			pthread_cond_signal(&worker->cond);
+			pthread_mutex_unlock(&worker->mutex);
+		}
+
+		// wait for all workers to switch to their new files
+		pthread_mutex_lock(&collector.rotate_mutex);
+		while ( collector.pending ) 
+			pthread_cond_wait(&collector.rotate_cond, &collector.rotate_mutex);
+		pthread_mutex_unlock(&collector.rotate_mutex);
+
+		// the closer completes the old files and signals the launcher
+		if ( collector.handoff ) 
+			free(collector.job);
+		else
+			SubmitRotationJob(collector.job);
+		collector.job = NULL;
+
+		dropped = 0;
+		for ( i=0; i<num_workers; i++ ) {
+			for ( j=0; j<num_receivers; j++ ) 
+				dropped += PacketRingDropped(collector.worker[i].ring[j]);
+		}
+		pthread_rwlock_wrlock(&collector.source_lock);
+		LogInfo("Total ignored packets: %u, dropped packets: %u", collector.ignored_packets, dropped - last_dropped);
+		collector.ignored_packets = 0;
+		pthread_rwlock_unlock(&collector.source_lock);
+		last_dropped = dropped;
+		RepeaterStat();
+
+		if ( final )
+			break;
+
+		t_start += twin;
+	}
+
+	for ( i=0; i<num_workers; i++ ) 
+		pthread_join(collector.worker[i].tid, NULL);
+
+	StopRepeater();
+	StopCloser();
+
+	for ( i=0; i<num_workers; i++ ) {
+		for ( j=0; j<num_receivers; j++ ) 
+			FreePacketRing(collector.worker[i].ring[j]);
+		free(collector.worker[i].ring);
+	}
+	free(collector.worker);
+	free(collector.receiver);
+
+} /* End of run_threaded */
+#endif
 
 int main(int argc, char **argv) {
  
@@ -766,14 +2059,14 @@ char	*userid, *groupid, *checkptr, *listenport, *mcastgroup, *extension_tags;
 char	*Ident, *dynsrcdir, pidfile[MAXPATHLEN];
 struct stat fstat;
 packet_function_t receive_packet;
-send_peer_t  peer;
 FlowSource_t *fs;
 struct sigaction act;
 int		family, bufflen;
 time_t 	twin, t_start;
 int		sock, synctime, do_daemonize, expire, report_sequence, do_xstat;
 int		subdir_index, sampling_rate, compress;
-int		c;
+int		num_workers, num_receivers, *sockets;
+int		c, i;
 #ifdef PCAP
 char	*pcap_file;
  
@@ -801,14 +2094,18 @@ char	*pcap_file;
 	sampling_rate	= 1;
 	compress		= 0;
 	do_xstat		= 0;
-	memset((void *)&peer, 0, sizeof(send_peer_t));
-	peer.family		= AF_UNSPEC;
 	Ident			= "none";
 	FlowSource		= NULL;
 	extension_tags	= DefaultExtensions;
 	dynsrcdir		= NULL;
-
-	while ((c = getopt(argc, argv, "46ef:whEVI:DB:b:j:l:M:n:p:P:R:S:s:T:t:x:Xru:g:z")) != EOF) {
+	num_workers		= 0;
+	num_receivers	= 1;
+	sockets			= NULL;
+	memset((void *)&handoff, 0, sizeof(handoff));
+	handoff.listen_sock	= -1;
+	handoff.sock		= -1;
+
+	while ((c = getopt(argc, argv, "46ef:whEVI:DB:b:j:k:l:M:n:p:P:R:S:s:T:t:U:W:x:Xru:g:z")) != EOF) {
 		switch (c) {
 			case 'h':
 				usage(argv[0]);
@@ -891,6 +2188,10 @@ char	*pcap_file;
 			case 'j':
 				mcastgroup = optarg;
 				break;
+			case 'k':
+				if ( !SetRollups(optarg) ) 
+					exit(255);
+				break;
 			case 'p':
 				listenport = optarg;
 				break;
@@ -909,17 +2210,10 @@ char	*pcap_file;
 				// pidfile now absolute path
 				pidfile[MAXPATHLEN-1] = 0;
 				break;
-			case 'R': {
-				char *p = strchr(optarg, '/');
-				if ( p ) { 
-					*p++ = '\0';
-					peer.port = strdup(p);
-				} else {
-					peer.port = DEFAULTCISCOPORT;
-				}
-				peer.hostname = strdup(optarg);
-
-				break; }
+			case 'R':
+				if ( !AddRepeaterDestination(optarg, DEFAULTCISCOPORT) ) 
+					exit(255);
+				break;
 			case 'r':
 				report_sequence = 1;
 				break;
@@ -969,6 +2263,23 @@ char	*pcap_file;
 					fprintf(stderr, "WARNING, Very small time frame - < 60s!\n");
 				}
 				break;
+			case 'W':
+#ifdef PCAP
+				fprintf(stderr, "Threaded collector not supported together with the PCAP reader\n");
+				exit(255);
+#endif
+				num_workers = (int)strtol(optarg, &checkptr, 10);
+				if ( *checkptr == ':' ) 
+					num_receivers = (int)strtol(checkptr+1, &checkptr, 10);
+				if ( *checkptr != '\0' || num_workers < 1 || num_workers > 64 || 
+					 num_receivers < 1 || num_receivers > 64 ) {
+					fprintf(stderr, "Argument error for -W: 1 - 64 workers and receivers expected\n");
+					exit(255);
+				}
+				break;
+			case 'U':
+				handoff.path = strdup(optarg);
+				break;
 			case 'x':
 				launch_process = optarg;
 				break;
@@ -1011,6 +2322,11 @@ char	*pcap_file;
 		exit(255);
 	}
 
+	if ( mcastgroup && num_receivers > 1 ) {
+		fprintf(stderr, "ERROR, -j supports a single receiver only!\n");
+		exit(255);
+	}
+
 	if ( do_daemonize && !InitLog(argv[0], SYSLOG_FACILITY)) {
 		exit(255);
 	}
@@ -1018,33 +2334,57 @@ char	*pcap_file;
 	InitExtensionMaps(NO_EXTENSION_LIST);
 	SetupExtensionDescriptors(strdup(extension_tags));
 
-	// Debug code to read from pcap file
+	// hot restart: receive on the sockets of the running collector
+	if ( handoff.path && TakeOver(&sockets, &num_receivers) ) {
+		sock = sockets[0];
+		// each socket needs its own receiver thread
+		if ( num_receivers > 1 && num_workers == 0 ) 
+			num_workers = num_receivers;
+		if ( num_workers == 0 ) {
+			free(sockets);
+			sockets = NULL;
+		}
+	} else {
+		// Debug code to read from pcap file
 #ifdef PCAP
-	sock = 0;
-	if ( pcap_file ) {
-		printf("Setup pcap reader\n");
-		setup_packethandler(pcap_file, NULL);
-		receive_packet 	= NextPacket;
-	} else 
+		sock = 0;
+		if ( pcap_file ) {
+			printf("Setup pcap reader\n");
+			setup_packethandler(pcap_file, NULL);
+			receive_packet 	= NextPacket;
+		} else 
 #endif
-	if ( mcastgroup ) 
-		sock = Multicast_receive_socket (mcastgroup, listenport, family, bufflen);
-	else 
-		sock = Unicast_receive_socket(bindhost, listenport, family, bufflen );
-
-	if ( sock == -1 ) {
-		fprintf(stderr,"Terminated due to errors.\n");
-		exit(255);
-	}
+		if ( mcastgroup ) 
+			sock = Multicast_receive_socket (mcastgroup, listenport, family, bufflen);
+		else 
+			sock = Unicast_receive_socket(bindhost, listenport, family, bufflen, num_receivers > 1 );
 
-	if ( peer.hostname ) {
-		peer.sockfd = Unicast_send_socket (peer.hostname, peer.port, peer.family, bufflen, 
-											&peer.addr, &peer.addrlen );
-		if ( peer.sockfd <= 0 )
+		if ( sock == -1 ) {
+			fprintf(stderr,"Terminated due to errors.\n");
 			exit(255);
-		LogInfo("Replay flows to host: %s port: %s", peer.hostname, peer.port);
+		}
+
+		// each receiver thread gets its own socket - all bound to the same port
+		if ( num_workers ) {
+			sockets = (int *)malloc(num_receivers * sizeof(int));
+			if ( !sockets ) {
+				fprintf(stderr, "malloc() allocation error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+				exit(255);
+			}
+			sockets[0] = sock;
+			for ( i=1; i<num_receivers; i++ ) {
+				sockets[i] = Unicast_receive_socket(bindhost, listenport, family, bufflen, 1 );
+				if ( sockets[i] == -1 ) {
+					fprintf(stderr,"Terminated due to errors.\n");
+					exit(255);
+				}
+			}
+		}
 	}
 
+	if ( !OpenRepeater(bufflen) ) 
+		exit(255);
+
 	if ( sampling_rate < 0 ) {
 		default_sampling = -sampling_rate;
 		overwrite_sampling = default_sampling;
@@ -1111,6 +2451,9 @@ char	*pcap_file;
 	t_start = time(NULL);
 	if ( synctime )
 		t_start = t_start - ( t_start % twin);
+	// continue the time slot of the previous collector
+	if ( handoff.t_start )
+		t_start = handoff.t_start;
 
 	if ( do_daemonize ) {
 		verbose = 0;
@@ -1150,6 +2493,8 @@ char	*pcap_file;
 			case 0:
 				// child
 				close(sock);
+				for ( i=1; sockets && i<num_receivers; i++ ) 
+					close(sockets[i]);
 				launcher((char *)shmem, FlowSource, launch_process, expire);
 				_exit(0);
 				break;
@@ -1205,9 +2550,26 @@ char	*pcap_file;
 	sigaction(SIGALRM, &act, NULL);
 	sigaction(SIGCHLD, &act, NULL);
 
+	if ( handoff.path && !StartHandoff() ) 
+		LogError("Hot restart socket '%s' not available", handoff.path);
+
 	LogInfo("Startup.");
-	run(receive_packet, sock, peer, twin, t_start, report_sequence, subdir_index, compress, do_xstat);
+#ifndef PCAP
+	if ( num_workers ) {
+		run_threaded(sockets, num_receivers, num_workers, twin, t_start, subdir_index, compress, do_xstat);
+		if ( handoff.active ) 
+			SendHandoff(sockets, num_receivers);
+		for ( i=1; i<num_receivers; i++ ) 
+			close(sockets[i]);
+		free(sockets);
+	} else
+#endif
+	run(receive_packet, sock, twin, t_start, report_sequence, subdir_index, compress, do_xstat);
+	if ( handoff.active && num_workers == 0 ) 
+		SendHandoff(&sock, 1);
 	close(sock);
+	if ( handoff.path ) 
+		unlink(handoff.path);
 	kill_launcher(launcher_pid);
 
 	fs = FlowSource;
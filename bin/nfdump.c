@@ -72,9 +72,15 @@
 #include "nftree.h"
 #include "nfprof.h"
 #include "nfdump.h"
+#include "nfarena.h"
+#include "nfprint.h"
+#include "nfarrow.h"
 #include "nflowcache.h"
 #include "nfstat.h"
 #include "nfexport.h"
+#include "nfrollup.h"
+#include "nfcache.h"
+#include "nfserver.h"
 #include "ipconv.h"
 #include "util.h"
 #include "flist.h"
@@ -84,6 +90,8 @@
 
 #define AGGR_SIZE 7
 
+#define MAX_PARTIAL_FILES 256
+
 /* Global Variables */
 FilterEngine_data_t	*Engine;
 
@@ -103,6 +111,9 @@ static uint32_t skipped_blocks;
 static uint32_t	is_anonymized;
 static time_t 	t_first_flow, t_last_flow;
 static char		Ident[IDENTLEN];
+static int		print_threads;
+static int		use_rollups;
+static int		query_process;
 
 
 int hash_hit = 0; 
@@ -226,6 +237,8 @@ printmap_t printmap[] = {
 	{ "bilong", 	format_special,      		FORMAT_bilong 	},
 	{ "pipe", 		flow_record_to_pipe,      	NULL 			},
 	{ "csv", 		flow_record_to_csv,      	NULL 			},
+	{ "arrow", 		flow_record_to_arrow,      	NULL 			},
+	{ "arrows", 	flow_record_to_arrow,      	NULL 			},
 	{ "null", 		flow_record_to_null,      	NULL 			},
 #ifdef NSEL
 	{ "nsel",		format_special, 			FORMAT_nsel		},
@@ -250,6 +263,10 @@ static void usage(char *name);
 
 static void PrintSummary(stat_record_t *stat_record, int plain_numbers, int csv_output);
 
+static int process_rollups(nffile_t *nffile, stat_record_t *stat_record);
+
+static int run_query(int argc, char **argv);
+
 static stat_record_t process_data(char *wfile, int element_stat, int flow_stat, int sort_flows,
 	printer_t print_header, printer_t print_record, time_t twin_start, time_t twin_end, 
 	uint64_t limitflows, int tag, int compress, int do_xstat);
@@ -270,6 +287,11 @@ static void usage(char *name) {
 					"-B\t\tAggregate netflow records as bidirectional flows - Guess direction.\n"
 					"-r <file>\tread input from file\n"
 					"-w <file>\twrite output to file\n"
+					"-W <file>\twrite statistics -s or aggregation -a/-A as mergeable partial result to file.\n"
+					"-J <file>\tmerge partial statistics file written with -W. May be given multiple times.\n"
+					"-U <socket>[:<workers>[:<cache>]]\tRun as query server on Unix socket <socket>.\n"
+					"-Q <socket>\tRun the query given by all following options on the query server. Must be first option.\n"
+					"-C <dir>[:<size>]\tCache results of -s, -a or -A queries in <dir>. Max size of <dir>, default 256M.\n"
 					"-f\t\tread netflow filter from file\n"
 					"-n\t\tDefine number of top N. \n"
 					"-c\t\tLimit number of records to display\n"
@@ -277,6 +299,10 @@ static void usage(char *name) {
 					"-N\t\tPrint plain numbers\n"
 					"-s <expr>[/<order>]\tGenerate statistics for <expr> any valid record element.\n"
 					"\t\tand ordered by <order>: packets, bytes, flows, bps pps and bpp.\n"
+					"\t\tAdd :approx for approximate statistics with fixed memory.\n"
+					"\t\tDistinct count stats such as dstport-srcip may be ordered by distinct.\n"
+					"\t\tAdd :q=<duration|bpp|bps|pps> for p50, p95 and p99 of this value, ordered by p50, p95 or p99.\n"
+					"-P <sec>\tAggregate and print statistics separately for each time slot of <sec> seconds.\n"
 					"-q\t\tQuiet: Do not print the header and bottom stat lines.\n"
 					"-H Add xstat histogram data to flow file.(default 'no')\n"
 					"-i <ident>\tChange Ident to <ident> in file given by -r.\n"
@@ -301,7 +327,9 @@ static void usage(char *name) {
 					"\t\t extended Even more information.\n"
 					"\t\t csv      ',' separated, machine parseable output format.\n"
 					"\t\t pipe     '|' separated legacy machine parseable output format.\n"
+					"\t\t arrow    Apache Arrow IPC file. arrows: Arrow IPC stream.\n"
 					"\t\t\tmode may be extended by '6' for full IPv6 listing. e.g.long6, extended6.\n"
+					"-Y <num>\tUse <num> threads to format printed flows. Default: number of CPUs.\n"
 					"-E <file>\tPrint exporter ans sampling info for collected flows.\n"
 					"-v <file>\tverify netflow data file. Print version and blocks.\n"
 					"-x <file>\tverify extension records in netflow data file.\n"
@@ -355,6 +383,21 @@ char 		bps_str[NUMBER_STRING_SIZE], pps_str[NUMBER_STRING_SIZE], bpp_str[NUMBER_
 
 } // End of PrintSummary
 
+/*
+ * Answer the element statistics of a file from its rollups instead of the flows
+ * Returns 1 if the file is done, 0 if the flows need to be processed
+ */
+static int process_rollups(nffile_t *nffile, stat_record_t *stat_record) {
+
+	if ( !ReadRollupBlock(nffile) || !AddRollupStat(nffile->block_header, stat_record) )
+		return 0;
+
+	total_bytes += sizeof(data_block_header_t) + nffile->block_header->size;
+
+	return 1;
+
+} // End of process_rollups
+
 stat_record_t process_data(char *wfile, int element_stat, int flow_stat, int sort_flows,
 	printer_t print_header, printer_t print_record, time_t twin_start, time_t twin_end, 
 	uint64_t limitflows, int tag, int compress, int do_xstat) {
@@ -363,7 +406,7 @@ master_record_t		*master_record;
 nffile_t			*nffile_w, *nffile_r;
 xstat_t				*xstat;
 stat_record_t 		stat_record;
-int 				done, write_file;
+int 				done, write_file, parallel_print, arrow_batch, check_rollups;
 
 #ifdef COMPAT15
 int	v1_map_done = 0;
@@ -444,12 +487,25 @@ int	v1_map_done = 0;
 	// is expanded into this record
 	// Engine->nfrecord = (uint64_t *)master_record;
 
+	// format printed flows in multiple threads
+	parallel_print = print_record && !write_file && PrintThreads_Init(print_record, tag, print_threads);
+
+	// Arrow output writes a record batch for each data block
+	arrow_batch = print_record == flow_record_to_arrow && !write_file;
+
+	// try the rollups of each file first
+	check_rollups = use_rollups;
+
 	done = 0;
 	while ( !done ) {
 	int i, ret;
 
 		// get next data block from file
-		ret = ReadBlock(nffile_r);
+		if ( check_rollups ) {
+			check_rollups = 0;
+			ret = process_rollups(nffile_r, &stat_record) ? NF_EOF : ReadBlock(nffile_r);
+		} else 
+			ret = ReadBlock(nffile_r);
 
 		switch (ret) {
 			case NF_CORRUPT:
@@ -472,6 +528,7 @@ int	v1_map_done = 0;
 						t_first_flow = next->stat_record->first_seen;
 					if ( next->stat_record->last_seen > t_last_flow ) 
 						t_last_flow = next->stat_record->last_seen;
+					check_rollups = use_rollups;
 					// continue with next file
 				}
 				continue;
@@ -529,8 +586,11 @@ int	v1_map_done = 0;
 #endif
 
 		if ( nffile_r->block_header->id == Large_BLOCK_Type ) {
-			// skip
-			printf("Xstat block skipped ...\n");
+			// skip - rollups silently
+			if ( !IsRollupBlock(nffile_r->block_header) ) {
+				FlushOutput();
+				printf("Xstat block skipped ...\n");
+			}
 			continue;
 		}
 
@@ -551,7 +611,7 @@ int	v1_map_done = 0;
 				case CommonRecordType:  {
 					int match;
 					uint32_t map_id = flow_record->ext_map;
-					generic_exporter_t *exp_info = exporter_list[flow_record->exporter_sysid];
+					generic_exporter_t *exp_info;
 					if ( map_id >= MAX_EXTENSION_MAPS ) {
 						LogError("Corrupt data file. Extension map id %u too big.\n", flow_record->ext_map);
 						exit(255);
@@ -563,6 +623,7 @@ int	v1_map_done = 0;
 					} 
 
 					total_flows++;
+					exp_info = exporter_list[GetExporterSysID(flow_record, extension_map_list->slot[map_id])];
 					master_record = &(extension_map_list->slot[map_id]->master_record);
 					Engine->nfrecord = (uint64_t *)master_record;
 					ExpandRecord_v2( flow_record, extension_map_list->slot[map_id], 
@@ -605,6 +666,9 @@ int	v1_map_done = 0;
 							AppendToBuffer(nffile_w, (void *)flow_record, flow_record->size);
 							if ( xstat ) 
 								UpdateXStat(xstat, master_record);
+						} else if ( parallel_print ) {
+							if ( limitflows == 0 || stat_record.numflows <= limitflows ) 
+								PrintThreads_Record(master_record);
 						} else if ( print_record ) {
 							char *string;
 							// if we need to print out this record
@@ -612,9 +676,9 @@ int	v1_map_done = 0;
 							if ( string ) {
 								if ( limitflows ) {
 									if ( (stat_record.numflows <= limitflows) )
-										printf("%s\n", string);
+										OutputString(string);
 								} else 
-									printf("%s\n", string);
+									OutputString(string);
 							}
 						} else { 
 							// mutually exclusive conditions should prevent executing this code
@@ -667,6 +731,9 @@ int	v1_map_done = 0;
 
 		} // for all records
 
+		if ( arrow_batch ) 
+			Arrow_Batch();
+
 		// check if we are done, due to -c option 
 		if ( limitflows ) 
 			done = stat_record.numflows >= limitflows;
@@ -699,6 +766,13 @@ int	v1_map_done = 0;
 		} // else stdout
 	}	 
 
+	// print any buffered flows
+	if ( parallel_print ) {
+		PrintThreads_Flush();
+		PrintThreads_Dispose();
+	}
+	FlushOutput();
+
 	PackExtensionMapList(extension_map_list);
 
 	DisposeFile(nffile_r);
@@ -713,19 +787,26 @@ stat_record_t	sum_stat;
 printer_t 	print_header, print_record;
 nfprof_t 	profile_data;
 char 		*rfile, *Rfile, *Mdirs, *wfile, *ffile, *filter, *tstring, *stat_type;
+char		*partial_wfile, *partial_files[MAX_PARTIAL_FILES];
 char		*byte_limit_string, *packet_limit_string, *print_format, *record_header;
-char		*print_order, *query_file, *UnCompress_file, *nameserver, *aggr_fmt;
+char		*print_order, *query_file, *UnCompress_file, *nameserver, *aggr_fmt, *query_socket;
 int 		c, ffd, ret, element_stat, fdump;
 int 		i, user_format, quiet, flow_stat, topN, aggregate, aggregate_mask, bidir;
 int 		print_stat, syntax_only, date_sorted, do_tag, compress, do_xstat;
-int			plain_numbers, GuessDir, pipe_output, csv_output;
+int			plain_numbers, GuessDir, pipe_output, csv_output, arrow_output, time_slot, num_partials;
+int			use_cache;
 time_t 		t_start, t_end;
 uint16_t	Aggregate_Bits;
 uint32_t	limitflows;
 uint64_t	AggregateMasks[AGGR_SIZE];
 char 		Ident[IDENTLEN];
 
+	// run this query on the query server
+	if ( argc > 2 && strcmp(argv[1], "-Q") == 0 ) 
+		exit(RunQueryClient(argv[2], argc - 3, argv + 3));
+
 	rfile = Rfile = Mdirs = wfile = ffile = filter = tstring = stat_type = NULL;
+	query_socket = NULL;
 	byte_limit_string = packet_limit_string = NULL;
 	fdump = aggregate = 0;
 	aggregate_mask	= 0;
@@ -749,8 +830,14 @@ char 		Ident[IDENTLEN];
 	plain_numbers   = 0;
 	pipe_output		= 0;
 	csv_output		= 0;
+	arrow_output	= 0;
+	use_cache		= 0;
 	is_anonymized	= 0;
 	GuessDir		= 0;
+	time_slot		= 0;
+	num_partials	= 0;
+	partial_wfile	= NULL;
+	print_threads	= PrintThreads_Default();
 	nameserver		= NULL;
 
 	print_format    = NULL;
@@ -767,7 +854,7 @@ char 		Ident[IDENTLEN];
 
 	for ( i=0; i<AGGR_SIZE; AggregateMasks[i++] = 0 ) ;
 
-	while ((c = getopt(argc, argv, "6aA:Bbc:D:E:s:hHn:i:j:f:qzr:v:w:K:M:NImO:R:XZt:TVv:x:l:L:o:")) != EOF) {
+	while ((c = getopt(argc, argv, "6aA:Bbc:C:D:E:s:hHn:i:j:J:f:qzr:v:w:W:K:M:NImO:P:R:U:XZt:TVv:x:l:L:o:Y:")) != EOF) {
 		switch (c) {
 			case 'h':
 				usage(argv[0]);
@@ -792,6 +879,11 @@ char 		Ident[IDENTLEN];
 				// implies
 				aggregate = 1;
 				break;
+			case 'C':
+				if ( !CacheInit(optarg) )
+					exit(255);
+				use_cache = 1;
+				break;
 			case 'D':
 				nameserver = optarg;
 				if ( !set_nameserver(nameserver) ) {
@@ -812,6 +904,13 @@ char 		Ident[IDENTLEN];
 			case 'Z':
 				syntax_only = 1;
 				break;
+			case 'U':
+				if ( query_process ) {
+					LogError("-U not allowed in a query\n");
+					exit(255);
+				}
+				query_socket = optarg;
+				break;
 			case 'q':
 				quiet = 1;
 				break;
@@ -893,12 +992,36 @@ char 		Ident[IDENTLEN];
 				}
 				date_sorted = ret == 6;		// index into order_mode
 				} break;
+			case 'P':
+				time_slot = atoi(optarg);
+				if ( time_slot <= 0 || !SetTimeSlot(time_slot) ) {
+					LogError("Time slot '%s' out of range\n", optarg);
+					exit(255);
+				}
+				break;
 			case 'R':
 				Rfile = optarg;
 				break;
 			case 'w':
 				wfile = optarg;
 				break;
+			case 'W':
+				partial_wfile = optarg;
+				break;
+			case 'Y':
+				print_threads = atoi(optarg);
+				if ( print_threads < 1 || print_threads > MaxPrintThreads ) {
+					LogError("Number of print threads out of range 1..%i\n", MaxPrintThreads);
+					exit(255);
+				}
+				break;
+			case 'J':
+				if ( num_partials == MAX_PARTIAL_FILES ) {
+					LogError("Too many partial files. Max %i allowed\n", MAX_PARTIAL_FILES);
+					exit(255);
+				}
+				partial_files[num_partials++] = optarg;
+				break;
 			case 'n':
 				topN = atoi(optarg);
 				if ( topN < 0 ) {
@@ -941,6 +1064,13 @@ char 		Ident[IDENTLEN];
 				exit(0);
 		}
 	}
+	// serve queries - each query runs in a forked process
+	if ( query_socket ) {
+		if ( !RunQueryServer(query_socket, run_query) ) 
+			exit(255);
+		exit(0);
+	}
+
 	if (argc - optind > 1) {
 		usage(argv[0]);
 		exit(255);
@@ -965,6 +1095,40 @@ char 		Ident[IDENTLEN];
 		aggregate = 1;
 	}
 
+	if ( time_slot && !(aggregate || flow_stat || element_stat || num_partials) ) {
+		LogError("Time slots -P need aggregation -a, -A or statistics -s\n");
+		exit(255);
+	}
+
+	if ( partial_wfile && wfile ) {
+		LogError("-w and -W are mutually exclusive\n");
+		exit(255);
+	}
+	if ( partial_wfile && !(aggregate || flow_stat || element_stat || num_partials) ) {
+		LogError("-W needs statistics -s or aggregation -a, -A\n");
+		exit(255);
+	}
+	if ( partial_wfile && element_stat && (aggregate || flow_stat) ) {
+		LogError("-W writes either element statistics or the aggregated flows. -s record can not be combined with other stats\n");
+		exit(255);
+	}
+	if ( num_partials && (rfile || Rfile || Mdirs || aggregate || flow_stat || print_order) ) {
+		LogError("-J merges element statistics only and can not be combined with -r, -R, -M, -a, -A, -m or -s record\n");
+		exit(255);
+	}
+	if ( num_partials ) {
+		// setup stats from the first partial file, unless given by -s
+		if ( !SetStatPartial(partial_files[0]) )
+			exit(255);
+		element_stat = 1;
+	}
+
+	// aggregated flows are written as regular nfdump file and merged by reading it again with -a/-A
+	if ( partial_wfile && !element_stat ) {
+		wfile = partial_wfile;
+		partial_wfile = NULL;
+	}
+
 	if ( rfile && Rfile ) {
 		LogError("-r and -R are mutually exclusive. Plase specify either -r or -R\n");
 		exit(255);
@@ -991,6 +1155,11 @@ char 		Ident[IDENTLEN];
 		memset((void *)&sum_stat, 0, sizeof(stat_record_t));
 		sum_stat.first_seen = 0x7fffffff;
 		sum_stat.msec_first = 999;
+		// answer from the file index without opening the files, if available
+		if ( GetIndexStat(&sum_stat) ) {
+			PrintStat(&sum_stat);
+			exit(0);
+		}
 		nffile = GetNextFile(NULL, 0, 0);
 		if ( !nffile ) {
 			LogError("Error open file: %s\n", strerror(errno));
@@ -1069,6 +1238,15 @@ char 		Ident[IDENTLEN];
 						set_record_header();
 						record_header = get_record_header();
 					}
+					// binary Arrow output - no header or summary text
+					if ( strncasecmp(print_format, "arrow", MAXMODELEN) == 0 ) {
+						arrow_output = ARROW_FILE;
+						quiet = 1;
+					}
+					if ( strncasecmp(print_format, "arrows", MAXMODELEN) == 0 ) {
+						arrow_output = ARROW_STREAM;
+						quiet = 1;
+					}
 					// predefined static format
 					print_record  = printmap[i].func;
 					user_format	  = 0;
@@ -1121,6 +1299,9 @@ char 		Ident[IDENTLEN];
 		FilterFilename = ffile;
 	}
 
+	// plain element statistics may be answered from the rollups of the files
+	use_rollups = !filter || strlen(filter) == 0;
+
 	// if no filter is given, set the default ip filter which passes through every flow
 	if ( !filter  || strlen(filter) == 0 ) 
 		filter = "any";
@@ -1143,6 +1324,16 @@ char 		Ident[IDENTLEN];
 		exit(255);
 	}
 
+	if ( arrow_output && !wfile && !partial_wfile ) {
+		if ( flow_stat && element_stat ) {
+			LogError("-s record and element statistics can not be combined in arrow output\n");
+			exit(255);
+		}
+		if ( !Arrow_Init(arrow_output, element_stat ? ARROW_STATS : ARROW_FLOWS) )
+			exit(255);
+	} else
+		arrow_output = 0;
+
 	if ((aggregate || flow_stat || print_order)  && !Init_FlowTable() )
 			exit(250);
 
@@ -1157,7 +1348,18 @@ char 		Ident[IDENTLEN];
 	}
 
 
-	if ( !(flow_stat || element_stat || wfile || quiet ) && record_header ) {
+	use_rollups = use_rollups && element_stat && !(aggregate || flow_stat || print_order) && !t_start &&
+		!limitflows && !packet_limit_string && !byte_limit_string && !partial_wfile && !num_partials && RollupCompatible();
+
+	// repeated statistics queries over the same files may be answered from the result cache
+	if ( use_cache && (aggregate || flow_stat || element_stat) && !wfile && !partial_wfile && !num_partials ) {
+		char **files;
+		int num_files = GetFileNames(&files);
+		if ( CacheLookup(argc, argv, filter, files, num_files) )
+			exit(0);
+	}
+
+	if ( !(flow_stat || element_stat || wfile || quiet ) && record_header && !num_partials ) {
 		if ( user_format ) {
 			printf("%s\n", record_header);
 		} else {
@@ -1170,13 +1372,34 @@ char 		Ident[IDENTLEN];
 	}
 
 	nfprof_start(&profile_data);
-	sum_stat = process_data(wfile, element_stat, aggregate || flow_stat, print_order != NULL,
-						print_header, print_record, t_start, t_end, 
-						limitflows, do_tag, compress, do_xstat);
+	if ( num_partials ) {
+		memset((void *)&sum_stat, 0, sizeof(stat_record_t));
+		sum_stat.first_seen = 0x7fffffff;
+		sum_stat.msec_first = 999;
+		for ( i=0; i<num_partials; i++ ) {
+			struct stat stat_buff;
+			if ( !MergeStatPartial(partial_files[i], &sum_stat) )
+				exit(255);
+			if ( stat(partial_files[i], &stat_buff) == 0 ) 
+				total_bytes += stat_buff.st_size;
+		}
+		t_first_flow = sum_stat.first_seen;
+		t_last_flow  = sum_stat.last_seen;
+	} else {
+		sum_stat = process_data(wfile, element_stat, aggregate || flow_stat, print_order != NULL,
+							print_header, print_record, t_start, t_end, 
+							limitflows, do_tag, compress, do_xstat);
+	}
 	nfprof_end(&profile_data, total_flows);
 
 	if ( total_bytes == 0 ) {
-		printf("No matched flows\n");
+		if ( arrow_output ) {
+			// an empty table
+			Arrow_Close();
+			FlushOutput();
+		} else
+			printf("No matched flows\n");
+		CacheDone();
 		exit(0);
 	}
 
@@ -1204,14 +1427,22 @@ char 		Ident[IDENTLEN];
 #endif
 	} 
 
-	if (element_stat) {
+	if ( partial_wfile ) {
+		if ( !WriteStatPartial(partial_wfile, &sum_stat) )
+			exit(255);
+	} else if (element_stat) {
 		PrintElementStat(&sum_stat, plain_numbers, record_header, print_record, topN, do_tag, quiet, pipe_output, csv_output);
 	} 
 
+	if ( arrow_output ) {
+		Arrow_Close();
+		FlushOutput();
+	}
+
 	if ( !quiet ) {
 		if ( csv_output ) {
 			PrintSummary(&sum_stat, plain_numbers, csv_output);
-		} else if ( !wfile ) {
+		} else if ( !wfile && !partial_wfile ) {
 			if (is_anonymized)
 				printf("IP addresses anonymised\n");
 			PrintSummary(&sum_stat, plain_numbers, csv_output);
@@ -1231,6 +1462,9 @@ char 		Ident[IDENTLEN];
 	Dispose_StatTable();
 	FreeExtensionMaps(extension_map_list);
 
+	FlushOutput();
+	CacheDone();
+
 #ifdef DEVEL
 	if ( hash_hit || hash_miss )
 		printf("Hash hit: %i, miss: %i, skip: %i, ratio: %5.3f\n", hash_hit, hash_miss, hash_skip, (float)hash_hit/((float)(hash_hit+hash_miss)));
@@ -1238,3 +1472,12 @@ char 		Ident[IDENTLEN];
 
 	return 0;
 }
+
+// run a query of the query server in the forked query process
+static int run_query(int argc, char **argv) {
+
+	query_process = 1;
+	optind = 1;
+	return main(argc, argv);
+
+} // End of run_query
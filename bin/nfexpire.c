@@ -84,6 +84,7 @@ static void usage(char *name) {
 					"-l datadir\tList stat from directory\n"
 					"-e datadir\tExpire data in directory\n"
 					"-r datadir\tRescan data directory\n"
+					"-i datadir\tRebuild file index of data directory\n"
 					"-u datadir\tUpdate expire params from collector logging at <datadir>\n"
 					"-s size\t\tmax size: scales b bytes, k kilo, m mega, g giga t tera\n"
 					"-t lifetime\tmaximum life time of data: scales: w week, d day, H hour, M minute\n"
@@ -94,7 +95,7 @@ static void usage(char *name) {
 
 void CheckDataDir( char *datadir) {
 	if ( datadir ) {
-		fprintf(stderr, "Specify only one option out of -l -e -r -u or -p \n");
+		fprintf(stderr, "Specify only one option out of -l -e -r -i -u or -p \n");
 		exit(250);
 	}
 } // End of CheckDataDir
@@ -210,7 +211,7 @@ int i;
 int main( int argc, char **argv ) {
 struct stat fstat;
 int 		c, err, maxsize_set, maxlife_set;
-int			do_rescan, do_expire, do_list, print_stat, do_update_param, print_books, is_profile, nfsen_format;
+int			do_rescan, do_expire, do_list, do_index, print_stat, do_update_param, print_books, is_profile, nfsen_format;
 char		*maxsize_string, *lifetime_string, *datadir;
 uint64_t	maxsize, lifetime, low_water;
 uint32_t	runtime;
@@ -222,6 +223,7 @@ channel_t	*channel, *current_channel;
 	do_rescan  		= 0;
 	do_expire  		= 0;
 	do_list	   		= 0;
+	do_index   		= 0;
 	do_update_param = 0;
 	is_profile		= 0;
 	print_stat		= 0;
@@ -232,7 +234,7 @@ channel_t	*channel, *current_channel;
 	nfsen_format	= 0;
 	runtime			= 0;
 
-	while ((c = getopt(argc, argv, "e:hl:L:T:Ypr:s:t:u:w:")) != EOF) {
+	while ((c = getopt(argc, argv, "e:hi:l:L:T:Ypr:s:t:u:w:")) != EOF) {
 		switch (c) {
 			case 'h':
 				usage(argv[0]);
@@ -259,6 +261,11 @@ channel_t	*channel, *current_channel;
 				print_stat = 1;
 				datadir = optarg;
 				break;
+			case 'i':
+				CheckDataDir(datadir);
+				datadir = optarg;
+				do_index = 1;
+				break;
 			case 'e':
 				CheckDataDir(datadir);
 				datadir = optarg;
@@ -390,6 +397,21 @@ channel_t	*channel, *current_channel;
 		current_channel = current_channel->next;
 	}
 
+	// process do_index: build the file index of all channels
+	if ( do_index ) {
+		current_channel = channel;
+		while ( current_channel ) {
+			int numfiles;
+			printf("Indexing files in %s .. ", current_channel->datadir);
+			numfiles = RebuildIndex(current_channel->datadir);
+			if ( numfiles < 0 ) 
+				printf("failed.\n");
+			else
+				printf("%i files indexed.\n", numfiles);
+			current_channel = current_channel->next;
+		}
+	}
+
 	// now process do_expire if required
 	if ( do_expire ) {
 		dirstat_t	old_stat, current_stat;
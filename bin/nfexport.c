@@ -60,6 +60,7 @@
 #include "nfx.h"
 #include "nfstat.h"
 #include "nfxstat.h"
+#include "nfarena.h"
 #include "nflowcache.h"
 #include "exporter.h"
 
@@ -271,7 +272,7 @@ char				*string;
 	maxindex = FlowTable->NumRecords;
 	if ( date_sorted ) {
 		// Sort records according the date
-		SortList = (SortElement_t *)calloc(maxindex, sizeof(SortElement_t));
+		SortList = (SortElement_t *)LargeAlloc(maxindex * sizeof(SortElement_t));
 
 		if ( !SortList ) {
 			LogError("malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror (errno));
@@ -311,7 +312,10 @@ char				*string;
 			extension_info = r->map_info_ref;
 
 			flow_record = &(extension_info->master_record);
-			ExpandRecord_v2( raw_record, extension_info, r->exp_ref, flow_record);
+			if ( FlowTable->compact ) 
+				ExpandCompactRecord(r, flow_record);
+			else
+				ExpandRecord_v2( raw_record, extension_info, r->exp_ref, flow_record);
 			flow_record->dPkts 		= r->counter[INPACKETS];
 			flow_record->dOctets 	= r->counter[INBYTES];
 			flow_record->out_pkts 	= r->counter[OUTPACKETS];
@@ -344,6 +348,7 @@ char				*string;
 			// Update statistics
 			UpdateStat(nffile->stat_record, flow_record);
 		}
+		LargeFree((void *)SortList);
 
 	} else {
 		// print them as they came
@@ -358,7 +363,10 @@ char				*string;
 				extension_info = r->map_info_ref;
 
 				flow_record = &(extension_info->master_record);
-				ExpandRecord_v2( raw_record, extension_info, r->exp_ref, flow_record);
+				if ( FlowTable->compact ) 
+					ExpandCompactRecord(r, flow_record);
+				else
+					ExpandRecord_v2( raw_record, extension_info, r->exp_ref, flow_record);
 				flow_record->dPkts 		= r->counter[INPACKETS];
 				flow_record->dOctets 	= r->counter[INBYTES];
 				flow_record->out_pkts 	= r->counter[OUTPACKETS];
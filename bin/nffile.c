@@ -72,12 +72,14 @@ char 	*CurrentIdent;
 
 // LZO params
 #define LZO_BUFFSIZE  ((BUFFSIZE + BUFFSIZE / 16 + 64 + 3) + sizeof(data_block_header_t))
-#define HEAP_ALLOC(var,size) \
-    lzo_align_t __LZO_MMODEL var [ ((size) + (sizeof(lzo_align_t) - 1)) / sizeof(lzo_align_t) ]
 
-static HEAP_ALLOC(wrkmem,LZO1X_1_MEM_COMPRESS);
-static void *lzo_buff;
-static int lzo_initialized = 0;
+// compression buffers are per thread, as files may be compressed in parallel
+static __thread lzo_voidp wrkmem;
+static __thread void *lzo_buff;
+static __thread int lzo_initialized = 0;
+
+// optional cache of decompressed blocks
+static block_cache_t *block_cache = NULL;
 
 #define ERR_SIZE 256
 static char	error_string[ERR_SIZE];
@@ -138,7 +140,8 @@ static int LZO_initialize(void) {
 			return 0;
 	} 
 	lzo_buff = malloc(BUFFSIZE+ sizeof(data_block_header_t));
-	if ( !lzo_buff ) {
+	wrkmem	 = malloc(LZO1X_1_MEM_COMPRESS);
+	if ( !lzo_buff || !wrkmem ) {
 		LogError("malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
 		return 0;
 	}
@@ -506,13 +509,20 @@ nffile_t		*nffile;
 		return NULL;
 
 	// file is valid - re-open the file mode RDWR
+	// no O_APPEND: CloseUpdateFile() needs to rewrite the header at the beginning of the file
 	close(nffile->fd);
-	nffile->fd = open(filename, O_RDWR | O_APPEND, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH );
+	nffile->fd = open(filename, O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH );
 	if ( nffile->fd < 0 ) {
 		LogError("Failed to open file %s: '%s'" , filename, strerror(errno));
 		DisposeFile(nffile);
 		return NULL;
 	}
+	if ( lseek(nffile->fd, 0, SEEK_END) < 0 ) {
+		LogError("lseek() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		close(nffile->fd);
+		DisposeFile(nffile);
+		return NULL;
+	}
 
 	// init output data buffer
 	nffile->block_header = malloc(BUFFSIZE + sizeof(data_block_header_t));
@@ -589,9 +599,22 @@ int CloseUpdateFile(nffile_t *nffile, char *ident) {
 
 } /* End of CloseUpdateFile */
 
+void SetBlockCache(block_cache_t *cache) {
+
+	block_cache = cache;
+
+} // End of SetBlockCache
+
 int ReadBlock(nffile_t *nffile) {
 ssize_t ret, read_bytes, buff_bytes, request_size;
 void 	*read_ptr, *buff;
+struct stat stat_buf;
+off_t	offset;
+
+	// only compressed blocks of regular files are cached
+	offset = -1;
+	if ( block_cache && FILE_IS_COMPRESSED(nffile) && fstat(nffile->fd, &stat_buf) == 0 && S_ISREG(stat_buf.st_mode) ) 
+		offset = lseek(nffile->fd, 0, SEEK_CUR);
 
 	ret = read(nffile->fd, nffile->block_header, sizeof(data_block_header_t));
 	if ( ret == 0 )		// EOF
@@ -617,6 +640,22 @@ void 	*read_ptr, *buff;
 		return NF_CORRUPT;
 	}
 
+	if ( offset >= 0 ) {
+		uint32_t size = nffile->block_header->size;
+		if ( block_cache->get(&stat_buf, offset, nffile->block_header) ) {
+			// skip the compressed block
+			if ( lseek(nffile->fd, size, SEEK_CUR) < 0 ) {
+				LogError("lseek() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+				return NF_ERROR;
+			}
+			return read_bytes + nffile->block_header->size;
+		}
+	}
+
+	// the file may have been opened by another thread
+	if ( FILE_IS_COMPRESSED(nffile) && !lzo_initialized && !LZO_initialize() ) 
+		return NF_ERROR;
+
 	buff = FILE_IS_COMPRESSED(nffile) ? lzo_buff : nffile->buff_ptr;
 
 	ret = read(nffile->fd, buff, nffile->block_header->size);
@@ -632,6 +671,8 @@ void 	*read_ptr, *buff;
        			return NF_CORRUPT;
    			}
 			nffile->block_header->size = new_len;
+			if ( offset >= 0 ) 
+				block_cache->put(&stat_buf, offset, nffile->block_header);
 			return read_bytes + new_len;
 		} else
 			return read_bytes + ret;
@@ -723,6 +764,10 @@ lzo_uint out_len;
 		return ret;
 	} 
 
+	// the file may have been opened by another thread
+	if ( !lzo_initialized && !LZO_initialize() ) 
+		return -1;
+
 	out_block_header = (data_block_header_t *)lzo_buff;
 	*out_block_header = *(nffile->block_header);
 
@@ -766,6 +811,10 @@ lzo_uint out_len;
 		return ret;
 	} 
 
+	// the file may have been opened by another thread
+	if ( !lzo_initialized && !LZO_initialize() ) 
+		return -1;
+
 	out_block_header = (data_block_header_t *)lzo_buff;
 	*out_block_header = *(block_header);
 
@@ -147,6 +147,39 @@ typedef struct stat_header_s {
 	uint16_t	size;		// size of the stat record in bytes without this header
 } stat_header_t;
 
+/*
+ * File index
+ * ==========
+ * A data directory may contain an index file INDEX_FILE, created by 'nfexpire -i'.
+ * If the index exists, nfcapd, sfcapd and nfprofile append an index record for each
+ * data file, when the file is closed, and nfexpire drops the records of expired files.
+ * nfdump uses the index to select the files of a -R range without scanning the
+ * directory, and to skip files outside the -t time window without opening them.
+ * The records are in file name order, unless INDEX_UNSORTED is set.
+ * All values are in host byte order.
+ */
+#define INDEX_FILE		".nfindex"
+#define INDEX_MAGIC		0x4E464958	// NFIX
+#define INDEX_VERSION	1
+
+typedef struct index_header_s {
+	uint32_t	magic;			// INDEX_MAGIC
+	uint16_t	version;		// INDEX_VERSION
+	uint16_t	record_size;	// sizeof(index_record_t)
+	uint32_t	flags;
+#define INDEX_UNSORTED	0x1		// records are not in file name order
+	uint32_t	first;			// number of expired records at the start of the index
+} index_header_t;
+
+typedef struct index_record_s {
+	char			name[128];			// file name relative to the data directory
+	char			ident[IDENTLEN];	// ident of the file
+	uint64_t		size;				// file size in bytes
+	uint32_t		t_slot;				// start of the time slot of this file
+	uint32_t		fill;
+	stat_record_t	stat_record;		// stat record of the file
+} index_record_t;
+
 
 // Netflow v9 field type/values
 
@@ -236,6 +269,18 @@ typedef struct nffile_s {
 	int					fd;				// file descriptor
 } nffile_t;
 
+/*
+ * Optional cache of decompressed data blocks, e.g. shared by all queries of the nfdump
+ * query server. A block is identified by the stat of its file and its file offset.
+ * get() returns 1 and copies header and data of the block into block_header, if cached.
+ * put() offers a freshly decompressed block to the cache.
+ */
+struct stat;
+typedef struct block_cache_s {
+	int		(*get)(struct stat *stat_buf, off_t offset, data_block_header_t *block_header);
+	void	(*put)(struct stat *stat_buf, off_t offset, data_block_header_t *block_header);
+} block_cache_t;
+
 /* 
  * The new block type 2 introduces a changed common record and multiple extension records. This allows a more flexible data
  * storage of netflow v9 records and 3rd party extension to nfdump.
@@ -253,6 +298,7 @@ typedef struct nffile_s {
  * Type 2: Extension map
  * Type 3: xstat - port histogram record
  * Type 4: xstat - bpp histogram record
+ * Type 11: rollup - per file top K elements of a stat
  */
 
 #define CommonRecordType	1
@@ -272,6 +318,9 @@ typedef struct nffile_s {
 // new extension record type for 1.7
 #define ExtensionMap17Type	10
 
+// rollup record in Large_BLOCK_Type block
+#define RollupRecordType	11
+
  /* 
  * All records are 32bit aligned and layouted in a 64bit array. The numbers placed in () refer to the netflow v9 type id.
  *
@@ -344,6 +393,8 @@ typedef struct common_record_s {
 #define ClearFlag(var, flag) 	(var &= ~flag)
 #define TestFlag(var, flag)		(var & flag)
 
+	// low 8 bits of the exporter sysid. Records of exporters with a sysid > 255 
+	// carry the full sysid in extension EX_EXPORTER_SYSID
 	uint8_t		exporter_sysid;
  	uint16_t	ext_map;
 
@@ -909,8 +960,20 @@ typedef struct tpl_ext_27_s {
 } tpl_ext_27_t;
 
 
+/*
+ * exporter sysid
+ * The common record has room for an 8 bit exporter sysid only. nfcapd adds this extension
+ * to the records of all exporters with a sysid > 255
+ * +----+--------------+--------------+--------------+--------------+
+ * |  0 |                        exporter sysid                     |
+ * +----+--------------+--------------+--------------+--------------+
+ */
+#define EX_EXPORTER_SYSID	28
+typedef struct tpl_ext_28_s {
+	uint32_t	exporter_sysid;
+	uint8_t		data[4];	// points to further data
+} tpl_ext_28_t;
 
-#define EX_RESERVED_1	28
 #define EX_RESERVED_2	29
 #define EX_RESERVED_3	30
 #define EX_RESERVED_4	31
@@ -1238,6 +1301,7 @@ typedef struct exporter_info_record_s {
 	uint16_t	sa_family;
 
 	// internal assigned ID
+#define MAX_EXPORTER_SYSID	65535
 	uint16_t	sysid;
 
 	// exporter ID/Domain ID/Observation Domain ID assigned by the device
@@ -1347,20 +1411,15 @@ typedef struct master_record_s {
 	uint16_t	type;			// index 0  0xffff 0000 0000 0000
 	uint16_t	size;			// index 0	0x0000'ffff'0000 0000
 	uint8_t		flags;			// index 0	0x0000'0000'ff00'0000
-	uint8_t		exporter_sysid;	// index 0	0x0000'0000'00ff'0000
+	uint8_t		exporter_sysid_lo;	// index 0	0x0000'0000'00ff'0000 - full sysid see below
 	uint16_t	ext_map;		// index 0	0x0000'0000'0000'ffff
 #	define OffsetRecordFlags 	0
-#	define OffsetExporterSysID	0
 #ifdef WORDS_BIGENDIAN
 #	define MaskRecordFlags  	0x00000000ff000000LL
-#	define MaskExporterSysID  	0x0000000000ff0000LL
 #	define ShiftRecordFlags 	24
-#	define ShiftExporterSysID 	16
 #else
 #	define MaskRecordFlags  	0x000000ff00000000LL
-#	define MaskExporterSysID  	0x0000ff0000000000LL
 #	define ShiftRecordFlags 	32
-#	define ShiftExporterSysID 	40
 #endif
 
 	//
@@ -1768,20 +1827,27 @@ typedef struct master_record_s {
 	uint16_t	fill;			// fill	index 31 0xffff'0000'0000'0000
 	uint8_t		engine_type;	// type index 31 0x0000'ff00'0000'0000
 	uint8_t		engine_id;		// ID	index 31 0x0000'00ff'0000'0000
-	uint32_t	fill2;
+
+	// common record / extension 28
+	uint32_t	exporter_sysid;	// index 31 0x0000'0000'ffff'ffff
 
 #	define OffsetRouterID	31
+#	define OffsetExporterSysID	31
 #ifdef WORDS_BIGENDIAN
 #	define MaskEngineType		0x0000FF0000000000LL
 #	define ShiftEngineType		40
 #	define MaskEngineID			0x000000FF00000000LL
 #	define ShiftEngineID		32
+#	define MaskExporterSysID	0x00000000FFFFFFFFLL
+#	define ShiftExporterSysID	0
 
 #else
 #	define MaskEngineType		0x0000000000FF0000LL
 #	define ShiftEngineType		16
 #	define MaskEngineID			0x00000000FF000000LL
 #	define ShiftEngineID		24
+#	define MaskExporterSysID	0xFFFFFFFF00000000LL
+#	define ShiftExporterSysID	32
 #endif
 
 	// IPFIX extensions in v9
@@ -2091,6 +2157,8 @@ int CloseUpdateFile(nffile_t *nffile, char *ident);
 
 int ReadBlock(nffile_t *nffile);
 
+void SetBlockCache(block_cache_t *cache);
+
 int WriteBlock(nffile_t *nffile);
 
 int WriteExtraBlock(nffile_t *nffile, data_block_header_t *block_header);
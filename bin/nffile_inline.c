@@ -50,6 +50,23 @@ static inline void CopyV6IP(uint32_t *dst, uint32_t *src);
 
 static inline void ExpandRecord_v2(common_record_t *input_record, extension_info_t *extension_info, exporter_info_record_t *exporter_info, master_record_t *output_record );
 
+static inline uint32_t GetExporterSysID(common_record_t *record, extension_info_t *extension_info);
+
+/*
+ * returns the full exporter sysid of a record. The EX_EXPORTER_SYSID extension
+ * is located at a fixed offset from the end of the record.
+ */
+static inline uint32_t GetExporterSysID(common_record_t *record, extension_info_t *extension_info) {
+
+	if ( extension_info->sysid_offset ) {
+		tpl_ext_28_t *tpl = (tpl_ext_28_t *)((pointer_addr_t)record + record->size - extension_info->sysid_offset);
+		return tpl->exporter_sysid;
+	}
+
+	return record->exporter_sysid;
+
+} // End of GetExporterSysID
+
 #ifdef NEED_PACKRECORD
 static void PackRecord(master_record_t *master_record, nffile_t *nffile);
 #endif
@@ -107,9 +124,11 @@ void		*p = (void *)input_record;
 	if ( exporter_info ) {
 		uint32_t sysid = exporter_info->sysid;
 		output_record->exporter_sysid = sysid;
-		input_record->exporter_sysid  = sysid;
+		input_record->exporter_sysid  = sysid & 0xFF;
 		output_record->exp_ref 		  = exporter_info;
 	} else {
+		// overwritten by extension EX_EXPORTER_SYSID, if available
+		output_record->exporter_sysid = input_record->exporter_sysid;
 		output_record->exp_ref 		  = NULL;
 	}
 
@@ -347,6 +366,14 @@ void		*p = (void *)input_record;
 				output_record->received = v.val.val64;
 				p = (void *)tpl->data;
 			} break;
+			case EX_EXPORTER_SYSID: {
+				tpl_ext_28_t *tpl = (tpl_ext_28_t *)p;
+				if ( exporter_info ) 
+					tpl->exporter_sysid = exporter_info->sysid;
+				else
+					output_record->exporter_sysid = tpl->exporter_sysid;
+				p = (void *)tpl->data;
+			} break;
 #ifdef NSEL
 			case EX_NSEL_COMMON: {
 				tpl_ext_37_t *tpl = (tpl_ext_37_t *)p;
@@ -471,6 +498,7 @@ int		i;
 	// write common record
 	size = COMMON_RECORD_DATA_SIZE;
 	memcpy(p, (void *)master_record, size);
+	((common_record_t *)p)->exporter_sysid = master_record->exporter_sysid & 0xFF;
 	p = (void *)((pointer_addr_t)p + size);
 
 	// Required extension 1 - IP addresses
@@ -676,6 +704,11 @@ int		i;
 				tpl->received = master_record->received;
 				p = (void *)tpl->data;
 				} break;
+			case EX_EXPORTER_SYSID: {
+				tpl_ext_28_t *tpl = (tpl_ext_28_t *)p;
+				tpl->exporter_sysid = master_record->exporter_sysid;
+				p = (void *)tpl->data;
+				} break;
 #ifdef NSEL
 			case EX_NSEL_COMMON: {
 				tpl_ext_37_t *tpl = (tpl_ext_37_t *)p;
@@ -54,6 +54,7 @@
 
 #include "nffile.h"
 #include "nfx.h"
+#include "nfarena.h"
 #include "nflowcache.h"
 
 #ifndef DEVEL
@@ -62,24 +63,32 @@
 #   define dbg_printf(...) printf(__VA_ARGS__)
 #endif
 
-#define ALIGN_BYTES (offsetof (struct { char x; uint64_t y; }, y) - 1)
-
 extern int hash_hit;
 extern int hash_miss;
 extern int hash_skip;
 
 /* function prototypes */
-static void MemoryHandle_free(MemoryHandle_t *handle);
+static inline FlowTableRecord_t *hash_insert_FlowTable(uint32_t index_cache, void *flowkey, common_record_t *flow_record);
 
-static int MemoryHandle_init(MemoryHandle_t *handle);
+static inline int TimeMsec_CMP(time_t t1, uint16_t offset1, time_t t2, uint16_t offset2 );
 
-static inline void *MemoryHandle_get(MemoryHandle_t *handle, uint32_t size);
+static inline uint32_t KeyHash(uint64_t *key, uint32_t keylen);
 
-static inline FlowTableRecord_t *hash_insert_FlowTable(uint32_t index_cache, void *flowkey, common_record_t *flow_record);
+static int CompileAggregateKey(void);
 
-static inline int TimeMsec_CMP(time_t t1, uint16_t offset1, time_t t2, uint16_t offset2 );
+static void Key_Generic(uint64_t *key, uint64_t *record);
+
+static void Key_1(uint64_t *key, uint64_t *record);
+
+static void Key_2(uint64_t *key, uint64_t *record);
 
-static inline uint32_t SuperFastHash (const char * data, int len);
+static void Key_3(uint64_t *key, uint64_t *record);
+
+static void Key_4(uint64_t *key, uint64_t *record);
+
+static void Key_5(uint64_t *key, uint64_t *record);
+
+static void Key_6(uint64_t *key, uint64_t *record);
 
 static inline void New_Hash_Key(void *keymem, master_record_t *flow_record, int swap_flow);
 
@@ -166,6 +175,33 @@ typedef struct Default_key_s {
 } Default_key_t;
 
 
+/*
+ * Compiled aggregation key
+ * ParseAggregateMask() compiles the aggregate_stack into a list of key operations. Each
+ * operation extracts a masked value from the master record and places it at bit position
+ * pos of the key word. Values of the same master record word with adjacent bits, such as
+ * srcport and dstport, are extracted by a single operation. Full 64bit values ( IP addresses )
+ * get their own key word, all smaller values are packed into as few key words as possible.
+ * The key is therefore a multiple of uint64_t and hashed and compared word by word.
+ * If each operation fills exactly one key word - e.g. -A srcip,dstport - a straight-line
+ * key function without loop is selected.
+ */
+#define MaxKeyOps 64
+
+typedef struct aggregate_key_op_s {
+	uint32_t	offset;		// offset in master record
+	uint32_t	word;		// key word index
+	uint64_t	mask;		// mask for this value in master record
+	uint32_t	shift;		// right shift of masked value
+	uint32_t	pos;		// left shift into key word
+	uint32_t	width;		// number of bits of the value
+} aggregate_key_op_t;
+
+static aggregate_key_op_t	key_op[MaxKeyOps];
+static uint32_t				num_key_ops   = 0;
+static uint32_t				num_key_words = 0;
+static void					(*Aggregate_Key)(uint64_t *key, uint64_t *record) = Key_Generic;
+
 static aggregate_param_t *aggregate_stack = NULL;
 static uint32_t	aggregate_key_len 		  = sizeof(Default_key_t);
 static uint32_t	bidir_flows				  = 0;
@@ -193,84 +229,6 @@ static inline int TimeMsec_CMP(time_t t1, uint16_t offset1, time_t t2, uint16_t
 		return 0;
 } // End of TimeMsec_CMP
 
-static int MemoryHandle_init(MemoryHandle_t *handle) {
-
-	handle->memblock = (void **)calloc(MaxMemBlocks, sizeof(void *));
-	if ( !handle->memblock ) {
-		fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror (errno));
-		return 0;
-	}
-
-	handle->BlockSize	  = MemBlockSize;
-
-	handle->memblock[0]  = malloc(MemBlockSize);
-	handle->MaxBlocks	= MaxMemBlocks;
-	handle->NumBlocks	= 1;
-	handle->CurrentBlock = 0;
-	handle->Allocted 	 = 0;
-	
-	return 1;
-
-} // End of  MemoryHandle_init
-
-static void MemoryHandle_free(MemoryHandle_t *handle) {
-int i;
-
-	dbg_printf("MEM: NumBlocks: %u\n", handle->NumBlocks);
-	for ( i=0; i < handle->NumBlocks; i++ ) {
-		free(handle->memblock[i]);
-	}
-	handle->NumBlocks	= 0;
-	handle->CurrentBlock = 0;
-	handle->Allocted 	 = 0;
-
-	free((void *)handle->memblock);
-	handle->memblock	= NULL;
-	handle->MaxBlocks	= 0;
-
-} // End of MemoryHandle_free
-
-static inline void *MemoryHandle_get(MemoryHandle_t *handle, uint32_t size) {
-void 		*p;
-uint32_t	aligned_size;
-
-	// make sure size of memory is aligned
-	aligned_size = (((u_int)(size) + ALIGN_BYTES) &~ ALIGN_BYTES);
-
-	if ( (handle->Allocted+aligned_size) > MemBlockSize ) {
-		// not enough space - allocate a new memblock
-
-		handle->CurrentBlock++;
-		if ( handle->CurrentBlock >= handle->MaxBlocks ) {
-			// we run out in memblock array - re-allocate memblock array
-			handle->MaxBlocks += MaxMemBlocks;
-			handle->memblock   = (void **)realloc(handle->memblock, handle->MaxBlocks * sizeof(void *));
-			if ( !handle->memblock ) {
-				fprintf(stderr, "realloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror (errno));
-				exit(255);
-			}
-		} 
-
-		// allocate new memblock
-		p = malloc(MemBlockSize);
-		if ( !p ) {
-			fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror (errno));
-			exit(255);
-		}
-		handle->memblock[handle->CurrentBlock] = p;
-		// reset counter for new memblock
-		handle->Allocted = 0;
-		handle->NumBlocks++;
-	} 
-
-	// enough space available in current memblock
-	p = handle->memblock[handle->CurrentBlock] + handle->Allocted;
-	handle->Allocted += aligned_size;
-	dbg_printf("Mem Handle: Requested: %u, aligned: %u, ptr: %lu\n", size, aligned_size, (long unsigned)p);
-	return p;
-
-} // End of MemoryHandle_get
-
 hash_FlowTable *GetFlowTable(void) {
 	return &FlowTable;
 } // End of GetFlowTable
@@ -282,15 +240,25 @@ uint32_t maxindex;
 	FlowTable.IndexMask   = maxindex -1;
 	FlowTable.NumBits	  = HashBits;
 	FlowTable.NumRecords  = 0;
-	FlowTable.bucket	  = (FlowTableRecord_t **)calloc(maxindex, sizeof(FlowTableRecord_t *));
-	FlowTable.bucketcache = (FlowTableRecord_t **)calloc(maxindex, sizeof(FlowTableRecord_t *));
+	FlowTable.bucket	  = (FlowTableRecord_t **)LargeAlloc(maxindex * sizeof(FlowTableRecord_t *));
+	FlowTable.bucketcache = (FlowTableRecord_t **)LargeAlloc(maxindex * sizeof(FlowTableRecord_t *));
 	if ( !FlowTable.bucket || !FlowTable.bucketcache ) {
 		fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror (errno));
 		return 0;
 	}
 
+	// the time slot is appended to the key
+	if ( FlowTable.time_slot ) {
+		FlowTable.slot_offset = aggregate_key_len;
+		aggregate_key_len += sizeof(uint32_t);
+	}
+
 	FlowTable.keysize = aggregate_key_len;
 
+	// with custom aggregation the output record is rebuilt from the key - no need to store the full flow
+	// srcnet/dstnet need the netmask of the flow, which is not part of the key
+	FlowTable.compact = aggregate_stack != NULL && FlowTable.apply_netbits == 0;
+
 	// keylen = number of uint64_t 
  	FlowTable.keylen  = aggregate_key_len >> 3;	// aggregate_key_len / 8
 	if ( (aggregate_key_len & 0x7 ) != 0 )
@@ -299,7 +267,7 @@ uint32_t maxindex;
 	dbg_printf("FlowTable.keysize %i bytes\n", FlowTable.keysize);
 	dbg_printf("FlowTable.keylen %i uint64_t\n", FlowTable.keylen);
 
-	if ( !MemoryHandle_init(&FlowTable.mem) ) 
+	if ( !Arena_Init(&FlowTable.mem, ArenaBlockSize) ) 
 		return 0;
 
 	initialised = 1;
@@ -312,9 +280,9 @@ void Dispose_FlowTable(void) {
 
 	if ( !initialised )
 		return;
-	free((void *)FlowTable.bucket);
-	free((void *)FlowTable.bucketcache);
-	MemoryHandle_free(&FlowTable.mem);
+	LargeFree((void *)FlowTable.bucket);
+	LargeFree((void *)FlowTable.bucketcache);
+	Arena_Free(&FlowTable.mem);
 	FlowTable.NumRecords  	= 0;
 	FlowTable.bucket 		= NULL;
 	FlowTable.bucketcache 	= NULL;
@@ -327,7 +295,7 @@ uint32_t			index;
 int bsize;
 FlowTableRecord_t	*record;
 
-	*index_cache = SuperFastHash((char *)flowkey, FlowTable.keysize);
+	*index_cache = KeyHash((uint64_t *)flowkey, FlowTable.keylen);
 	index = *index_cache & FlowTable.IndexMask;
 
 	if ( FlowTable.bucket[index] == NULL ) {
@@ -384,15 +352,21 @@ inline static FlowTableRecord_t *hash_insert_FlowTable(uint32_t index_cache, voi
 FlowTableRecord_t	*record;
 uint32_t index = index_cache & FlowTable.IndexMask;
 
-	// allocate enough memory for the new flow including all additional information in FlowTableRecord_t
-	// MemoryHandle_get always succeeds. If no memory, MemoryHandle_get already exists cleanly
-	record = MemoryHandle_get(&FlowTable.mem, sizeof(FlowTableRecord_t) - sizeof(common_record_t) + raw_record->size);
+	if ( FlowTable.compact ) {
+		// compact record: keep the record header only - all aggregated values are in the key
+		record = Arena_Alloc(&FlowTable.mem, sizeof(FlowTableRecord_t));
+		memcpy((void *)&record->flowrecord, (void *)raw_record, COMMON_RECORD_DATA_SIZE);
+	} else {
+		// allocate enough memory for the new flow including all additional information in FlowTableRecord_t
+		// Arena_Alloc always succeeds. If no memory, Arena_Alloc already exists cleanly
+		record = Arena_Alloc(&FlowTable.mem, sizeof(FlowTableRecord_t) - sizeof(common_record_t) + raw_record->size);
+		memcpy((void *)&record->flowrecord, (void *)raw_record, raw_record->size);
+	}
 
 	record->next 	 = NULL;
 	record->hash 	 = index_cache;
 	record->hash_key = flowkey;
 
-	memcpy((void *)&record->flowrecord, (void *)raw_record, raw_record->size);
 	if ( FlowTable.bucket[index] == NULL ) 
 		FlowTable.bucket[index] = record;
 	else 
@@ -409,8 +383,8 @@ void InsertFlow(common_record_t *raw_record, master_record_t *flow_record, exten
 FlowTableRecord_t	*record;
 
 	// allocate enough memory for the new flow including all additional information in FlowTableRecord_t
-	// MemoryHandle_get always succeeds. If no memory, MemoryHandle_get already exits cleanly
-	record = MemoryHandle_get(&FlowTable.mem, sizeof(FlowTableRecord_t) - sizeof(common_record_t) + raw_record->size);
+	// Arena_Alloc always succeeds. If no memory, Arena_Alloc already exits cleanly
+	record = Arena_Alloc(&FlowTable.mem, sizeof(FlowTableRecord_t) - sizeof(common_record_t) + raw_record->size);
 
 	record->next 	 = NULL;
 	record->hash 	 = 0;
@@ -427,6 +401,7 @@ FlowTableRecord_t	*record;
 	// safe the extension map and exporter reference
 	record->map_info_ref = extension_info;
 	record->exp_ref = flow_record->exp_ref;
+	record->exporter_sysid = flow_record->exporter_sysid;
 
 	record->counter[INBYTES]	 = flow_record->dOctets;
 	record->counter[INPACKETS] 	 = flow_record->dPkts;
@@ -445,12 +420,10 @@ FlowTableRecord_t	*FlowTableRecord;
 uint32_t			index_cache; 
 
 	if ( keymem == NULL ) {
-		keymem = MemoryHandle_get(&FlowTable.mem ,FlowTable.keysize );
-		// the last aligned word may not be fully used. set it to 0 to guarantee
-		// a proper comarison
-
-		// for 64 bit arch int == 8 bytes otherwise 4
-		((int *)keymem)[FlowTable.keylen-1] = 0;
+		keymem = Arena_Alloc(&FlowTable.mem ,FlowTable.keylen * sizeof(uint64_t) );
+		// padding bytes and the last aligned word may not be fully used. set them to 0 
+		// to guarantee a proper comarison
+		memset(keymem, 0, FlowTable.keylen * sizeof(uint64_t));
 
 	}
 
@@ -491,6 +464,7 @@ uint32_t			index_cache;
 
 		FlowTableRecord->map_info_ref  	 	 = extension_info;
 		FlowTableRecord->exp_ref  	 		 = flow_record->exp_ref;
+		FlowTableRecord->exporter_sysid		 = flow_record->exporter_sysid;
 
 		// keymen got part of the cache
 		keymem = NULL;
@@ -501,12 +475,10 @@ uint32_t			index_cache;
 		// use tmp memory for bidir hash key to search for bidir flow
 		// we need it only to lookup 
 		if ( bidirkeymem == NULL ) {
-			bidirkeymem = MemoryHandle_get(&FlowTable.mem ,FlowTable.keysize );
-			// the last aligned word may not be fully used. set it to 0 to guarantee
-			// a proper comarison
-
-			// for 64 bit arch int == 8 bytes otherwise 4
-			((int *)bidirkeymem)[FlowTable.keylen-1] = 0;
+			bidirkeymem = Arena_Alloc(&FlowTable.mem ,FlowTable.keylen * sizeof(uint64_t) );
+			// padding bytes and the last aligned word may not be fully used. set them to 0 
+			// to guarantee a proper comarison
+			memset(bidirkeymem, 0, FlowTable.keylen * sizeof(uint64_t));
 		}
 
 		// generate the hash key for reverse record (bidir)
@@ -544,6 +516,7 @@ uint32_t			index_cache;
 			FlowTableRecord->counter[FLOWS]   	 = flow_record->aggr_flows ? flow_record->aggr_flows : 1;
 			FlowTableRecord->map_info_ref  	 	 = extension_info;
 			FlowTableRecord->exp_ref  	 		 = flow_record->exp_ref;
+			FlowTableRecord->exporter_sysid		 = flow_record->exporter_sysid;
 
 			keymem = NULL;
 		}
@@ -553,61 +526,27 @@ uint32_t			index_cache;
 } // End of AddFlow
 
 
-#undef get16bits
-#if (defined(__GNUC__) && defined(__i386__)) || defined(__WATCOMC__) \
-  || defined(_MSC_VER) || defined (__BORLANDC__) || defined (__TURBOC__)
-#define get16bits(d) (*((const uint16_t *) (d)))
-#endif
-
-#if !defined (get16bits)
-#define get16bits(d) ((((uint32_t)(((const uint8_t *)(d))[1])) << 8)\
-					   +(uint32_t)(((const uint8_t *)(d))[0]) )
-#endif
-
-static inline uint32_t SuperFastHash (const char * data, int len) {
-uint32_t hash = len, tmp;
-int rem;
-
-	if (len <= 0 || data == NULL) return 0;
-
-	rem = len & 3;
-	len >>= 2;
-
-	/* Main loop */
-	for (;len > 0; len--) {
-		hash  += get16bits (data);
-		tmp	= (get16bits (data+2) << 11) ^ hash;
-		hash   = (hash << 16) ^ tmp;
-		data  += 2*sizeof (uint16_t);
-		hash  += hash >> 11;
+/*
+ * The key is a sequence of uint64_t words with unused bytes set to 0. Mix it word 
+ * by word and finalise, so that the low bits, used as table index, depend on all key bits.
+ */
+static inline uint32_t KeyHash(uint64_t *key, uint32_t keylen) {
+uint64_t hash = 0x9E3779B97F4A7C15ULL ^ keylen;
+uint32_t i;
+
+	for ( i=0; i<keylen; i++ ) {
+		hash ^= key[i];
+		hash *= 0xff51afd7ed558ccdULL;
+		hash ^= hash >> 32;
 	}
 
-	/* Handle end cases */
-	switch (rem) {
-		case 3: hash += get16bits (data);
-				hash ^= hash << 16;
-				hash ^= data[sizeof (uint16_t)] << 18;
-				hash += hash >> 11;
-				break;
-		case 2: hash += get16bits (data);
-				hash ^= hash << 11;
-				hash += hash >> 17;
-				break;
-		case 1: hash += *data;
-				hash ^= hash << 10;
-				hash += hash >> 1;
-	}
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	hash ^= hash >> 29;
 
-	/* Force "avalanching" of final 127 bits */
-	hash ^= hash << 3;
-	hash += hash >> 5;
-	hash ^= hash << 4;
-	hash += hash >> 17;
-	hash ^= hash << 25;
-	hash += hash >> 6;
+	return (uint32_t)hash;
 
-	return hash;
-}
+} // End of KeyHash
 
 int SetBidirAggregation(void) {
 	
@@ -802,6 +741,9 @@ struct aggregate_info_s *a;
 	// final '0' record
 	aggregate_stack[stack_count] = a->param;
 
+	if ( !CompileAggregateKey() )
+		return 0;
+
 	dbg_printf("Aggregate key len: %i bytes\n", aggregate_key_len);
 	dbg_printf("Aggregate format string: '%s'\n", *aggr_fmt);
 
@@ -826,6 +768,194 @@ struct aggregate_info_s *a;
 	return 1;
 } // End of ParseAggregateMask
 
+static int CompileAggregateKey(void) {
+aggregate_param_t *aggr_param;
+aggregate_key_op_t	op, *fields[MaxKeyOps];
+uint32_t i, j, num_fields, used[MaxKeyOps];
+
+	num_key_ops = 0;
+	aggr_param  = aggregate_stack;
+	while ( aggr_param->size ) {
+		if ( num_key_ops == MaxKeyOps ) {
+			fprintf(stderr, "Too many aggregation parameters\n");
+			return 0;
+		}
+		op.offset = aggr_param->offset;
+		op.mask	  = aggr_param->mask;
+		op.shift  = aggr_param->size == 8 ? 0 : __builtin_ctzll(aggr_param->mask);
+		op.width  = aggr_param->size == 8 ? 64 : 64 - __builtin_clzll(aggr_param->mask >> op.shift);
+		op.word	  = 0;
+		op.pos	  = 0;
+
+		// merge with a value of the same master record word, if the bits are adjacent
+		for ( i=0; op.width < 64 && i<num_key_ops; i++ ) {
+			uint64_t mask = key_op[i].mask | op.mask;
+			uint64_t bits = mask >> __builtin_ctzll(mask);
+			if ( key_op[i].offset == op.offset && key_op[i].width < 64 && 
+				 (key_op[i].mask & op.mask) == 0 && (bits & (bits + 1)) == 0 ) {
+				key_op[i].mask  = mask;
+				key_op[i].shift = __builtin_ctzll(mask);
+				key_op[i].width = 64 - __builtin_clzll(bits);
+				break;
+			}
+		}
+		if ( op.width == 64 || i == num_key_ops ) 
+			key_op[num_key_ops++] = op;
+		aggr_param++;
+	}
+
+	// full words first - each gets its own key word
+	num_key_words = 0;
+	num_fields	  = 0;
+	for ( i=0; i<num_key_ops; i++ ) {
+		if ( key_op[i].width == 64 ) {
+			key_op[i].word = num_key_words++;
+		} else {
+			fields[num_fields++] = &key_op[i];
+		}
+	}
+
+	// pack fields, widest first, into the first key word with enough bits left
+	for ( i=0; i<num_fields; i++ ) {
+		for ( j=i+1; j<num_fields; j++ ) {
+			if ( fields[j]->width > fields[i]->width ) {
+				aggregate_key_op_t *tmp = fields[i];
+				fields[i] = fields[j];
+				fields[j] = tmp;
+			}
+		}
+	}
+	memset((void *)used, 0, sizeof(used));
+	j = num_key_words;
+	for ( i=0; i<num_fields; i++ ) {
+		uint32_t w = j;
+		while ( w < num_key_words && ( used[w] + fields[i]->width ) > 64 )
+			w++;
+		if ( w == num_key_words )
+			num_key_words++;
+		fields[i]->word = w;
+		fields[i]->pos  = used[w];
+		used[w] += fields[i]->width;
+	}
+
+	// order operations by key word
+	for ( i=0; i<num_key_ops; i++ ) {
+		for ( j=i+1; j<num_key_ops; j++ ) {
+			if ( key_op[j].word < key_op[i].word || 
+				 ( key_op[j].word == key_op[i].word && key_op[j].pos < key_op[i].pos ) ) {
+				op = key_op[i];
+				key_op[i] = key_op[j];
+				key_op[j] = op;
+			}
+		}
+	}
+
+	aggregate_key_len = num_key_words * sizeof(uint64_t);
+
+	// select key function
+	Aggregate_Key = Key_Generic;
+	if ( num_key_ops == num_key_words ) {
+		switch (num_key_ops) {
+			case 1: Aggregate_Key = Key_1; break;
+			case 2: Aggregate_Key = Key_2; break;
+			case 3: Aggregate_Key = Key_3; break;
+			case 4: Aggregate_Key = Key_4; break;
+			case 5: Aggregate_Key = Key_5; break;
+			case 6: Aggregate_Key = Key_6; break;
+		}
+	}
+
+#ifdef DEVEL
+	printf("Compiled key: %u ops, %u words\n", num_key_ops, num_key_words);
+	for ( i=0; i<num_key_ops; i++ ) {
+		printf("Offset: %u, Mask: %llx, Shift: %u -> word: %u, pos: %u, width: %u\n", key_op[i].offset, 
+			(long long unsigned)key_op[i].mask, key_op[i].shift, key_op[i].word, key_op[i].pos, key_op[i].width);
+	}
+#endif
+
+	return 1;
+
+} // End of CompileAggregateKey
+
+#define KeyValue(i) ( (record[key_op[i].offset] & key_op[i].mask) >> key_op[i].shift )
+
+static void Key_Generic(uint64_t *key, uint64_t *record) {
+uint32_t i;
+
+	for ( i=0; i<num_key_words; i++ )
+		key[i] = 0;
+
+	for ( i=0; i<num_key_ops; i++ )
+		key[key_op[i].word] |= KeyValue(i) << key_op[i].pos;
+
+} // End of Key_Generic
+
+static void Key_1(uint64_t *key, uint64_t *record) {
+	key[0] = KeyValue(0);
+} // End of Key_1
+
+static void Key_2(uint64_t *key, uint64_t *record) {
+	key[0] = KeyValue(0);
+	key[1] = KeyValue(1);
+} // End of Key_2
+
+static void Key_3(uint64_t *key, uint64_t *record) {
+	key[0] = KeyValue(0);
+	key[1] = KeyValue(1);
+	key[2] = KeyValue(2);
+} // End of Key_3
+
+static void Key_4(uint64_t *key, uint64_t *record) {
+	key[0] = KeyValue(0);
+	key[1] = KeyValue(1);
+	key[2] = KeyValue(2);
+	key[3] = KeyValue(3);
+} // End of Key_4
+
+static void Key_5(uint64_t *key, uint64_t *record) {
+	key[0] = KeyValue(0);
+	key[1] = KeyValue(1);
+	key[2] = KeyValue(2);
+	key[3] = KeyValue(3);
+	key[4] = KeyValue(4);
+} // End of Key_5
+
+static void Key_6(uint64_t *key, uint64_t *record) {
+	key[0] = KeyValue(0);
+	key[1] = KeyValue(1);
+	key[2] = KeyValue(2);
+	key[3] = KeyValue(3);
+	key[4] = KeyValue(4);
+	key[5] = KeyValue(5);
+} // End of Key_6
+
+/*
+ * Rebuild the master record of a compact record: the record header and times are taken from
+ * the first flow, all aggregated values are extracted back from the key. As with full records,
+ * the caller applies the aggregation mask before printing.
+ */
+void ExpandCompactRecord(FlowTableRecord_t *record, master_record_t *flow_record) {
+uint64_t *r   = (uint64_t *)flow_record;
+uint64_t *key = (uint64_t *)record->hash_key;
+uint32_t i;
+
+	memset((void *)flow_record, 0, offsetof(master_record_t, map_ref));
+
+	// type, size, flags, exporter_sysid, ext_map, msec_first, msec_last, first, last .. tos
+	// have the same layout in the common record and the master record
+	memcpy((void *)flow_record, (void *)&record->flowrecord, offsetof(common_record_t, srcport));
+
+	for ( i=0; i<num_key_ops; i++ ) {
+		uint64_t value = key[key_op[i].word] >> key_op[i].pos;
+		if ( key_op[i].width < 64 ) 
+			value &= ( 1LL << key_op[i].width ) - 1;
+		r[key_op[i].offset] |= value << key_op[i].shift;
+	}
+	flow_record->exp_ref = record->exp_ref;
+	flow_record->exporter_sysid = record->exporter_sysid;
+
+} // End of ExpandCompactRecord
+
 master_record_t *GetMasterAggregateMask(void) {
 master_record_t *aggr_record_mask;
 
@@ -850,6 +980,8 @@ master_record_t *aggr_record_mask;
 		// not really needed, but preset it anyway
 		r[0] = 0xffffffffffffffffLL;
 		r[1] = 0xffffffffffffffffLL;
+		// keep the full exporter sysid
+		r[OffsetExporterSysID] |= MaskExporterSysID;
 		aggr_record_mask->dPkts   	= 0xffffffffffffffffLL;
 		aggr_record_mask->dOctets 	= 0xffffffffffffffffLL;
 		aggr_record_mask->out_pkts   = 0xffffffffffffffffLL;
@@ -868,44 +1000,20 @@ static inline void New_Hash_Key(void *keymem, master_record_t *flow_record, int
 uint64_t *record = (uint64_t *)flow_record;
 Default_key_t *keyptr;
 
+	// time slot of this flow
+	if ( FlowTable.time_slot ) {
+		uint32_t *_v = (uint32_t *)(keymem + FlowTable.slot_offset);
+		*_v = flow_record->first - ( flow_record->first % FlowTable.time_slot );
+	}
+
 	// apply src/dst mask bits if requested
 	if ( FlowTable.apply_netbits ) {
 		ApplyNetMaskBits(flow_record, FlowTable.apply_netbits);
 	}
 
 	if ( aggregate_stack ) {
-		// custom user aggregation
-		aggregate_param_t *aggr_param = aggregate_stack;
-		while ( aggr_param->size ) {
-			uint64_t val = (record[aggr_param->offset] & aggr_param->mask) >> aggr_param->shift;
-
-			switch ( aggr_param->size ) {
-				case 8: {
-					uint64_t *_v = (uint64_t *)keymem;
-					*_v = val;
-					keymem += sizeof(uint64_t);
-					} break;
-				case 4: {
-					uint32_t *_v = (uint32_t *)keymem;
-					*_v = val;
-					keymem += sizeof(uint32_t);
-					} break;
-				case 2: {
-					uint16_t *_v = (uint16_t *)keymem;
-					*_v = val;
-					keymem += sizeof(uint16_t);
-					} break;
-				case 1: {
-					uint8_t *_v = (uint8_t *)keymem;
-					*_v = val;
-					keymem += sizeof(uint8_t);
-					} break;
-				default:
-					fprintf(stderr, "Panic: Software error in %s line %d\n", __FILE__, __LINE__);
-					exit(255);
-			} // switch
-			aggr_param++;
-		} // while 
+		// custom user aggregation - compiled key
+		Aggregate_Key((uint64_t *)keymem, record);
 	} else if ( swap_flow ) {
 		// default 5-tuple aggregation for bidirectional flows
 		keyptr = (Default_key_t *)keymem;
@@ -60,6 +60,8 @@ typedef struct FlowTableRecord {
 
 	extension_info_t	   *map_info_ref;
 	exporter_info_record_t *exp_ref;
+	// full exporter sysid - a compact record does not keep extension EX_EXPORTER_SYSID
+	uint32_t	exporter_sysid;
 	// flow record follows
 	// flow data size may vary depending on the number of extensions
 	// common_record_t already contains a pointer to more data ( extensions ) at the end
@@ -68,26 +70,6 @@ typedef struct FlowTableRecord {
 	// no further vars beyond this point! The flow record above has additional data.
 } FlowTableRecord_t;
 
-typedef struct MemoryHandle_s {
-	/* 
-	 * to speedup aggregation/record statistics, the internal hash tables use their own memory management.
-	 * memory is allocated with malloc in chunks of MemBlockSize. All memory blocks are kept in the
-	 * memblock array. Memory blocks are allocated on request up to the number of MaxMemBlocks. If more 
-	 * blocks are requested, the memblock array is automatically extended.
-	 * Memory allocated from a memblock is aligned accoording ALIGN
-	 */
-
-	uint32_t	BlockSize;		/* max size of each pre-allocated memblock */
-
-	/* memory blocks - containing the flow records and keys */
-	void		**memblock;		/* array holding all NumBlocks allocated memory blocks */
-	uint32_t 	MaxBlocks;		/* Size of memblock array */
-	uint32_t 	NumBlocks;		/* number of allocated flow blocks in memblock array */
-	uint32_t	CurrentBlock;	/* Index of current memblock to allocate memory from */
-	uint32_t 	Allocted;		/* Number of bytes already allocated in memblock */
-
-} MemoryHandle_t;
-
 #ifdef __x86_64
 # 	define ALIGN_MASK 0xFFFFFFF8
 #else
@@ -99,8 +81,7 @@ typedef struct MemoryHandle_s {
 // typically 20 - tradeoff memory/speed
 #define HashBits 20
 
-// Each pre-allocated memory block is 10M
-#define MemBlockSize 10*1024*1024
+// Initial size of stat block arrays
 #define MaxMemBlocks	256
 
 
@@ -112,17 +93,24 @@ typedef struct hash_FlowTable {
 	FlowTableRecord_t 	**bucket;		/* Hash entry point: points to elements in the flow block */
 	FlowTableRecord_t 	**bucketcache;	/* in case of index collisions, this array points to the last element with that index */
 
-	uint32_t			keylen;			/* key length of hash key as number of 4byte ints */
+	uint32_t			keylen;			/* key length of hash key as number of uint64_t */
 	uint32_t			keysize;		/* size of key in bytes */
 
-	/* use a MemoryHandle for the table */
-	MemoryHandle_t		mem;
+	/* flow records and keys are allocated from an arena */
+	arena_t				mem;
 
 	/* src/dst IP aggr masks - use to properly maks the IP before printing */
 	uint64_t			IPmask[4];		// 0-1 srcIP, 2-3 dstIP
 	int					has_masks;
 	int					apply_netbits;	// bit 0: src, bit 1: dst
 
+	/* time slot aggregation: the start of the time slot of each flow is part of the key */
+	uint32_t			time_slot;		// width of time slot in seconds, 0 = off
+	uint32_t			slot_offset;	// offset of the time slot in the key
+
+	/* compact records: only the record header, no extensions, is stored. All aggregated values are in the key */
+	int					compact;
+
 } hash_FlowTable;
 
 hash_FlowTable *GetFlowTable(void);
@@ -145,4 +133,6 @@ int ParseAggregateMask( char *arg, char **aggr_fmt  );
 
 master_record_t *GetMasterAggregateMask(void);
 
+void ExpandCompactRecord(FlowTableRecord_t *record, master_record_t *flow_record);
+
 #endif //_NFLOWCACHE_H
@@ -47,6 +47,7 @@
 #include <stdlib.h>
 #include <time.h>
 #include <netinet/in.h>
+#include <sys/un.h>
 #include <string.h>
 
 #ifdef HAVE_STDINT_H
@@ -68,7 +69,7 @@ static int joinGroup(int sockfd, int loopBack, int mcastTTL, struct sockaddr_sto
 
 /* function definitions */
 
-int Unicast_receive_socket(const char *bindhost, const char *listenport, int family, int sockbuflen ) {
+int Unicast_receive_socket(const char *bindhost, const char *listenport, int family, int sockbuflen, int reuseport ) {
 struct addrinfo hints, *res, *ressave;
 socklen_t   	optlen;
 int 			error, p, sockfd;
@@ -121,6 +122,26 @@ int 			error, p, sockfd;
         if ( !( sockfd < 0 ) ) {
 			// socket call was successfull
 
+			// several sockets share the port - the kernel distributes the packets among them
+			if ( reuseport ) {
+#ifdef SO_REUSEPORT
+				p = 1;
+				if ( setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &p, sizeof(p)) != 0 ) {
+					fprintf(stderr, "setsockopt(SO_REUSEPORT): %s\n", strerror (errno));
+					LogError("setsockopt(SO_REUSEPORT): %s", strerror (errno));
+					close(sockfd);
+					freeaddrinfo(ressave);
+					return -1;
+				}
+#else
+				fprintf(stderr, "SO_REUSEPORT not supported on this system\n");
+				LogError("SO_REUSEPORT not supported on this system");
+				close(sockfd);
+				freeaddrinfo(ressave);
+				return -1;
+#endif
+			}
+
             if (bind(sockfd, res->ai_addr, res->ai_addrlen) == 0) {
 				if ( res->ai_family == AF_INET ) 
         			LogInfo("Bound to IPv4 host/IP: %s, Port: %s", 
@@ -551,4 +572,179 @@ int ret;
 	return ret;
 } /* End of isMulticast */
 
+/*
+ * Unix domain sockets, used to hand over open sockets to another process
+ */
+int Unix_listen_socket(const char *path) {
+struct sockaddr_un	addr;
+int sockfd;
+
+	if ( strlen(path) >= sizeof(addr.sun_path) ) {
+		LogError("Socket path '%s' too long", path);
+		return -1;
+	}
+
+	sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if ( sockfd < 0 ) {
+		LogError("socket() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno) );
+		return -1;
+	}
+	memset((void *)&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	unlink(path);
+	if ( bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ) {
+		LogError("bind() to '%s' failed: %s", path, strerror(errno) );
+		close(sockfd);
+		return -1;
+	}
+	if ( listen(sockfd, 1) < 0 ) {
+		LogError("listen() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno) );
+		close(sockfd);
+		unlink(path);
+		return -1;
+	}
+
+	return sockfd;
+
+} /* End of Unix_listen_socket */
+
+/*
+ * Returns -1 with errno set, if no process listens on path
+ */
+int Unix_connect_socket(const char *path) {
+struct sockaddr_un	addr;
+int sockfd, err;
+
+	if ( strlen(path) >= sizeof(addr.sun_path) ) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if ( sockfd < 0 ) 
+		return -1;
+
+	memset((void *)&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	if ( connect(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ) {
+		err = errno;
+		close(sockfd);
+		errno = err;
+		return -1;
+	}
+
+	return sockfd;
+
+} /* End of Unix_connect_socket */
+
+/*
+ * Send num_fds file descriptors together with len bytes of data
+ */
+int Send_descriptors(int sockfd, int *fds, int num_fds, void *data, size_t len) {
+struct msghdr	msg;
+struct cmsghdr	*cmsg;
+struct iovec	iov;
+char			*control;
+size_t			control_len;
+ssize_t			ret;
+
+	control_len = CMSG_SPACE(num_fds * sizeof(int));
+	control = calloc(1, control_len);
+	if ( !control ) {
+		LogError("calloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno) );
+		return 0;
+	}
+
+	iov.iov_base = data;
+	iov.iov_len	 = len;
+	memset((void *)&msg, 0, sizeof(msg));
+	msg.msg_iov		   = &iov;
+	msg.msg_iovlen	   = 1;
+	msg.msg_control	   = control;
+	msg.msg_controllen = control_len;
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type	 = SCM_RIGHTS;
+	cmsg->cmsg_len	 = CMSG_LEN(num_fds * sizeof(int));
+	memcpy(CMSG_DATA(cmsg), (void *)fds, num_fds * sizeof(int));
+
+	do {
+		ret = sendmsg(sockfd, &msg, 0);
+	} while ( ret < 0 && errno == EINTR );
+	free(control);
+
+	if ( ret != (ssize_t)len ) {
+		LogError("sendmsg() error in %s line %d: %s", __FILE__, __LINE__, ret < 0 ? strerror(errno) : "short write" );
+		return 0;
+	}
+
+	return 1;
+
+} /* End of Send_descriptors */
+
+/*
+ * Receive up to max_fds file descriptors together with len bytes of data
+ * Returns the number of descriptors received or -1 on error or end of file
+ */
+int Receive_descriptors(int sockfd, int *fds, int max_fds, void *data, size_t len) {
+struct msghdr	msg;
+struct cmsghdr	*cmsg;
+struct iovec	iov;
+char			*control;
+size_t			control_len, got;
+ssize_t			ret;
+int				num_fds;
+
+	control_len = CMSG_SPACE(max_fds * sizeof(int));
+	control = calloc(1, control_len);
+	if ( !control ) {
+		LogError("calloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno) );
+		return -1;
+	}
+
+	iov.iov_base = data;
+	iov.iov_len	 = len;
+	memset((void *)&msg, 0, sizeof(msg));
+	msg.msg_iov		   = &iov;
+	msg.msg_iovlen	   = 1;
+	msg.msg_control	   = control;
+	msg.msg_controllen = control_len;
+
+	do {
+		ret = recvmsg(sockfd, &msg, 0);
+	} while ( ret < 0 && errno == EINTR );
+	if ( ret <= 0 ) {
+		free(control);
+		return -1;
+	}
+
+	num_fds = 0;
+	for ( cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg) ) {
+		if ( cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS ) {
+			num_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			memcpy((void *)fds, CMSG_DATA(cmsg), num_fds * sizeof(int));
+		}
+	}
+	free(control);
+	if ( msg.msg_flags & MSG_CTRUNC ) {
+		LogError("recvmsg() error in %s line %d: too many descriptors", __FILE__, __LINE__ );
+		return -1;
+	}
+
+	// the data may arrive in pieces
+	got = ret;
+	while ( got < len ) {
+		ret = read(sockfd, (char *)data + got, len - got);
+		if ( ret < 0 && errno == EINTR ) 
+			continue;
+		if ( ret <= 0 ) 
+			return -1;
+		got += ret;
+	}
+
+	return num_fds;
 
+} /* End of Receive_descriptors */
@@ -58,7 +58,7 @@ typedef struct send_peer_s {
 
 /* Function prototypes */
 
-int Unicast_receive_socket(const char *bindhost, const char *listenport, int family, int sockbuflen );
+int Unicast_receive_socket(const char *bindhost, const char *listenport, int family, int sockbuflen, int reuseport );
 
 int Multicast_receive_socket (const char *hostname, const char *listenport, int family, int sockbuflen);
 
@@ -68,4 +68,12 @@ int Unicast_send_socket (const char *hostname, const char *listenport, int famil
 int Multicast_send_socket (const char *hostname, const char *listenport, int family, 
 		unsigned int wmem_size, struct sockaddr_storage *addr, int *addrlen);
 
+int Unix_listen_socket(const char *path);
+
+int Unix_connect_socket(const char *path);
+
+int Send_descriptors(int sockfd, int *fds, int num_fds, void *data, size_t len);
+
+int Receive_descriptors(int sockfd, int *fds, int max_fds, void *data, size_t len);
+
 #endif //_NFNET_H
@@ -112,6 +112,7 @@
 #endif
 
 #include "expire.h"
+#include "nfrollup.h"
 
 #include "flowtree.h"
 #include "netflow_pcap.h"
@@ -254,6 +255,7 @@ static void usage(char *name) {
 					"-P pidfile\tset the PID file\n"
 					"-t time frame\tset the time window to rotate pcap/nfcapd file\n"
 					"-z\t\tCompress flows in output file.\n"
+					"-k stats[:K]\tAppend top K rollups of stats to each flow file. see nfcapd(1)\n"
 					"-E\t\tPrint extended format of netflow data. for debugging purpose only.\n"
 					"-T\t\tInclude extension tags in records.\n"
 					"-D\t\tdetach from terminal (daemonize)\n"
@@ -717,6 +719,9 @@ int err, done;
 			FlushExporterStats(fs);
 			// Close file
 			CloseUpdateFile(nffile, fs->Ident);
+			// Append rollups of the closed file, if requested
+			if ( !WriteRollups(fs->current) )
+				LogError("Ident: %s, failed to write rollups", fs->Ident);
 	
 			// if rename fails, we are in big trouble, as we need to get rid of the old .current file
 			// otherwise, we will loose flows and can not continue collecting new flows
@@ -739,6 +744,9 @@ int err, done;
 				// Update books
 				stat(FullName, &fstat);
 				UpdateBooks(fs->bookkeeper, t_start, 512*fstat.st_blocks);
+
+				// Update file index, if the data directory is indexed
+				AppendIndex(fs->datadir, netflowFname, t_start);
 			}
 
 			LogInfo("Ident: '%s' Flows: %llu, Packets: %llu, Bytes: %llu, Max Flows: %u", 
@@ -1186,7 +1194,7 @@ p_flow_thread_args_t *p_flow_thread_args;
 	verbose			= 0;
 	expire			= 0;
 	cache_size		= 0;
-	while ((c = getopt(argc, argv, "B:DEg:hi:r:s:l:p:P:t:u:S:T:e:Vz")) != EOF) {
+	while ((c = getopt(argc, argv, "B:DEg:hi:k:r:s:l:p:P:t:u:S:T:e:Vz")) != EOF) {
 		switch (c) {
 			struct stat fstat;
 			case 'h':
@@ -1260,6 +1268,10 @@ p_flow_thread_args_t *p_flow_thread_args;
 			case 'z':
 				compress = 1;
 				break;
+			case 'k':
+				if ( !SetRollups(optarg) ) 
+					exit(255);
+				break;
 			case 'P':
 				if ( optarg[0] == '/' ) { 	// absolute path given
 					strncpy(pidfile, optarg, MAXPATHLEN-1);
@@ -0,0 +1,329 @@
+/*
+ *  This file is part of the nfdump project.
+ *
+ *  Copyright (c) 2014, the nfdump contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of SWITCH nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  $Author$
+ *
+ *  $Id$
+ *
+ *  $LastChangedRevision$
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "nffile.h"
+#include "nf_common.h"
+#include "nfprint.h"
+
+static struct print_pool_s {
+	printer_t		print_record;	/* printer function - must be ParallelPrinter() */
+	int				tag;
+	int				NumThreads;		/* requested number of threads */
+	int				running;		/* number of threads started */
+	int				terminate;		/* signal threads to exit */
+	pthread_t		*tid;
+
+	print_block_t	*block;			/* ring of NumBlocks blocks */
+	uint32_t		NumBlocks;
+	uint64_t		fill_seq;		/* sequence number of the block currently filled */
+	uint64_t		work_seq;		/* sequence number of the next block to format */
+	uint64_t		write_seq;		/* sequence number of the next block to write */
+
+	pthread_mutex_t	mutex;
+	pthread_cond_t	work_cond;		/* new block queued */
+	pthread_cond_t	done_cond;		/* block formatted */
+} pool;
+
+/* function prototypes */
+static void FormatPrintBlock(print_block_t *block);
+
+static void *PrintThread(void *arg);
+
+static int StartThreads(void);
+
+static void QueuePrintBlock(void);
+
+static void WritePrintBlock(print_block_t *block);
+
+/* Functions */
+
+// number of threads used, if not specified: one thread per online CPU
+int PrintThreads_Default(void) {
+long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if ( n < 1 )
+		return 1;
+	return n > MaxPrintThreads ? MaxPrintThreads : n;
+
+} // End of PrintThreads_Default
+
+int PrintThreads_Init(printer_t print_record, int tag, int num_threads) {
+uint32_t i;
+
+	memset((void *)&pool, 0, sizeof(pool));
+
+	// single threaded or not thread safe printer - print directly
+	if ( num_threads <= 1 || !ParallelPrinter(print_record) )
+		return 0;
+
+	if ( num_threads > MaxPrintThreads )
+		num_threads = MaxPrintThreads;
+
+	pthread_mutex_init(&pool.mutex, NULL);
+	pthread_cond_init(&pool.work_cond, NULL);
+	pthread_cond_init(&pool.done_cond, NULL);
+	pool.NumThreads	  = num_threads;
+
+	pool.print_record = print_record;
+	pool.tag		  = tag;
+	pool.NumBlocks	  = num_threads * PrintBlocksPerThread;
+	pool.block		  = (print_block_t *)calloc(pool.NumBlocks, sizeof(print_block_t));
+	pool.tid		  = (pthread_t *)calloc(num_threads, sizeof(pthread_t));
+	if ( !pool.block || !pool.tid ) {
+		fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		PrintThreads_Dispose();
+		return 0;
+	}
+	for ( i=0; i<pool.NumBlocks; i++ ) {
+		pool.block[i].record = (master_record_t *)malloc(PrintBlockRecords * sizeof(master_record_t));
+		if ( !pool.block[i].record ) {
+			fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+			PrintThreads_Dispose();
+			return 0;
+		}
+	}
+
+	return 1;
+
+} // End of PrintThreads_Init
+
+// format all records of a block into its text buffer
+static void FormatPrintBlock(print_block_t *block) {
+uint32_t i;
+
+	block->length = 0;
+	for ( i=0; i<block->NumRecords; i++ ) {
+		char *string;
+		size_t len;
+
+		pool.print_record((void *)&block->record[i], &string, pool.tag);
+		if ( !string )
+			continue;
+
+		len = strlen(string);
+		if ( ( block->length + len + 1 ) > block->size ) {
+			size_t size = block->size ? 2 * block->size : 256 * PrintBlockRecords;
+			while ( size < ( block->length + len + 1 ) )
+				size <<= 1;
+			block->text = realloc(block->text, size);
+			if ( !block->text ) {
+				fprintf(stderr, "realloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+				exit(255);
+			}
+			block->size = size;
+		}
+		memcpy(block->text + block->length, string, len);
+		block->length += len;
+		block->text[block->length++] = '\n';
+	}
+
+} // End of FormatPrintBlock
+
+static void *PrintThread(void *arg) {
+
+	pthread_mutex_lock(&pool.mutex);
+	while ( 1 ) {
+		print_block_t *block;
+
+		while ( !pool.terminate && pool.work_seq == pool.fill_seq )
+			pthread_cond_wait(&pool.work_cond, &pool.mutex);
+		if ( pool.work_seq == pool.fill_seq ) 
+			break;	// terminate and no more work
+
+		block = &pool.block[pool.work_seq % pool.NumBlocks];
+		pool.work_seq++;
+		pthread_mutex_unlock(&pool.mutex);
+
+		FormatPrintBlock(block);
+
+		pthread_mutex_lock(&pool.mutex);
+		block->state = PRINT_BLOCK_DONE;
+		pthread_cond_broadcast(&pool.done_cond);
+	}
+	pthread_mutex_unlock(&pool.mutex);
+
+	return NULL;
+
+} // End of PrintThread
+
+static int StartThreads(void) {
+int i, err;
+
+	for ( i=0; i<pool.NumThreads; i++ ) {
+		err = pthread_create(&pool.tid[i], NULL, PrintThread, NULL);
+		if ( err ) {
+			fprintf(stderr, "pthread_create() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(err) );
+			break;
+		}
+	}
+	pool.running = i;
+
+	return pool.running;
+
+} // End of StartThreads
+
+static void WritePrintBlock(print_block_t *block) {
+
+	OutputText(block->text, block->length);
+	block->NumRecords = 0;
+	block->length	  = 0;
+	block->state	  = PRINT_BLOCK_FREE;
+
+} // End of WritePrintBlock
+
+// queue the current block for formatting and wait for the next block in the ring to become free
+static void QueuePrintBlock(void) {
+print_block_t *block;
+
+	pthread_mutex_lock(&pool.mutex);
+	pool.block[pool.fill_seq % pool.NumBlocks].state = PRINT_BLOCK_QUEUED;
+	pool.fill_seq++;
+	pthread_cond_signal(&pool.work_cond);
+
+	// the next block is free, unless it still holds output of the previous round
+	block = &pool.block[pool.fill_seq % pool.NumBlocks];
+	if ( block->state != PRINT_BLOCK_FREE ) {
+		// blocks are written in order
+		while ( pool.write_seq < pool.fill_seq ) {
+			print_block_t *next = &pool.block[pool.write_seq % pool.NumBlocks];
+			while ( next->state != PRINT_BLOCK_DONE )
+				pthread_cond_wait(&pool.done_cond, &pool.mutex);
+			pthread_mutex_unlock(&pool.mutex);
+			WritePrintBlock(next);
+			pthread_mutex_lock(&pool.mutex);
+			pool.write_seq++;
+			if ( next == block )
+				break;
+		}
+	}
+	pthread_mutex_unlock(&pool.mutex);
+
+} // End of QueuePrintBlock
+
+void PrintThreads_Record(master_record_t *record) {
+print_block_t *block = &pool.block[pool.fill_seq % pool.NumBlocks];
+
+	memcpy((void *)&block->record[block->NumRecords], (void *)record, sizeof(master_record_t));
+	block->NumRecords++;
+	if ( block->NumRecords < PrintBlockRecords ) 
+		return;
+
+	// block full - threads are started with the first full block
+	if ( pool.running == 0 && StartThreads() == 0 ) {
+		// no threads - format in this thread
+		FormatPrintBlock(block);
+		WritePrintBlock(block);
+		return;
+	}
+	QueuePrintBlock();
+
+} // End of PrintThreads_Record
+
+// write all pending records
+void PrintThreads_Flush(void) {
+print_block_t *block = &pool.block[pool.fill_seq % pool.NumBlocks];
+
+	if ( pool.running == 0 ) {
+		// small output - never started any threads
+		FormatPrintBlock(block);
+		WritePrintBlock(block);
+		return;
+	}
+
+	pthread_mutex_lock(&pool.mutex);
+	if ( block->NumRecords ) {
+		block->state = PRINT_BLOCK_QUEUED;
+		pool.fill_seq++;
+		pthread_cond_signal(&pool.work_cond);
+	}
+	while ( pool.write_seq < pool.fill_seq ) {
+		print_block_t *next = &pool.block[pool.write_seq % pool.NumBlocks];
+		while ( next->state != PRINT_BLOCK_DONE )
+			pthread_cond_wait(&pool.done_cond, &pool.mutex);
+		pthread_mutex_unlock(&pool.mutex);
+		WritePrintBlock(next);
+		pthread_mutex_lock(&pool.mutex);
+		pool.write_seq++;
+	}
+	pthread_mutex_unlock(&pool.mutex);
+
+} // End of PrintThreads_Flush
+
+void PrintThreads_Dispose(void) {
+uint32_t i;
+int j;
+
+	if ( pool.running ) {
+		pthread_mutex_lock(&pool.mutex);
+		pool.terminate = 1;
+		pthread_cond_broadcast(&pool.work_cond);
+		pthread_mutex_unlock(&pool.mutex);
+		for ( j=0; j<pool.running; j++ ) 
+			pthread_join(pool.tid[j], NULL);
+	}
+
+	if ( pool.block ) {
+		for ( i=0; i<pool.NumBlocks; i++ ) {
+			free(pool.block[i].record);
+			free(pool.block[i].text);
+		}
+		free(pool.block);
+	}
+	free(pool.tid);
+	if ( pool.NumThreads ) {
+		pthread_mutex_destroy(&pool.mutex);
+		pthread_cond_destroy(&pool.work_cond);
+		pthread_cond_destroy(&pool.done_cond);
+	}
+	memset((void *)&pool, 0, sizeof(pool));
+
+} // End of PrintThreads_Dispose
@@ -0,0 +1,81 @@
+/*
+ *  This file is part of the nfdump project.
+ *
+ *  Copyright (c) 2014, the nfdump contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of SWITCH nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  $Author$
+ *
+ *  $Id$
+ *
+ *  $LastChangedRevision$
+ *
+ */
+
+#ifndef _NFPRINT_H
+#define _NFPRINT_H 1
+
+/* Definitions */
+
+/*
+ * Parallel print
+ * In print mode, the matched records are collected in blocks of PrintBlockRecords records.
+ * A pool of formatter threads converts each block into a text chunk. The chunks are written
+ * in the order the blocks were filled, therefore the output is identical to the single
+ * threaded output. The ring of blocks limits the records in flight to PrintBlocksPerThread
+ * blocks per thread.
+ */
+#define PrintBlockRecords		1024
+#define PrintBlocksPerThread	2
+#define MaxPrintThreads			64
+
+// block states
+#define PRINT_BLOCK_FREE	0
+#define PRINT_BLOCK_QUEUED	1
+#define PRINT_BLOCK_DONE	2
+
+typedef struct print_block_s {
+	master_record_t	*record;		/* copies of the records to format */
+	uint32_t		NumRecords;		/* number of records in block */
+	uint32_t		state;			/* PRINT_BLOCK_FREE, _QUEUED or _DONE */
+	char			*text;			/* formatted output lines */
+	size_t			length;			/* length of text */
+	size_t			size;			/* allocated size of text */
+} print_block_t;
+
+/* Function prototypes */
+int PrintThreads_Init(printer_t print_record, int tag, int num_threads);
+
+void PrintThreads_Record(master_record_t *record);
+
+void PrintThreads_Flush(void);
+
+void PrintThreads_Dispose(void);
+
+int PrintThreads_Default(void);
+
+#endif //_NFPRINT_H
@@ -62,6 +62,7 @@
 #include "nfx.h"
 #include "nfstat.h"
 #include "nfstatfile.h"
+#include "nfrollup.h"
 #include "bookkeeper.h"
 #include "nfxstat.h"
 #include "collector.h"
@@ -114,6 +115,7 @@ static void usage(char *name) {
 					"-Z\t\tCheck filter syntax and exit.\n"
 					"-S subdir\tSub directory format. see nfcapd(1) for format\n"
 					"-z\t\tCompress flows in output file.\n"
+					"-k stats[:K]\tAppend top K rollups of stats to each channel file. see nfcapd(1)\n"
 					"-t <time>\ttime for RRD update\n", name);
 } /* usage */
 
@@ -235,7 +237,7 @@ int	v1_map_done = 0;
 		for ( i=0; i < nffile->block_header->NumRecords; i++ ) {
 			switch ( flow_record->type ) { 
 					case CommonRecordType: {
-					generic_exporter_t *exp_info = exporter_list[flow_record->exporter_sysid];
+					generic_exporter_t *exp_info;
 					uint32_t map_id = flow_record->ext_map;
 					master_record_t	*master_record;
 
@@ -245,6 +247,7 @@ int	v1_map_done = 0;
 						continue;
 					} 
 	
+					exp_info = exporter_list[GetExporterSysID(flow_record, extension_map_list->slot[map_id])];
 					master_record = &(extension_map_list->slot[map_id]->master_record);
 					ExpandRecord_v2( flow_record, extension_map_list->slot[flow_record->ext_map], 
 						exp_info ? &(exp_info->info) : NULL, master_record);
@@ -551,7 +554,7 @@ time_t tslot;
 	// default file names
 	ffile = "filter.txt";
 	rfile = NULL;
-	while ((c = getopt(argc, argv, "D:HIL:p:P:hf:r:n:M:S:t:VzZ")) != EOF) {
+	while ((c = getopt(argc, argv, "D:HIL:k:p:P:hf:r:n:M:S:t:VzZ")) != EOF) {
 		switch (c) {
 			case 'h':
 				usage(argv[0]);
@@ -604,6 +607,10 @@ time_t tslot;
 			case 'z':
 				compress = 1;
 				break;
+			case 'k':
+				if ( !SetRollups(optarg) ) 
+					exit(255);
+				break;
 			default:
 				usage(argv[0]);
 				exit(0);
@@ -274,11 +274,12 @@ int	v1_map_done = 0;
 			switch ( flow_record->type ) {
 				case CommonRecordType: {
 					uint32_t map_id = flow_record->ext_map;
-					generic_exporter_t *exp_info = exporter_list[flow_record->exporter_sysid];
+					generic_exporter_t *exp_info;
 					if ( extension_map_list->slot[map_id] == NULL ) {
 						snprintf(string, 1024, "Corrupt data file! No such extension map id: %u. Skip record", flow_record->ext_map );
 						string[1023] = '\0';
 					} else {
+						exp_info = exporter_list[GetExporterSysID(flow_record, extension_map_list->slot[map_id])];
 						ExpandRecord_v2( flow_record, extension_map_list->slot[flow_record->ext_map], 
 							exp_info ? &(exp_info->info) : NULL, &master_record);
 
@@ -0,0 +1,591 @@
+/*
+ *  This file is part of the nfdump project.
+ *
+ *  Copyright (c) 2014, the nfdump contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of SWITCH nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  $Author$
+ *
+ *  $Id$
+ *
+ *  $LastChangedRevision$
+ *
+ */
+
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <string.h>
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "nffile.h"
+#include "nfx.h"
+#include "nfxstat.h"
+#include "nf_common.h"
+#include "util.h"
+#include "nfrollup.h"
+
+/*
+ * Supported rollup stats. The elements are extracted from the master record the
+ * same way as the corresponding -s stat in nfstat.c, so merged rollups are identical
+ * to the element statistics of the flows.
+ */
+struct rollup_element_s {
+	uint32_t	offset0;
+	uint32_t	offset1;
+	uint64_t	mask;
+	uint32_t	shift;
+};
+
+static struct rollup_stat_s {
+	char					*statname;
+	struct rollup_element_s	element[2];
+	uint8_t					num_elem;
+} rollup_stat[] = {
+	{ "srcip",		{ {OffsetSrcIPv6a, OffsetSrcIPv6b, MaskIPv6, 0},	{0,0,0,0} }, 1 },
+	{ "dstip",		{ {OffsetDstIPv6a, OffsetDstIPv6b, MaskIPv6, 0},	{0,0,0,0} }, 1 },
+	{ "ip",			{ {OffsetSrcIPv6a, OffsetSrcIPv6b, MaskIPv6, 0},	{OffsetDstIPv6a, OffsetDstIPv6b, MaskIPv6, 0} }, 2 },
+	{ "srcport",	{ {0, OffsetPort, MaskSrcPort, ShiftSrcPort},		{0,0,0,0} }, 1 },
+	{ "dstport",	{ {0, OffsetPort, MaskDstPort, ShiftDstPort},		{0,0,0,0} }, 1 },
+	{ "port",		{ {0, OffsetPort, MaskSrcPort, ShiftSrcPort},		{0, OffsetPort, MaskDstPort, ShiftDstPort} }, 2 },
+	{ "proto",		{ {0, OffsetProto, MaskProto, ShiftProto},			{0,0,0,0} }, 1 },
+	{ "srcas",		{ {0, OffsetAS, MaskSrcAS, ShiftSrcAS},				{0,0,0,0} }, 1 },
+	{ "dstas",		{ {0, OffsetAS, MaskDstAS, ShiftDstAS},				{0,0,0,0} }, 1 },
+	{ "as",			{ {0, OffsetAS, MaskSrcAS, ShiftSrcAS},				{0, OffsetAS, MaskDstAS, ShiftDstAS} }, 2 },
+	{ NULL,			{ {0,0,0,0},										{0,0,0,0} }, 0 }
+};
+
+#define MaxRollups	(sizeof(rollup_stat)/sizeof(struct rollup_stat_s))
+
+// open addressing hash table of all elements of a file
+typedef struct rollup_table_s {
+	uint32_t		size;			/* number of slots - power of 2 */
+	uint32_t		NumEntries;		/* number of used slots */
+	rollup_entry_t	*entry;
+	uint8_t			*used;
+	uint8_t			*selected;		/* element is in the top K of any order */
+} rollup_table_t;
+
+#define RollupTableInit	4096
+
+/* configured rollups -k */
+static int		 rollup_request[MaxRollups];
+static int		 NumRollups = 0;
+static uint32_t	 RollupK = RollupDefaultK;
+
+// counter index for sorting the elements
+static int		 sort_order;
+
+/* function prototypes */
+static int InitRollupTable(rollup_table_t *table, uint32_t size);
+
+static void FreeRollupTable(rollup_table_t *table);
+
+static inline uint32_t RollupHash(uint64_t *key);
+
+static rollup_entry_t *RollupLookup(rollup_table_t *table, uint64_t *key);
+
+static void AddRollup(rollup_table_t *table, int stat, master_record_t *flow_record);
+
+static int RollupCMP(const void *p1, const void *p2);
+
+static uint32_t BuildRollupRecord(rollup_table_t *table, int stat, rollup_record_t *rollup_record, stat_record_t *stat_record);
+
+#include "nffile_inline.c"
+#include "nfdump_inline.c"
+
+int SetRollups(char *spec) {
+char *s, *p, *q;
+int	i, j;
+
+	s = strdup(spec);
+	if ( !s ) {
+		fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		exit(255);
+	}
+
+	// optional :K
+	p = strchr(s, ':');
+	if ( p ) {
+		char *end;
+		long k;
+		*p++ = '\0';
+		k = strtol(p, &end, 10);
+		if ( *end != '\0' || k <= 0 || k > RollupMaxK ) {
+			fprintf(stderr, "Invalid number of rollup elements '%s'. Expect 1..%u\n", p, RollupMaxK);
+			free(s);
+			return 0;
+		}
+		RollupK = k;
+	}
+
+	NumRollups = 0;
+	p = s;
+	while ( p ) {
+		q = strchr(p, ',');
+		if ( q )
+			*q++ = '\0';
+		if ( strcasecmp(p, "all") == 0 ) {
+			for ( i=0; rollup_stat[i].statname; i++ )
+				rollup_request[i] = i;
+			NumRollups = i;
+		} else {
+			i = RollupStat(p);
+			if ( i < 0 ) {
+				fprintf(stderr, "Unknown rollup stat '%s'\n", p);
+				free(s);
+				return 0;
+			}
+			// ignore duplicates
+			for ( j=0; j<NumRollups && rollup_request[j] != i; j++ )
+				;
+			if ( j == NumRollups ) 
+				rollup_request[NumRollups++] = i;
+		}
+		p = q;
+	}
+	free(s);
+
+	return NumRollups > 0;
+
+} // End of SetRollups
+
+int RollupStat(char *statname) {
+int i;
+
+	for ( i=0; rollup_stat[i].statname; i++ ) {
+		if ( strcasecmp(statname, rollup_stat[i].statname) == 0 )
+			return i;
+	}
+	return -1;
+
+} // End of RollupStat
+
+static int InitRollupTable(rollup_table_t *table, uint32_t size) {
+
+	table->size		  = size;
+	table->NumEntries = 0;
+	table->entry	  = (rollup_entry_t *)malloc(size * sizeof(rollup_entry_t));
+	table->used		  = (uint8_t *)calloc(size, sizeof(uint8_t));
+	table->selected	  = NULL;
+	if ( !table->entry || !table->used ) {
+		LogError("malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		free(table->entry);
+		free(table->used);
+		table->entry = NULL;
+		table->used  = NULL;
+		return 0;
+	}
+	return 1;
+
+} // End of InitRollupTable
+
+static void FreeRollupTable(rollup_table_t *table) {
+
+	free(table->entry);
+	free(table->used);
+	free(table->selected);
+	table->entry	= NULL;
+	table->used		= NULL;
+	table->selected	= NULL;
+
+} // End of FreeRollupTable
+
+static inline uint32_t RollupHash(uint64_t *key) {
+uint64_t h = key[0] ^ ( key[1] * 0x9E3779B97F4A7C15LL );
+
+	h ^= h >> 32;
+	h *= 0xff51afd7ed558ccdLL;
+	h ^= h >> 29;
+	return (uint32_t)h;
+
+} // End of RollupHash
+
+static rollup_entry_t *RollupLookup(rollup_table_t *table, uint64_t *key) {
+uint32_t index, mask;
+
+	// keep the load factor below 0.75
+	if ( 4 * (table->NumEntries + 1) > 3 * table->size ) {
+		rollup_table_t grown;
+		uint32_t i;
+		if ( !InitRollupTable(&grown, table->size << 1) ) 
+			exit(255);
+		for ( i=0; i<table->size; i++ ) {
+			if ( table->used[i] ) {
+				index = RollupHash(table->entry[i].stat_key) & (grown.size - 1);
+				while ( grown.used[index] )
+					index = ( index + 1 ) & (grown.size - 1);
+				grown.entry[index] = table->entry[i];
+				grown.used[index]  = 1;
+			}
+		}
+		grown.NumEntries = table->NumEntries;
+		FreeRollupTable(table);
+		*table = grown;
+	}
+
+	mask  = table->size - 1;
+	index = RollupHash(key) & mask;
+	while ( table->used[index] ) {
+		if ( table->entry[index].stat_key[1] == key[1] && table->entry[index].stat_key[0] == key[0] )
+			return &table->entry[index];
+		index = ( index + 1 ) & mask;
+	}
+
+	// new element
+	memset((void *)&table->entry[index], 0, sizeof(rollup_entry_t));
+	table->entry[index].stat_key[0] = key[0];
+	table->entry[index].stat_key[1] = key[1];
+	table->entry[index].first		= 0xffffffff;
+	table->used[index] = 1;
+	table->NumEntries++;
+
+	return &table->entry[index];
+
+} // End of RollupLookup
+
+static void AddRollup(rollup_table_t *table, int stat, master_record_t *flow_record) {
+rollup_entry_t	*entry;
+uint64_t		value[2][2];
+int				i;
+
+	for ( i=0; i<rollup_stat[stat].num_elem; i++ ) {
+		struct rollup_element_s *element = &rollup_stat[stat].element[i];
+
+		value[i][1] = (((uint64_t *)flow_record)[element->offset1] & element->mask) >> element->shift;
+		value[i][0] = element->offset0 ? ((uint64_t *)flow_record)[element->offset0] : 0;
+
+		// if src and dst have the same values, count the flow once only
+		if ( i == 1 && value[0][0] == value[1][0] && value[0][1] == value[1][1] ) 
+			break;
+
+		entry = RollupLookup(table, value[i]);
+		if ( entry->first == 0xffffffff ) {
+			entry->first		= flow_record->first;
+			entry->msec_first	= flow_record->msec_first;
+			entry->last			= flow_record->last;
+			entry->msec_last	= flow_record->msec_last;
+			entry->record_flags	= flow_record->flags & 0x1;
+			entry->prot			= flow_record->prot;
+		} else {
+			if ( flow_record->first < entry->first || 
+				( flow_record->first == entry->first && flow_record->msec_first < entry->msec_first ) ) {
+				entry->first		= flow_record->first;
+				entry->msec_first	= flow_record->msec_first;
+			}
+			if ( flow_record->last > entry->last || 
+				( flow_record->last == entry->last && flow_record->msec_last > entry->msec_last ) ) {
+				entry->last			= flow_record->last;
+				entry->msec_last	= flow_record->msec_last;
+			}
+		}
+		entry->counter[0] += flow_record->aggr_flows ? flow_record->aggr_flows : 1;
+		entry->counter[1] += flow_record->dPkts;
+		entry->counter[2] += flow_record->dOctets;
+	}
+
+} // End of AddRollup
+
+static int RollupCMP(const void *p1, const void *p2) {
+const rollup_entry_t *e1 = *(const rollup_entry_t **)p1;
+const rollup_entry_t *e2 = *(const rollup_entry_t **)p2;
+
+	// descending by counter, ties by key to get reproducible rollups
+	if ( e1->counter[sort_order] != e2->counter[sort_order] ) 
+		return e1->counter[sort_order] > e2->counter[sort_order] ? -1 : 1;
+	if ( e1->stat_key[0] != e2->stat_key[0] ) 
+		return e1->stat_key[0] < e2->stat_key[0] ? -1 : 1;
+	if ( e1->stat_key[1] != e2->stat_key[1] ) 
+		return e1->stat_key[1] < e2->stat_key[1] ? -1 : 1;
+	return 0;
+
+} // End of RollupCMP
+
+/*
+ * Select the top K elements for each order and store the union in rollup_record
+ * Returns the size of the rollup record incl. all entries
+ */
+static uint32_t BuildRollupRecord(rollup_table_t *table, int stat, rollup_record_t *rollup_record, stat_record_t *stat_record) {
+rollup_entry_t	**list, *entries;
+uint32_t		i, num;
+int				order;
+
+	memset((void *)rollup_record, 0, sizeof(rollup_record_t));
+	rollup_record->record_header.type = RollupRecordType;
+	strncpy(rollup_record->statname, rollup_stat[stat].statname, 15);
+	rollup_record->K		   = RollupK;
+	rollup_record->NumElements = table->NumEntries;
+	rollup_record->stat_record = *stat_record;
+
+	list = (rollup_entry_t **)malloc((table->NumEntries + 1) * sizeof(rollup_entry_t *));
+	table->selected = (uint8_t *)calloc(table->size, sizeof(uint8_t));
+	if ( !list || !table->selected ) {
+		LogError("malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		exit(255);
+	}
+	num = 0;
+	for ( i=0; i<table->size; i++ ) {
+		if ( table->used[i] )
+			list[num++] = &table->entry[i];
+	}
+
+	if ( num <= RollupK ) {
+		// all elements fit - rollup is complete
+		for ( i=0; i<table->size; i++ )
+			table->selected[i] = table->used[i];
+	} else {
+		for ( order=0; order<3; order++ ) {
+			sort_order = order;
+			qsort((void *)list, num, sizeof(rollup_entry_t *), RollupCMP);
+			for ( i=0; i<RollupK; i++ ) 
+				table->selected[list[i] - table->entry] = 1;
+		}
+	}
+
+	// store selected elements, sorted by flows and get the thresholds of the remaining ones
+	sort_order = 0;
+	qsort((void *)list, num, sizeof(rollup_entry_t *), RollupCMP);
+	entries = RollupEntries(rollup_record);
+	for ( i=0; i<num; i++ ) {
+		rollup_entry_t *entry = list[i];
+		if ( table->selected[entry - table->entry] ) {
+			entries[rollup_record->NumEntries++] = *entry;
+		} else {
+			for ( order=0; order<3; order++ ) {
+				if ( entry->counter[order] > rollup_record->threshold[order] )
+					rollup_record->threshold[order] = entry->counter[order];
+			}
+		}
+	}
+	free(list);
+
+	rollup_record->record_header.size = sizeof(rollup_record_t) + rollup_record->NumEntries * sizeof(rollup_entry_t);
+	return rollup_record->record_header.size;
+
+} // End of BuildRollupRecord
+
+/*
+ * Compute the configured rollups of the flow file filename and append them as
+ * a Large_BLOCK_Type block. Called by the collectors after the file is closed.
+ */
+int WriteRollups(char *filename) {
+nffile_t				*nffile;
+extension_map_list_t	*extension_map_list;
+rollup_table_t			table[MaxRollups];
+data_block_header_t		*block_header;
+rollup_record_t			*rollup_record;
+stat_record_t			stat_record;
+int						i, j, ret, done;
+
+	if ( NumRollups == 0 ) 
+		return 1;
+
+	nffile = OpenFile(filename, NULL);
+	if ( !nffile ) 
+		return 0;
+
+	memset((void *)&stat_record, 0, sizeof(stat_record_t));
+	stat_record.first_seen = 0x7fffffff;
+	stat_record.msec_first = 999;
+
+	extension_map_list = InitExtensionMaps(NEEDS_EXTENSION_LIST);
+	for ( j=0; j<NumRollups; j++ ) {
+		if ( !InitRollupTable(&table[j], RollupTableInit) ) 
+			exit(255);
+	}
+
+	done = 0;
+	while ( !done ) {
+		common_record_t *flow_record;
+
+		ret = ReadBlock(nffile);
+		switch (ret) {
+			case NF_CORRUPT:
+			case NF_ERROR:
+				LogError("Rollups: failed to read file '%s'", filename);
+				for ( j=0; j<NumRollups; j++ ) 
+					FreeRollupTable(&table[j]);
+				FreeExtensionMaps(extension_map_list);
+				CloseFile(nffile);
+				DisposeFile(nffile);
+				return 0;
+			case NF_EOF:
+				done = 1;
+				continue;
+		}
+
+		if ( nffile->block_header->id != DATA_BLOCK_TYPE_2 ) 
+			continue;
+
+		flow_record = nffile->buff_ptr;
+		for ( i=0; i < nffile->block_header->NumRecords; i++ ) {
+			switch ( flow_record->type ) {
+				case CommonRecordType: {
+					uint32_t map_id = flow_record->ext_map;
+					if ( map_id < MAX_EXTENSION_MAPS && extension_map_list->slot[map_id] ) {
+						master_record_t *master_record = &(extension_map_list->slot[map_id]->master_record);
+						ExpandRecord_v2(flow_record, extension_map_list->slot[map_id], NULL, master_record);
+						UpdateStat(&stat_record, master_record);
+						for ( j=0; j<NumRollups; j++ ) 
+							AddRollup(&table[j], rollup_request[j], master_record);
+					}
+					} break;
+				case ExtensionMapType:
+					Insert_Extension_Map(extension_map_list, (extension_map_t *)flow_record);
+					break;
+				default:
+					// other record types are not relevant for rollups
+					break;
+			}
+			flow_record = (common_record_t *)((pointer_addr_t)flow_record + flow_record->size);
+		}
+	}
+	CloseFile(nffile);
+	DisposeFile(nffile);
+	FreeExtensionMaps(extension_map_list);
+
+	// all rollups go into a single block - max 10 stats * 3 * RollupMaxK entries fit easily into BUFFSIZE
+	block_header = (data_block_header_t *)malloc(BUFFSIZE + sizeof(data_block_header_t));
+	if ( !block_header ) {
+		LogError("malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		exit(255);
+	}
+	block_header->NumRecords = 0;
+	block_header->size		 = 0;
+	block_header->id		 = Large_BLOCK_Type;
+	block_header->flags		 = 0;
+	rollup_record = (rollup_record_t *)((pointer_addr_t)block_header + sizeof(data_block_header_t));
+	for ( j=0; j<NumRollups; j++ ) {
+		uint32_t size = BuildRollupRecord(&table[j], rollup_request[j], rollup_record, &stat_record);
+		block_header->size += size;
+		block_header->NumRecords++;
+		rollup_record = (rollup_record_t *)((pointer_addr_t)rollup_record + size);
+		FreeRollupTable(&table[j]);
+	}
+
+	nffile = AppendFile(filename);
+	if ( !nffile ) {
+		free(block_header);
+		return 0;
+	}
+	ret = WriteExtraBlock(nffile, block_header);
+	free(block_header);
+	if ( ret <= 0 ) {
+		LogError("Rollups: failed to write rollup block to '%s': %s", filename, strerror(errno));
+		CloseFile(nffile);
+		DisposeFile(nffile);
+		return 0;
+	}
+	ret = CloseUpdateFile(nffile, NULL);
+	DisposeFile(nffile);
+
+	return ret;
+
+} // End of WriteRollups
+
+int IsRollupBlock(data_block_header_t *block_header) {
+L_record_header_t *record_header = (L_record_header_t *)((pointer_addr_t)block_header + sizeof(data_block_header_t));
+
+	return block_header->id == Large_BLOCK_Type && block_header->NumRecords && 
+		block_header->size >= sizeof(rollup_record_t) && record_header->type == RollupRecordType;
+
+} // End of IsRollupBlock
+
+/*
+ * Search the remaining blocks of nffile for the rollup block. Data blocks are skipped
+ * without reading them. If found, the rollup block is in the nffile buffer.
+ * The file position is restored in any case, so the flows may still be read.
+ */
+int ReadRollupBlock(nffile_t *nffile) {
+off_t	offset;
+ssize_t	ret;
+int		found;
+
+	offset = lseek(nffile->fd, 0, SEEK_CUR);
+	if ( offset < 0 ) 
+		return 0;
+
+	found = 0;
+	while ( !found ) {
+		ret = read(nffile->fd, nffile->block_header, sizeof(data_block_header_t));
+		if ( ret != sizeof(data_block_header_t) ) 
+			break;
+
+		if ( nffile->block_header->id != Large_BLOCK_Type ) {
+			if ( lseek(nffile->fd, nffile->block_header->size, SEEK_CUR) < 0 ) 
+				break;
+			continue;
+		}
+
+		// read the whole block - decompress it if needed
+		if ( lseek(nffile->fd, -(off_t)sizeof(data_block_header_t), SEEK_CUR) < 0 || ReadBlock(nffile) <= 0 ) 
+			break;
+		found = IsRollupBlock(nffile->block_header);
+	}
+
+	if ( lseek(nffile->fd, offset, SEEK_SET) < 0 ) {
+		LogError("lseek() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		return 0;
+	}
+
+	return found;
+
+} // End of ReadRollupBlock
+
+rollup_record_t *GetRollupRecord(data_block_header_t *block_header, char *statname) {
+L_record_header_t	*record_header;
+uint32_t			i, size;
+
+	record_header = (L_record_header_t *)((pointer_addr_t)block_header + sizeof(data_block_header_t));
+	size = 0;
+	for ( i=0; i<block_header->NumRecords; i++ ) {
+		if ( record_header->size < sizeof(L_record_header_t) || ( size + record_header->size ) > block_header->size ) {
+			LogError("Corrupt rollup block: record size %u exceeds block\n", record_header->size);
+			return NULL;
+		}
+		if ( record_header->type == RollupRecordType ) {
+			rollup_record_t *rollup_record = (rollup_record_t *)record_header;
+			if ( strncmp(rollup_record->statname, statname, 16) == 0 &&
+				 rollup_record->record_header.size == sizeof(rollup_record_t) + rollup_record->NumEntries * sizeof(rollup_entry_t) ) 
+				return rollup_record;
+		}
+		size += record_header->size;
+		record_header = (L_record_header_t *)((pointer_addr_t)record_header + record_header->size);
+	}
+
+	return NULL;
+
+} // End of GetRollupRecord
@@ -0,0 +1,100 @@
+/*
+ *  This file is part of the nfdump project.
+ *
+ *  Copyright (c) 2014, the nfdump contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of SWITCH nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  $Author$
+ *
+ *  $Id$
+ *
+ *  $LastChangedRevision$
+ *
+ */
+
+
+#ifndef _NFROLLUP_H
+#define _NFROLLUP_H 1
+
+/* Definitions */
+
+/*
+ * Rollups
+ * The collectors may precompute element statistics for each flow file at file rotation ( -k ).
+ * For each configured stat, the union of the top K elements ordered by flows, packets and bytes 
+ * is stored with the exact counters of the file in a rollup record. All rollup records of a 
+ * file are appended in a single Large_BLOCK_Type block. nfdump answers compatible -s requests 
+ * from these records without reading the flows. If a file contains more than K elements, the 
+ * largest counter of any element not stored is recorded for each order as threshold. Merged
+ * counters are therefore exact, if all thresholds are 0, and may be low by at most the sum of
+ * the thresholds otherwise.
+ */
+
+// default and max number of elements per order
+#define RollupDefaultK	100
+#define RollupMaxK		1000
+
+typedef struct rollup_entry_s {
+	uint64_t	stat_key[2];
+	uint64_t	counter[3];		/* flows, packets, bytes */
+	uint32_t	first;
+	uint32_t	last;
+	uint16_t	msec_first;
+	uint16_t	msec_last;
+	uint8_t		record_flags;	/* bit 0: IPv6 element */
+	uint8_t		prot;
+	uint8_t		fill[2];
+} rollup_entry_t;
+
+typedef struct rollup_record_s {
+	// type = RollupRecordType
+	L_record_header_t record_header;
+	char		statname[16];	/* name of -s stat */
+	uint32_t	K;				/* max number of elements per order */
+	uint32_t	NumEntries;		/* number of rollup_entry_t following */
+	uint64_t	NumElements;	/* number of distinct elements in the file */
+	uint64_t	threshold[3];	/* largest counter of any element not stored - 0 if complete */
+	stat_record_t	stat_record;	/* summary of all flows, counted as by nfdump */
+	// .. NumEntries rollup_entry_t follow
+} rollup_record_t;
+
+#define RollupEntries(r) ((rollup_entry_t *)((pointer_addr_t)(r) + sizeof(rollup_record_t)))
+
+/* Function prototypes */
+int SetRollups(char *spec);
+
+int RollupStat(char *statname);
+
+int WriteRollups(char *filename);
+
+int IsRollupBlock(data_block_header_t *block_header);
+
+int ReadRollupBlock(nffile_t *nffile);
+
+rollup_record_t *GetRollupRecord(data_block_header_t *block_header, char *statname);
+
+#endif //_NFROLLUP_H
@@ -0,0 +1,715 @@
+/*
+ *  This file is part of the nfdump project.
+ *
+ *  Copyright (c) 2014, the nfdump contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of SWITCH nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  $Author$
+ *
+ *  $Id$
+ *
+ *  $LastChangedRevision$
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/param.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "nffile.h"
+#include "util.h"
+#include "nfserver.h"
+
+/*
+ * Block cache
+ * Set associative cache in a shared anonymous mapping, inherited by all workers and queries.
+ * Each set is protected by a process shared robust mutex, as a query may be killed anytime.
+ */
+typedef struct cache_slot_s {
+	uint64_t	dev;
+	uint64_t	ino;
+	int64_t		mtime;
+	int64_t		fsize;
+	int64_t		offset;
+	uint64_t	lru;
+	uint32_t	size;		// block header + data
+	uint32_t	valid;
+} cache_slot_t;
+
+typedef struct cache_set_s {
+	pthread_mutex_t	mutex;
+	uint64_t		clock;
+	cache_slot_t	slot[QueryCacheWays];
+} cache_set_t;
+
+static struct shared_cache_s {
+	cache_set_t	*set;
+	char		*data;
+	uint32_t	NumSets;
+	uint32_t	SetMask;
+	size_t		SlotSize;
+} shared_cache;
+
+static block_cache_t query_block_cache;
+
+static volatile sig_atomic_t done;
+
+/* function prototypes */
+static uint64_t ParseSize(char *s);
+
+static int InitBlockCache(uint64_t size);
+
+static cache_set_t *LockSet(struct stat *stat_buf, off_t offset, char **data);
+
+static int CacheGet(struct stat *stat_buf, off_t offset, data_block_header_t *block_header);
+
+static void CachePut(struct stat *stat_buf, off_t offset, data_block_header_t *block_header);
+
+static int ReadFull(int fd, void *buff, size_t len);
+
+static int WriteFull(int fd, void *buff, size_t len);
+
+static void FreeArgs(char **argv);
+
+static char **ReadRequest(int fd, int *argc);
+
+static void RunQuery(int sock, int fd, int (*query)(int argc, char **argv));
+
+static void QueryWorker(int sock, int (*query)(int argc, char **argv));
+
+static void IntHandler(int signal);
+
+/* Functions */
+
+static uint64_t ParseSize(char *s) {
+uint64_t	size;
+char		*end;
+
+	size = strtoull(s, &end, 10);
+	switch (*end) {
+		case 'k':
+		case 'K':
+			size *= 1024LL;
+			end++;
+			break;
+		case 'm':
+		case 'M':
+			size *= 1024LL * 1024LL;
+			end++;
+			break;
+		case 'g':
+		case 'G':
+			size *= 1024LL * 1024LL * 1024LL;
+			end++;
+			break;
+	}
+	return *end == '\0' ? size : 0;
+
+} // End of ParseSize
+
+static int InitBlockCache(uint64_t size) {
+pthread_mutexattr_t	attr;
+uint32_t	i, sets;
+
+	shared_cache.SlotSize = sizeof(data_block_header_t) + WRITE_BUFFSIZE;
+
+	// number of sets - power of 2
+	sets = 1;
+	while ( ( (uint64_t)sets << 1 ) * QueryCacheWays * shared_cache.SlotSize <= size )
+		sets <<= 1;
+	shared_cache.NumSets = sets;
+	shared_cache.SetMask = sets - 1;
+
+	shared_cache.set = (cache_set_t *)mmap(NULL, sets * sizeof(cache_set_t), PROT_READ | PROT_WRITE, 
+		MAP_ANON | MAP_SHARED, -1, 0);
+	shared_cache.data = (char *)mmap(NULL, (size_t)sets * QueryCacheWays * shared_cache.SlotSize, 
+		PROT_READ | PROT_WRITE, MAP_ANON | MAP_SHARED, -1, 0);
+	if ( shared_cache.set == MAP_FAILED || shared_cache.data == MAP_FAILED ) {
+		LogError("mmap() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		return 0;
+	}
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	for ( i=0; i<sets; i++ ) {
+		memset((void *)&shared_cache.set[i], 0, sizeof(cache_set_t));
+		pthread_mutex_init(&shared_cache.set[i].mutex, &attr);
+	}
+	pthread_mutexattr_destroy(&attr);
+
+	query_block_cache.get = CacheGet;
+	query_block_cache.put = CachePut;
+	SetBlockCache(&query_block_cache);
+
+	return 1;
+
+} // End of InitBlockCache
+
+// locks and returns the set of the block, data points to the data of the first slot of the set
+static cache_set_t *LockSet(struct stat *stat_buf, off_t offset, char **data) {
+cache_set_t	*set;
+uint64_t	h;
+uint32_t	index;
+
+	h  = ( (uint64_t)stat_buf->st_ino * 0x9E3779B97F4A7C15LL ) ^ (uint64_t)stat_buf->st_dev;
+	h ^= (uint64_t)offset * 0xC2B2AE3D27D4EB4FLL;
+	h ^= h >> 31;
+	index = (uint32_t)h & shared_cache.SetMask;
+
+	set	  = &shared_cache.set[index];
+	*data = shared_cache.data + (size_t)index * QueryCacheWays * shared_cache.SlotSize;
+
+	if ( pthread_mutex_lock(&set->mutex) == EOWNERDEAD ) {
+		int i;
+		// a query died while holding the lock - drop the set
+		for ( i=0; i<QueryCacheWays; i++ ) 
+			set->slot[i].valid = 0;
+		pthread_mutex_consistent(&set->mutex);
+	}
+
+	return set;
+
+} // End of LockSet
+
+static int CacheGet(struct stat *stat_buf, off_t offset, data_block_header_t *block_header) {
+cache_set_t	*set;
+char		*data;
+int			i;
+
+	set = LockSet(stat_buf, offset, &data);
+	for ( i=0; i<QueryCacheWays; i++ ) {
+		cache_slot_t *slot = &set->slot[i];
+		if ( slot->valid && slot->offset == offset && slot->ino == stat_buf->st_ino && slot->dev == stat_buf->st_dev &&
+			 slot->mtime == stat_buf->st_mtime && slot->fsize == stat_buf->st_size ) {
+			memcpy((void *)block_header, data + i * shared_cache.SlotSize, slot->size);
+			slot->lru = ++set->clock;
+			pthread_mutex_unlock(&set->mutex);
+			return 1;
+		}
+	}
+	pthread_mutex_unlock(&set->mutex);
+
+	return 0;
+
+} // End of CacheGet
+
+static void CachePut(struct stat *stat_buf, off_t offset, data_block_header_t *block_header) {
+cache_set_t		*set;
+cache_slot_t	*slot;
+char			*data;
+uint32_t		size;
+int				i, way;
+
+	size = sizeof(data_block_header_t) + block_header->size;
+	if ( size > shared_cache.SlotSize )
+		return;
+
+	set = LockSet(stat_buf, offset, &data);
+	way = 0;
+	for ( i=0; i<QueryCacheWays; i++ ) {
+		slot = &set->slot[i];
+		if ( !slot->valid ) {
+			way = i;
+			break;
+		}
+		if ( slot->offset == offset && slot->ino == stat_buf->st_ino && slot->dev == stat_buf->st_dev &&
+			 slot->mtime == stat_buf->st_mtime && slot->fsize == stat_buf->st_size ) {
+			// cached meanwhile by another query
+			pthread_mutex_unlock(&set->mutex);
+			return;
+		}
+		if ( slot->lru < set->slot[way].lru )
+			way = i;
+	}
+
+	slot = &set->slot[way];
+	slot->valid  = 0;
+	memcpy(data + way * shared_cache.SlotSize, (void *)block_header, size);
+	slot->dev	 = stat_buf->st_dev;
+	slot->ino	 = stat_buf->st_ino;
+	slot->mtime  = stat_buf->st_mtime;
+	slot->fsize  = stat_buf->st_size;
+	slot->offset = offset;
+	slot->size	 = size;
+	slot->lru	 = ++set->clock;
+	slot->valid  = 1;
+	pthread_mutex_unlock(&set->mutex);
+
+} // End of CachePut
+
+static int ReadFull(int fd, void *buff, size_t len) {
+char *p = (char *)buff;
+
+	while ( len ) {
+		ssize_t ret = read(fd, p, len);
+		if ( ret < 0 ) {
+			if ( errno == EINTR )
+				continue;
+			return 0;
+		}
+		if ( ret == 0 ) 
+			return 0;
+		p	+= ret;
+		len -= ret;
+	}
+	return 1;
+
+} // End of ReadFull
+
+static int WriteFull(int fd, void *buff, size_t len) {
+char *p = (char *)buff;
+
+	while ( len ) {
+		ssize_t ret = write(fd, p, len);
+		if ( ret < 0 ) {
+			if ( errno == EINTR )
+				continue;
+			return 0;
+		}
+		p	+= ret;
+		len -= ret;
+	}
+	return 1;
+
+} // End of WriteFull
+
+static void FreeArgs(char **argv) {
+int i;
+
+	for ( i=0; argv[i]; i++ ) 
+		free(argv[i]);
+	free(argv);
+
+} // End of FreeArgs
+
+// returns the NULL terminated argument vector of the request - argv[0] is the working directory
+static char **ReadRequest(int fd, int *argc) {
+char		**argv;
+uint32_t	num, len, i;
+
+	if ( !ReadFull(fd, &num, sizeof(num)) )
+		return NULL;
+	num = ntohl(num);
+	if ( num == 0 || num > QUERY_MAX_ARGS ) {
+		LogError("Invalid query request: %u arguments\n", num);
+		return NULL;
+	}
+
+	argv = (char **)calloc(num + 1, sizeof(char *));
+	if ( !argv ) {
+		LogError("calloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		return NULL;
+	}
+	for ( i=0; i<num; i++ ) {
+		if ( !ReadFull(fd, &len, sizeof(len)) ) {
+			FreeArgs(argv);
+			return NULL;
+		}
+		len = ntohl(len);
+		if ( len > QUERY_MAX_ARGLEN ) {
+			LogError("Invalid query request: argument length %u\n", len);
+			FreeArgs(argv);
+			return NULL;
+		}
+		argv[i] = (char *)malloc(len + 1);
+		if ( !argv[i] ) {
+			LogError("malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+			FreeArgs(argv);
+			return NULL;
+		}
+		if ( !ReadFull(fd, argv[i], len) ) {
+			FreeArgs(argv);
+			return NULL;
+		}
+		argv[i][len] = '\0';
+	}
+	*argc = num;
+
+	return argv;
+
+} // End of ReadRequest
+
+static void RunQuery(int sock, int fd, int (*query)(int argc, char **argv)) {
+struct pollfd	pfd[2];
+char			buff[sizeof(query_frame_t) + 65536];
+query_frame_t	*frame = (query_frame_t *)buff;
+char			**argv;
+int				argc, out[2], err[2], i, open_fds, status, connected;
+uint32_t		exit_status;
+pid_t			pid;
+
+	argv = ReadRequest(fd, &argc);
+	if ( !argv ) 
+		return;
+
+	if ( pipe(out) < 0 ) {
+		LogError("pipe() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		FreeArgs(argv);
+		return;
+	}
+	if ( pipe(err) < 0 ) {
+		LogError("pipe() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		close(out[0]); close(out[1]);
+		FreeArgs(argv);
+		return;
+	}
+
+	pid = fork();
+	if ( pid < 0 ) {
+		LogError("fork() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		close(out[0]); close(out[1]);
+		close(err[0]); close(err[1]);
+		FreeArgs(argv);
+		return;
+	}
+
+	if ( pid == 0 ) {
+		// query process
+		close(sock);
+		close(fd);
+		dup2(out[1], STDOUT_FILENO);
+		dup2(err[1], STDERR_FILENO);
+		close(out[0]); close(out[1]);
+		close(err[0]); close(err[1]);
+		signal(SIGPIPE, SIG_DFL);
+		if ( chdir(argv[0]) < 0 ) {
+			fprintf(stderr, "chdir() to '%s' failed: %s\n", argv[0], strerror(errno));
+			exit(255);
+		}
+		argv[0] = "nfdump";
+		exit(query(argc, argv));
+	}
+
+	// worker - pass the output of the query on to the client
+	close(out[1]);
+	close(err[1]);
+	pfd[0].fd	  = out[0];
+	pfd[0].events = POLLIN;
+	pfd[1].fd	  = err[0];
+	pfd[1].events = POLLIN;
+	open_fds  = 2;
+	connected = 1;
+	while ( open_fds ) {
+		if ( poll(pfd, 2, -1) < 0 ) {
+			if ( errno == EINTR )
+				continue;
+			LogError("poll() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+			break;
+		}
+		for ( i=0; i<2; i++ ) {
+			ssize_t ret;
+			if ( pfd[i].fd < 0 || !(pfd[i].revents & (POLLIN | POLLHUP | POLLERR)) )
+				continue;
+			ret = read(pfd[i].fd, buff + sizeof(query_frame_t), sizeof(buff) - sizeof(query_frame_t));
+			if ( ret < 0 && errno == EINTR )
+				continue;
+			if ( ret <= 0 ) {
+				close(pfd[i].fd);
+				pfd[i].fd = -1;
+				open_fds--;
+				continue;
+			}
+			frame->type	  = htonl(i == 0 ? QUERY_STDOUT : QUERY_STDERR);
+			frame->length = htonl(ret);
+			if ( connected && !WriteFull(fd, buff, sizeof(query_frame_t) + ret) ) {
+				// client is gone - stop the query
+				connected = 0;
+				kill(pid, SIGKILL);
+			}
+		}
+	}
+	for ( i=0; i<2; i++ ) 
+		if ( pfd[i].fd >= 0 ) 
+			close(pfd[i].fd);
+
+	while ( waitpid(pid, &status, 0) < 0 && errno == EINTR )
+		;
+	exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+
+	if ( connected ) {
+		frame->type	  = htonl(QUERY_EXIT);
+		frame->length = htonl(sizeof(uint32_t));
+		exit_status	  = htonl(exit_status);
+		memcpy(buff + sizeof(query_frame_t), &exit_status, sizeof(uint32_t));
+		WriteFull(fd, buff, sizeof(query_frame_t) + sizeof(uint32_t));
+	}
+
+	FreeArgs(argv);
+
+} // End of RunQuery
+
+static void QueryWorker(int sock, int (*query)(int argc, char **argv)) {
+int fd;
+
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGINT, SIG_IGN);
+	signal(SIGPIPE, SIG_IGN);
+
+	while ( 1 ) {
+		fd = accept(sock, NULL, NULL);
+		if ( fd < 0 ) {
+			if ( errno == EINTR || errno == ECONNABORTED )
+				continue;
+			LogError("accept() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+			exit(255);
+		}
+		RunQuery(sock, fd, query);
+		close(fd);
+	}
+
+	/* not reached */
+
+} // End of QueryWorker
+
+static void IntHandler(int signal) {
+
+	done = 1;
+
+} // End of IntHandler
+
+int RunQueryServer(char *option, int (*query)(int argc, char **argv)) {
+struct sockaddr_un	addr;
+struct sigaction	act;
+uint64_t			cache_size;
+pid_t				*worker;
+char				*s;
+int					sock, num_workers, i;
+
+	// <socket>[:<workers>[:<cache size>]]
+	num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+	if ( num_workers < 1 )
+		num_workers = 1;
+	cache_size = QueryCacheSize;
+
+	s = strchr(option, ':');
+	if ( s ) {
+		char *c;
+		*s++ = '\0';
+		c = strchr(s, ':');
+		if ( c ) {
+			*c++ = '\0';
+			cache_size = ParseSize(c);
+			if ( cache_size == 0 ) {
+				LogError("Invalid block cache size '%s'\n", c);
+				return 0;
+			}
+		}
+		num_workers = atoi(s);
+		if ( num_workers < 1 || num_workers > 1024 ) {
+			LogError("Invalid number of workers '%s'\n", s);
+			return 0;
+		}
+	}
+
+	if ( strlen(option) >= sizeof(addr.sun_path) ) {
+		LogError("Socket path '%s' too long\n", option);
+		return 0;
+	}
+
+	if ( !InitBlockCache(cache_size) ) 
+		return 0;
+
+	sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if ( sock < 0 ) {
+		LogError("socket() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		return 0;
+	}
+	memset((void *)&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, option, sizeof(addr.sun_path) - 1);
+	unlink(option);
+	if ( bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ) {
+		LogError("bind() to '%s' failed: %s\n", option, strerror(errno) );
+		close(sock);
+		return 0;
+	}
+	if ( listen(sock, 128) < 0 ) {
+		LogError("listen() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		close(sock);
+		unlink(option);
+		return 0;
+	}
+
+	worker = (pid_t *)calloc(num_workers, sizeof(pid_t));
+	if ( !worker ) {
+		LogError("calloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		close(sock);
+		unlink(option);
+		return 0;
+	}
+
+	// no SA_RESTART - wait() returns on a signal
+	done = 0;
+	memset((void *)&act, 0, sizeof(act));
+	act.sa_handler = IntHandler;
+	sigemptyset(&act.sa_mask);
+	act.sa_flags = 0;
+	sigaction(SIGTERM, &act, NULL);
+	sigaction(SIGINT, &act, NULL);
+
+	while ( !done ) {
+		pid_t pid;
+		// start missing workers
+		for ( i=0; i<num_workers; i++ ) {
+			if ( worker[i] ) 
+				continue;
+			pid = fork();
+			if ( pid < 0 ) {
+				LogError("fork() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+				break;
+			}
+			if ( pid == 0 ) 
+				QueryWorker(sock, query);
+			worker[i] = pid;
+		}
+
+		pid = wait(NULL);
+		if ( pid < 0 ) {
+			if ( errno != EINTR ) {
+				LogError("wait() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+				sleep(1);
+			}
+			continue;
+		}
+		for ( i=0; i<num_workers; i++ ) {
+			if ( worker[i] == pid ) {
+				LogError("Query worker %d terminated - restart\n", pid);
+				worker[i] = 0;
+			}
+		}
+	}
+
+	for ( i=0; i<num_workers; i++ ) 
+		if ( worker[i] )
+			kill(worker[i], SIGTERM);
+	while ( wait(NULL) > 0 || errno == EINTR )
+		;
+
+	close(sock);
+	unlink(option);
+	free(worker);
+
+	return 1;
+
+} // End of RunQueryServer
+
+int RunQueryClient(char *socket_path, int argc, char **argv) {
+struct sockaddr_un	addr;
+query_frame_t		frame;
+char				cwd[MAXPATHLEN];
+char				buff[65536];
+uint32_t			num, len, exit_status;
+int					sock, i;
+
+	if ( strlen(socket_path) >= sizeof(addr.sun_path) ) {
+		LogError("Socket path '%s' too long\n", socket_path);
+		return 255;
+	}
+	if ( !getcwd(cwd, MAXPATHLEN) ) {
+		LogError("getcwd() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		return 255;
+	}
+
+	sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if ( sock < 0 ) {
+		LogError("socket() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		return 255;
+	}
+	memset((void *)&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+	if ( connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ) {
+		LogError("Can't connect to query server '%s': %s\n", socket_path, strerror(errno) );
+		close(sock);
+		return 255;
+	}
+
+	// request: working directory and arguments
+	num = htonl(argc + 1);
+	len = htonl(strlen(cwd));
+	if ( !WriteFull(sock, &num, sizeof(num)) || !WriteFull(sock, &len, sizeof(len)) || 
+		 !WriteFull(sock, cwd, strlen(cwd)) ) {
+		LogError("write() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		close(sock);
+		return 255;
+	}
+	for ( i=0; i<argc; i++ ) {
+		len = htonl(strlen(argv[i]));
+		if ( !WriteFull(sock, &len, sizeof(len)) || !WriteFull(sock, argv[i], strlen(argv[i])) ) {
+			LogError("write() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+			close(sock);
+			return 255;
+		}
+	}
+
+	// response
+	while ( ReadFull(sock, &frame, sizeof(frame)) ) {
+		frame.type	 = ntohl(frame.type);
+		frame.length = ntohl(frame.length);
+		if ( frame.type == QUERY_EXIT ) {
+			if ( frame.length != sizeof(uint32_t) || !ReadFull(sock, &exit_status, sizeof(uint32_t)) ) 
+				break;
+			close(sock);
+			return ntohl(exit_status);
+		}
+		while ( frame.length ) {
+			len = frame.length > sizeof(buff) ? sizeof(buff) : frame.length;
+			if ( !ReadFull(sock, buff, len) ) {
+				frame.length = 0;
+				break;
+			}
+			WriteFull(frame.type == QUERY_STDERR ? STDERR_FILENO : STDOUT_FILENO, buff, len);
+			frame.length -= len;
+		}
+	}
+
+	LogError("Query server closed the connection\n");
+	close(sock);
+	return 255;
+
+} // End of RunQueryClient
@@ -0,0 +1,86 @@
+/*
+ *  This file is part of the nfdump project.
+ *
+ *  Copyright (c) 2014, the nfdump contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of SWITCH nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  $Author$
+ *
+ *  $Id$
+ *
+ *  $LastChangedRevision$
+ *
+ */
+
+#ifndef _NFSERVER_H
+#define _NFSERVER_H 1
+
+/* Definitions */
+
+/*
+ * Query server
+ * nfdump -U <socket> listens on a Unix domain socket and runs queries with the same
+ * arguments as nfdump on a pool of pre-forked workers. Each worker forks a fresh process
+ * for each query, which saves starting nfdump, while the process state of each query
+ * stays independent. All queries share a cache of decompressed data blocks.
+ *
+ * Protocol:
+ * The client sends a request and reads response frames until the exit frame. All integers
+ * are in network byte order.
+ *   request:  uint32_t num, followed by num strings, each as uint32_t length and the
+ *             characters without '\0'. The first string is the working directory of the
+ *             query, the others are the nfdump arguments without the program name.
+ *   response: query_frame_t followed by length bytes. Frames of type QUERY_STDOUT and
+ *             QUERY_STDERR contain the output of the query, QUERY_EXIT ends the response
+ *             and contains the uint32_t exit status of the query.
+ */
+
+#define QUERY_STDOUT	1
+#define QUERY_STDERR	2
+#define QUERY_EXIT		3
+
+typedef struct query_frame_s {
+	uint32_t	type;
+	uint32_t	length;
+} query_frame_t;
+
+// limits of a request
+#define QUERY_MAX_ARGS		1024
+#define QUERY_MAX_ARGLEN	65536
+
+// default size of the block cache
+#define QueryCacheSize		(256LL * 1024LL * 1024LL)
+
+// ways of each set of the block cache
+#define QueryCacheWays		8
+
+/* Function prototypes */
+int RunQueryServer(char *option, int (*query)(int argc, char **argv));
+
+int RunQueryClient(char *socket_path, int argc, char **argv);
+
+#endif //_NFSERVER_H
@@ -0,0 +1,951 @@
+/*
+ *  This file is part of the nfdump project.
+ *
+ *  Copyright (c) 2014, the nfdump contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of SWITCH nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  $Author$
+ *
+ *  $Id$
+ *
+ *  $LastChangedRevision$
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "nffile.h"
+#include "nfx.h"
+#include "nf_common.h"
+#include "nfstat.h"
+#include "nfsketch.h"
+
+typedef struct merge_element_s {
+	uint64_t	count;
+	uint32_t	index;
+} merge_element_t;
+
+/* function prototypes */
+static inline uint32_t TopK_Hash(topk_summary_t *topk, uint64_t *key, uint8_t prot);
+
+static inline void TopK_SiftDown(topk_summary_t *topk, uint32_t pos);
+
+static inline void TopK_SiftUp(topk_summary_t *topk, uint32_t pos);
+
+static void TopK_Unlink(topk_summary_t *topk, StatRecord_t *record);
+
+static int MergeCMP(const void *p1, const void *p2);
+
+static inline uint64_t Mix64(uint64_t h);
+
+static inline void HLL_Register(uint8_t *registers, uint64_t hash);
+
+static int HLL_Dense(hll_t *hll);
+
+static int HLL_Grow(hll_t *hll);
+
+static inline int32_t DDS_Key(double value);
+
+static void DDS_Range(ddsketch_t *dds, int32_t key);
+
+/* Functions */
+
+static inline uint32_t TopK_Hash(topk_summary_t *topk, uint64_t *key, uint8_t prot) {
+uint64_t	h;
+
+	// spread the key bits - stat keys such as ports or small ip nets have little entropy
+	h  = key[1] * 0x9E3779B97F4A7C15LL;
+	h ^= key[0] + ( h >> 29 );
+	if ( topk->order_proto )
+		h ^= prot;
+	h ^= h >> 32;
+
+	return (uint32_t)h & topk->IndexMask;
+
+} // End of TopK_Hash
+
+topk_summary_t *TopK_Init(uint32_t capacity, uint32_t order, uint32_t order_proto) {
+topk_summary_t	*topk;
+uint32_t		size;
+
+	topk = (topk_summary_t *)calloc(1, sizeof(topk_summary_t));
+	if ( !topk ) {
+		fprintf(stderr, "calloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		return NULL;
+	}
+
+	// index size: next power of 2, at least twice the number of counters
+	size = 1;
+	while ( size < 2 * capacity )
+		size <<= 1;
+
+	topk->capacity	  = capacity;
+	topk->NumEntries  = 0;
+	topk->IndexMask	  = size - 1;
+	topk->order		  = order;
+	topk->order_proto = order_proto;
+	topk->total		  = 0;
+
+	topk->bucket	= (StatRecord_t **)calloc(size, sizeof(StatRecord_t *));
+	topk->entry		= (StatRecord_t *)calloc(capacity, sizeof(StatRecord_t));
+	topk->error		= (uint64_t *)calloc(capacity, sizeof(uint64_t));
+	topk->heap		= (uint32_t *)calloc(capacity, sizeof(uint32_t));
+	topk->heap_pos	= (uint32_t *)calloc(capacity, sizeof(uint32_t));
+	if ( !topk->bucket || !topk->entry || !topk->error || !topk->heap || !topk->heap_pos ) {
+		fprintf(stderr, "calloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		TopK_Free(topk);
+		return NULL;
+	}
+
+	return topk;
+
+} // End of TopK_Init
+
+void TopK_Free(topk_summary_t *topk) {
+uint32_t	i;
+
+	if ( !topk )
+		return;
+
+	if ( topk->entry ) {
+		for ( i=0; i<topk->NumEntries; i++ ) {
+			HLL_Free(topk->entry[i].hll);
+			DDS_Free(topk->entry[i].dds);
+		}
+	}
+	free((void *)topk->bucket);
+	free((void *)topk->entry);
+	free((void *)topk->error);
+	free((void *)topk->heap);
+	free((void *)topk->heap_pos);
+	free((void *)topk);
+
+} // End of TopK_Free
+
+StatRecord_t *TopK_Lookup(topk_summary_t *topk, uint64_t *key, uint8_t prot) {
+StatRecord_t	*record;
+
+	record = topk->bucket[TopK_Hash(topk, key, prot)];
+	if ( topk->order_proto ) {
+		while ( record && ( record->stat_key[1] != key[1] || record->stat_key[0] != key[0] || prot != record->prot ) ) {
+			record = record->next;
+		}
+	} else {
+		while ( record && ( record->stat_key[1] != key[1] || record->stat_key[0] != key[0] ) ) {
+			record = record->next;
+		}
+	}
+	return record;
+
+} // End of TopK_Lookup
+
+static void TopK_Unlink(topk_summary_t *topk, StatRecord_t *record) {
+StatRecord_t	**r;
+
+	r = &(topk->bucket[TopK_Hash(topk, record->stat_key, record->prot)]);
+	while ( *r && *r != record )
+		r = &((*r)->next);
+	if ( *r )
+		*r = record->next;
+	record->next = NULL;
+
+} // End of TopK_Unlink
+
+static inline void TopK_SiftDown(topk_summary_t *topk, uint32_t pos) {
+uint32_t	order, num, child, tmp;
+
+	order = topk->order;
+	num	  = topk->NumEntries;
+	while ( ( child = 2 * pos + 1 ) < num ) {
+		if ( (child + 1) < num &&
+			topk->entry[topk->heap[child+1]].counter[order] < topk->entry[topk->heap[child]].counter[order] )
+			child++;
+		if ( topk->entry[topk->heap[pos]].counter[order] <= topk->entry[topk->heap[child]].counter[order] )
+			break;
+
+		tmp = topk->heap[pos];
+		topk->heap[pos]   = topk->heap[child];
+		topk->heap[child] = tmp;
+		topk->heap_pos[topk->heap[pos]]   = pos;
+		topk->heap_pos[topk->heap[child]] = child;
+		pos = child;
+	}
+
+} // End of TopK_SiftDown
+
+static inline void TopK_SiftUp(topk_summary_t *topk, uint32_t pos) {
+uint32_t	order, parent, tmp;
+
+	order = topk->order;
+	while ( pos > 0 ) {
+		parent = ( pos - 1 ) >> 1;
+		if ( topk->entry[topk->heap[parent]].counter[order] <= topk->entry[topk->heap[pos]].counter[order] )
+			break;
+
+		tmp = topk->heap[pos];
+		topk->heap[pos]    = topk->heap[parent];
+		topk->heap[parent] = tmp;
+		topk->heap_pos[topk->heap[pos]]    = pos;
+		topk->heap_pos[topk->heap[parent]] = parent;
+		pos = parent;
+	}
+
+} // End of TopK_SiftUp
+
+/*
+ * Insert a new key. If all counters are in use, the key with the smallest count is replaced.
+ * The returned record has all counters cleared, except the weight counter, which
+ * inherits the count of the replaced key. The caller adds the flow values and calls
+ * TopK_Settle() afterwards.
+ */
+StatRecord_t *TopK_Insert(topk_summary_t *topk, uint64_t *key, uint8_t prot) {
+StatRecord_t	*record;
+uint32_t		index, pos;
+uint64_t		min;
+
+	if ( topk->NumEntries < topk->capacity ) {
+		index  = topk->NumEntries++;
+		record = &(topk->entry[index]);
+		memset((void *)record, 0, sizeof(StatRecord_t));
+		topk->error[index] = 0;
+
+		pos = topk->NumEntries - 1;
+		topk->heap[pos] 	 = index;
+		topk->heap_pos[index] = pos;
+		TopK_SiftUp(topk, pos);
+	} else {
+		// replace the min element, which is the root of the heap
+		index  = topk->heap[0];
+		record = &(topk->entry[index]);
+		TopK_Unlink(topk, record);
+
+		min = record->counter[topk->order];
+		HLL_Free(record->hll);
+		DDS_Free(record->dds);
+		memset((void *)record, 0, sizeof(StatRecord_t));
+		record->counter[topk->order] = min;
+		topk->error[index] = min;
+	}
+
+	record->stat_key[0] = key[0];
+	record->stat_key[1] = key[1];
+	record->prot		= prot;
+
+	pos = TopK_Hash(topk, key, prot);
+	record->next 	  = topk->bucket[pos];
+	topk->bucket[pos] = record;
+
+	return record;
+
+} // End of TopK_Insert
+
+/*
+ * The weight counter of record was increased by weight - restore the heap order
+ */
+void TopK_Settle(topk_summary_t *topk, StatRecord_t *record, uint64_t weight) {
+
+	topk->total += weight;
+	TopK_SiftDown(topk, topk->heap_pos[record - topk->entry]);
+
+} // End of TopK_Settle
+
+uint64_t TopK_Error(topk_summary_t *topk, StatRecord_t *record) {
+
+	return topk->error[record - topk->entry];
+
+} // End of TopK_Error
+
+/*
+ * Any key not monitored has a real count of at most the smallest monitored count
+ */
+uint64_t TopK_Bound(topk_summary_t *topk) {
+
+	if ( topk->NumEntries < topk->capacity )
+		return 0;
+
+	return topk->entry[topk->heap[0]].counter[topk->order];
+
+} // End of TopK_Bound
+
+static int MergeCMP(const void *p1, const void *p2) {
+merge_element_t *e1 = (merge_element_t *)p1;
+merge_element_t *e2 = (merge_element_t *)p2;
+
+	if ( e1->count == e2->count )
+		return 0;
+	return e1->count < e2->count ? 1 : -1;
+
+} // End of MergeCMP
+
+/*
+ * Merge summary other into topk. Keys found in both summaries add their counts. Keys
+ * found in one summary only may have been evicted in the other one, so they get the
+ * other's bound added as count and error. The capacity largest counts are kept.
+ * The result keeps the Space-Saving guarantees, independent of the merge order.
+ * Distinct count sketches of other are copied, other remains unchanged.
+ */
+int TopK_Merge(topk_summary_t *topk, topk_summary_t *other) {
+StatRecord_t	*merged, *r, *o;
+merge_element_t	*sort_list;
+uint64_t		*merged_error, bound, other_bound;
+uint8_t			*matched;
+uint32_t		i, c, num, order;
+
+	if ( topk->order != other->order || topk->order_proto != other->order_proto ) {
+		fprintf(stderr, "Can not merge approximate statistics of different type\n");
+		return 0;
+	}
+
+	order		= topk->order;
+	bound		= TopK_Bound(topk);
+	other_bound = TopK_Bound(other);
+	num = topk->NumEntries + other->NumEntries;
+
+	merged		 = (StatRecord_t *)malloc(num * sizeof(StatRecord_t));
+	merged_error = (uint64_t *)malloc(num * sizeof(uint64_t));
+	sort_list	 = (merge_element_t *)malloc(num * sizeof(merge_element_t));
+	matched		 = (uint8_t *)calloc(other->NumEntries + 1, sizeof(uint8_t));
+	if ( !merged || !merged_error || !sort_list || !matched ) {
+		fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		free((void *)merged);
+		free((void *)merged_error);
+		free((void *)sort_list);
+		free((void *)matched);
+		return 0;
+	}
+
+	c = 0;
+	for ( i=0; i<topk->NumEntries; i++ ) {
+		r = &(topk->entry[i]);
+		merged[c] = *r;
+		merged_error[c] = topk->error[i];
+		o = TopK_Lookup(other, r->stat_key, r->prot);
+		if ( o ) {
+			merged[c].counter[0] += o->counter[0];
+			merged[c].counter[1] += o->counter[1];
+			merged[c].counter[2] += o->counter[2];
+			if ( o->first < merged[c].first ||
+				 ( o->first == merged[c].first && o->msec_first < merged[c].msec_first ) ) {
+				merged[c].first		 = o->first;
+				merged[c].msec_first = o->msec_first;
+			}
+			if ( o->last > merged[c].last ||
+				 ( o->last == merged[c].last && o->msec_last > merged[c].msec_last ) ) {
+				merged[c].last		= o->last;
+				merged[c].msec_last = o->msec_last;
+			}
+			merged_error[c] += other->error[o - other->entry];
+			matched[o - other->entry] = 1;
+			if ( o->hll ) {
+				if ( merged[c].hll )
+					HLL_Merge(merged[c].hll, o->hll);
+				else
+					merged[c].hll = HLL_Dup(o->hll);
+			}
+			if ( o->dds ) {
+				if ( merged[c].dds )
+					DDS_Merge(merged[c].dds, o->dds);
+				else
+					merged[c].dds = DDS_Dup(o->dds);
+			}
+		} else {
+			merged[c].counter[order] += other_bound;
+			merged_error[c] += other_bound;
+		}
+		c++;
+	}
+	for ( i=0; i<other->NumEntries; i++ ) {
+		if ( matched[i] )
+			continue;
+		merged[c] = other->entry[i];
+		merged[c].hll = HLL_Dup(other->entry[i].hll);
+		merged[c].dds = DDS_Dup(other->entry[i].dds);
+		merged[c].counter[order] += bound;
+		merged_error[c] = other->error[i] + bound;
+		c++;
+	}
+
+	for ( i=0; i<c; i++ ) {
+		sort_list[i].count = merged[i].counter[order];
+		sort_list[i].index = i;
+	}
+	qsort((void *)sort_list, c, sizeof(merge_element_t), MergeCMP);
+
+	// rebuild the summary with the largest counts. Stored in ascending order, the
+	// entry array is a valid min-heap right away
+	num = c < topk->capacity ? c : topk->capacity;
+	memset((void *)topk->bucket, 0, (topk->IndexMask + 1) * sizeof(StatRecord_t *));
+	for ( i=0; i<num; i++ ) {
+		uint32_t pos, j = sort_list[num - 1 - i].index;
+		r = &(topk->entry[i]);
+		*r = merged[j];
+		topk->error[i]	  = merged_error[j];
+		topk->heap[i]	  = i;
+		topk->heap_pos[i] = i;
+
+		pos = TopK_Hash(topk, r->stat_key, r->prot);
+		r->next 		  = topk->bucket[pos];
+		topk->bucket[pos] = r;
+	}
+	// elements, which did not make it into the summary
+	for ( i=num; i<c; i++ ) {
+		HLL_Free(merged[sort_list[i].index].hll);
+		DDS_Free(merged[sort_list[i].index].dds);
+	}
+
+	topk->NumEntries = num;
+	topk->total 	+= other->total;
+
+	free((void *)merged);
+	free((void *)merged_error);
+	free((void *)sort_list);
+	free((void *)matched);
+
+	return 1;
+
+} // End of TopK_Merge
+
+/*
+ * finalizer of MurmurHash3 - good avalanche for sequential values such as ports or addresses
+ */
+static inline uint64_t Mix64(uint64_t h) {
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdLL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53LL;
+	h ^= h >> 33;
+
+	return h;
+
+} // End of Mix64
+
+uint64_t HLL_Hash(uint64_t *value) {
+
+	return Mix64(value[0] ^ Mix64(value[1]));
+
+} // End of HLL_Hash
+
+hll_t *HLL_New(void) {
+hll_t	*hll;
+
+	hll = (hll_t *)calloc(1, sizeof(hll_t));
+	if ( !hll ) {
+		fprintf(stderr, "calloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		exit(250);
+	}
+	hll->size	= 4;
+	hll->sparse = (uint64_t *)calloc(hll->size, sizeof(uint64_t));
+	if ( !hll->sparse ) {
+		fprintf(stderr, "calloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		exit(250);
+	}
+
+	return hll;
+
+} // End of HLL_New
+
+hll_t *HLL_Dup(hll_t *hll) {
+hll_t	*dup;
+
+	if ( !hll )
+		return NULL;
+
+	dup = (hll_t *)malloc(sizeof(hll_t));
+	if ( !dup ) {
+		fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		exit(250);
+	}
+	*dup = *hll;
+	if ( hll->size ) {
+		dup->sparse = (uint64_t *)malloc(hll->size * sizeof(uint64_t));
+		if ( !dup->sparse ) {
+			fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+			exit(250);
+		}
+		memcpy((void *)dup->sparse, (void *)hll->sparse, hll->size * sizeof(uint64_t));
+	} else {
+		dup->registers = (uint8_t *)malloc(HLL_REGISTERS);
+		if ( !dup->registers ) {
+			fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+			exit(250);
+		}
+		memcpy((void *)dup->registers, (void *)hll->registers, HLL_REGISTERS);
+	}
+
+	return dup;
+
+} // End of HLL_Dup
+
+void HLL_Free(hll_t *hll) {
+
+	if ( !hll )
+		return;
+
+	free((void *)hll->sparse);
+	free((void *)hll->registers);
+	free((void *)hll);
+
+} // End of HLL_Free
+
+static inline void HLL_Register(uint8_t *registers, uint64_t hash) {
+uint32_t	index;
+uint8_t		rank;
+
+	// upper HLL_BITS select the register, the rank is the position of the first 1 bit in the rest
+	index = hash >> ( 64 - HLL_BITS );
+	hash  = ( hash << HLL_BITS ) | ( 1LL << ( HLL_BITS - 1 ) );
+	rank  = 1;
+	while ( ( hash & 0x8000000000000000LL ) == 0 ) {
+		rank++;
+		hash <<= 1;
+	}
+	if ( rank > registers[index] )
+		registers[index] = rank;
+
+} // End of HLL_Register
+
+static int HLL_Dense(hll_t *hll) {
+uint32_t	i;
+
+	hll->registers = (uint8_t *)calloc(HLL_REGISTERS, sizeof(uint8_t));
+	if ( !hll->registers ) {
+		fprintf(stderr, "calloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		exit(250);
+	}
+	for ( i=0; i<hll->size; i++ ) {
+		if ( hll->sparse[i] )
+			HLL_Register(hll->registers, hll->sparse[i]);
+	}
+	free((void *)hll->sparse);
+	hll->sparse = NULL;
+	hll->size	= 0;
+	hll->num	= 0;
+
+	return 1;
+
+} // End of HLL_Dense
+
+static int HLL_Grow(hll_t *hll) {
+uint64_t	*sparse;
+uint32_t	i, size, mask;
+
+	size = hll->size << 1;
+	if ( ( size * sizeof(uint64_t) ) > HLL_REGISTERS ) 
+		return HLL_Dense(hll);
+
+	sparse = (uint64_t *)calloc(size, sizeof(uint64_t));
+	if ( !sparse ) {
+		fprintf(stderr, "calloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		exit(250);
+	}
+	mask = size - 1;
+	for ( i=0; i<hll->size; i++ ) {
+		uint32_t slot;
+		if ( hll->sparse[i] == 0 )
+			continue;
+		slot = hll->sparse[i] & mask;
+		while ( sparse[slot] )
+			slot = ( slot + 1 ) & mask;
+		sparse[slot] = hll->sparse[i];
+	}
+	free((void *)hll->sparse);
+	hll->sparse = sparse;
+	hll->size	= size;
+
+	return 1;
+
+} // End of HLL_Grow
+
+void HLL_Add(hll_t *hll, uint64_t hash) {
+uint32_t	slot, mask;
+
+	if ( hll->size == 0 ) {
+		HLL_Register(hll->registers, hash);
+		return;
+	}
+
+	// 0 marks an empty slot
+	if ( hash == 0 )
+		hash = 1;
+
+	mask = hll->size - 1;
+	slot = hash & mask;
+	while ( hll->sparse[slot] ) {
+		if ( hll->sparse[slot] == hash )
+			return;
+		slot = ( slot + 1 ) & mask;
+	}
+	hll->sparse[slot] = hash;
+	hll->num++;
+
+	// keep load factor below 3/4
+	if ( ( hll->num << 2 ) > ( hll->size * 3 ) )
+		HLL_Grow(hll);
+
+} // End of HLL_Add
+
+uint64_t HLL_Count(hll_t *hll) {
+double		sum, estimate, m;
+uint32_t	i, zeros;
+
+	if ( !hll )
+		return 0;
+
+	// sparse mode is exact - apart from 64bit hash collisions
+	if ( hll->size )
+		return hll->num;
+
+	m	  = HLL_REGISTERS;
+	sum   = 0;
+	zeros = 0;
+	for ( i=0; i<HLL_REGISTERS; i++ ) {
+		sum += ldexp(1.0, -hll->registers[i]);
+		if ( hll->registers[i] == 0 )
+			zeros++;
+	}
+	estimate = ( 0.7213 / ( 1.0 + 1.079 / m ) ) * m * m / sum;
+
+	// small range correction - linear counting
+	if ( estimate <= 2.5 * m && zeros )
+		estimate = m * log(m / (double)zeros);
+
+	return (uint64_t)( estimate + 0.5 );
+
+} // End of HLL_Count
+
+int HLL_Merge(hll_t *hll, hll_t *other) {
+uint32_t	i;
+
+	if ( other->size ) {
+		for ( i=0; i<other->size; i++ ) {
+			if ( other->sparse[i] )
+				HLL_Add(hll, other->sparse[i]);
+		}
+		return 1;
+	}
+
+	if ( hll->size )
+		HLL_Dense(hll);
+
+	for ( i=0; i<HLL_REGISTERS; i++ ) {
+		if ( other->registers[i] > hll->registers[i] )
+			hll->registers[i] = other->registers[i];
+	}
+
+	return 1;
+
+} // End of HLL_Merge
+
+static inline int32_t DDS_Key(double value) {
+
+	return (int32_t)ceil(log(value) / log(DDS_GAMMA));
+
+} // End of DDS_Key
+
+ddsketch_t *DDS_New(void) {
+ddsketch_t	*dds;
+
+	dds = (ddsketch_t *)calloc(1, sizeof(ddsketch_t));
+	if ( !dds ) {
+		fprintf(stderr, "calloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		exit(250);
+	}
+	return dds;
+
+} // End of DDS_New
+
+ddsketch_t *DDS_Dup(ddsketch_t *dds) {
+ddsketch_t	*dup;
+
+	if ( !dds )
+		return NULL;
+
+	dup = (ddsketch_t *)malloc(sizeof(ddsketch_t));
+	if ( !dup ) {
+		fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		exit(250);
+	}
+	*dup = *dds;
+	if ( dds->num_bins ) {
+		dup->bins = (uint64_t *)malloc(dds->num_bins * sizeof(uint64_t));
+		if ( !dup->bins ) {
+			fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+			exit(250);
+		}
+		memcpy((void *)dup->bins, (void *)dds->bins, dds->num_bins * sizeof(uint64_t));
+	}
+	return dup;
+
+} // End of DDS_Dup
+
+void DDS_Free(ddsketch_t *dds) {
+
+	if ( !dds )
+		return;
+
+	free((void *)dds->bins);
+	free((void *)dds);
+
+} // End of DDS_Free
+
+/*
+ * extend the bin range, so that key is covered. If the range exceeds DDS_MAXBINS,
+ * the lowest bins are collapsed into the lowest remaining bin
+ */
+static void DDS_Range(ddsketch_t *dds, int32_t key) {
+uint64_t	*bins;
+uint32_t	num_bins, i;
+int32_t		low, high, offset;
+
+	if ( dds->num_bins ) {
+		// already covered - or collapsed into the lowest bin of a full range
+		if ( key >= dds->offset && key < ( dds->offset + (int32_t)dds->num_bins ) )
+			return;
+		if ( key < dds->offset && dds->num_bins == DDS_MAXBINS )
+			return;
+	}
+
+	if ( dds->num_bins == 0 ) {
+		low  = key;
+		high = key;
+	} else {
+		low  = key < dds->offset ? key : dds->offset;
+		high = dds->offset + (int32_t)dds->num_bins - 1;
+		high = key > high ? key : high;
+	}
+
+	// grow in steps of 16 bins, to avoid a realloc for every new key
+	offset = low;
+	if ( dds->num_bins ) {
+		if ( low < dds->offset )
+			offset = low - 15;
+		else
+			high += 15;
+	}
+	if ( ( high - offset + 1 ) > DDS_MAXBINS ) 
+		offset = high - DDS_MAXBINS + 1;
+	num_bins = high - offset + 1;
+
+	bins = (uint64_t *)calloc(num_bins, sizeof(uint64_t));
+	if ( !bins ) {
+		fprintf(stderr, "calloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		exit(250);
+	}
+
+	for ( i=0; i<dds->num_bins; i++ ) {
+		int32_t k = dds->offset + (int32_t)i;
+		if ( dds->bins[i] == 0 )
+			continue;
+		if ( k < offset )
+			k = offset;
+		bins[k - offset] += dds->bins[i];
+	}
+
+	free((void *)dds->bins);
+	dds->bins	  = bins;
+	dds->num_bins = num_bins;
+	dds->offset	  = offset;
+
+} // End of DDS_Range
+
+void DDS_Add(ddsketch_t *dds, double value, uint64_t weight) {
+int32_t	key;
+
+	dds->count += weight;
+	if ( value <= 0 ) {
+		dds->zero_count += weight;
+		return;
+	}
+
+	key = DDS_Key(value);
+	DDS_Range(dds, key);
+
+	// collapsed low values end up in the lowest bin
+	if ( key < dds->offset ) 
+		key = dds->offset;
+	dds->bins[key - dds->offset] += weight;
+
+} // End of DDS_Add
+
+double DDS_Quantile(ddsketch_t *dds, double q) {
+uint64_t	rank, sum;
+uint32_t	i;
+
+	if ( !dds || dds->count == 0 )
+		return 0;
+
+	rank = (uint64_t)( q * (double)( dds->count - 1 ) );
+	sum  = dds->zero_count;
+	if ( sum > rank ) 
+		return 0;
+
+	for ( i=0; i<dds->num_bins; i++ ) {
+		sum += dds->bins[i];
+		if ( sum > rank ) 
+			break;
+	}
+	if ( i == dds->num_bins )
+		i = dds->num_bins - 1;
+
+	// value in the middle of the bin - relative error <= DDS_ALPHA
+	return 2.0 * pow(DDS_GAMMA, dds->offset + (int32_t)i) / ( DDS_GAMMA + 1.0 );
+
+} // End of DDS_Quantile
+
+int DDS_Merge(ddsketch_t *dds, ddsketch_t *other) {
+uint32_t	i;
+
+	if ( other->num_bins ) {
+		DDS_Range(dds, other->offset);
+		DDS_Range(dds, other->offset + (int32_t)other->num_bins - 1);
+	}
+
+	for ( i=0; i<other->num_bins; i++ ) {
+		int32_t k = other->offset + (int32_t)i;
+		if ( other->bins[i] == 0 )
+			continue;
+		if ( k < dds->offset )
+			k = dds->offset;
+		dds->bins[k - dds->offset] += other->bins[i];
+	}
+	dds->count		+= other->count;
+	dds->zero_count += other->zero_count;
+
+	return 1;
+
+} // End of DDS_Merge
+
+/*
+ * Sketches are written in host byte order, as part of a partial statistics file.
+ * The sparse set of a HyperLogLog sketch is written as list of hashes.
+ */
+int HLL_Write(FILE *fp, hll_t *hll) {
+uint32_t	header[2], i;
+
+	header[0] = hll->size ? hll->num : 0;
+	header[1] = hll->size ? 0 : 1;	// dense
+	if ( fwrite((void *)header, sizeof(header), 1, fp) != 1 )
+		return 0;
+
+	if ( header[1] ) 
+		return fwrite((void *)hll->registers, HLL_REGISTERS, 1, fp) == 1;
+
+	for ( i=0; i<hll->size; i++ ) {
+		if ( hll->sparse[i] && fwrite((void *)&hll->sparse[i], sizeof(uint64_t), 1, fp) != 1 )
+			return 0;
+	}
+	return 1;
+
+} // End of HLL_Write
+
+hll_t *HLL_Read(FILE *fp) {
+hll_t		*hll;
+uint64_t	hash;
+uint32_t	header[2], i;
+
+	if ( fread((void *)header, sizeof(header), 1, fp) != 1 )
+		return NULL;
+
+	hll = HLL_New();
+	if ( header[1] ) {
+		HLL_Dense(hll);
+		if ( fread((void *)hll->registers, HLL_REGISTERS, 1, fp) != 1 ) {
+			HLL_Free(hll);
+			return NULL;
+		}
+		return hll;
+	}
+
+	for ( i=0; i<header[0]; i++ ) {
+		if ( fread((void *)&hash, sizeof(uint64_t), 1, fp) != 1 ) {
+			HLL_Free(hll);
+			return NULL;
+		}
+		HLL_Add(hll, hash);
+	}
+	return hll;
+
+} // End of HLL_Read
+
+int DDS_Write(FILE *fp, ddsketch_t *dds) {
+uint64_t	counts[2];
+int32_t		range[2];
+
+	counts[0] = dds->count;
+	counts[1] = dds->zero_count;
+	range[0]  = dds->offset;
+	range[1]  = dds->num_bins;
+	if ( fwrite((void *)counts, sizeof(counts), 1, fp) != 1 || fwrite((void *)range, sizeof(range), 1, fp) != 1 )
+		return 0;
+	if ( dds->num_bins && fwrite((void *)dds->bins, sizeof(uint64_t), dds->num_bins, fp) != dds->num_bins )
+		return 0;
+
+	return 1;
+
+} // End of DDS_Write
+
+ddsketch_t *DDS_Read(FILE *fp) {
+ddsketch_t	*dds;
+uint64_t	counts[2];
+int32_t		range[2];
+
+	if ( fread((void *)counts, sizeof(counts), 1, fp) != 1 || fread((void *)range, sizeof(range), 1, fp) != 1 )
+		return NULL;
+	if ( range[1] < 0 || range[1] > DDS_MAXBINS )
+		return NULL;
+
+	dds = DDS_New();
+	dds->count		= counts[0];
+	dds->zero_count = counts[1];
+	dds->offset		= range[0];
+	dds->num_bins	= range[1];
+	if ( dds->num_bins ) {
+		dds->bins = (uint64_t *)malloc(dds->num_bins * sizeof(uint64_t));
+		if ( !dds->bins ) {
+			fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+			exit(250);
+		}
+		if ( fread((void *)dds->bins, sizeof(uint64_t), dds->num_bins, fp) != dds->num_bins ) {
+			DDS_Free(dds);
+			return NULL;
+		}
+	}
+	return dds;
+
+} // End of DDS_Read
@@ -0,0 +1,161 @@
+/*
+ *  This file is part of the nfdump project.
+ *
+ *  Copyright (c) 2014, the nfdump contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of SWITCH nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  $Author$
+ *
+ *  $Id$
+ *
+ *  $LastChangedRevision$
+ *
+ */
+
+#ifndef _NFSKETCH_H
+#define _NFSKETCH_H 1
+
+/* Definitions */
+
+/*
+ * Top K summary
+ * Approximate element statistics ( -s <stat>:approx ) do not store every key seen,
+ * but monitor a fixed number of keys using the Space-Saving algorithm. If a new key
+ * arrives and all counters are in use, the key with the smallest count is replaced
+ * and the new key inherits its count as error. The count of each monitored key is
+ * therefore an upper bound of the real count and never off by more than its error.
+ * The memory footprint is fixed by the number of counters.
+ */
+
+// default number of monitored keys
+#define ApproxCounters	16384
+
+typedef struct topk_summary_s {
+	uint32_t		capacity;		/* max number of monitored keys */
+	uint32_t		NumEntries;		/* number of keys currently monitored */
+	uint32_t		IndexMask;		/* mask for bucket index */
+	uint32_t		order;			/* counter[] index used as weight: FLOWS, INPACKETS or INBYTES */
+	uint32_t		order_proto;	/* protocol is part of the key */
+	uint64_t		total;			/* sum of all weights added */
+
+	StatRecord_t	**bucket;		/* hash index into entry array */
+	StatRecord_t	*entry;			/* capacity monitored keys */
+	uint64_t		*error;			/* max overestimation of each entry */
+	uint32_t		*heap;			/* min-heap of entry indices, ordered by weight */
+	uint32_t		*heap_pos;		/* position of each entry in heap */
+} topk_summary_t;
+
+/*
+ * HyperLogLog
+ * Distinct count statistics ( e.g. -s dstport-srcip ) attach a HyperLogLog sketch to each
+ * stat record. As most stat records see only a few distinct values, the sketch starts
+ * as a small hash set of exact values, which is converted into HLL_REGISTERS registers,
+ * as soon as it would use more memory than the registers. The standard error of the
+ * dense estimate is 1.04/sqrt(HLL_REGISTERS) - 1.6%.
+ */
+#define HLL_BITS		12
+#define HLL_REGISTERS	(1 << HLL_BITS)
+
+typedef struct hll_s {
+	uint32_t		num;			/* number of values in sparse mode */
+	uint32_t		size;			/* number of sparse slots - 0 in dense mode */
+	uint64_t		*sparse;		/* open addressing hash set of 64bit value hashes */
+	uint8_t			*registers;		/* HLL_REGISTERS registers in dense mode */
+} hll_t;
+
+/*
+ * DDSketch
+ * Quantile statistics ( e.g. -s dstport:q=duration ) attach a DDSketch to each stat record.
+ * Values are counted in logarithmic bins of width DDS_GAMMA, therefore any quantile is
+ * returned with a relative error of at most DDS_ALPHA. The bins cover a contiguous range
+ * of bin keys. If the range exceeds DDS_MAXBINS, the lowest bins are collapsed, which
+ * only affects the accuracy of the lowest quantiles.
+ */
+#define DDS_ALPHA		0.01
+#define DDS_GAMMA		( ( 1.0 + DDS_ALPHA ) / ( 1.0 - DDS_ALPHA ) )
+#define DDS_MAXBINS		2048
+
+typedef struct ddsketch_s {
+	uint64_t		count;			/* total weight of all values */
+	uint64_t		zero_count;		/* weight of values <= 0 */
+	int32_t			offset;			/* bin key of bins[0] */
+	uint32_t		num_bins;		/* number of allocated bins */
+	uint64_t		*bins;			/* weight of each bin */
+} ddsketch_t;
+
+/* Function prototypes */
+topk_summary_t *TopK_Init(uint32_t capacity, uint32_t order, uint32_t order_proto);
+
+void TopK_Free(topk_summary_t *topk);
+
+StatRecord_t *TopK_Lookup(topk_summary_t *topk, uint64_t *key, uint8_t prot);
+
+StatRecord_t *TopK_Insert(topk_summary_t *topk, uint64_t *key, uint8_t prot);
+
+void TopK_Settle(topk_summary_t *topk, StatRecord_t *record, uint64_t weight);
+
+uint64_t TopK_Error(topk_summary_t *topk, StatRecord_t *record);
+
+uint64_t TopK_Bound(topk_summary_t *topk);
+
+int TopK_Merge(topk_summary_t *topk, topk_summary_t *other);
+
+uint64_t HLL_Hash(uint64_t *value);
+
+hll_t *HLL_New(void);
+
+hll_t *HLL_Dup(hll_t *hll);
+
+void HLL_Free(hll_t *hll);
+
+void HLL_Add(hll_t *hll, uint64_t hash);
+
+uint64_t HLL_Count(hll_t *hll);
+
+int HLL_Merge(hll_t *hll, hll_t *other);
+
+ddsketch_t *DDS_New(void);
+
+ddsketch_t *DDS_Dup(ddsketch_t *dds);
+
+void DDS_Free(ddsketch_t *dds);
+
+void DDS_Add(ddsketch_t *dds, double value, uint64_t weight);
+
+double DDS_Quantile(ddsketch_t *dds, double q);
+
+int DDS_Merge(ddsketch_t *dds, ddsketch_t *other);
+
+int HLL_Write(FILE *fp, hll_t *hll);
+
+hll_t *HLL_Read(FILE *fp);
+
+int DDS_Write(FILE *fp, ddsketch_t *dds);
+
+ddsketch_t *DDS_Read(FILE *fp);
+
+#endif //_NFSKETCH_H
@@ -47,6 +47,7 @@
 #include <time.h>
 #include <string.h>
 #include <ctype.h>
+#include <unistd.h>
 
 #ifdef HAVE_STDINT_H
 #include <stdint.h>
@@ -64,8 +65,12 @@
 #include "netflow_v5_v7.h"
 #include "nf_common.h"
 #include "util.h"
+#include "nfarena.h"
 #include "nflowcache.h"
 #include "nfstat.h"
+#include "nfsketch.h"
+#include "nfarrow.h"
+#include "nfrollup.h"
 
 extern int hash_hit;
 extern int hash_miss;
@@ -87,6 +92,8 @@ struct StatParameter_s {
 											// need 2 elements to be able to get src/dst stats in one stat record
 	uint8_t					num_elem;		// number of elements used. 1 or 2
 	uint8_t					type;			// Type of element: Number, IP address, MAC address etc. 
+	struct flow_element_s	distinct[2];	// distinct count stats: element counted for each of the elements above
+	char					*DistinctInfo;	// name of the distinct element in the output header line
 } StatParameters[] ={
 	// flow record stat
 	{ "record",	 "", 			
@@ -290,6 +297,37 @@ struct StatParameter_s {
 		{ {0, OffsetAppLatency, MaskLatency, 0}, {0,0,0,0} },
 			1, IS_LATENCY },
 
+	// distinct count stats
+	{ "dstport-srcip", "Dst Port", 
+		{ {0, OffsetPort, MaskDstPort, ShiftDstPort}, 		{0,0,0,0} },
+			1, IS_NUMBER,
+		{ {OffsetSrcIPv6a, OffsetSrcIPv6b, MaskIPv6, 0},	{0,0,0,0} }, "srcip" },
+
+	{ "dstip-srcip", "Dst IP Addr", 
+		{ {OffsetDstIPv6a, OffsetDstIPv6b, MaskIPv6, 0},	{0,0,0,0} },
+			1, IS_IPADDR,
+		{ {OffsetSrcIPv6a, OffsetSrcIPv6b, MaskIPv6, 0},	{0,0,0,0} }, "srcip" },
+
+	{ "srcip-dstip", "Src IP Addr", 
+		{ {OffsetSrcIPv6a, OffsetSrcIPv6b, MaskIPv6, 0},	{0,0,0,0} },
+			1, IS_IPADDR,
+		{ {OffsetDstIPv6a, OffsetDstIPv6b, MaskIPv6, 0},	{0,0,0,0} }, "dstip" },
+
+	{ "srcip-dstport", "Src IP Addr", 
+		{ {OffsetSrcIPv6a, OffsetSrcIPv6b, MaskIPv6, 0},	{0,0,0,0} },
+			1, IS_IPADDR,
+		{ {0, OffsetPort, MaskDstPort, ShiftDstPort}, 		{0,0,0,0} }, "dstport" },
+
+	{ "dstip-dstport", "Dst IP Addr", 
+		{ {OffsetDstIPv6a, OffsetDstIPv6b, MaskIPv6, 0},	{0,0,0,0} },
+			1, IS_IPADDR,
+		{ {0, OffsetPort, MaskDstPort, ShiftDstPort}, 		{0,0,0,0} }, "dstport" },
+
+	{ "ip-peer", "IP Addr", 
+		{ {OffsetSrcIPv6a, OffsetSrcIPv6b, MaskIPv6, 0},	{OffsetDstIPv6a, OffsetDstIPv6b, MaskIPv6, 0} },
+			2, IS_IPADDR,
+		{ {OffsetDstIPv6a, OffsetDstIPv6b, MaskIPv6, 0},	{OffsetSrcIPv6a, OffsetSrcIPv6b, MaskIPv6, 0} }, "peer" },
+
 #ifdef NSEL
 	{ "event", " Event", 
 		{ {0, OffsetConnID, MaskFWevent, ShiftFWevent}, 		{0,0,0,0} },
@@ -379,8 +417,27 @@ struct StatRequest_s {
 	uint16_t	order_bits;		// bits 0: flows 1: packets 2: bytes 3: pps 4: bps, 5 bpp
 	int16_t		StatType;		// value out of enum StatTypes
 	uint8_t		order_proto;	// protocol separated statistics
+	uint8_t		approx;			// approximate statistics with bounded memory
+	uint8_t		quantile;		// quantile statistics of this per flow value: enum QuantileValues
 } StatRequest[MaxStats];		// This number should do it for a single run
 
+/*
+ * quantile stats: the distribution of a per flow value is recorded for each element
+ */
+enum QuantileValues { QUANTILE_NONE = 0, QUANTILE_DURATION, QUANTILE_BPP, QUANTILE_BPS, QUANTILE_PPS };
+
+static struct quantile_value_s {
+	char	*name;		// value name used in -s <stat>:q=<name>
+	char	*unit;		// unit printed in the header line
+} quantile_value[] = {
+	{ NULL, 		NULL },
+	{ "duration",	"msec" },
+	{ "bpp",		"bytes" },
+	{ "bps",		"bits/s" },
+	{ "pps",		"packets/s" },
+	{ NULL, 		NULL }
+};
+
 
 /* 
  * pps, bps and bpp are not directly available in the flow/stat record
@@ -399,6 +456,10 @@ static inline uint64_t	tend_record(FlowTableRecord_t *record);
 static inline uint64_t	pps_element(StatRecord_t *record);
 static inline uint64_t	bps_element(StatRecord_t *record);
 static inline uint64_t	bpp_element(StatRecord_t *record);
+static inline uint64_t	distinct_element(StatRecord_t *record);
+static inline uint64_t	p50_element(StatRecord_t *record);
+static inline uint64_t	p95_element(StatRecord_t *record);
+static inline uint64_t	p99_element(StatRecord_t *record);
 
 #define ASCENDING 1
 #define DESCENDING 0
@@ -417,43 +478,74 @@ struct order_mode_s {
 	{ "bpp", 	 32, DESCENDING, bpp_record, bpp_element},
 	{ "tstart",  64, ASCENDING,  tstart_record, NULL},
 	{ "tend",   128, ASCENDING,  tend_record, NULL},
+	{ "distinct", 256, DESCENDING, NULL, distinct_element},
+	{ "p50",    512, DESCENDING, NULL, p50_element},
+	{ "p95",   1024, DESCENDING, NULL, p95_element},
+	{ "p99",   2048, DESCENDING, NULL, p99_element},
 	{ NULL,       0, 0, NULL}
 };
 #define Default_PrintOrder 1		// order_mode[0].val
+#define DistinctOrder	   256		// order_mode[8].val
+#define QuantileOrders	  3584		// order_mode[9..11].val
 static uint32_t	print_order_bits = 0;
 static uint32_t	PrintOrder 		 = 0;
 static uint32_t	NumStats 		 = 0;
 
 static uint64_t	byte_limit, packet_limit;
+static uint32_t	TimeSlot = 0;	// time slot aggregation in seconds, 0 = off
 static int byte_mode, packet_mode;
 enum { NONE = 0, LESS, MORE };
 
 /* function prototypes */
-static int ParseStatString(char *str, int16_t	*StatType, int *flow_record_stat, uint16_t *order_proto);
+static int ParseStatString(char *str, int16_t	*StatType, int *flow_record_stat, uint16_t *order_proto, uint8_t *approx,
+	uint8_t *quantile);
 
-static inline StatRecord_t *stat_hash_lookup(uint64_t *value, uint8_t prot, int hash_num);
+static inline StatRecord_t *stat_hash_lookup(uint64_t *value, uint8_t prot, uint32_t time_slot, int hash_num);
 
-static inline StatRecord_t *stat_hash_insert(uint64_t *value, uint8_t prot, int hash_num);
+static inline StatRecord_t *stat_hash_insert(uint64_t *value, uint8_t prot, uint32_t time_slot, int hash_num);
 
 static void Expand_StatTable_Blocks(int hash_num);
 
+static inline StatRecord_t *AddApproxStat(topk_summary_t *topk, uint64_t *value, master_record_t *flow_record);
+
+static inline void AddQuantile(StatRecord_t *stat_record, int quantile, master_record_t *flow_record);
+
 static inline void PrintSortedFlowcache(SortElement_t *SortList, uint32_t maxindex, int limit_count, int GuessFlowDirection, 
 	printer_t print_record, int tag, int ascending, extension_map_list_t *extension_map_list );
 
-static void PrintStatLine(stat_record_t	*stat, uint32_t plain_numbers, StatRecord_t *StatData, int type, int order_proto, int tag);
+static void PrintStatLine(stat_record_t	*stat, uint32_t plain_numbers, StatRecord_t *StatData, int type, int order_proto, int tag, 
+	topk_summary_t *topk, char *distinct, int quantile);
+
+static void PrintPipeStatLine(StatRecord_t *StatData, int type, int order_proto, int tag, topk_summary_t *topk, char *distinct, 
+	int quantile);
 
-static void PrintPipeStatLine(StatRecord_t *StatData, int type, int order_proto, int tag);
+static void PrintCvsStatLine(stat_record_t	*stat, StatRecord_t *StatData, int type, int order_proto, int tag, 
+	topk_summary_t *topk, char *distinct, int quantile);
 
-static void PrintCvsStatLine(stat_record_t	*stat, StatRecord_t *StatData, int type, int order_proto, int tag);
+static void PrintArrowStatLine(StatRecord_t *StatData, char *statname, char *order, int type, int order_proto, 
+	topk_summary_t *topk, char *distinct, int quantile);
 
 static inline int TimeMsec_CMP(time_t t1, uint16_t offset1, time_t t2, uint16_t offset2 );
 
 static SortElement_t *StatTopN(int topN, uint32_t *count, int hash_num, int order );
 
+static int ElementSlotCMP(const void *p1, const void *p2);
+
+static int FlowSlotCMP(const void *p1, const void *p2);
+
+static void PrintFlowTimeSlots(SortElement_t *SortList, uint32_t maxindex, int topN, int print_slot, 
+	printer_t print_record, int tag, extension_map_list_t *extension_map_list);
+
+static int WritePartialRecord(FILE *fp, StatRecord_t *record, uint64_t error);
+
+static int ReadPartialRecord(FILE *fp, partial_record_t *partial_record, hll_t **hll, ddsketch_t **dds);
+
 static void SwapFlow(master_record_t *flow_record);
 
 /* locals */
 static hash_StatTable *StatTable;
+static arena_t StatArena;
+static arena_t SortArena;
 static int initialised = 0;
 
 
@@ -533,6 +625,30 @@ static uint64_t	bpp_element(StatRecord_t *record) {
 
 } // End of bpp_element
 
+static uint64_t	distinct_element(StatRecord_t *record) {
+	
+	return HLL_Count(record->hll);
+
+} // End of distinct_element
+
+static uint64_t	p50_element(StatRecord_t *record) {
+	
+	return (uint64_t)( DDS_Quantile(record->dds, 0.50) + 0.5 );
+
+} // End of p50_element
+
+static uint64_t	p95_element(StatRecord_t *record) {
+	
+	return (uint64_t)( DDS_Quantile(record->dds, 0.95) + 0.5 );
+
+} // End of p95_element
+
+static uint64_t	p99_element(StatRecord_t *record) {
+	
+	return (uint64_t)( DDS_Quantile(record->dds, 0.99) + 0.5 );
+
+} // End of p99_element
+
 
 static inline int TimeMsec_CMP(time_t t1, uint16_t offset1, time_t t2, uint16_t offset2 ) {
     if ( t1 > t2 )
@@ -664,6 +780,21 @@ uint32_t	len,scale;
 
 } // End of SetLimits
 
+int SetTimeSlot(uint32_t seconds) {
+
+	if ( seconds == 0 ) {
+		fprintf(stderr, "Time slot must be at least 1 second\n");
+		return 0;
+	}
+	TimeSlot = seconds;
+
+	// aggregated flows get the time slot as additional key
+	GetFlowTable()->time_slot = seconds;
+
+	return 1;
+
+} // End of SetTimeSlot
+
 int Init_StatTable(uint16_t NumBits, uint32_t Prealloc) {
 uint32_t maxindex;
 int		 hash_num;
@@ -681,12 +812,63 @@ int		 hash_num;
 		return 0;
 	}
 
+	// all stat blocks are allocated from a common arena
+	if ( !Arena_Init(&StatArena, Prealloc * sizeof(StatRecord_t)) )
+		return 0;
+
+	// the top N lists of all stats and orders reuse the same sort arena
+	if ( !Arena_Init(&SortArena, ArenaBlockSize) )
+		return 0;
+
 	for ( hash_num=0; hash_num<NumStats; hash_num++ ) {
+		if ( StatRequest[hash_num].order_bits == 0 ) {
+			StatRequest[hash_num].order_bits = PrintOrder ? order_mode[PrintOrder].val : Default_PrintOrder;
+		}
+
+		if ( (StatRequest[hash_num].order_bits & DistinctOrder) && 
+			 !StatParameters[StatRequest[hash_num].StatType].DistinctInfo ) {
+			fprintf(stderr, "Order distinct requires a distinct count statistic such as dstport-srcip\n");
+			return 0;
+		}
+
+		if ( (StatRequest[hash_num].order_bits & QuantileOrders) && !StatRequest[hash_num].quantile ) {
+			fprintf(stderr, "Quantile orders require a quantile statistic such as dstport:q=duration\n");
+			return 0;
+		}
+
+		if ( StatRequest[hash_num].approx && TimeSlot ) {
+			fprintf(stderr, "Approximate statistics can not be combined with time slots\n");
+			return 0;
+		}
+
+		if ( StatRequest[hash_num].approx ) {
+			// the top K summary monitors a single additive counter: flows, packets or bytes
+			uint32_t order = 0;
+			switch ( StatRequest[hash_num].order_bits ) {
+				case 1:
+					order = FLOWS;
+					break;
+				case 2:
+					order = INPACKETS;
+					break;
+				case 4:
+					order = INBYTES;
+					break;
+				default:
+					fprintf(stderr, "Approximate statistics require exactly one order of flows, packets or bytes\n");
+					return 0;
+			}
+			StatTable[hash_num].topk = TopK_Init(ApproxCounters, order, StatRequest[hash_num].order_proto);
+			if ( !StatTable[hash_num].topk ) 
+				return 0;
+			continue;
+		}
+
 		StatTable[hash_num].IndexMask   = maxindex -1;
 		StatTable[hash_num].NumBits     = NumBits;
 		StatTable[hash_num].Prealloc    = Prealloc;
-		StatTable[hash_num].bucket	  	= (StatRecord_t **)calloc(maxindex, sizeof(StatRecord_t *));
-		StatTable[hash_num].bucketcache = (StatRecord_t **)calloc(maxindex, sizeof(StatRecord_t *));
+		StatTable[hash_num].bucket	  	= (StatRecord_t **)LargeAlloc(maxindex * sizeof(StatRecord_t *));
+		StatTable[hash_num].bucketcache = (StatRecord_t **)LargeAlloc(maxindex * sizeof(StatRecord_t *));
 		if ( !StatTable[hash_num].bucket || !StatTable[hash_num].bucketcache ) {
 			fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
 			return 0;
@@ -696,20 +878,12 @@ int		 hash_num;
 			fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
 			return 0;
 		}
-		StatTable[hash_num].memblock[0] = (StatRecord_t *)calloc(Prealloc, sizeof(StatRecord_t));
-		if ( !StatTable[hash_num].memblock[0] ) {
-			fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
-			return 0;
-		}
+		StatTable[hash_num].memblock[0] = (StatRecord_t *)Arena_Calloc(&StatArena, Prealloc * sizeof(StatRecord_t));
 	
 		StatTable[hash_num].NumBlocks = 1;
 		StatTable[hash_num].MaxBlocks = MaxMemBlocks;
 		StatTable[hash_num].NextBlock = 0;
 		StatTable[hash_num].NextElem  = 0;
-
-		if ( StatRequest[hash_num].order_bits == 0 ) {
-			StatRequest[hash_num].order_bits = PrintOrder ? order_mode[PrintOrder].val : Default_PrintOrder;
-		}
 	}
 
 	initialised = 1;
@@ -724,11 +898,25 @@ unsigned int i, hash_num;
 		return;
 
 	for ( hash_num=0; hash_num<NumStats; hash_num++ ) {
-		free((void *)StatTable[hash_num].bucket);
-		for ( i=0; i<StatTable[hash_num].NumBlocks; i++ ) 
-			free((void *)StatTable[hash_num].memblock[i]);
+		if ( StatTable[hash_num].topk ) {
+			TopK_Free(StatTable[hash_num].topk);
+			continue;
+		}
+		LargeFree((void *)StatTable[hash_num].bucket);
+		LargeFree((void *)StatTable[hash_num].bucketcache);
+		if ( StatParameters[StatRequest[hash_num].StatType].DistinctInfo || StatRequest[hash_num].quantile ) {
+			for ( i=0; i<StatTable[hash_num].NumBlocks; i++ ) {
+				uint32_t j, num = i == StatTable[hash_num].NextBlock ? StatTable[hash_num].NextElem : StatTable[hash_num].Prealloc;
+				for ( j=0; j<num; j++ ) {
+					HLL_Free(StatTable[hash_num].memblock[i][j].hll);
+					DDS_Free(StatTable[hash_num].memblock[i][j].dds);
+				}
+			}
+		}
 		free((void *)StatTable[hash_num].memblock);
 	}
+	Arena_Free(&StatArena);
+	Arena_Free(&SortArena);
 
 } // End of Dispose_Tables
 
@@ -736,6 +924,8 @@ int SetStat(char *str, int *element_stat, int *flow_stat) {
 int			flow_record_stat = 0;
 int16_t 	StatType    = 0;
 uint16_t	order_proto = 0;
+uint8_t		approx		= 0;
+uint8_t		quantile	= 0;
 
 	if ( NumStats == MaxStats ) {
 		fprintf(stderr, "Too many stat options! Stats are limited to %i stats per single run!\n", MaxStats);
@@ -743,8 +933,20 @@ uint16_t	order_proto = 0;
 	}
 
 	print_order_bits = 0;
-	if ( ParseStatString(str, &StatType, &flow_record_stat, &order_proto) ) {
+	if ( ParseStatString(str, &StatType, &flow_record_stat, &order_proto, &approx, &quantile) ) {
 		if ( flow_record_stat ) {
+			if ( approx ) {
+				fprintf(stderr, "Approximate statistics are not available for flow records\n");
+				return 0;
+			}
+			if ( quantile ) {
+				fprintf(stderr, "Quantile statistics are not available for flow records\n");
+				return 0;
+			}
+			if ( print_order_bits & ( DistinctOrder | QuantileOrders ) ) {
+				fprintf(stderr, "Order distinct and quantile orders are not available for flow records\n");
+				return 0;
+			}
 			if ( !print_order_bits ) 
 				print_order_bits = PrintOrder ? order_mode[PrintOrder].val : Default_PrintOrder;
 			*flow_stat = 1;
@@ -752,6 +954,8 @@ uint16_t	order_proto = 0;
 			StatRequest[NumStats].StatType 	  = StatType;
 			StatRequest[NumStats].order_bits  = print_order_bits;
 			StatRequest[NumStats].order_proto = order_proto;
+			StatRequest[NumStats].approx	  = approx;
+			StatRequest[NumStats].quantile	  = quantile;
 			NumStats++;
 			*element_stat = 1;
 		}
@@ -763,7 +967,8 @@ uint16_t	order_proto = 0;
 
 } // End of SetStat
 
-static int ParseStatString(char *str, int16_t	*StatType, int *flow_record_stat, uint16_t *order_proto) {
+static int ParseStatString(char *str, int16_t	*StatType, int *flow_record_stat, uint16_t *order_proto, uint8_t *approx,
+	uint8_t *quantile) {
 char	*s, *p, *q, *r;
 int i=0;
 
@@ -772,6 +977,33 @@ int i=0;
 		return 0;
 
 	s = strdup(str);
+
+	// approximate stat may be requested anywhere in the string e.g. srcip/bytes:approx
+	*approx = 0;
+	p = strstr(s, ":approx");
+	if ( p ) {
+		*approx = 1;
+		memmove(p, p + 7, strlen(p + 7) + 1);
+	}
+
+	// quantile stat may be requested anywhere in the string e.g. dstport:q=duration/p95
+	*quantile = QUANTILE_NONE;
+	p = strstr(s, ":q=");
+	if ( p ) {
+		size_t len = strcspn(p + 3, ":/");
+		for ( i=1; quantile_value[i].name; i++ ) {
+			if ( strlen(quantile_value[i].name) == len && strncasecmp(p + 3, quantile_value[i].name, len) == 0 ) 
+				break;
+		}
+		if ( !quantile_value[i].name ) {
+			fprintf(stderr, "Unknown quantile value. Use duration, bpp, bps or pps\n");
+			free(s);
+			return 0;
+		}
+		*quantile = i;
+		memmove(p, p + 3 + len, strlen(p + 3 + len) + 1);
+	}
+
 	q = strchr(s, '/');
 	if ( q ) 
 		*q = 0;
@@ -868,7 +1100,7 @@ int Parse_PrintOrder(char *order) {
 			break;
 		PrintOrder++;
 	}
-	if ( !order_mode[PrintOrder].string ) {
+	if ( !order_mode[PrintOrder].string || ( order_mode[PrintOrder].val & ( DistinctOrder | QuantileOrders ) ) ) {
 		PrintOrder = 0;
 		return -1;
 	}
@@ -877,22 +1109,24 @@ int Parse_PrintOrder(char *order) {
 
 } // End of Parse_PrintOrder
 
-static inline StatRecord_t *stat_hash_lookup(uint64_t *value, uint8_t prot, int hash_num) {
+static inline StatRecord_t *stat_hash_lookup(uint64_t *value, uint8_t prot, uint32_t time_slot, int hash_num) {
 uint32_t		index;
 StatRecord_t	*record;
 
-	index = value[1] & StatTable[hash_num].IndexMask;
+	index = ( value[1] ^ time_slot ) & StatTable[hash_num].IndexMask;
 
 	if ( StatTable[hash_num].bucket[index] == NULL )
 		return NULL;
 
 	record = StatTable[hash_num].bucket[index];
 	if ( StatRequest[hash_num].order_proto ) {
-		while ( record && ( record->stat_key[1] != value[1] || record->stat_key[0] != value[0] || prot != record->prot ) ) {
+		while ( record && ( record->stat_key[1] != value[1] || record->stat_key[0] != value[0] || prot != record->prot ||
+							record->time_slot != time_slot ) ) {
 			record = record->next;
 		}
 	} else {
-		while ( record && ( record->stat_key[1] != value[1] || record->stat_key[0] != value[0] ) ) {
+		while ( record && ( record->stat_key[1] != value[1] || record->stat_key[0] != value[0] || 
+							record->time_slot != time_slot ) ) {
 			record = record->next;
 		}
 	}
@@ -911,19 +1145,15 @@ static void Expand_StatTable_Blocks(int hash_num) {
 			exit(250);
 		}
 	}
+	// Arena_Calloc always succeeds. If no memory, Arena_Calloc already exits cleanly
 	StatTable[hash_num].memblock[StatTable[hash_num].NumBlocks] = 
-			(StatRecord_t *)calloc(StatTable[hash_num].Prealloc, sizeof(StatRecord_t));
-
-	if ( !StatTable[hash_num].memblock[StatTable[hash_num].NumBlocks] ) {
-		fprintf(stderr, "calloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror (errno));
-		exit(250);
-	}
+			(StatRecord_t *)Arena_Calloc(&StatArena, StatTable[hash_num].Prealloc * sizeof(StatRecord_t));
 	StatTable[hash_num].NextBlock = StatTable[hash_num].NumBlocks++;
 	StatTable[hash_num].NextElem  = 0;
 
 } // End of Expand_StatTable_Blocks
 
-static inline StatRecord_t *stat_hash_insert(uint64_t *value, uint8_t prot, int hash_num) {
+static inline StatRecord_t *stat_hash_insert(uint64_t *value, uint8_t prot, uint32_t time_slot, int hash_num) {
 uint32_t		index;
 StatRecord_t	*record;
 
@@ -936,8 +1166,9 @@ StatRecord_t	*record;
 	record->stat_key[0] = value[0];
 	record->stat_key[1] = value[1];
 	record->prot		= prot;
+	record->time_slot	= time_slot;
 
-	index = value[1] & StatTable[hash_num].IndexMask;
+	index = ( value[1] ^ time_slot ) & StatTable[hash_num].IndexMask;
 	if ( StatTable[hash_num].bucket[index] == NULL ) 
 		StatTable[hash_num].bucket[index] = record;
 	else
@@ -951,8 +1182,11 @@ StatRecord_t	*record;
 void AddStat(common_record_t *raw_record, master_record_t *flow_record ) {
 StatRecord_t		*stat_record;
 uint64_t			value[2][2];
+uint32_t			time_slot;
 int	j, i;
 
+	time_slot = TimeSlot ? flow_record->first - ( flow_record->first % TimeSlot ) : 0;
+
 	// for every requested -s stat do
 	for ( j=0; j<NumStats; j++ ) {
 		int stat   = StatRequest[j].StatType;
@@ -973,8 +1207,9 @@ int	j, i;
 			if ( i == 1 && value[0][0] == value[1][0] && value[0][1] == value[1][1] ) {
 				break;
 			}
-			stat_record = stat_hash_lookup(value[i], flow_record->prot, j);
-			if ( stat_record ) {
+			if ( StatTable[j].topk ) {
+				stat_record = AddApproxStat(StatTable[j].topk, value[i], flow_record);
+			} else if ( (stat_record = stat_hash_lookup(value[i], flow_record->prot, time_slot, j)) != NULL ) {
 				stat_record->counter[INBYTES] 	+= flow_record->dOctets;
 				stat_record->counter[INPACKETS] += flow_record->dPkts;
 		
@@ -989,7 +1224,7 @@ int	j, i;
 				stat_record->counter[FLOWS] += flow_record->aggr_flows ? flow_record->aggr_flows : 1;
 
 			} else {
-				stat_record = stat_hash_insert(value[i], flow_record->prot, j);
+				stat_record = stat_hash_insert(value[i], flow_record->prot, time_slot, j);
 		
 				stat_record->counter[INBYTES]   = flow_record->dOctets;
 				stat_record->counter[INPACKETS]	= flow_record->dPkts;
@@ -1000,12 +1235,191 @@ int	j, i;
 				stat_record->record_flags		= flow_record->flags & 0x1;
 				stat_record->counter[FLOWS]		= flow_record->aggr_flows ? flow_record->aggr_flows : 1;
 			}
+
+			if ( StatParameters[stat].DistinctInfo ) {
+				uint64_t distinct[2];
+				offset = StatParameters[stat].distinct[i].offset1;
+				mask   = StatParameters[stat].distinct[i].mask;
+				shift  = StatParameters[stat].distinct[i].shift;
+
+				distinct[1] = (((uint64_t *)flow_record)[offset] & mask) >> shift;
+				offset = StatParameters[stat].distinct[i].offset0;
+				distinct[0] = offset ? ((uint64_t *)flow_record)[offset] : 0;
+
+				if ( !stat_record->hll ) 
+					stat_record->hll = HLL_New();
+				HLL_Add(stat_record->hll, HLL_Hash(distinct));
+			}
+
+			if ( StatRequest[j].quantile ) 
+				AddQuantile(stat_record, StatRequest[j].quantile, flow_record);
 		} // for the number of elements in this stat type
 	} // for every requested -s stat
 
 } // End of AddStat
 
-static void PrintStatLine(stat_record_t	*stat, uint32_t plain_numbers, StatRecord_t *StatData, int type, int order_proto, int tag) {
+static inline StatRecord_t *AddApproxStat(topk_summary_t *topk, uint64_t *value, master_record_t *flow_record) {
+StatRecord_t	*stat_record;
+uint64_t		weight;
+
+	stat_record = TopK_Lookup(topk, value, flow_record->prot);
+	if ( stat_record ) {
+		if ( TimeMsec_CMP(flow_record->first, flow_record->msec_first, stat_record->first, stat_record->msec_first) == 2) {
+			stat_record->first 		= flow_record->first;
+			stat_record->msec_first = flow_record->msec_first;
+		}
+		if ( TimeMsec_CMP(flow_record->last, flow_record->msec_last, stat_record->last, stat_record->msec_last) == 1) {
+			stat_record->last 		= flow_record->last;
+			stat_record->msec_last 	= flow_record->msec_last;
+		}
+	} else {
+		// new or replaced key - counters are cleared, except the inherited weight
+		stat_record = TopK_Insert(topk, value, flow_record->prot);
+		stat_record->first    		= flow_record->first;
+		stat_record->msec_first 	= flow_record->msec_first;
+		stat_record->last			= flow_record->last;
+		stat_record->msec_last		= flow_record->msec_last;
+		stat_record->record_flags	= flow_record->flags & 0x1;
+	}
+
+	stat_record->counter[INBYTES] 	+= flow_record->dOctets;
+	stat_record->counter[INPACKETS] += flow_record->dPkts;
+	stat_record->counter[FLOWS] 	+= flow_record->aggr_flows ? flow_record->aggr_flows : 1;
+
+	switch ( topk->order ) {
+		case INBYTES:
+			weight = flow_record->dOctets;
+			break;
+		case INPACKETS:
+			weight = flow_record->dPkts;
+			break;
+		default:
+			weight = flow_record->aggr_flows ? flow_record->aggr_flows : 1;
+	}
+	TopK_Settle(topk, stat_record, weight);
+
+	return stat_record;
+
+} // End of AddApproxStat
+
+static inline void AddQuantile(StatRecord_t *stat_record, int quantile, master_record_t *flow_record) {
+double	duration, value;
+
+	duration = ( flow_record->last - flow_record->first ) * 1000.0;
+	duration += (double)flow_record->msec_last - (double)flow_record->msec_first;
+
+	switch ( quantile ) {
+		case QUANTILE_DURATION:
+			value = duration;
+			break;
+		case QUANTILE_BPP:
+			if ( flow_record->dPkts == 0 )
+				return;
+			value = (double)flow_record->dOctets / (double)flow_record->dPkts;
+			break;
+		case QUANTILE_BPS:
+			// rates are undefined for flows without duration
+			if ( duration <= 0 )
+				return;
+			value = (double)( 8 * flow_record->dOctets ) * 1000.0 / duration;
+			break;
+		case QUANTILE_PPS:
+			if ( duration <= 0 )
+				return;
+			value = (double)flow_record->dPkts * 1000.0 / duration;
+			break;
+		default:
+			return;
+	}
+
+	if ( !stat_record->dds )
+		stat_record->dds = DDS_New();
+	DDS_Add(stat_record->dds, value, flow_record->aggr_flows ? flow_record->aggr_flows : 1);
+
+} // End of AddQuantile
+
+/*
+ * Rollups written by the collectors hold exact counters of the top K elements of a file.
+ * They can replace the flows for plain -s requests: no approx, distinct or quantile stats,
+ * no protocol separation other than the proto stat itself and counter orders only.
+ */
+int RollupCompatible(void) {
+int hash_num;
+
+	if ( TimeSlot || NumStats == 0 )
+		return 0;
+
+	for ( hash_num=0; hash_num<NumStats; hash_num++ ) {
+		int stat = StatRequest[hash_num].StatType;
+		if ( RollupStat(StatParameters[stat].statname) < 0 )
+			return 0;
+		if ( StatRequest[hash_num].approx || StatRequest[hash_num].quantile || StatParameters[stat].DistinctInfo )
+			return 0;
+		if ( StatRequest[hash_num].order_proto && strcmp(StatParameters[stat].statname, "proto") != 0 )
+			return 0;
+		// flows, packets, bytes
+		if ( StatRequest[hash_num].order_bits & ~0x7 )
+			return 0;
+	}
+	return 1;
+
+} // End of RollupCompatible
+
+/*
+ * Merge the rollups of a file into the stat tables and its flow summary into sum_stat. Returns 0
+ * without any change, if a requested stat is missing - the flows of the file need to be processed.
+ */
+int AddRollupStat(data_block_header_t *block_header, stat_record_t *sum_stat) {
+rollup_record_t	*rollup_record[MaxStats];
+StatRecord_t	*stat_record;
+uint32_t		i;
+int				hash_num, order;
+
+	for ( hash_num=0; hash_num<NumStats; hash_num++ ) {
+		rollup_record[hash_num] = GetRollupRecord(block_header, StatParameters[StatRequest[hash_num].StatType].statname);
+		if ( !rollup_record[hash_num] )
+			return 0;
+	}
+
+	for ( hash_num=0; hash_num<NumStats; hash_num++ ) {
+		rollup_entry_t *entry = RollupEntries(rollup_record[hash_num]);
+		for ( i=0; i<rollup_record[hash_num]->NumEntries; i++ ) {
+			stat_record = stat_hash_lookup(entry[i].stat_key, entry[i].prot, 0, hash_num);
+			if ( stat_record ) {
+				if ( TimeMsec_CMP(entry[i].first, entry[i].msec_first, stat_record->first, stat_record->msec_first) == 2) {
+					stat_record->first 		= entry[i].first;
+					stat_record->msec_first = entry[i].msec_first;
+				}
+				if ( TimeMsec_CMP(entry[i].last, entry[i].msec_last, stat_record->last, stat_record->msec_last) == 1) {
+					stat_record->last 		= entry[i].last;
+					stat_record->msec_last 	= entry[i].msec_last;
+				}
+			} else {
+				stat_record = stat_hash_insert(entry[i].stat_key, entry[i].prot, 0, hash_num);
+				stat_record->first    		= entry[i].first;
+				stat_record->msec_first 	= entry[i].msec_first;
+				stat_record->last			= entry[i].last;
+				stat_record->msec_last		= entry[i].msec_last;
+				stat_record->record_flags	= entry[i].record_flags;
+			}
+			stat_record->counter[FLOWS]		+= entry[i].counter[0];
+			stat_record->counter[INPACKETS]	+= entry[i].counter[1];
+			stat_record->counter[INBYTES]	+= entry[i].counter[2];
+		}
+		// any element not in the rollup may be missing up to the threshold
+		for ( order=0; order<3; order++ ) 
+			StatTable[hash_num].rollup_bound[order] += rollup_record[hash_num]->threshold[order];
+	}
+
+	// all rollups of a file carry the same flow summary
+	SumStatRecords(sum_stat, &rollup_record[0]->stat_record);
+
+	return 1;
+
+} // End of AddRollupStat
+
+static void PrintStatLine(stat_record_t	*stat, uint32_t plain_numbers, StatRecord_t *StatData, int type, int order_proto, int tag, 
+	topk_summary_t *topk, char *distinct, int quantile) {
 char		proto[16], valstr[40], datestr[64];
 char		flows_str[NUMBER_STRING_SIZE], byte_str[NUMBER_STRING_SIZE], packets_str[NUMBER_STRING_SIZE];
 char		pps_str[NUMBER_STRING_SIZE], bps_str[NUMBER_STRING_SIZE];
@@ -1131,17 +1545,39 @@ struct tm	*tbuff;
 	}
 
 	if ( Getv6Mode() && ( type == IS_IPADDR ) )
-		printf("%s.%03u %9.3f %s %s%39s %8s(%4.1f) %8s(%4.1f) %8s(%4.1f) %8s %8s %5u\n", 
+		printf("%s.%03u %9.3f %s %s%39s %8s(%4.1f) %8s(%4.1f) %8s(%4.1f) %8s %8s %5u", 
 				datestr, StatData->msec_first, duration, proto, tag_string, valstr, 
 				flows_str, flows_percent, packets_str, packets_percent, byte_str, bytes_percent, pps_str, bps_str, bpp );
 	else
-		printf("%s.%03u %9.3f %s %s%17s %8s(%4.1f) %8s(%4.1f) %8s(%4.1f) %8s %8s %5u\n", 
+		printf("%s.%03u %9.3f %s %s%17s %8s(%4.1f) %8s(%4.1f) %8s(%4.1f) %8s %8s %5u", 
 				datestr, StatData->msec_first, duration, proto, tag_string, valstr, 
 				flows_str, flows_percent, packets_str, packets_percent, byte_str, bytes_percent, pps_str, bps_str, bpp );
 
+	if ( distinct ) {
+		char distinct_str[NUMBER_STRING_SIZE];
+		format_number(HLL_Count(StatData->hll), distinct_str, scale, FIXED_WIDTH);
+		printf(" %8s", distinct_str);
+	}
+
+	if ( quantile ) {
+		char p50_str[NUMBER_STRING_SIZE], p95_str[NUMBER_STRING_SIZE], p99_str[NUMBER_STRING_SIZE];
+		format_number(p50_element(StatData), p50_str, scale, FIXED_WIDTH);
+		format_number(p95_element(StatData), p95_str, scale, FIXED_WIDTH);
+		format_number(p99_element(StatData), p99_str, scale, FIXED_WIDTH);
+		printf(" %8s %8s %8s", p50_str, p95_str, p99_str);
+	}
+
+	if ( topk ) {
+		char error_str[NUMBER_STRING_SIZE];
+		format_number(TopK_Error(topk, StatData), error_str, scale, FIXED_WIDTH);
+		printf(" %8s\n", error_str);
+	} else 
+		printf("\n");
+
 } // End of PrintStatLine
 
-static void PrintPipeStatLine(StatRecord_t *StatData, int type, int order_proto, int tag) {
+static void PrintPipeStatLine(StatRecord_t *StatData, int type, int order_proto, int tag, topk_summary_t *topk, char *distinct, 
+	int quantile) {
 double		duration;
 uint32_t	pps, bps, bpp;
 uint32_t	sa[4];
@@ -1184,21 +1620,38 @@ int			af;
 	}
 
 	if ( type == IS_IPADDR )
-		printf("%i|%u|%u|%u|%u|%u|%u|%u|%u|%u|%llu|%llu|%llu|%u|%u|%u\n",
+		printf("%i|%u|%u|%u|%u|%u|%u|%u|%u|%u|%llu|%llu|%llu|%u|%u|%u",
 				af, StatData->first, StatData->msec_first ,StatData->last, StatData->msec_last, StatData->prot, 
 				sa[0], sa[1], sa[2], sa[3], (long long unsigned)StatData->counter[FLOWS], 
 				(long long unsigned)StatData->counter[INPACKETS], (long long unsigned)StatData->counter[INBYTES], 
 				pps, bps, bpp);
 	else
-		printf("%i|%u|%u|%u|%u|%u|%llu|%llu|%llu|%llu|%u|%u|%u\n",
+		printf("%i|%u|%u|%u|%u|%u|%llu|%llu|%llu|%llu|%u|%u|%u",
 				af, StatData->first, StatData->msec_first ,StatData->last, StatData->msec_last, StatData->prot, 
 				(long long unsigned)StatData->stat_key[1], (long long unsigned)StatData->counter[FLOWS], 
 				(long long unsigned)StatData->counter[INPACKETS], (long long unsigned)StatData->counter[INBYTES], 
 				pps, bps, bpp);
 
+	if ( distinct ) 
+		printf("|%llu", (long long unsigned)HLL_Count(StatData->hll));
+
+	if ( quantile ) 
+		printf("|%llu|%llu|%llu", (long long unsigned)p50_element(StatData), 
+			(long long unsigned)p95_element(StatData), (long long unsigned)p99_element(StatData));
+
+	if ( topk ) 
+		printf("|%llu", (long long unsigned)TopK_Error(topk, StatData));
+
+	// -P time slot start and end
+	if ( TimeSlot ) 
+		printf("|%u|%u", StatData->time_slot, StatData->time_slot + TimeSlot - 1);
+
+	printf("\n");
+
 } // End of PrintPipeStatLine
 
-static void PrintCvsStatLine(stat_record_t	*stat, StatRecord_t *StatData, int type, int order_proto, int tag) {
+static void PrintCvsStatLine(stat_record_t	*stat, StatRecord_t *StatData, int type, int order_proto, int tag, 
+	topk_summary_t *topk, char *distinct, int quantile) {
 char		proto[16], valstr[40], datestr1[64], datestr2[64];
 char tag_string[2];
 double		duration, flows_percent, packets_percent, bytes_percent;
@@ -1296,7 +1749,7 @@ struct tm	*tbuff;
 		i++;
 	}
 
-	printf("%s,%s,%.3f,%s,%s,%llu,%.1f,%llu,%.1f,%llu,%.1f,%u,%u,%u\n", 
+	printf("%s,%s,%.3f,%s,%s,%llu,%.1f,%llu,%.1f,%llu,%.1f,%u,%u,%u", 
 		datestr1, datestr2, duration, proto, valstr, 
 		(long long unsigned)StatData->counter[FLOWS], flows_percent, 
 		(long long unsigned)StatData->counter[INPACKETS], packets_percent,
@@ -1304,8 +1757,91 @@ struct tm	*tbuff;
 		pps,bps,bpp
 	);
 
+	if ( distinct ) 
+		printf(",%llu", (long long unsigned)HLL_Count(StatData->hll));
+
+	if ( quantile ) 
+		printf(",%llu,%llu,%llu", (long long unsigned)p50_element(StatData), 
+			(long long unsigned)p95_element(StatData), (long long unsigned)p99_element(StatData));
+
+	if ( topk ) 
+		printf(",%llu", (long long unsigned)TopK_Error(topk, StatData));
+
+	// -P time slot start and end
+	if ( TimeSlot ) {
+		when = StatData->time_slot;
+		tbuff = localtime(&when);
+		if ( !tbuff ) {
+			perror("Error time convert");
+			exit(250);
+		}
+		strftime(datestr1, 63, "%Y-%m-%d %H:%M:%S", tbuff);
+
+		when = StatData->time_slot + TimeSlot - 1;
+		tbuff = localtime(&when);
+		if ( !tbuff ) {
+			perror("Error time convert");
+			exit(250);
+		}
+		strftime(datestr2, 63, "%Y-%m-%d %H:%M:%S", tbuff);
+		printf(",%s,%s", datestr1, datestr2);
+	}
+
+	printf("\n");
+
 } // End of PrintCvsStatLine
 
+static void PrintArrowStatLine(StatRecord_t *StatData, char *statname, char *order, int type, int order_proto, 
+	topk_summary_t *topk, char *distinct, int quantile) {
+arrow_stat_t	stat;
+
+	memset((void *)&stat, 0, sizeof(stat));
+	stat.stat	= statname;
+	stat.order	= order;
+	stat.first	= 1000LL * (uint64_t)StatData->first + StatData->msec_first;
+	stat.last	= 1000LL * (uint64_t)StatData->last  + StatData->msec_last;
+	stat.time_slot = StatData->time_slot;
+	stat.has_proto = order_proto;
+	stat.prot	   = StatData->prot;
+
+	switch (type) {
+		case NONE:
+			stat.key_type = ARROW_KEY_NONE;
+			break;
+		case IS_IPADDR:
+			stat.key_type = ARROW_KEY_IPADDR;
+			stat.ipv6	  = (StatData->record_flags & 0x1) != 0;
+			break;
+		default:
+			// numbers, mac addresses, mpls labels etc. as raw value
+			stat.key_type = ARROW_KEY_NUMBER;
+	}
+	stat.key[0] = StatData->stat_key[0];
+	stat.key[1] = StatData->stat_key[1];
+
+	stat.flows	 = StatData->counter[FLOWS];
+	stat.packets = StatData->counter[INPACKETS];
+	stat.bytes	 = StatData->counter[INBYTES];
+
+	if ( distinct ) {
+		stat.has_distinct = 1;
+		stat.distinct	  = HLL_Count(StatData->hll);
+	}
+	if ( quantile ) {
+		stat.has_quantile = 1;
+		stat.quantile[0]  = p50_element(StatData);
+		stat.quantile[1]  = p95_element(StatData);
+		stat.quantile[2]  = p99_element(StatData);
+	}
+	if ( topk ) {
+		stat.has_error = 1;
+		stat.error	   = TopK_Error(topk, StatData);
+	}
+
+	Arrow_StatRecord(&stat);
+
+} // End of PrintArrowStatLine
+
 void PrintFlowTable(printer_t print_record, uint32_t limitflows, int tag, int GuessDir, extension_map_list_t *extension_map_list) {
 hash_FlowTable *FlowTable;
 FlowTableRecord_t	*r;
@@ -1321,7 +1857,7 @@ char				*string;
 	maxindex = FlowTable->NumRecords;
 	if ( PrintOrder ) {
 		// Sort according the date
-		SortList = (SortElement_t *)calloc(maxindex, sizeof(SortElement_t));
+		SortList = (SortElement_t *)LargeAlloc(maxindex * sizeof(SortElement_t));
 
 		if ( !SortList ) {
 			fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror (errno));
@@ -1371,6 +1907,8 @@ char				*string;
 		PrintSortedFlowcache(SortList, maxindex, limitflows, GuessDir, 
 			print_record, tag, order_mode[PrintOrder].direction, extension_map_list);
 
+		LargeFree((void *)SortList);
+
 /*
 		if ( limitflows && limitflows < maxindex )
 			maxindex = limitflows;
@@ -1419,8 +1957,10 @@ char				*string;
 				common_record_t *raw_record;
 				int map_id;
 
-				if ( limitflows && c >= limitflows )
+				if ( limitflows && c >= limitflows ) {
+					FlushOutput();
 					return;
+				}
 
 				// we want to print only those flows which pass the packet or byte limits
 				if ( byte_limit ) {
@@ -1442,7 +1982,10 @@ char				*string;
 				map_id = r->map_info_ref->map->map_id;
 
 				flow_record = &(extension_map_list->slot[map_id]->master_record);
-				ExpandRecord_v2( raw_record, extension_map_list->slot[map_id], r->exp_ref, flow_record);
+				if ( FlowTable->compact ) 
+					ExpandCompactRecord(r, flow_record);
+				else
+					ExpandRecord_v2( raw_record, extension_map_list->slot[map_id], r->exp_ref, flow_record);
 				flow_record->dPkts 		= r->counter[INPACKETS];
 				flow_record->dOctets 	= r->counter[INBYTES];
 				flow_record->out_pkts 	= r->counter[OUTPACKETS];
@@ -1463,12 +2006,14 @@ char				*string;
 				if ( GuessDir && ( flow_record->srcport < 1024 && flow_record->dstport > 1024 ) )
 					SwapFlow(flow_record);
 				print_record((void *)flow_record, &string, tag);
-				printf("%s\n", string);
+				if ( string )
+					OutputString(string);
 
 				c++;
 				r = r->next;
 			}
 		}
+		FlushOutput();
 	}
 
 } // End of PrintFlowTable
@@ -1487,7 +2032,7 @@ uint32_t			maxindex, c;
 	maxindex = FlowTable->NumRecords;
 
 	// Create the sort array
-	SortList = (SortElement_t *)calloc(maxindex, sizeof(SortElement_t));
+	SortList = (SortElement_t *)LargeAlloc(maxindex * sizeof(SortElement_t));
 
 	if ( !SortList ) {
 		fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror (errno));
@@ -1542,8 +2087,12 @@ uint32_t			maxindex, c;
 	if ( !(quiet || cvs_output) ) 
 		printf("Aggregated flows %u\n", maxindex);
 
-	if ( c >= 2 )
- 		heapSort(SortList, c, topN);
+	if ( c >= 2 ) {
+		if ( TimeSlot )
+			qsort((void *)SortList, c, sizeof(SortElement_t), FlowSlotCMP);
+		else
+ 			heapSort(SortList, c, topN);
+	}
 	if ( !quiet ) {
 		if ( !cvs_output ) {
 			if ( topN != 0 )
@@ -1555,7 +2104,10 @@ uint32_t			maxindex, c;
 			printf("%s\n", record_header);
 	}
 
-	PrintSortedFlowcache(SortList, maxindex, topN, 0, print_record, tag, DESCENDING, extension_map_list);
+	if ( TimeSlot )
+		PrintFlowTimeSlots(SortList, maxindex, topN, !(quiet || cvs_output), print_record, tag, extension_map_list);
+	else
+		PrintSortedFlowcache(SortList, maxindex, topN, 0, print_record, tag, DESCENDING, extension_map_list);
 
 	// process all the remaining stats, if requested
 	for ( order_index++ ; order_index<NumOrders; order_index++ ) {
@@ -1573,8 +2125,12 @@ uint32_t			maxindex, c;
 					SortList[i].count  = r->counter[order_index];
 			}
 
-			if ( maxindex >= 2 )
- 				heapSort(SortList, maxindex, topN);
+			if ( maxindex >= 2 ) {
+				if ( TimeSlot )
+					qsort((void *)SortList, maxindex, sizeof(SortElement_t), FlowSlotCMP);
+				else
+ 					heapSort(SortList, maxindex, topN);
+			}
 			if ( !quiet ) {
 				if ( !cvs_output ) {
 					if ( topN != 0 ) 
@@ -1585,11 +2141,15 @@ uint32_t			maxindex, c;
 				if ( !record_header ) 
 					printf("%s\n", record_header);
 			}
-			PrintSortedFlowcache(SortList, maxindex, topN, 0, print_record, tag, DESCENDING, extension_map_list);
+			if ( TimeSlot )
+				PrintFlowTimeSlots(SortList, maxindex, topN, !(quiet || cvs_output), print_record, tag, extension_map_list);
+			else
+				PrintSortedFlowcache(SortList, maxindex, topN, 0, print_record, tag, DESCENDING, extension_map_list);
 
 		}
 	}
 
+	LargeFree((void *)SortList);
 
 } // End of PrintFlowStat
 
@@ -1622,7 +2182,10 @@ int	i, max;
 		map_id = r->map_info_ref->map->map_id;
 
 		flow_record = &(extension_map_list->slot[map_id]->master_record);
-		ExpandRecord_v2( raw_record, extension_map_list->slot[map_id], r->exp_ref, flow_record);
+		if ( FlowTable->compact ) 
+			ExpandCompactRecord(r, flow_record);
+		else
+			ExpandRecord_v2( raw_record, extension_map_list->slot[map_id], r->exp_ref, flow_record);
 		flow_record->dPkts 		= r->counter[INPACKETS];
 		flow_record->dOctets 	= r->counter[INBYTES];
 		flow_record->out_pkts 	= r->counter[OUTPACKETS];
@@ -1652,24 +2215,35 @@ int	i, max;
 			SwapFlow(flow_record);
 
 		print_record((void *)flow_record, &string, tag);
-		printf("%s\n", string);
+		if ( string )
+			OutputString(string);
 	}
+	FlushOutput();
 
 } // End of PrintSortedFlowcache
 
 void PrintElementStat(stat_record_t	*sum_stat, uint32_t limitflows, char *record_header, printer_t print_record, int topN, int tag, int quiet, int pipe_output, int cvs_output) {
 SortElement_t	*topN_element_list;
 uint32_t		numflows, maxindex;
-int32_t 		i, j, hash_num, order_index, order_bit;
+int32_t 		i, j, start, end, hash_num, order_index, order_bit;
+int				arrow_output;
 
+	// Arrow output collects the stat lines as rows of a single table
+	arrow_output = print_record == flow_record_to_arrow;
 	numflows = 0;
 	// for every requested -s stat do
 	for ( hash_num=0; hash_num<NumStats; hash_num++ ) {
 		int stat   = StatRequest[hash_num].StatType;
 		int order  = StatRequest[hash_num].order_bits;
 		int	type = StatParameters[stat].type;
-		for ( order_index=0; order_index<NumOrders; order_index++ ) {
-			order_bit = 1 << order_index;
+		topk_summary_t *topk = StatTable[hash_num].topk;
+		char *distinct = StatParameters[stat].DistinctInfo;
+		int quantile   = StatRequest[hash_num].quantile;
+		for ( order_index=0; order_mode[order_index].string; order_index++ ) {
+			// beyond the counter orders, only orders with an element function apply
+			if ( order_index >= NumOrders && !order_mode[order_index].element_function )
+				continue;
+			order_bit = order_mode[order_index].val;
 			if ( order & order_bit ) {
 				topN_element_list = StatTopN(topN, &numflows, hash_num, order_index);
 
@@ -1681,41 +2255,76 @@ int32_t 		i, j, hash_num, order_index, order_bit;
 					else
 						printf("Top %s ordered by %s:\n", 
 							StatParameters[stat].HeaderInfo, order_mode[order_index].string);
+					if ( topk ) 
+						printf("Approximate: %u counters, %s of any unlisted element <= %llu\n", 
+							topk->capacity, order_mode[order_index].string, (unsigned long long)TopK_Bound(topk));
+					if ( order_index < 3 && StatTable[hash_num].rollup_bound[order_index] ) 
+						printf("Approximate: from rollups, %s of any element may be low by up to %llu\n", 
+							order_mode[order_index].string, (unsigned long long)StatTable[hash_num].rollup_bound[order_index]);
+					if ( distinct ) 
+						printf("Distinct: estimated number of distinct %s per element\n", distinct);
+					if ( quantile ) 
+						printf("Quantiles: %s of the flows per element in %s\n", 
+							quantile_value[quantile].name, quantile_value[quantile].unit);
 					//      2005-07-26 20:08:59.197 1553.730      ss    65255   203435   52.2 M      130   281636   268
 					if ( Getv6Mode() && (type == IS_IPADDR )) 
-						printf("Date first seen          Duration Proto %39s    Flows(%%)     Packets(%%)       Bytes(%%)         pps      bps   bpp\n",
-							StatParameters[stat].HeaderInfo);
+						printf("Date first seen          Duration Proto %39s    Flows(%%)     Packets(%%)       Bytes(%%)         pps      bps   bpp%s%s%s\n",
+							StatParameters[stat].HeaderInfo, distinct ? " Distinct" : "", 
+							quantile ? "      p50      p95      p99" : "", topk ? "    Error" : "");
 					else
-						printf("Date first seen          Duration Proto %17s    Flows(%%)     Packets(%%)       Bytes(%%)         pps      bps   bpp\n",
-							StatParameters[stat].HeaderInfo);
+						printf("Date first seen          Duration Proto %17s    Flows(%%)     Packets(%%)       Bytes(%%)         pps      bps   bpp%s%s%s\n",
+							StatParameters[stat].HeaderInfo, distinct ? " Distinct" : "", 
+							quantile ? "      p50      p95      p99" : "", topk ? "    Error" : "");
 				}
 
 				if ( cvs_output ) {
-					printf("ts,te,td,pr,val,fl,flP,ipkt,ipktP,ibyt,ibytP,pps,pbs,bpp\n");
+					printf("ts,te,td,pr,val,fl,flP,ipkt,ipktP,ibyt,ibytP,pps,pbs,bpp%s%s%s%s\n", 
+						distinct ? ",dist" : "", quantile ? ",p50,p95,p99" : "", topk ? ",err" : "", 
+						TimeSlot ? ",slots,slote" : "");
 				}
 
 				maxindex = ( StatTable[hash_num].NextBlock * StatTable[hash_num].Prealloc ) + StatTable[hash_num].NextElem;
-				j = numflows - topN;
-				j = j < 0 ? 0 : j;
-				if ( topN == 0 )
-					j = 0;
-				for ( i=numflows-1; i>=j ; i--) {
-					//if ( !topN_element_list[i].count )
-						//break;
-
-					// Again - ugly output formating - needs to be cleand up
-					if ( pipe_output ) 
-						PrintPipeStatLine((StatRecord_t *)topN_element_list[i].record, type, 
-							StatRequest[hash_num].order_proto, tag);
-					else if ( cvs_output ) 
-						PrintCvsStatLine(sum_stat, (StatRecord_t *)topN_element_list[i].record, type, 
-							StatRequest[hash_num].order_proto, tag);
-					else
-						PrintStatLine(sum_stat, limitflows, (StatRecord_t *)topN_element_list[i].record, 
-							type, StatRequest[hash_num].order_proto, tag);
+				// without time slots, all elements are in a single slot
+				start = 0;
+				while ( start < (int32_t)numflows ) {
+					end = numflows;
+					if ( TimeSlot ) {
+						uint32_t slot = ((StatRecord_t *)topN_element_list[start].record)->time_slot;
+						end = start + 1;
+						while ( end < (int32_t)numflows && ((StatRecord_t *)topN_element_list[end].record)->time_slot == slot )
+							end++;
+						// csv and pipe rows carry the slot in their own columns
+						if ( !pipe_output && !cvs_output ) 
+							printf("Time slot: %s\n", TimeString(slot, slot + TimeSlot - 1));
+					}
+					j = end - topN;
+					j = j < start ? start : j;
+					if ( topN == 0 )
+						j = start;
+					for ( i=end-1; i>=j ; i--) {
+						//if ( !topN_element_list[i].count )
+							//break;
+
+						// Again - ugly output formating - needs to be cleand up
+						if ( arrow_output ) 
+							PrintArrowStatLine((StatRecord_t *)topN_element_list[i].record, StatParameters[stat].statname, 
+								order_mode[order_index].string, type, StatRequest[hash_num].order_proto, topk, distinct, quantile);
+						else if ( pipe_output ) 
+							PrintPipeStatLine((StatRecord_t *)topN_element_list[i].record, type, 
+								StatRequest[hash_num].order_proto, tag, topk, distinct, quantile);
+						else if ( cvs_output ) 
+							PrintCvsStatLine(sum_stat, (StatRecord_t *)topN_element_list[i].record, type, 
+								StatRequest[hash_num].order_proto, tag, topk, distinct, quantile);
+						else
+							PrintStatLine(sum_stat, limitflows, (StatRecord_t *)topN_element_list[i].record, 
+								type, StatRequest[hash_num].order_proto, tag, topk, distinct, quantile);
+					}
+					start = end;
 				}
-				free((void *)topN_element_list);
-				printf("\n");
+				// release the top N list for the next stat or order
+				Arena_Reset(&SortArena);
+				if ( !arrow_output )
+					printf("\n");
 			}
 		} // for every requested order
 	} // for every requested -s stat do
@@ -1723,23 +2332,28 @@ int32_t 		i, j, hash_num, order_index, order_bit;
 
 static SortElement_t *StatTopN(int topN, uint32_t *count, int hash_num, int order ) {
 SortElement_t 		*topN_list;
-StatRecord_t		*r;
+StatRecord_t		*r, **bucket;
 unsigned int		i;
-uint32_t	   		c, maxindex;
-
-	maxindex  = ( StatTable[hash_num].NextBlock * StatTable[hash_num].Prealloc ) + StatTable[hash_num].NextElem;
-	topN_list = (SortElement_t *)calloc(maxindex, sizeof(SortElement_t));
+uint32_t	   		c, maxindex, IndexMask;
 
-	if ( !topN_list ) {
-		perror("Can't allocate Top N lists: \n");
-		return NULL;
+	if ( StatTable[hash_num].topk ) {
+		// the top K summary uses the same bucket chains as the stat hash table
+		maxindex  = StatTable[hash_num].topk->NumEntries;
+		bucket	  = StatTable[hash_num].topk->bucket;
+		IndexMask = StatTable[hash_num].topk->IndexMask;
+	} else {
+		maxindex  = ( StatTable[hash_num].NextBlock * StatTable[hash_num].Prealloc ) + StatTable[hash_num].NextElem;
+		bucket	  = StatTable[hash_num].bucket;
+		IndexMask = StatTable[hash_num].IndexMask;
 	}
+	// Arena_Calloc always succeeds. If no memory, Arena_Calloc already exits cleanly
+	topN_list = (SortElement_t *)Arena_Calloc(&SortArena, maxindex * sizeof(SortElement_t));
 
 	// preset topN_list table - still unsorted
 	c = 0;
 	// Iterate through all buckets
-	for ( i=0; i <= StatTable[hash_num].IndexMask; i++ ) {
-		r = StatTable[hash_num].bucket[i];
+	for ( i=0; i <= IndexMask; i++ ) {
+		r = bucket[i];
 		// foreach elem in this bucket
 		while ( r ) {
 			// next elem in bucket
@@ -1779,8 +2393,13 @@ uint32_t	   		c, maxindex;
 	*/
 
 	// Sorting makes only sense, when 2 or more flows are left
-	if ( c >= 2 )
- 		heapSort(topN_list, c, topN);
+	// with time slots, all elements are sorted by time slot first
+	if ( c >= 2 ) {
+		if ( TimeSlot )
+			qsort((void *)topN_list, c, sizeof(SortElement_t), ElementSlotCMP);
+		else
+ 			heapSort(topN_list, c, topN);
+	}
 
 	/*
 	for ( i = 0; i < maxindex; i++ ) 
@@ -1791,6 +2410,64 @@ uint32_t	   		c, maxindex;
 	
 } // End of StatTopN
 
+/*
+ * sort by time slot ascending, and within each time slot ascending by count, 
+ * which results in the same order as heapSort for each time slot
+ */
+static int ElementSlotCMP(const void *p1, const void *p2) {
+const SortElement_t *e1 = (const SortElement_t *)p1;
+const SortElement_t *e2 = (const SortElement_t *)p2;
+uint32_t slot1 = ((StatRecord_t *)e1->record)->time_slot;
+uint32_t slot2 = ((StatRecord_t *)e2->record)->time_slot;
+
+	if ( slot1 != slot2 )
+		return slot1 < slot2 ? -1 : 1;
+	if ( e1->count != e2->count )
+		return e1->count < e2->count ? -1 : 1;
+	return 0;
+
+} // End of ElementSlotCMP
+
+static int FlowSlotCMP(const void *p1, const void *p2) {
+const SortElement_t *e1 = (const SortElement_t *)p1;
+const SortElement_t *e2 = (const SortElement_t *)p2;
+uint32_t first1 = ((FlowTableRecord_t *)e1->record)->flowrecord.first;
+uint32_t first2 = ((FlowTableRecord_t *)e2->record)->flowrecord.first;
+uint32_t slot1  = first1 - ( first1 % TimeSlot );
+uint32_t slot2  = first2 - ( first2 % TimeSlot );
+
+	if ( slot1 != slot2 )
+		return slot1 < slot2 ? -1 : 1;
+	if ( e1->count != e2->count )
+		return e1->count < e2->count ? -1 : 1;
+	return 0;
+
+} // End of FlowSlotCMP
+
+static void PrintFlowTimeSlots(SortElement_t *SortList, uint32_t maxindex, int topN, int print_slot, 
+	printer_t print_record, int tag, extension_map_list_t *extension_map_list) {
+uint32_t	start, end, slot, first;
+
+	// SortList is sorted by time slot - print the top N flows of each time slot
+	start = 0;
+	while ( start < maxindex ) {
+		first = ((FlowTableRecord_t *)SortList[start].record)->flowrecord.first;
+		slot  = first - ( first % TimeSlot );
+		end   = start + 1;
+		while ( end < maxindex ) {
+			first = ((FlowTableRecord_t *)SortList[end].record)->flowrecord.first;
+			if ( ( first - ( first % TimeSlot ) ) != slot )
+				break;
+			end++;
+		}
+		if ( print_slot )
+			printf("Time slot: %s\n", TimeString(slot, slot + TimeSlot - 1));
+		PrintSortedFlowcache(&SortList[start], end - start, topN, 0, print_record, tag, DESCENDING, extension_map_list);
+		start = end;
+	}
+
+} // End of PrintFlowTimeSlots
+
 
 static void SwapFlow(master_record_t *flow_record) {
 uint64_t _tmp_ip[2];
@@ -1825,3 +2502,345 @@ uint32_t _tmp;
 	flow_record->out_bytes = _tmp_l;
 
 } // End of SwapFlow
+
+static int WritePartialRecord(FILE *fp, StatRecord_t *record, uint64_t error) {
+partial_record_t	partial_record;
+
+	memset((void *)&partial_record, 0, sizeof(partial_record_t));
+	partial_record.stat_key[0]	= record->stat_key[0];
+	partial_record.stat_key[1]	= record->stat_key[1];
+	partial_record.counter[0]	= record->counter[0];
+	partial_record.counter[1]	= record->counter[1];
+	partial_record.counter[2]	= record->counter[2];
+	partial_record.error		= error;
+	partial_record.first		= record->first;
+	partial_record.last			= record->last;
+	partial_record.msec_first	= record->msec_first;
+	partial_record.msec_last	= record->msec_last;
+	partial_record.record_flags = record->record_flags;
+	partial_record.tcp_flags	= record->tcp_flags;
+	partial_record.tos			= record->tos;
+	partial_record.prot			= record->prot;
+	partial_record.time_slot	= record->time_slot;
+	partial_record.sketches		= ( record->hll ? 1 : 0 ) | ( record->dds ? 2 : 0 );
+
+	if ( fwrite((void *)&partial_record, sizeof(partial_record_t), 1, fp) != 1 )
+		return 0;
+	if ( record->hll && !HLL_Write(fp, record->hll) )
+		return 0;
+	if ( record->dds && !DDS_Write(fp, record->dds) )
+		return 0;
+
+	return 1;
+
+} // End of WritePartialRecord
+
+int WriteStatPartial(char *filename, stat_record_t *sum_stat) {
+partial_header_t	header;
+partial_stat_t		partial_stat;
+FILE				*fp;
+uint32_t			hash_num, i, j;
+int					ok;
+
+	fp = fopen(filename, "w");
+	if ( !fp ) {
+		fprintf(stderr, "Can't open partial statistics file '%s': %s\n", filename, strerror(errno));
+		return 0;
+	}
+
+	memset((void *)&header, 0, sizeof(partial_header_t));
+	header.magic		= PARTIAL_MAGIC;
+	header.version		= PARTIAL_VERSION;
+	header.NumStats		= NumStats;
+	header.time_slot	= TimeSlot;
+	header.stat_record	= *sum_stat;
+	ok = fwrite((void *)&header, sizeof(partial_header_t), 1, fp) == 1;
+
+	for ( hash_num=0; ok && hash_num<NumStats; hash_num++ ) {
+		topk_summary_t *topk = StatTable[hash_num].topk;
+
+		memset((void *)&partial_stat, 0, sizeof(partial_stat_t));
+		strncpy(partial_stat.statname, StatParameters[StatRequest[hash_num].StatType].statname, 15);
+		partial_stat.order_bits  = StatRequest[hash_num].order_bits;
+		partial_stat.order_proto = StatRequest[hash_num].order_proto;
+		partial_stat.approx		 = StatRequest[hash_num].approx;
+		partial_stat.quantile	 = StatRequest[hash_num].quantile;
+		if ( topk ) {
+			partial_stat.capacity	= topk->capacity;
+			partial_stat.total		= topk->total;
+			partial_stat.NumRecords = topk->NumEntries;
+		} else {
+			partial_stat.NumRecords = ( StatTable[hash_num].NextBlock * StatTable[hash_num].Prealloc ) + StatTable[hash_num].NextElem;
+		}
+		ok = fwrite((void *)&partial_stat, sizeof(partial_stat_t), 1, fp) == 1;
+
+		if ( topk ) {
+			for ( i=0; ok && i<topk->NumEntries; i++ ) 
+				ok = WritePartialRecord(fp, &topk->entry[i], topk->error[i]);
+		} else {
+			for ( i=0; ok && i<StatTable[hash_num].NumBlocks; i++ ) {
+				uint32_t num = i == StatTable[hash_num].NextBlock ? StatTable[hash_num].NextElem : StatTable[hash_num].Prealloc;
+				for ( j=0; ok && j<num; j++ ) 
+					ok = WritePartialRecord(fp, &StatTable[hash_num].memblock[i][j], 0);
+			}
+		}
+	}
+
+	if ( fclose(fp) != 0 )
+		ok = 0;
+
+	if ( !ok ) {
+		fprintf(stderr, "Failed to write partial statistics file '%s': %s\n", filename, strerror(errno));
+		unlink(filename);
+		return 0;
+	}
+
+	return 1;
+
+} // End of WriteStatPartial
+
+static int ReadPartialRecord(FILE *fp, partial_record_t *partial_record, hll_t **hll, ddsketch_t **dds) {
+
+	*hll = NULL;
+	*dds = NULL;
+	if ( fread((void *)partial_record, sizeof(partial_record_t), 1, fp) != 1 )
+		return 0;
+	if ( partial_record->sketches & 1 ) {
+		*hll = HLL_Read(fp);
+		if ( !*hll )
+			return 0;
+	}
+	if ( partial_record->sketches & 2 ) {
+		*dds = DDS_Read(fp);
+		if ( !*dds ) {
+			HLL_Free(*hll);
+			return 0;
+		}
+	}
+	return 1;
+
+} // End of ReadPartialRecord
+
+/*
+ * no -s stat given - setup the stats as found in the partial file
+ */
+int SetStatPartial(char *filename) {
+partial_header_t	header;
+partial_stat_t		partial_stat;
+FILE				*fp;
+uint32_t			i;
+int					StatType;
+
+	if ( NumStats )
+		return 1;
+
+	fp = fopen(filename, "r");
+	if ( !fp ) {
+		fprintf(stderr, "Can't open partial statistics file '%s': %s\n", filename, strerror(errno));
+		return 0;
+	}
+	if ( fread((void *)&header, sizeof(partial_header_t), 1, fp) != 1 || 
+		 header.magic != PARTIAL_MAGIC || header.version != PARTIAL_VERSION ) {
+		fprintf(stderr, "'%s' is not a partial statistics file of this version or byte order\n", filename);
+		fclose(fp);
+		return 0;
+	}
+	if ( header.NumStats > MaxStats ) {
+		fprintf(stderr, "Corrupt partial statistics file '%s'\n", filename);
+		fclose(fp);
+		return 0;
+	}
+
+	// only the stat definitions are needed - they precede the records of each stat
+	if ( fread((void *)&partial_stat, sizeof(partial_stat_t), 1, fp) != 1 ) {
+		fprintf(stderr, "Corrupt partial statistics file '%s'\n", filename);
+		fclose(fp);
+		return 0;
+	}
+	for ( i=0; i<header.NumStats; i++ ) {
+		partial_record_t	partial_record;
+		hll_t				*hll;
+		ddsketch_t			*dds;
+		uint64_t			r;
+
+		partial_stat.statname[15] = '\0';
+		StatType = 0;
+		while ( StatParameters[StatType].statname && strcmp(StatParameters[StatType].statname, partial_stat.statname) != 0 )
+			StatType++;
+		if ( !StatParameters[StatType].statname ) {
+			fprintf(stderr, "Unknown stat '%s' in partial statistics file '%s'\n", partial_stat.statname, filename);
+			fclose(fp);
+			return 0;
+		}
+		StatRequest[NumStats].StatType	  = StatType;
+		StatRequest[NumStats].order_bits  = partial_stat.order_bits;
+		StatRequest[NumStats].order_proto = partial_stat.order_proto;
+		StatRequest[NumStats].approx	  = partial_stat.approx;
+		StatRequest[NumStats].quantile	  = partial_stat.quantile;
+		NumStats++;
+
+		// skip records to the next stat
+		if ( i == header.NumStats - 1 )
+			break;
+		for ( r=0; r<partial_stat.NumRecords; r++ ) {
+			if ( !ReadPartialRecord(fp, &partial_record, &hll, &dds) ) {
+				fprintf(stderr, "Corrupt partial statistics file '%s'\n", filename);
+				fclose(fp);
+				return 0;
+			}
+			HLL_Free(hll);
+			DDS_Free(dds);
+		}
+		if ( fread((void *)&partial_stat, sizeof(partial_stat_t), 1, fp) != 1 ) {
+			fprintf(stderr, "Corrupt partial statistics file '%s'\n", filename);
+			fclose(fp);
+			return 0;
+		}
+	}
+	fclose(fp);
+
+	if ( header.time_slot && !TimeSlot )
+		SetTimeSlot(header.time_slot);
+
+	return 1;
+
+} // End of SetStatPartial
+
+int MergeStatPartial(char *filename, stat_record_t *sum_stat) {
+partial_header_t	header;
+partial_stat_t		partial_stat;
+partial_record_t	partial_record;
+StatRecord_t		*stat_record;
+hll_t				*hll;
+ddsketch_t			*dds;
+FILE				*fp;
+uint64_t			r;
+uint32_t			hash_num;
+
+	fp = fopen(filename, "r");
+	if ( !fp ) {
+		fprintf(stderr, "Can't open partial statistics file '%s': %s\n", filename, strerror(errno));
+		return 0;
+	}
+	if ( fread((void *)&header, sizeof(partial_header_t), 1, fp) != 1 || 
+		 header.magic != PARTIAL_MAGIC || header.version != PARTIAL_VERSION ) {
+		fprintf(stderr, "'%s' is not a partial statistics file of this version or byte order\n", filename);
+		fclose(fp);
+		return 0;
+	}
+	if ( header.NumStats != NumStats || header.time_slot != TimeSlot ) {
+		fprintf(stderr, "Statistics or time slot in partial statistics file '%s' do not match\n", filename);
+		fclose(fp);
+		return 0;
+	}
+	SumStatRecords(sum_stat, &header.stat_record);
+
+	for ( hash_num=0; hash_num<NumStats; hash_num++ ) {
+		topk_summary_t *topk = NULL;
+
+		if ( fread((void *)&partial_stat, sizeof(partial_stat_t), 1, fp) != 1 ) {
+			fprintf(stderr, "Corrupt partial statistics file '%s'\n", filename);
+			fclose(fp);
+			return 0;
+		}
+		partial_stat.statname[15] = '\0';
+		if ( strcmp(partial_stat.statname, StatParameters[StatRequest[hash_num].StatType].statname) != 0 ||
+			 partial_stat.order_proto != StatRequest[hash_num].order_proto ||
+			 partial_stat.approx	  != StatRequest[hash_num].approx ||
+			 partial_stat.quantile	  != StatRequest[hash_num].quantile ) {
+			fprintf(stderr, "Stat '%s' in partial statistics file '%s' does not match\n", partial_stat.statname, filename);
+			fclose(fp);
+			return 0;
+		}
+
+		// approximate stats: load the summary and merge it as a whole
+		if ( StatTable[hash_num].topk ) {
+			if ( partial_stat.NumRecords > partial_stat.capacity ) {
+				fprintf(stderr, "Corrupt partial statistics file '%s'\n", filename);
+				fclose(fp);
+				return 0;
+			}
+			topk = TopK_Init(partial_stat.capacity, StatTable[hash_num].topk->order, partial_stat.order_proto);
+			if ( !topk ) {
+				fclose(fp);
+				return 0;
+			}
+		}
+
+		for ( r=0; r<partial_stat.NumRecords; r++ ) {
+			if ( !ReadPartialRecord(fp, &partial_record, &hll, &dds) ) {
+				fprintf(stderr, "Corrupt partial statistics file '%s'\n", filename);
+				TopK_Free(topk);
+				fclose(fp);
+				return 0;
+			}
+
+			if ( topk ) 
+				stat_record = TopK_Lookup(topk, partial_record.stat_key, partial_record.prot);
+			else
+				stat_record = stat_hash_lookup(partial_record.stat_key, partial_record.prot, partial_record.time_slot, hash_num);
+
+			if ( stat_record ) {
+				stat_record->counter[0] += partial_record.counter[0];
+				stat_record->counter[1] += partial_record.counter[1];
+				stat_record->counter[2] += partial_record.counter[2];
+				if ( TimeMsec_CMP(partial_record.first, partial_record.msec_first, stat_record->first, stat_record->msec_first) == 2) {
+					stat_record->first 		= partial_record.first;
+					stat_record->msec_first = partial_record.msec_first;
+				}
+				if ( TimeMsec_CMP(partial_record.last, partial_record.msec_last, stat_record->last, stat_record->msec_last) == 1) {
+					stat_record->last 		= partial_record.last;
+					stat_record->msec_last 	= partial_record.msec_last;
+				}
+				stat_record->tcp_flags |= partial_record.tcp_flags;
+				if ( hll ) {
+					if ( stat_record->hll ) {
+						HLL_Merge(stat_record->hll, hll);
+						HLL_Free(hll);
+					} else
+						stat_record->hll = hll;
+				}
+				if ( dds ) {
+					if ( stat_record->dds ) {
+						DDS_Merge(stat_record->dds, dds);
+						DDS_Free(dds);
+					} else
+						stat_record->dds = dds;
+				}
+				continue;
+			}
+
+			if ( topk ) 
+				stat_record = TopK_Insert(topk, partial_record.stat_key, partial_record.prot);
+			else
+				stat_record = stat_hash_insert(partial_record.stat_key, partial_record.prot, partial_record.time_slot, hash_num);
+			stat_record->counter[0]	  = partial_record.counter[0];
+			stat_record->counter[1]	  = partial_record.counter[1];
+			stat_record->counter[2]	  = partial_record.counter[2];
+			stat_record->first		  = partial_record.first;
+			stat_record->last		  = partial_record.last;
+			stat_record->msec_first	  = partial_record.msec_first;
+			stat_record->msec_last	  = partial_record.msec_last;
+			stat_record->record_flags = partial_record.record_flags;
+			stat_record->tcp_flags	  = partial_record.tcp_flags;
+			stat_record->tos		  = partial_record.tos;
+			stat_record->time_slot	  = partial_record.time_slot;
+			stat_record->hll		  = hll;
+			stat_record->dds		  = dds;
+			if ( topk ) {
+				topk->error[stat_record - topk->entry] = partial_record.error;
+				TopK_Settle(topk, stat_record, 0);
+			}
+		}
+
+		if ( topk ) {
+			topk->total = partial_stat.total;
+			TopK_Merge(StatTable[hash_num].topk, topk);
+			TopK_Free(topk);
+		}
+	}
+	fclose(fp);
+
+	return 1;
+
+} // End of MergeStatPartial
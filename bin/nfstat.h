@@ -62,6 +62,12 @@ typedef struct StatRecord {
 	// key 
 	uint8_t		prot;
 	uint64_t	stat_key[2];
+	// distinct count stats only
+	struct hll_s	*hll;
+	// quantile stats only
+	struct ddsketch_s	*dds;
+	// start of time slot with -P
+	uint32_t	time_slot;
 } StatRecord_t;
 
 typedef struct hash_StatTable {
@@ -80,6 +86,12 @@ typedef struct hash_StatTable {
 	uint32_t 			Prealloc;		/* Number of stat records in each stat block */
 	uint32_t			NextBlock;		/* This stat block contains the next free slot for a stat recorrd */
 	uint32_t			NextElem;		/* This element in the current stat block is the next free slot */
+
+	/* approximate stat - fixed size top K summary instead of the hash table above */
+	struct topk_summary_s	*topk;
+
+	/* rollups - sum of the thresholds of all merged rollups for flows, packets and bytes */
+	uint64_t			rollup_bound[3];
 } hash_StatTable;
 
 typedef struct SortElement {
@@ -87,12 +99,62 @@ typedef struct SortElement {
     uint64_t	count;
 } SortElement_t;
 
+/*
+ * Partial statistics
+ * Instead of printing the element statistics, all stat records of a run may be written
+ * into a partial statistics file ( -W ). Any number of partial files, e.g. from different
+ * nodes or days, can be merged later ( -J ) into the final statistics. As no element is 
+ * dropped, the merged statistics are exact - apart from approximate statistics. 
+ * All values are in host byte order.
+ */
+#define PARTIAL_MAGIC	0x4E465053	// NFPS
+// version 2: 64 bit DDSketch bins
+#define PARTIAL_VERSION	2
+
+typedef struct partial_header_s {
+	uint32_t		magic;			/* PARTIAL_MAGIC */
+	uint32_t		version;		/* PARTIAL_VERSION */
+	uint32_t		NumStats;		/* number of partial_stat_t blocks following */
+	uint32_t		time_slot;		/* -P time slot or 0 */
+	stat_record_t	stat_record;	/* summary of all processed flows */
+} partial_header_t;
+
+typedef struct partial_stat_s {
+	char			statname[16];	/* name of -s stat */
+	uint16_t		order_bits;
+	uint8_t			order_proto;
+	uint8_t			approx;
+	uint8_t			quantile;
+	uint8_t			fill[3];
+	uint32_t		capacity;		/* approx: number of counters */
+	uint64_t		total;			/* approx: sum of all weights */
+	uint64_t		NumRecords;		/* number of partial_record_t following */
+} partial_stat_t;
+
+typedef struct partial_record_s {
+	uint64_t		stat_key[2];
+	uint64_t		counter[3];
+	uint64_t		error;			/* approx: max overestimation */
+	uint32_t		first;
+	uint32_t		last;
+	uint16_t		msec_first;
+	uint16_t		msec_last;
+	uint8_t			record_flags;
+	uint8_t			tcp_flags;
+	uint8_t			tos;
+	uint8_t			prot;
+	uint32_t		time_slot;
+	uint32_t		sketches;		/* bit 0: HyperLogLog follows, bit 1: DDSketch follows */
+} partial_record_t;
+
 #define MULTIPLE_LIST_ORDERS 1
 #define SINGLE_LIST_ORDER    0
 
 /* Function prototypes */
 void SetLimits(int stat, char *packet_limit_string, char *byte_limit_string );
 
+int SetTimeSlot(uint32_t seconds);
+
 int Init_StatTable(uint16_t NumBits, uint32_t Prealloc);
 
 void Dispose_StatTable(void);
@@ -103,6 +165,10 @@ int Parse_PrintOrder(char *order);
 
 void AddStat(common_record_t *raw_record, master_record_t *flow_record );
 
+int RollupCompatible(void);
+
+int AddRollupStat(data_block_header_t *block_header, stat_record_t *sum_stat);
+
 void PrintFlowTable(printer_t print_record, uint32_t limitflows, int tag, int GuessDir, extension_map_list_t *extension_map_list);
 
 void PrintFlowStat(char *record_header, printer_t print_record, int topN, int tag, int quiet, int cvs_output, extension_map_list_t *extension_map_list);
@@ -113,4 +179,10 @@ int ParseListOrder(char *s, int multiple_orders );
 
 void PrintSortedFlows(printer_t print_record, uint32_t limitflows, int tag);
 
+int WriteStatPartial(char *filename, stat_record_t *sum_stat);
+
+int SetStatPartial(char *filename);
+
+int MergeStatPartial(char *filename, stat_record_t *sum_stat);
+
 #endif //_NFSTAT_H
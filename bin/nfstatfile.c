@@ -54,7 +54,9 @@
 #include <stdint.h>
 #endif
 
+#include "nffile.h"
 #include "nfstatfile.h"
+#include "util.h"
 
 #define stat_filename ".nfstat"
 
@@ -577,3 +579,253 @@ char	string[32];
 } // End of PrintDirStat
 
 
+
+static int ReadIndexRecord(char *dirname, char *filename, time_t t_slot, index_record_t *index_record) {
+file_header_t	file_header;
+struct stat		stat_buf;
+char			path[MAXPATHLEN];
+int				fd;
+
+	if ( strlen(filename) >= sizeof(index_record->name) ) {
+		LogError( "File name too long for index: '%s'\n", filename );
+		return 0;
+	}
+
+	snprintf(path, MAXPATHLEN-1, "%s/%s", dirname, filename);
+	path[MAXPATHLEN-1] = '\0';
+
+	fd = open(path, O_RDONLY);
+	if ( fd < 0 ) {
+		LogError( "open() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		return 0;
+	}
+
+	memset((void *)index_record, 0, sizeof(index_record_t));
+	if ( read(fd, (void *)&file_header, sizeof(file_header_t)) != sizeof(file_header_t) ||
+		 read(fd, (void *)&index_record->stat_record, sizeof(stat_record_t)) != sizeof(stat_record_t) ||
+		 fstat(fd, &stat_buf) < 0 ) {
+		LogError( "read() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		close(fd);
+		return 0;
+	}
+	close(fd);
+
+	if ( file_header.magic != MAGIC || file_header.version != LAYOUT_VERSION_1 ) {
+		LogError( "Not an nfdump file: '%s'\n", path );
+		return 0;
+	}
+
+	// length checked above - the record is zeroed, so the ident remains terminated
+	strcpy(index_record->name, filename);
+	memcpy(index_record->ident, file_header.ident, IDENTLEN-1);
+	index_record->size	 = stat_buf.st_size;
+	index_record->t_slot = t_slot;
+
+	return 1;
+
+} // End of ReadIndexRecord
+
+static int OpenIndex(char *dirname, index_header_t *index_header, uint32_t *num_records) {
+struct stat stat_buf;
+char	path[MAXPATHLEN];
+int		fd;
+
+	snprintf(path, MAXPATHLEN-1, "%s/%s", dirname, INDEX_FILE);
+	path[MAXPATHLEN-1] = '\0';
+
+	fd = open(path, O_RDWR);
+	if ( fd < 0 ) {
+		if ( errno != ENOENT )
+			LogError( "open() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		return -1;
+	}
+
+	if ( SetFileLock(fd) != 0 ) {
+		LogError( "ioctl(F_WRLCK) error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		close(fd);
+		return -1;
+	}
+
+	if ( pread(fd, (void *)index_header, sizeof(index_header_t), 0) != sizeof(index_header_t) ||
+		 index_header->magic != INDEX_MAGIC || index_header->version != INDEX_VERSION || 
+		 index_header->record_size != sizeof(index_record_t) || fstat(fd, &stat_buf) < 0 ) {
+		LogError( "Corrupt index file '%s'. Rebuild index with 'nfexpire -i'\n", path );
+		ReleaseFileLock(fd);
+		close(fd);
+		return -1;
+	}
+	// a partially written record at the end of the index is overwritten by the next record
+	*num_records = (stat_buf.st_size - sizeof(index_header_t)) / sizeof(index_record_t);
+
+	return fd;
+
+} // End of OpenIndex
+
+static void CloseIndex(int fd) {
+
+	ReleaseFileLock(fd);
+	if ( close(fd) < 0 ) {
+		LogError( "close() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+	}
+
+} // End of CloseIndex
+
+int CreateIndex(char *dirname) {
+index_header_t index_header;
+char	path[MAXPATHLEN];
+int		fd;
+
+	snprintf(path, MAXPATHLEN-1, "%s/%s", dirname, INDEX_FILE);
+	path[MAXPATHLEN-1] = '\0';
+
+	fd = open(path, O_RDWR|O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if ( fd < 0 ) {
+		LogError( "open() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		return 0;
+	}
+
+	if ( SetFileLock(fd) != 0 ) {
+		LogError( "ioctl(F_WRLCK) error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		close(fd);
+		return 0;
+	}
+
+	memset((void *)&index_header, 0, sizeof(index_header_t));
+	index_header.magic		 = INDEX_MAGIC;
+	index_header.version	 = INDEX_VERSION;
+	index_header.record_size = sizeof(index_record_t);
+
+	if ( ftruncate(fd, 0) < 0 || pwrite(fd, (void *)&index_header, sizeof(index_header_t), 0) != sizeof(index_header_t) ) {
+		LogError( "write() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		CloseIndex(fd);
+		return 0;
+	}
+
+	CloseIndex(fd);
+	return 1;
+
+} // End of CreateIndex
+
+int AppendIndex(char *dirname, char *filename, time_t t_slot) {
+index_header_t	index_header;
+index_record_t	index_record, last_record;
+uint32_t		num_records;
+off_t			offset;
+int				fd;
+
+	fd = OpenIndex(dirname, &index_header, &num_records);
+	if ( fd < 0 ) 
+		// no index in this directory
+		return 0;
+
+	if ( !ReadIndexRecord(dirname, filename, t_slot, &index_record) ) {
+		CloseIndex(fd);
+		return 0;
+	}
+
+	if ( num_records > index_header.first ) {
+		offset = sizeof(index_header_t) + (off_t)(num_records - 1) * sizeof(index_record_t);
+		if ( pread(fd, (void *)&last_record, sizeof(index_record_t), offset) != sizeof(index_record_t) ) {
+			LogError( "read() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+			CloseIndex(fd);
+			return 0;
+		}
+		last_record.name[sizeof(last_record.name)-1] = '\0';
+		if ( strcmp(last_record.name, index_record.name) == 0 ) {
+			// file already indexed - update record
+			num_records--;
+		} else if ( (index_header.flags & INDEX_UNSORTED) == 0 && ComparePath(index_record.name, last_record.name) < 0 ) {
+			index_header.flags |= INDEX_UNSORTED;
+			if ( pwrite(fd, (void *)&index_header, sizeof(index_header_t), 0) != sizeof(index_header_t) ) {
+				LogError( "write() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+			}
+		}
+	}
+
+	offset = sizeof(index_header_t) + (off_t)num_records * sizeof(index_record_t);
+	if ( pwrite(fd, (void *)&index_record, sizeof(index_record_t), offset) != sizeof(index_record_t) ) {
+		LogError( "write() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		CloseIndex(fd);
+		return 0;
+	}
+
+	CloseIndex(fd);
+	return 1;
+
+} // End of AppendIndex
+
+int ExpireIndex(char *dirname) {
+index_header_t	index_header;
+index_record_t	index_record;
+struct stat		stat_buf;
+char			path[MAXPATHLEN];
+uint32_t		num_records, first, i;
+off_t			offset;
+int				fd;
+
+	fd = OpenIndex(dirname, &index_header, &num_records);
+	if ( fd < 0 ) 
+		// no index in this directory
+		return 0;
+
+	// files are expired in file name order - skip all leading records of deleted files
+	first = index_header.first;
+	while ( first < num_records ) {
+		offset = sizeof(index_header_t) + (off_t)first * sizeof(index_record_t);
+		if ( pread(fd, (void *)&index_record, sizeof(index_record_t), offset) != sizeof(index_record_t) ) {
+			LogError( "read() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+			break;
+		}
+		index_record.name[sizeof(index_record.name)-1] = '\0';
+		snprintf(path, MAXPATHLEN-1, "%s/%s", dirname, index_record.name);
+		path[MAXPATHLEN-1] = '\0';
+		if ( stat(path, &stat_buf) == 0 || errno != ENOENT )
+			break;
+		first++;
+	}
+
+	if ( first == index_header.first ) {
+		CloseIndex(fd);
+		return 1;
+	}
+
+	if ( first > (num_records - first) ) {
+		// more expired than valid records - compact the index
+		for ( i=first; i<num_records; i++ ) {
+			offset = sizeof(index_header_t) + (off_t)i * sizeof(index_record_t);
+			if ( pread(fd, (void *)&index_record, sizeof(index_record_t), offset) != sizeof(index_record_t) ) {
+				LogError( "read() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+				break;
+			}
+			offset = sizeof(index_header_t) + (off_t)(i - first) * sizeof(index_record_t);
+			if ( pwrite(fd, (void *)&index_record, sizeof(index_record_t), offset) != sizeof(index_record_t) ) {
+				LogError( "write() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+				break;
+			}
+		}
+		if ( i < num_records ) {
+			// the index is inconsistent now - remove it, so nfdump falls back to scan the directory
+			snprintf(path, MAXPATHLEN-1, "%s/%s", dirname, INDEX_FILE);
+			path[MAXPATHLEN-1] = '\0';
+			unlink(path);
+			LogError( "Removed index file '%s'. Rebuild index with 'nfexpire -i'\n", path );
+			CloseIndex(fd);
+			return 0;
+		}
+		offset = sizeof(index_header_t) + (off_t)(num_records - first) * sizeof(index_record_t);
+		if ( ftruncate(fd, offset) < 0 ) {
+			LogError( "ftruncate() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		}
+		first = 0;
+	}
+
+	index_header.first = first;
+	if ( pwrite(fd, (void *)&index_header, sizeof(index_header_t), 0) != sizeof(index_header_t) ) {
+		LogError( "write() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+	}
+
+	CloseIndex(fd);
+	return 1;
+
+} // End of ExpireIndex
+
@@ -76,4 +76,10 @@ int WriteStatInfo(dirstat_t *dirstat);
 
 int ReleaseStatInfo(dirstat_t *dirstat);
 
+int CreateIndex(char *dirname);
+
+int AppendIndex(char *dirname, char *filename, time_t t_slot);
+
+int ExpireIndex(char *dirname);
+
 #endif //_NFSTATFILE_H
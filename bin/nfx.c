@@ -102,7 +102,7 @@ extension_descriptor_t extension_descriptor[] = {
 	{ EX_RECEIVED,			8,	16, 0,   "time packet received"},
 
 	// reserved for more v9/IPFIX
-	{ EX_RESERVED_1,		0,	0, 0,    NULL},
+	{ EX_EXPORTER_SYSID,	4,	0, 0,    "exporter sysid"},
 	{ EX_RESERVED_2,		0,	0, 0,    NULL},
 	{ EX_RESERVED_3,		0,	0, 0,    NULL},
 	{ EX_RESERVED_4,		0,	0, 0,    NULL},
@@ -194,6 +194,7 @@ extension_info_t *l;
 int Insert_Extension_Map(extension_map_list_t *extension_map_list, extension_map_t *map) {
 extension_info_t *l;
 uint16_t map_id;
+int i;
 
 	map_id = map->map_id == INIT_ID ? 0 : map->map_id & EXTENSION_MAP_MASK;
 	map->map_id = map_id;
@@ -264,6 +265,15 @@ uint16_t map_id;
 		}
 		memcpy((void *)l->map, (void *)map, map->size);
 
+		// the full exporter sysid follows all extensions after EX_EXPORTER_SYSID
+		l->sysid_offset = 0;
+		for ( i=0; l->map->ex_id[i]; i++ ) {
+			if ( l->sysid_offset ) 
+				l->sysid_offset += extension_descriptor[l->map->ex_id[i]].size;
+			else if ( l->map->ex_id[i] == EX_EXPORTER_SYSID ) 
+				l->sysid_offset = extension_descriptor[EX_EXPORTER_SYSID].size;
+		}
+
 		// append new extension to list
 		*(extension_map_list->last_map) = l;
 		extension_map_list->last_map 	= &l->next;
@@ -55,6 +55,7 @@ typedef struct extension_info_s {
 	extension_map_t	*map;
 	uint32_t		ref_count;
 	uint32_t		*offset_cache;
+	uint32_t		sysid_offset;	// offset of EX_EXPORTER_SYSID from the end of the record - 0: not in map
 	master_record_t	master_record;
 } extension_info_t;
 
@@ -61,6 +61,7 @@
 #include "nfdump.h"
 #include "nffile.h"
 #include "nfstatfile.h"
+#include "nfrollup.h"
 #include "nfxstat.h"
 #include "flist.h"
 #include "util.h"
@@ -380,6 +381,10 @@ int ret, update_ok;
 			CloseUpdateFile(profile_channels[num].nffile, Ident);
 			profile_channels[num].nffile = DisposeFile(profile_channels[num].nffile);
 
+			// Append rollups of the closed file, if requested
+			if ( !WriteRollups(profile_channels[num].ofile) ) 
+				LogError("Failed to write rollups to '%s'\n", profile_channels[num].ofile);
+
 			stat(profile_channels[num].ofile, &fstat);
 
 			ret = ReadStatInfo(profile_channels[num].dirstat_path, &dirstat, CREATE_AND_LOCK);
@@ -389,10 +394,15 @@ int ret, update_ok;
 			if ( rename(profile_channels[num].ofile, profile_channels[num].wfile) < 0 ) {
 				LogError("Failed to rename file %s to %s: %s\n", 
 					profile_channels[num].ofile, profile_channels[num].wfile, strerror(errno) );
-			} else if ( dirstat && tslot > dirstat->last ) {
-				dirstat->filesize += 512 * fstat.st_blocks;
-				dirstat->numfiles++;
-				dirstat->last = tslot;
+			} else {
+				if ( dirstat && tslot > dirstat->last ) {
+					dirstat->filesize += 512 * fstat.st_blocks;
+					dirstat->numfiles++;
+					dirstat->last = tslot;
+				}
+				// Update file index, if the channel directory is indexed
+				AppendIndex(profile_channels[num].dirstat_path, 
+					&profile_channels[num].wfile[strlen(profile_channels[num].dirstat_path)+1], tslot);
 			}
 
 			if ( dirstat ) {
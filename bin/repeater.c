@@ -0,0 +1,535 @@
+/*
+ *  This file is part of the nfdump project.
+ *
+ *  Copyright (c) 2014, the nfdump contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of SWITCH nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  $Author$
+ *
+ *  $Id$
+ *
+ *  $LastChangedRevision$
+ *
+ */
+
+#include "config.h"
+
+#ifdef HAVE_SENDMMSG
+// sendmmsg() is a GNU extension
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/param.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "util.h"
+#include "nffile.h"
+#include "nfx.h"
+#include "nf_common.h"
+#include "nfnet.h"
+#include "bookkeeper.h"
+#include "nfxstat.h"
+#include "collector.h"
+#include "repeater.h"
+
+#define REPEATER_BATCH		64		// max number of datagrams sent at once
+#define REPEATER_IDLE_WAIT	100		// max msec the idle repeater waits for datagrams
+
+typedef struct exporter_net_s {
+	int			family;
+	int			bits;
+	uint8_t		addr[16];
+} exporter_net_t;
+
+typedef struct destination_s {
+	send_peer_t		peer;
+	exporter_net_t	filter[MAX_REPEATER_FILTER];
+	int				num_filter;		// 0: repeat the datagrams of all exporters
+
+	// written by the repeater thread
+	uint64_t		sent;
+	uint64_t		dropped;		// the destination did not accept more datagrams
+	uint64_t		errors;
+	// values at the last RepeaterStat()
+	uint64_t		last_sent;
+	uint64_t		last_dropped;
+	uint64_t		last_errors;
+} destination_t;
+
+static struct repeater_s {
+	destination_t	destination[MAX_REPEATER_DESTINATIONS];
+	int				num_destinations;
+
+	packet_ring_t	**ring;			// one ring per producer
+	int				num_rings;
+	uint32_t		last_dropped;
+
+	pthread_t		tid;
+	// the idle repeater waits for datagrams or termination
+	pthread_mutex_t	mutex;
+	pthread_cond_t	cond;
+	int				sleeping;
+	int				stop;
+
+#ifdef HAVE_SENDMMSG
+	struct mmsghdr	msgs[REPEATER_BATCH];
+	struct iovec	iov[REPEATER_BATCH];
+#endif
+} repeater;
+
+/* function prototypes */
+static int ParseExporterNet(char *s, exporter_net_t *net);
+
+static int MatchFilter(destination_t *destination, struct sockaddr_storage *sender);
+
+static void SendBatch(destination_t *destination, ring_packet_t **packets, int num);
+
+static int RingsPending(void);
+
+static void LogRepeaterStat(int always);
+
+static void FreeDestinations(void);
+
+static void *RepeaterThread(void *arg);
+
+/* Functions */
+
+static int ParseExporterNet(char *s, exporter_net_t *net) {
+char	*p, *eptr;
+int		maxbits;
+
+	memset((void *)net, 0, sizeof(exporter_net_t));
+	p = strchr(s, '/');
+	if ( p ) 
+		*p++ = '\0';
+
+	if ( inet_pton(AF_INET, s, net->addr) == 1 ) {
+		net->family = AF_INET;
+		maxbits		= 32;
+	} else if ( inet_pton(AF_INET6, s, net->addr) == 1 ) {
+		net->family = AF_INET6;
+		maxbits		= 128;
+	} else {
+		fprintf(stderr, "Invalid exporter address: '%s'\n", s);
+		return 0;
+	}
+
+	net->bits = maxbits;
+	if ( p ) {
+		net->bits = strtol(p, &eptr, 10);
+		if ( *p == '\0' || *eptr != '\0' || net->bits < 0 || net->bits > maxbits ) {
+			fprintf(stderr, "Invalid netmask for exporter '%s': '%s'\n", s, p);
+			return 0;
+		}
+	}
+
+	return 1;
+
+} // End of ParseExporterNet
+
+// option: host[/port][@exporter[/bits][,exporter[/bits]...]]
+int AddRepeaterDestination(char *option, char *default_port) {
+destination_t	*destination;
+char			*s, *p, *exporter, *next;
+
+	if ( repeater.num_destinations >= MAX_REPEATER_DESTINATIONS ) {
+		fprintf(stderr, "Too many repeater destinations. Max %i\n", MAX_REPEATER_DESTINATIONS);
+		return 0;
+	}
+	destination = &repeater.destination[repeater.num_destinations];
+	memset((void *)destination, 0, sizeof(destination_t));
+	destination->peer.family = AF_UNSPEC;
+
+	s = strdup(option);
+	if ( !s ) {
+		fprintf(stderr, "malloc() allocation error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		return 0;
+	}
+
+	exporter = strchr(s, '@');
+	if ( exporter ) 
+		*exporter++ = '\0';
+
+	p = strchr(s, '/');
+	if ( p ) { 
+		*p++ = '\0';
+		destination->peer.port = p;
+	} else {
+		destination->peer.port = default_port;
+	}
+	destination->peer.hostname = s;
+
+	while ( exporter ) {
+		next = strchr(exporter, ',');
+		if ( next ) 
+			*next++ = '\0';
+		if ( destination->num_filter >= MAX_REPEATER_FILTER ) {
+			fprintf(stderr, "Too many exporters for repeater '%s'. Max %i\n", s, MAX_REPEATER_FILTER);
+			free(s);
+			return 0;
+		}
+		if ( !ParseExporterNet(exporter, &destination->filter[destination->num_filter]) ) {
+			free(s);
+			return 0;
+		}
+		destination->num_filter++;
+		exporter = next;
+	}
+
+	repeater.num_destinations++;
+
+	return 1;
+
+} // End of AddRepeaterDestination
+
+// close the sockets and free the host strings of all destinations
+static void FreeDestinations(void) {
+int i;
+
+	for ( i=0; i<repeater.num_destinations; i++ ) {
+		send_peer_t *peer = &repeater.destination[i].peer;
+		if ( peer->sockfd > 0 ) 
+			close(peer->sockfd);
+		peer->sockfd = 0;
+		// the port is either part of the host string or the default port
+		free(peer->hostname);
+		peer->hostname = NULL;
+	}
+	repeater.num_destinations = 0;
+
+} // End of FreeDestinations
+
+int OpenRepeater(unsigned int bufflen) {
+int i;
+
+	for ( i=0; i<repeater.num_destinations; i++ ) {
+		send_peer_t *peer = &repeater.destination[i].peer;
+		peer->sockfd = Unicast_send_socket (peer->hostname, peer->port, peer->family, bufflen, 
+											&peer->addr, &peer->addrlen );
+		if ( peer->sockfd <= 0 ) {
+			FreeDestinations();
+			return 0;
+		}
+		if ( repeater.destination[i].num_filter ) 
+			LogInfo("Replay flows of %i exporter networks to host: %s port: %s", 
+				repeater.destination[i].num_filter, peer->hostname, peer->port);
+		else
+			LogInfo("Replay flows to host: %s port: %s", peer->hostname, peer->port);
+	}
+
+	return 1;
+
+} // End of OpenRepeater
+
+static int MatchFilter(destination_t *destination, struct sockaddr_storage *sender) {
+uint8_t	*addr;
+int		i, family;
+
+	if ( destination->num_filter == 0 ) 
+		return 1;
+
+	if ( sender->ss_family == AF_INET ) {
+		family = AF_INET;
+		addr   = (uint8_t *)&((struct sockaddr_in *)sender)->sin_addr;
+	} else {
+		struct in6_addr *in6 = &((struct sockaddr_in6 *)sender)->sin6_addr;
+		if ( IN6_IS_ADDR_V4MAPPED(in6) ) {
+			// IPv4 exporter received on an IPv6 socket
+			family = AF_INET;
+			addr   = in6->s6_addr + 12;
+		} else {
+			family = AF_INET6;
+			addr   = in6->s6_addr;
+		}
+	}
+
+	for ( i=0; i<destination->num_filter; i++ ) {
+		exporter_net_t *net = &destination->filter[i];
+		int bytes = net->bits >> 3;
+		int bits  = net->bits & 7;
+		if ( net->family != family ) 
+			continue;
+		if ( memcmp(net->addr, addr, bytes) != 0 ) 
+			continue;
+		if ( bits && ((net->addr[bytes] ^ addr[bytes]) & (0xFF << (8 - bits))) ) 
+			continue;
+		return 1;
+	}
+
+	return 0;
+
+} // End of MatchFilter
+
+static void SendBatch(destination_t *destination, ring_packet_t **packets, int num) {
+send_peer_t	*peer = &destination->peer;
+int			i, n;
+
+#ifdef HAVE_SENDMMSG
+	n = 0;
+	for ( i=0; i<num; i++ ) {
+		if ( !MatchFilter(destination, &packets[i]->sender) ) 
+			continue;
+		repeater.iov[n].iov_base = (void *)&packets[i][1];
+		repeater.iov[n].iov_len	 = packets[i]->length;
+		memset((void *)&repeater.msgs[n], 0, sizeof(struct mmsghdr));
+		repeater.msgs[n].msg_hdr.msg_name	 = (void *)&peer->addr;
+		repeater.msgs[n].msg_hdr.msg_namelen = peer->addrlen;
+		repeater.msgs[n].msg_hdr.msg_iov	 = &repeater.iov[n];
+		repeater.msgs[n].msg_hdr.msg_iovlen	 = 1;
+		n++;
+	}
+
+	i = 0;
+	while ( i < n ) {
+		int ret = sendmmsg(peer->sockfd, &repeater.msgs[i], n - i, MSG_DONTWAIT);
+		if ( ret > 0 ) {
+			__atomic_add_fetch(&destination->sent, ret, __ATOMIC_RELAXED);
+			i += ret;
+		} else if ( errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS ) {
+			// the destination does not keep up - drop the rest of the batch
+			__atomic_add_fetch(&destination->dropped, n - i, __ATOMIC_RELAXED);
+			break;
+		} else if ( errno != EINTR ) {
+			// e.g. ICMP port unreachable of an earlier datagram - skip this datagram
+			__atomic_add_fetch(&destination->errors, 1, __ATOMIC_RELAXED);
+			i++;
+		}
+	}
+#else
+	for ( i=0; i<num; i++ ) {
+		if ( !MatchFilter(destination, &packets[i]->sender) ) 
+			continue;
+		do {
+			n = sendto(peer->sockfd, (void *)&packets[i][1], packets[i]->length, MSG_DONTWAIT, 
+				(struct sockaddr *)&peer->addr, peer->addrlen);
+		} while ( n < 0 && errno == EINTR );
+		if ( n >= 0 ) 
+			__atomic_add_fetch(&destination->sent, 1, __ATOMIC_RELAXED);
+		else if ( errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS ) 
+			__atomic_add_fetch(&destination->dropped, 1, __ATOMIC_RELAXED);
+		else
+			__atomic_add_fetch(&destination->errors, 1, __ATOMIC_RELAXED);
+	}
+#endif
+
+} // End of SendBatch
+
+static int RingsPending(void) {
+int i;
+
+	for ( i=0; i<repeater.num_rings; i++ ) {
+		if ( PacketRingGet(repeater.ring[i]) ) 
+			return 1;
+	}
+	return 0;
+
+} // End of RingsPending
+
+static void *RepeaterThread(void *arg) {
+ring_packet_t	*packets[REPEATER_BATCH];
+int				i, j, num, processed;
+
+	while ( 1 ) {
+		processed = 0;
+		for ( i=0; i<repeater.num_rings; i++ ) {
+			packet_ring_t *ring = repeater.ring[i];
+			num = PacketRingGetBatch(ring, packets, REPEATER_BATCH);
+			if ( num == 0 ) 
+				continue;
+			for ( j=0; j<repeater.num_destinations; j++ ) 
+				SendBatch(&repeater.destination[j], packets, num);
+			for ( j=0; j<num; j++ ) 
+				PacketRingRelease(ring, packets[j]);
+			processed += num;
+		}
+
+		if ( processed ) 
+			continue;
+
+		// all rings are drained
+		if ( __atomic_load_n(&repeater.stop, __ATOMIC_ACQUIRE) ) 
+			break;
+
+		// idle - wait for the producers
+		pthread_mutex_lock(&repeater.mutex);
+		__atomic_store_n(&repeater.sleeping, 1, __ATOMIC_SEQ_CST);
+		if ( !RingsPending() && !repeater.stop ) {
+			struct timeval	now;
+			struct timespec	wait;
+			gettimeofday(&now, NULL);
+			now.tv_usec += REPEATER_IDLE_WAIT * 1000;
+			wait.tv_sec  = now.tv_sec + now.tv_usec / 1000000;
+			wait.tv_nsec = (now.tv_usec % 1000000) * 1000;
+			pthread_cond_timedwait(&repeater.cond, &repeater.mutex, &wait);
+		}
+		__atomic_store_n(&repeater.sleeping, 0, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&repeater.mutex);
+	}
+
+	return NULL;
+
+} // End of RepeaterThread
+
+// each producer - a thread receiving datagrams - gets its own ring
+int StartRepeater(int num_producers) {
+sigset_t	signal_set, old_set;
+int			i, err;
+
+	if ( repeater.num_destinations == 0 ) 
+		return 1;
+
+	repeater.ring = (packet_ring_t **)calloc(num_producers, sizeof(packet_ring_t *));
+	if ( !repeater.ring ) {
+		LogError("calloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno) );
+		return 0;
+	}
+	for ( i=0; i<num_producers; i++ ) {
+		repeater.ring[i] = InitPacketRing();
+		if ( !repeater.ring[i] ) 
+			return 0;
+	}
+	repeater.num_rings	  = num_producers;
+	repeater.last_dropped = 0;
+	repeater.sleeping	  = 0;
+	repeater.stop		  = 0;
+	pthread_mutex_init(&repeater.mutex, NULL);
+	pthread_cond_init(&repeater.cond, NULL);
+
+	// all signals are handled by the main thread
+	sigfillset(&signal_set);
+	pthread_sigmask(SIG_BLOCK, &signal_set, &old_set);
+	err = pthread_create(&repeater.tid, NULL, RepeaterThread, NULL);
+	pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+	if ( err ) {
+		LogError("pthread_create() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(err) );
+		return 0;
+	}
+
+	return 1;
+
+} // End of StartRepeater
+
+// called on the receive path - never waits
+void RepeatPacket(int producer, void *buff, ssize_t length, struct sockaddr_storage *sender, struct timeval *received) {
+
+	if ( repeater.num_rings == 0 ) 
+		return;
+
+	if ( !PacketRingPut(repeater.ring[producer], NULL, buff, length, sender, received) ) 
+		return;
+
+	// pairs with the store of sleeping in RepeaterThread()
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if ( __atomic_load_n(&repeater.sleeping, __ATOMIC_RELAXED) ) {
+		pthread_mutex_lock(&repeater.mutex);
+		pthread_cond_signal(&repeater.cond);
+		pthread_mutex_unlock(&repeater.mutex);
+	}
+
+} // End of RepeatPacket
+
+// log the counters since the last call - unless always, only if anything was repeated
+static void LogRepeaterStat(int always) {
+uint64_t	sent, dropped, errors;
+uint32_t	queue_dropped;
+int			i;
+
+	queue_dropped = 0;
+	for ( i=0; i<repeater.num_rings; i++ ) 
+		queue_dropped += PacketRingDropped(repeater.ring[i]);
+	if ( queue_dropped != repeater.last_dropped ) 
+		LogError("Repeater queue full: %u packets not repeated", queue_dropped - repeater.last_dropped);
+	repeater.last_dropped = queue_dropped;
+
+	for ( i=0; i<repeater.num_destinations; i++ ) {
+		destination_t *destination = &repeater.destination[i];
+		sent	= __atomic_load_n(&destination->sent, __ATOMIC_RELAXED);
+		dropped = __atomic_load_n(&destination->dropped, __ATOMIC_RELAXED);
+		errors	= __atomic_load_n(&destination->errors, __ATOMIC_RELAXED);
+		if ( !always && sent == destination->last_sent && dropped == destination->last_dropped && 
+			 errors == destination->last_errors ) 
+			continue;
+		LogInfo("Repeater %s/%s: sent: %llu, dropped: %llu, errors: %llu", 
+			destination->peer.hostname, destination->peer.port, 
+			(unsigned long long)(sent - destination->last_sent), 
+			(unsigned long long)(dropped - destination->last_dropped),
+			(unsigned long long)(errors - destination->last_errors));
+		destination->last_sent	  = sent;
+		destination->last_dropped = dropped;
+		destination->last_errors  = errors;
+	}
+
+} // End of LogRepeaterStat
+
+void RepeaterStat(void) {
+
+	if ( repeater.num_rings ) 
+		LogRepeaterStat(1);
+
+} // End of RepeaterStat
+
+// all producers must have stopped - the repeater sends the queued datagrams and terminates
+void StopRepeater(void) {
+int i;
+
+	if ( repeater.num_rings == 0 ) 
+		return;
+
+	pthread_mutex_lock(&repeater.mutex);
+	__atomic_store_n(&repeater.stop, 1, __ATOMIC_RELEASE);
+	pthread_cond_signal(&repeater.cond);
+	pthread_mutex_unlock(&repeater.mutex);
+
+	pthread_join(repeater.tid, NULL);
+
+	// the datagrams sent since the last rotation
+	LogRepeaterStat(0);
+
+	for ( i=0; i<repeater.num_rings; i++ ) 
+		FreePacketRing(repeater.ring[i]);
+	free(repeater.ring);
+	repeater.ring	   = NULL;
+	repeater.num_rings = 0;
+
+	FreeDestinations();
+
+} // End of StopRepeater
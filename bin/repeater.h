@@ -0,0 +1,70 @@
+/*
+ *  This file is part of the nfdump project.
+ *
+ *  Copyright (c) 2014, the nfdump contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of SWITCH nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  $Author$
+ *
+ *  $Id$
+ *
+ *  $LastChangedRevision$
+ *
+ */
+
+#ifndef _REPEATER_H
+#define _REPEATER_H 1
+
+/* Definitions */
+
+/*
+ * Packet repeater ( -R )
+ * nfcapd repeats the incoming datagrams to up to MAX_REPEATER_DESTINATIONS destinations. Each
+ * destination may be restricted to the datagrams of some exporters. The receive path only copies
+ * the datagram into a lock-free ring - one ring per receiving thread - and never waits. A separate
+ * thread sends the datagrams in batches with sendmmsg(). If a destination does not accept more
+ * datagrams, the rest of the batch is dropped for this destination only, so a slow destination
+ * neither stalls the collector nor the other destinations. All drops are counted and logged at
+ * each file rotation.
+ */
+#define MAX_REPEATER_DESTINATIONS	8
+#define MAX_REPEATER_FILTER			16		// max number of exporter networks per destination
+
+/* Function prototypes */
+int AddRepeaterDestination(char *option, char *default_port);
+
+int OpenRepeater(unsigned int bufflen);
+
+int StartRepeater(int num_producers);
+
+void RepeatPacket(int producer, void *buff, ssize_t length, struct sockaddr_storage *sender, struct timeval *received);
+
+void RepeaterStat(void);
+
+void StopRepeater(void);
+
+#endif //_REPEATER_H
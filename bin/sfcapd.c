@@ -94,6 +94,7 @@
 #endif
 
 #include "expire.h"
+#include "nfrollup.h"
 
 #include "sflow.h"
 
@@ -150,6 +151,7 @@ static void usage(char *name) {
 					"-R IP[/port]\tRepeat incoming packets to IP address/port\n"
 					"-x process\tlaunch process after a new file becomes available\n"
 					"-z\t\tCompress flows in output file.\n"
+					"-k stats[:K]\tAppend top K rollups of stats to each flow file. see nfcapd(1)\n"
 					"-B bufflen\tSet socket buffer to bufflen bytes\n"
 					"-e\t\tExpire data at each cycle.\n"
 					"-D\t\tFork to background\n"
@@ -341,17 +343,28 @@ uint64_t	export_packets;
 uint32_t	blast_cnt, blast_failures, ignored_packets;
 ssize_t		cnt;
 void 		*in_buff;
-int 		err;
+int 		err, new_time, last;
 char 		*string;
 srecord_t	*commbuff;
+struct timeval tv;
+#ifndef PCAP
+packet_batch_t	*batch;
+#endif
 
 	Init_sflow();
 
+#ifdef PCAP
 	in_buff  = malloc(NETWORK_INPUT_BUFF_SIZE);
 	if ( !in_buff ) {
 		syslog(LOG_ERR, "malloc() buffer allocation error: %s", strerror(errno));
 		return;
 	}
+#else
+	batch = InitPacketBatch();
+	if ( !batch ) 
+		return;
+	in_buff = NULL;
+#endif
 
 	// init vars
 	commbuff = (srecord_t *)shmem;
@@ -383,6 +396,7 @@ srecord_t	*commbuff;
 
 	export_packets = blast_cnt = blast_failures = 0;
 	t_start = t_begin;
+	gettimeofday(&tv, NULL);
 
 	cnt = 0;
 	ignored_packets  = 0;
@@ -396,43 +410,55 @@ srecord_t	*commbuff;
 	 * for proper cleanup 
 	 */
 	while ( 1 ) {
-		struct timeval tv;
 
+		new_time = 0;
 		/* read next bunch of data into beginn of input buffer */
-		if ( !done) {
-
 #ifdef PCAP
+		if ( !done) {
 
 			// Debug code to read from pcap file
-			// cnt = NextPacket(in_buff, NETWORK_INPUT_BUFF_SIZE);
 			cnt = receive_packet (socket, in_buff, NETWORK_INPUT_BUFF_SIZE , 0, 
 				(struct sockaddr *)&sf_sender, &sf_sender_size);
 			if ( cnt == -2 )
 				done = 1;
-#else
 
-			cnt = recvfrom (socket, in_buff, NETWORK_INPUT_BUFF_SIZE , 0, 
-				(struct sockaddr *)&sf_sender, &sf_sender_size);
-#endif
 			if ( cnt == -1 && errno != EINTR ) {
 				syslog(LOG_ERR, "ERROR: recvfrom: %s", strerror(errno));
 				continue;
 			}
+			gettimeofday(&tv, NULL);
+			new_time = 1;
+		}
+		last = done;
+#else
+		// receive the next batch, when all packets of the current batch are processed
+		if ( !done && !PacketsPending(batch) ) {
+			if ( ReceiveBatch(batch, socket) < 0 && errno != EINTR ) {
+				syslog(LOG_ERR, "ERROR: recvmmsg: %s", strerror(errno));
+				continue;
+			}
+			// one time stamp for all packets of the batch
+			gettimeofday(&tv, NULL);
+			new_time = 1;
+		}
+		// if we are done, process the rest of the batch first
+		last = done && !PacketsPending(batch);
+		if ( !last ) 
+			cnt = NextPacket(batch, &in_buff, &sf_sender, &sf_sender_size);
+#endif
 
-			if ( peer.hostname ) {
-				ssize_t len;
-				len = sendto(peer.sockfd, in_buff, cnt, 0, (struct sockaddr *)&(peer.addr), peer.addrlen);
-				if ( len < 0 ) {
-					syslog(LOG_ERR, "ERROR: sendto(): %s", strerror(errno));
-				}
+		if ( peer.hostname && !last && cnt > 0 ) {
+			ssize_t len;
+			len = sendto(peer.sockfd, in_buff, cnt, 0, (struct sockaddr *)&(peer.addr), peer.addrlen);
+			if ( len < 0 ) {
+				syslog(LOG_ERR, "ERROR: sendto(): %s", strerror(errno));
 			}
 		}
 
 		/* Periodic file renaming, if time limit reached or if we are done.  */
-		gettimeofday(&tv, NULL);
 		t_now = tv.tv_sec;
 
-		if ( ((t_now - t_start) >= twin) || done ) {
+		if ( (new_time && (t_now - t_start) >= twin) || last ) {
 			char subfilename[64];
 			struct  tm *now;
 			char	*subdir;
@@ -503,6 +529,9 @@ srecord_t	*commbuff;
 				FlushExporterStats(fs);
 				// Write Stat record and close file
 				CloseUpdateFile(nffile, fs->Ident);
+				// Append rollups of the closed file, if requested
+				if ( !WriteRollups(fs->current) )
+					LogError("Ident: %s, failed to write rollups", fs->Ident);
 
 				if ( subdir && !SetupSubDir(fs->datadir, subdir, error, 255) ) {
 					// in this case the flows get lost! - the rename will fail
@@ -529,6 +558,9 @@ srecord_t	*commbuff;
 					// Update books
 					stat(nfcapd_filename, &fstat);
 					UpdateBooks(fs->bookkeeper, t_start, 512*fstat.st_blocks);
+
+					// Update file index, if the data directory is indexed
+					AppendIndex(fs->datadir, subfilename, t_start);
 				}
 
 				// log stats
@@ -659,7 +691,11 @@ srecord_t	*commbuff;
 	if ( verbose && blast_failures ) {
 		fprintf(stderr, "Total missed packets: %u\n", blast_failures);
 	}
+#ifdef PCAP
 	free(in_buff);
+#else
+	FreePacketBatch(batch);
+#endif
 
 	fs = FlowSource;
 	while ( fs ) {
@@ -713,7 +749,7 @@ int	c;
 	extension_tags	= DefaultExtensions;
 	pcap_file		= NULL;
 
-	while ((c = getopt(argc, argv, "46ewhEVI:DB:b:f:j:l:n:p:P:R:S:T:t:x:ru:g:z")) != EOF) {
+	while ((c = getopt(argc, argv, "46ewhEVI:DB:b:f:j:k:l:n:p:P:R:S:T:t:x:ru:g:z")) != EOF) {
 		switch (c) {
 			case 'h':
 				usage(argv[0]);
@@ -767,6 +803,10 @@ int	c;
 			case 'z':
 				compress = 1;
 				break;
+			case 'k':
+				if ( !SetRollups(optarg) ) 
+					exit(255);
+				break;
 			case 'B':
 				bufflen = strtol(optarg, &checkptr, 10);
 				if ( (checkptr != NULL && *checkptr == 0) && bufflen > 0 )
@@ -901,7 +941,7 @@ int	c;
 	if ( mcastgroup ) 
 		sock = Multicast_receive_socket (mcastgroup, listenport, family, bufflen);
 	else 
-		sock = Unicast_receive_socket(bindhost, listenport, family, bufflen );
+		sock = Unicast_receive_socket(bindhost, listenport, family, bufflen, 0 );
 
 	if ( sock == -1 ) {
 		fprintf(stderr,"Terminated due to errors.\n");
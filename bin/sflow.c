@@ -185,6 +185,9 @@ typedef struct exporter_sflow_s {
 	// extension maps are common for all exporters
 	extension_info_t sflow_extension_info[MAX_SFLOW_EXTENSIONS];
 
+	// record size of each extension map - exporters with a sysid > 255 have one extension more
+	uint16_t sflow_output_record_size[MAX_SFLOW_EXTENSIONS];
+
 } exporter_sflow_t;
 
 extern extension_descriptor_t extension_descriptor[];
@@ -206,7 +209,6 @@ extern FlowSource_t *FlowSource;
  * 6 : EX_NEXT_HOP_v4, EX_NEXT_HOP_BGP_v6, EX_ROUTER_IP_v6
  * 7 : EX_NEXT_HOP_v6, EX_NEXT_HOP_BGP_v6, EX_ROUTER_IP_v6
  */
-static uint16_t sflow_output_record_size[MAX_SFLOW_EXTENSIONS];
 
 // All available extensions for sflow
 static uint16_t sflow_extensions[] = { 
@@ -1075,7 +1077,7 @@ uint64_t _bytes, _packets, _t;	// tmp buffers
 	// output buffer size check
 	// IPv6 needs 2 x 16 bytes, IPv4 2 x 4 bytes
 	ipsize = sample->gotIPV6 ? 32 : 8;
-	if ( !CheckBufferSpace(fs->nffile, sflow_output_record_size[ip_flags] + ipsize )) {
+	if ( !CheckBufferSpace(fs->nffile, exporter->sflow_output_record_size[ip_flags] + ipsize )) {
 		// fishy! - should never happen. maybe disk full?
 		LogError("SFLOW: output buffer size error. Abort sflow record processing");
 		return;
@@ -1083,7 +1085,7 @@ uint64_t _bytes, _packets, _t;	// tmp buffers
 
 	common_record = (common_record_t *)fs->nffile->buff_ptr;
 
-	common_record->size			  = sflow_output_record_size[ip_flags] + ipsize;
+	common_record->size			  = exporter->sflow_output_record_size[ip_flags] + ipsize;
 	common_record->type			  = CommonRecordType;
 	common_record->flags		  = 0;
 	SetFlag(common_record->flags, FLAG_SAMPLED);
@@ -1244,6 +1246,11 @@ uint64_t _bytes, _packets, _t;	// tmp buffers
 printf("t-received: %llu\n", tpl->received);
 				next_data = (void *)tpl->data;
 			} break;
+			case EX_EXPORTER_SYSID: {
+				tpl_ext_28_t *tpl = (tpl_ext_28_t *)next_data;
+				tpl->exporter_sysid = exporter->info.sysid;
+				next_data = (void *)tpl->data;
+			} break;
 			default: 
 				// this should never happen
 				LogError("SFLOW: Unexpected extension %i for sflow record. Skip extension", id);
@@ -1305,12 +1312,12 @@ printf("t-received: %llu\n", tpl->received);
 
 	// update file record size ( -> output buffer size )
 	fs->nffile->block_header->NumRecords++;
-	fs->nffile->block_header->size 		+= (sflow_output_record_size[ip_flags] + ipsize);
+	fs->nffile->block_header->size 		+= (exporter->sflow_output_record_size[ip_flags] + ipsize);
 #ifdef DEVEL
-	if ( (next_data - fs->nffile->buff_ptr) != (sflow_output_record_size[ip_flags] + ipsize) ) {
+	if ( (next_data - fs->nffile->buff_ptr) != (exporter->sflow_output_record_size[ip_flags] + ipsize) ) {
 		printf("PANIC: Size error. Buffer diff: %llu, Size: %u\n", 
 			(unsigned long long)(next_data - fs->nffile->buff_ptr), 
-			(sflow_output_record_size[ip_flags] + ipsize));
+			(exporter->sflow_output_record_size[ip_flags] + ipsize));
 		exit(255);
 	}
 #endif
@@ -2555,8 +2562,10 @@ int i, id, extension_size, map_size, map_index;
 	exporter->sflow_extension_info[num].map   = NULL;
 	extension_size	 = 0;
 
-	// calculate the full extension map size
+	// calculate the full extension map size - the common record has room for an 8 bit exporter sysid only
 	map_size 	= Num_enabled_extensions * sizeof(uint16_t) + sizeof(extension_map_t);
+	if ( exporter->info.sysid > 255 ) 
+		map_size += sizeof(uint16_t);
 
 	// align 32 bits
 	if ( ( map_size & 0x3 ) != 0 )
@@ -2599,6 +2608,12 @@ int i, id, extension_size, map_size, map_index;
 		exporter->sflow_extension_info[num].map->ex_id[map_index++] = id;
 	}
 
+	if ( exporter->info.sysid > 255 ) {
+		id = EX_EXPORTER_SYSID;
+		extension_size += extension_descriptor[id].size;
+		exporter->sflow_extension_info[num].map->ex_id[map_index++] = id;
+	}
+
 	// terminating null record
 	exporter->sflow_extension_info[num].map->ex_id[map_index] = 0;
 
@@ -2607,9 +2622,9 @@ int i, id, extension_size, map_size, map_index;
 	// caculate the basic record size: without IP addr space ( v4/v6 dependant )
 	// byte/packet counters are 32bit -> 2 x uint32_t
 	// extension_size contains the sum of all optional extensions
-	sflow_output_record_size[num] = COMMON_RECORD_DATA_SIZE + 2*sizeof(uint32_t) + extension_size;	
+	exporter->sflow_output_record_size[num] = COMMON_RECORD_DATA_SIZE + 2*sizeof(uint32_t) + extension_size;	
 
-	dbg_printf("Record size: %i\n", sflow_output_record_size[num]);
+	dbg_printf("Record size: %i\n", exporter->sflow_output_record_size[num]);
 
 	exporter->sflow_extension_info[num].map->type 	   	  = ExtensionMapType;
 	exporter->sflow_extension_info[num].map->size 	   	  = map_size;
@@ -2634,18 +2649,20 @@ int i, id, extension_size, map_size, map_index;
 
 static inline exporter_sflow_t *GetExporter(FlowSource_t *fs, uint32_t agentSubId, uint32_t meanSkipCount) {
 exporter_sflow_t **e = (exporter_sflow_t **)&(fs->exporter_data);
+exporter_sflow_t *exporter;
 generic_sampler_t *sampler;
 #define IP_STRING_LEN   40
 char ipstr[IP_STRING_LEN];
 int i;
 
 	// search the appropriate exporter engine
-	while ( *e ) {
-		if ( (*e)->info.id == agentSubId && (*e)->info.version == SFLOW_VERSION &&
-			 (*e)->info.ip.v6[0] == fs->ip.v6[0] && (*e)->info.ip.v6[1] == fs->ip.v6[1]) 
-			return *e;
+	exporter = (exporter_sflow_t *)LookupExporter(fs, SFLOW_VERSION, agentSubId);
+	if ( exporter ) 
+		return exporter;
+
+	// append new exporter
+	while ( *e ) 
 		e = &((*e)->next);
-	}
 
 	if ( fs->sa_family == AF_INET ) {
 		uint32_t _ip = htonl(fs->ip.v4);
@@ -2696,6 +2713,13 @@ int i;
 	sampler->info.interval		= meanSkipCount;
 	sampler->next				= NULL;
 
+	if ( !HashExporter(fs, (generic_exporter_t *)(*e)) ) {
+		free(sampler);
+		free(*e);
+		*e = NULL;
+		return NULL;
+	}
+
 	FlushInfoExporter(fs, &((*e)->info));
 	sampler->info.exporter_sysid		= (*e)->info.sysid;
 	FlushInfoSampler(fs, &(sampler->info));
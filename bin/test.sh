@@ -65,16 +65,15 @@ diff -u test2.out nfdump.test.out
 rm -r test1.out test2.out
 
 # create tmp dir for flow replay
-if [ -d tmp ]; then
-	rm -f tmp/*
-	rmdir tmp
-fi
+rm -rf tmp
 mkdir tmp
+# index the data files
+./nfexpire -i tmp > /dev/null
 
 # Start nfcapd on localhost and replay flows
 echo
 echo -n Starting nfcapd ...
-./nfcapd -p 65530 -T '*' -l tmp -D -P tmp/pidfile
+./nfcapd -p 65530 -T '*' -l tmp -D -P tmp/pidfile -k all
 sleep 1
 echo done.
 echo -n Replay flows ...
@@ -98,6 +97,91 @@ fi
 # so diff the diff
 diff test5.out nfdump.test.out > test5.diff || true
 diff test5.diff nfdump.test.diff
+# file summary from index must match the file
+./nfdump -R tmp -I > test10.out
+./nfdump -r tmp/nfcapd.* -I > test11.out
+diff test10.out test11.out
+# element statistics from the rollups must match the flows
+./nfdump -r tmp/nfcapd.* -q -s srcip -s dstport/bytes -s proto > test12.out
+./nfdump -r tmp/nfcapd.* -q -s srcip -s dstport/bytes -s proto any > test13.out
+diff test12.out test13.out
+# a flow limit is not answered from the rollups
+./nfdump -r tmp/nfcapd.* -q -c 10 -s srcip -s proto > test12.out
+./nfdump -r tmp/nfcapd.* -q -c 10 -s srcip -s proto any > test13.out
+diff test12.out test13.out
+# the templates of the exporter are cached at shutdown
+[ -s tmp/.nfcapd.templates ]
+
+# threaded nfcapd must collect the same flows - start with the cached templates
+mkdir tmp2
+cp tmp/.nfcapd.templates tmp2
+./nfcapd -p 65530 -T '*' -l tmp2 -D -P tmp2/pidfile -W 2:2
+sleep 1
+./nfreplay -r test.flows -v9 -H 127.0.0.1 -p 65530
+sleep 1
+kill -TERM `cat tmp2/pidfile`;
+sleep 2
+if [ -f tmp2/pidfile ]; then
+	echo threaded nfcapd does not terminate
+	exit 1
+fi
+./nfdump -r tmp2/nfcapd.* -q -o raw | grep -v 'received at' > test19.out
+diff test5.out test19.out
+rm -f tmp2/nfcapd.* tmp2/.nfstat tmp2/.nfcapd.templates
+rmdir tmp2
+
+# netflow v5 round trip - IPv6 flows are skipped, times and counters are converted
+mkdir tmp8
+./nfcapd -p 65530 -T '*' -l tmp8 -D -P tmp8/pidfile
+sleep 1
+./nfreplay -r test.flows -v5 -H 127.0.0.1 -p 65530
+sleep 1
+kill -TERM `cat tmp8/pidfile`;
+sleep 2
+if [ -f tmp8/pidfile ]; then
+	echo nfcapd does not terminate
+	exit 1
+fi
+./nfdump -r tmp8/nfcapd.* -q -o raw | grep -v 'received at' > test31.out
+diff -u test31.out nfdump.v5.out
+rm -rf tmp8
+
+# hot restart: the new nfcapd continues the file of the running one
+mkdir tmp3
+./nfcapd -p 65530 -l tmp3 -D -P tmp3/pidfile -U tmp3/handoff
+sleep 1
+./nfreplay -r test.flows -v9 -H 127.0.0.1 -p 65530
+sleep 1
+./nfcapd -p 65530 -l tmp3 -D -P tmp3/pidfile -U tmp3/handoff
+./nfreplay -r test.flows -v9 -H 127.0.0.1 -p 65530
+sleep 1
+kill -TERM `cat tmp3/pidfile`;
+sleep 2
+if [ -f tmp3/pidfile ]; then
+	echo restarted nfcapd does not terminate
+	exit 1
+fi
+[ `ls tmp3/nfcapd.* | wc -l` -eq 1 ]
+[ `./nfdump -r tmp3/nfcapd.* -q | wc -l` -eq $(( 2 * `./nfdump -r test.flows -q | wc -l` )) ]
+rm -f tmp3/nfcapd.* tmp3/.nfstat tmp3/.nfcapd.templates
+rmdir tmp3
+
+# repeater: only the destination matching the exporter receives the packets
+mkdir tmp4 tmp5 tmp6
+./nfcapd -p 65531 -T '*' -l tmp5 -D -P tmp5/pidfile
+./nfcapd -p 65532 -T '*' -l tmp6 -D -P tmp6/pidfile
+./nfcapd -p 65530 -T '*' -l tmp4 -D -P tmp4/pidfile -R 127.0.0.1/65531@127.0.0.0/8 -R 127.0.0.1/65532@10.0.0.0/8
+sleep 1
+./nfreplay -r test.flows -v9 -H 127.0.0.1 -p 65530
+sleep 1
+kill -TERM `cat tmp4/pidfile` `cat tmp5/pidfile` `cat tmp6/pidfile`;
+sleep 2
+./nfdump -r tmp5/nfcapd.* -q -o raw | grep -v 'received at' > test20.out
+diff test5.out test20.out
+./nfdump -r tmp6/nfcapd.* -I | grep -q '^Flows: 0$'
+rm -f tmp4/nfcapd.* tmp4/.nfstat tmp4/.nfcapd.templates tmp5/nfcapd.* tmp5/.nfstat tmp5/.nfcapd.templates
+rm -f tmp6/nfcapd.* tmp6/.nfstat tmp6/.nfcapd.templates
+rmdir tmp4 tmp5 tmp6
 
 mkdir memck.$$
 # OpenBSD
@@ -111,11 +195,99 @@ export MallocErrorAbort=1
 export MallocCorruptionAbort=1
 ./nfdump -r test.flows 'host  172.16.14.18'
 ./nfdump -r test.flows -s ip 'host  172.16.14.18'
+./nfdump -r test.flows -s ip/bytes:approx 'host  172.16.14.18'
+# below the sketch capacity the approximate top N is exact: error bound 0 and same counters
+./nfdump -r test.flows -q -n 0 -s ip/bytes > test22.out
+./nfdump -r test.flows -q -n 0 -s ip/bytes:approx > test23.out
+[ `awk 'NF && $NF != 0' test23.out | wc -l` -eq 0 ]
+sed 's/ *[0-9][0-9]*$//' test23.out | sort > test24.out
+sort test22.out | diff - test24.out
+./nfdump -r test.flows -s dstport-srcip/distinct -s ip-peer 'host  172.16.14.18'
+# distinct srcip count per dstport must match the number of aggregated dstport,srcip records
+./nfdump -r test.flows -q -n 0 -s dstport-srcip/distinct | awk 'NF { print $5, $NF }' | sort > test25.out
+./nfdump -r test.flows -q -A dstport,srcip -o csv | cut -d, -f7 | sort | uniq -c | awk '{ print $2, $1 }' | sort > test26.out
+diff test25.out test26.out
+./nfdump -r test.flows -s dstport:q=duration/p95 -s srcip:q=bpp 'host  172.16.14.18'
+# quantiles per element over all flows
+./nfdump -r test.flows -q -n 0 -s dstport:q=duration/p95 -s srcip:q=bpp > test27.out
+diff -u test27.out nfdump.quantile.out
+./nfdump -r test.flows -P 300 -s srcip -s record 'host  172.16.14.18'
+# all test flows start within one 300s slot: the slot statistic must match a -t run from the slot start
+./nfdump -r test.flows -q -P 300 -s srcip | sed -n 's/^Time slot: \([^ ]*\) \([^ ]*\) - .*/\1.\2/p' | tr - / > test28.out
+[ `wc -l < test28.out` -eq 1 ]
+./nfdump -r test.flows -q -n 0 -P 300 -s srcip -s record | grep -v '^Time slot' | sort > test29.out
+./nfdump -r test.flows -q -n 0 -t `cat test28.out` -s srcip -s record | sort | diff test29.out -
+# csv and pipe lines carry their time slot - the slot of every line starts at a multiple of 60s
+./nfdump -r test.flows -q -n 0 -P 60 -s srcip -o csv > test29.out
+head -1 test29.out | grep -q ',slots,slote$'
+[ `sed 1d test29.out | grep -v '^$' | grep -cv ':00,[^,]*:59$'` -eq 0 ]
+./nfdump -r test.flows -q -n 0 -P 60 -s srcip -o pipe | awk -F'|' 'NF { if ( $(NF-1) % 60 || $NF != $(NF-1) + 59 || $2 < $(NF-1) || $2 > $NF ) exit 1 }'
 ./nfdump -r test.flows -s record 'host  172.16.14.18'
+./nfdump -r test.flows -A srcip,dstport 'host  172.16.14.18'
+./nfdump -r test.flows -A srcip4/24,srcport,dstport,proto 'host  172.16.14.18'
+# aggregated records keep the exporter sysid - also when written to a file
+./nfdump -r test.flows -q -A dstport -o csv | cut -d, -f47 | sort -u > test21.out
+echo 1 | diff - test21.out
+./nfdump -r test.flows -A dstport -w test-3.flows
+./nfdump -r test-3.flows -q -o csv | cut -d, -f47 | sort -u > test21.out
+echo 1 | diff - test21.out
+./nfdump -r test.flows -s srcip -s dstport-srcip -W test-1.nfp 'proto tcp'
+./nfdump -r test.flows -s srcip -s dstport-srcip -W test-2.nfp 'not proto tcp'
+./nfdump -J test-1.nfp -J test-2.nfp
+# merged partials must match the unsplit statistic
+./nfdump -q -n 0 -J test-1.nfp -J test-2.nfp > test30.out
+./nfdump -r test.flows -q -n 0 -s srcip -s dstport-srcip | diff test30.out -
 ./nfdump -r test.flows -w test-2.flows 'host  172.16.14.18'
 ./nfdump -r test.flows -O tstart -w test-2.flows 'host  172.16.14.18'
+# parallel print: enough records to start the formatter threads and to reuse their blocks
+mkdir tmp7
+i=0
+while [ $i -lt 400 ]; do
+	cp test.flows tmp7/nfcapd.2004071110`printf %03d $i`
+	i=$(( $i + 1 ))
+done
+./nfdump -R tmp7 -q -Y 1 -o extended > test6.out
+./nfdump -R tmp7 -q -Y 4 -o extended > test7.out
+[ `wc -l < test6.out` -eq $(( 400 * `./nfdump -r test.flows -q | wc -l` )) ]
+diff test6.out test7.out
+# Arrow stream: one record batch per data block
+./nfdump -R tmp7 -o arrows > test7.arrow
+[ "`./nfarrowread test7.arrow | sed -n 2,3p | tr '\n' ' '`" = "batches: 400 rows: `wc -l < test6.out` " ]
+rm -rf tmp7
+# Arrow file: schema from the footer, row count and values must match the flows
+./nfdump -r test.flows -o arrow > test8.out
+./nfarrowread test8.out > test8.schema
+[ "`sed -n 1p test8.schema`" = "fields: ts:timestamp te:timestamp td:duration sa:binary16 da:binary16 sp:uint16 dp:uint16 pr:uint8 flg:uint8 fwd:uint8 stos:uint8 ipkt:uint64 ibyt:uint64 opkt:uint64 obyt:uint64 fl:uint64 in:uint32 out:uint32 sas:uint32 das:uint32 smk:uint8 dmk:uint8 dtos:uint8 dir:uint8 nh:binary16 nhb:binary16 svln:uint16 dvln:uint16 ismc:uint64 odmc:uint64 idmc:uint64 osmc:uint64 mpls1:uint32 mpls2:uint32 mpls3:uint32 mpls4:uint32 mpls5:uint32 mpls6:uint32 mpls7:uint32 mpls8:uint32 mpls9:uint32 mpls10:uint32 cl:uint64 sl:uint64 al:uint64 ra:binary16 engt:uint8 engid:uint8 exid:uint16 tr:timestamp" ]
+[ "`sed -n 3p test8.schema`" = "rows: `./nfdump -r test.flows -q | wc -l`" ]
+./nfarrowread -c sa,da,sp,dp,ipkt,ibyt,in,out,sas,das test8.out > test8.values
+./nfdump -r test.flows -q -o csv | cut -d, -f4-7,12,13,16-19 | diff test8.values -
+# Arrow stats stream: nullable key columns, values must match the csv statistics
+./nfdump -r test.flows -s srcip -s dstport -o arrows > test9.out
+./nfarrowread test9.out > test9.schema
+[ "`sed -n 1p test9.schema`" = "fields: stat:utf8 order:utf8 slot:timestamp? ts:timestamp te:timestamp td:duration pr:uint8? val:uint64? ip:binary16? fl:uint64 ipkt:uint64 ibyt:uint64 dist:uint64? p50:uint64? p95:uint64? p99:uint64? err:uint64?" ]
+[ "`sed -n 3p test9.schema`" = "rows: 14" ]
+./nfarrowread -c stat,val,ip,fl,ipkt,ibyt test9.out | sed -e 's/,,/,/' > test9.values
+./nfdump -r test.flows -q -s srcip -s dstport -o csv | grep '^2' | cut -d, -f5,6,8,10 > test9.csv
+[ "`cut -d, -f1 test9.values | uniq -c | tr -s ' \n' ' '`" = " 10 srcip 4 dstport " ]
+cut -d, -f2- test9.values | diff test9.csv -
+mkdir -p cache
+./nfdump -C cache -r test.flows -s srcip -A srcip,dstport 'proto tcp' > test14.out
+./nfdump -C cache -r test.flows -s srcip -A srcip,dstport 'proto tcp' > test15.out
+diff test14.out test15.out
+[ $(ls cache | wc -l) -eq 1 ]
+rm -rf cache
+./nfdump -U nfquery.sock:2 &
+QUERY_SERVER=$!
+for i in 1 2 3 4 5 6 7 8 9 10; do [ -S nfquery.sock ] && break; sleep 1; done
+./nfdump -Q nfquery.sock -r test.flows -q -s srcip -s dstport 'proto tcp' > test16.out
+./nfdump -Q nfquery.sock -r test.flows -q -s srcip -s dstport 'proto tcp' > test17.out
+./nfdump -r test.flows -q -s srcip -s dstport 'proto tcp' > test18.out
+diff test16.out test18.out
+diff test17.out test18.out
+kill -TERM $QUERY_SERVER
+wait $QUERY_SERVER
 ./nfanon -K abcdefghijklmnopqrstuvwxyz012345 -r test.flows -w anon.flows
-rm -f tmp/nfcapd.* test*.out test*.flows
+rm -f tmp/nfcapd.* tmp/.nfstat tmp/.nfindex tmp/.nfcapd.templates test*.out test*.flows test*.nfp test*.arrow test*.schema test*.values test*.csv
 [ -d tmp ] && rmdir tmp
 [ -d memck.$$ ] && rm -rf  memck.$$
 
@@ -497,6 +497,25 @@ time_t		t;
 		
 } // End of ISO2UNIX
 
+/*
+ * Compare two relative file paths in the order, a directory walk with sorted 
+ * entries lists them: path components are compared one by one, therefore '/'
+ * sorts lower than any other char
+ */
+int ComparePath(char *p1, char *p2) {
+unsigned char c1, c2;
+
+	do {
+		c1 = *p1 == '/' ? 1 : (unsigned char)*p1;
+		c2 = *p2 == '/' ? 1 : (unsigned char)*p2;
+		p1++;
+		p2++;
+	} while ( c1 && c1 == c2 );
+
+	return c1 - c2;
+
+} // End of ComparePath
+
 
 void InitStringlist(stringlist_t *list, int block_size) {
 
@@ -83,6 +83,8 @@ char *UNIX2ISO(time_t t);
 
 time_t ISO2UNIX(char *timestring);
 
+int ComparePath(char *p1, char *p2);
+
 #define NUMBER_STRING_SIZE	32
 #define DONT_SCALE_NUMBER 0
 #define DO_SCALE_NUMBER   1